@@ -0,0 +1,82 @@
+use std::convert::TryInto;
+use std::fs::File;
+use std::io::{BufRead, BufReader};
+use std::path::PathBuf;
+use std::time::Instant;
+
+use hex::decode;
+use sscanf::scanf;
+
+use crate::parse;
+
+// frame as the original line based loader built it, kept to benchmark against
+#[allow(dead_code)]
+struct LegacyFrame {
+    timestamp: f64,
+    device: String,
+    id: u32,
+    data: Vec<u8>,
+}
+
+// the original loader: a String per line, sscanf into owned Strings, hex decode into a Vec per frame
+fn legacy_load(dump_files: &[PathBuf]) -> usize {
+    let mut frames: Vec<LegacyFrame> = Vec::with_capacity(100000);
+    for dump_file in dump_files {
+        let reader = BufReader::new(File::open(dump_file).unwrap());
+        for line in reader.lines().map(|l| l.unwrap()) {
+            let (timestamp, device, mut id, data) =
+                scanf!(line, "({f64}) {String} {String}#{String}").unwrap();
+            id.insert_str(0, "0".repeat(8 - id.len()).as_str());
+            frames.push(LegacyFrame {
+                timestamp,
+                device,
+                id: u32::from_be_bytes(decode(id).unwrap().try_into().unwrap()),
+                data: decode(data).unwrap(),
+            });
+        }
+    }
+    frames.len()
+}
+
+fn report(name: &str, frames: usize, bytes: u64, seconds: f64) {
+    println!(
+        "{:<24} {:>10} frames {:>9.3} s {:>9.1} MB/s {:>12.0} frames/s",
+        name,
+        frames,
+        seconds,
+        bytes as f64 / seconds / 1e6,
+        frames as f64 / seconds
+    );
+}
+
+// time the original loader against the mapped parser, single and multi threaded
+pub fn run(dump_files: &[PathBuf], threads: usize) {
+    let bytes: u64 = dump_files
+        .iter()
+        .map(|f| std::fs::metadata(f).map_or(0, |m| m.len()))
+        .sum();
+
+    let start = Instant::now();
+    let legacy = legacy_load(dump_files);
+    let legacy_time = start.elapsed().as_secs_f64();
+    report("lines + sscanf + hex", legacy, bytes, legacy_time);
+
+    let mut counts = vec![("mmap, 1 thread".to_string(), 1)];
+    if threads > 1 {
+        counts.push((format!("mmap, {} threads", threads), threads));
+    }
+    for (name, n) in counts {
+        let start = Instant::now();
+        let capture = parse::load(dump_files, n).unwrap();
+        let seconds = start.elapsed().as_secs_f64();
+        report(&name, capture.frames.len(), bytes, seconds);
+        println!("{:<24} {:>10.1}x", "", legacy_time / seconds);
+        if capture.frames.len() != legacy {
+            println!(
+                "frame count differs: {} vs {}",
+                capture.frames.len(),
+                legacy
+            );
+        }
+    }
+}
@@ -0,0 +1,428 @@
+use std::collections::HashMap;
+use std::fs::File;
+use std::io::{self, BufWriter, Write};
+use std::path::{Path, PathBuf};
+
+use crate::mmap::Mmap;
+use crate::parse::{self, Capture, Frame, Query};
+
+/*
+ * Columnar capture, all integers little endian:
+ *
+ *   magic
+ *   blocks      frames of one ID, column by column:
+ *                 u64 timestamp of the first frame, zigzag LEB128 µs deltas for the rest
+ *                 one byte per frame: data length, bit 7 set for remote frames
+ *                 data bytes of all frames back to back
+ *   footer      u16 device count, per device: u8 name length, name
+ *               u32 series count, per series (device and ID):
+ *                 u16 device, u32 ID, u8 extended, u64 frames, u32 block count, per block:
+ *                   u64 offset, u32 size, u32 frames, u64 first µs, u64 last µs
+ *   trailer     u64 footer offset, magic
+ *
+ * Blocks of different IDs are interleaved in capture order, the footer indexes them by ID and time
+ * so a query only decodes the blocks it needs.
+ */
+
+const MAGIC: &[u8; 8] = b"CANCOL01";
+const TRAILER: usize = 8 + MAGIC.len();
+
+// 10 s of a 100 Hz ID, the time granularity of lookups
+const BLOCK_FRAMES: usize = 1024;
+
+const REMOTE: u8 = 0x80;
+
+#[derive(Debug, Clone, Copy)]
+struct Block {
+    offset: u64,
+    size: u32,
+    frames: u32,
+    // earliest and latest timestamp in the block
+    first_us: u64,
+    last_us: u64,
+}
+
+// all frames of one ID on one device
+#[derive(Debug)]
+struct Series {
+    device: u16,
+    id: u32,
+    extended: bool,
+    frames: u64,
+    blocks: Vec<Block>,
+}
+
+struct SeriesWriter {
+    series: Series,
+    pending: Vec<Frame>,
+}
+
+fn put_varint(out: &mut Vec<u8>, mut value: u64) {
+    while value >= 0x80 {
+        out.push(value as u8 | 0x80);
+        value >>= 7;
+    }
+    out.push(value as u8);
+}
+
+fn encode_block(frames: &[Frame], out: &mut Vec<u8>) {
+    out.extend_from_slice(&frames[0].timestamp_us.to_le_bytes());
+    for pair in frames.windows(2) {
+        let delta = pair[1].timestamp_us.wrapping_sub(pair[0].timestamp_us) as i64;
+        put_varint(out, ((delta << 1) ^ (delta >> 63)) as u64);
+    }
+    out.extend(
+        frames
+            .iter()
+            .map(|f| f.len | if f.remote { REMOTE } else { 0 }),
+    );
+    for frame in frames {
+        out.extend_from_slice(frame.payload());
+    }
+}
+
+struct Writer {
+    out: BufWriter<File>,
+    offset: u64,
+    devices: Vec<String>,
+    index: HashMap<(u16, u32), usize>,
+    series: Vec<SeriesWriter>,
+    scratch: Vec<u8>,
+}
+
+impl Writer {
+    fn create(path: &Path) -> io::Result<Self> {
+        let mut out = BufWriter::new(File::create(path)?);
+        out.write_all(MAGIC)?;
+        Ok(Self {
+            out,
+            offset: MAGIC.len() as u64,
+            devices: Vec::new(),
+            index: HashMap::new(),
+            series: Vec::new(),
+            scratch: Vec::new(),
+        })
+    }
+
+    fn add(&mut self, frame: &Frame) -> io::Result<()> {
+        let series = &mut self.series;
+        let i = *self
+            .index
+            .entry((frame.device, frame.id))
+            .or_insert_with(|| {
+                series.push(SeriesWriter {
+                    series: Series {
+                        device: frame.device,
+                        id: frame.id,
+                        extended: frame.extended,
+                        frames: 0,
+                        blocks: Vec::new(),
+                    },
+                    pending: Vec::with_capacity(BLOCK_FRAMES),
+                });
+                series.len() - 1
+            });
+        self.series[i].pending.push(*frame);
+        if self.series[i].pending.len() == BLOCK_FRAMES {
+            self.flush(i)?;
+        }
+        Ok(())
+    }
+
+    fn flush(&mut self, i: usize) -> io::Result<()> {
+        let writer = &mut self.series[i];
+        if writer.pending.is_empty() {
+            return Ok(());
+        }
+
+        self.scratch.clear();
+        encode_block(&writer.pending, &mut self.scratch);
+        self.out.write_all(&self.scratch)?;
+
+        writer.series.blocks.push(Block {
+            offset: self.offset,
+            size: self.scratch.len() as u32,
+            frames: writer.pending.len() as u32,
+            first_us: writer.pending.iter().map(|f| f.timestamp_us).min().unwrap(),
+            last_us: writer.pending.iter().map(|f| f.timestamp_us).max().unwrap(),
+        });
+        writer.series.frames += writer.pending.len() as u64;
+        writer.pending.clear();
+        self.offset += self.scratch.len() as u64;
+        Ok(())
+    }
+
+    fn finish(mut self) -> io::Result<()> {
+        for i in 0..self.series.len() {
+            self.flush(i)?;
+        }
+
+        let mut footer = Vec::new();
+        footer.extend_from_slice(&(self.devices.len() as u16).to_le_bytes());
+        for device in &self.devices {
+            footer.push(device.len() as u8);
+            footer.extend_from_slice(device.as_bytes());
+        }
+        footer.extend_from_slice(&(self.series.len() as u32).to_le_bytes());
+        for SeriesWriter { series, .. } in &self.series {
+            footer.extend_from_slice(&series.device.to_le_bytes());
+            footer.extend_from_slice(&series.id.to_le_bytes());
+            footer.push(series.extended as u8);
+            footer.extend_from_slice(&series.frames.to_le_bytes());
+            footer.extend_from_slice(&(series.blocks.len() as u32).to_le_bytes());
+            for block in &series.blocks {
+                footer.extend_from_slice(&block.offset.to_le_bytes());
+                footer.extend_from_slice(&block.size.to_le_bytes());
+                footer.extend_from_slice(&block.frames.to_le_bytes());
+                footer.extend_from_slice(&block.first_us.to_le_bytes());
+                footer.extend_from_slice(&block.last_us.to_le_bytes());
+            }
+        }
+        footer.extend_from_slice(&self.offset.to_le_bytes());
+        footer.extend_from_slice(MAGIC);
+
+        self.out.write_all(&footer)?;
+        self.out.flush()
+    }
+}
+
+// convert the dump files into one columnar capture at out, returns frames written and lines skipped
+pub fn convert(paths: &[PathBuf], out: &Path, threads: usize) -> io::Result<(u64, usize)> {
+    let maps = parse::map_files(paths)?;
+    let chunks = parse::chunks(&maps);
+    let mut writer = Writer::create(out)?;
+    let mut skipped = 0;
+
+    // parse a window of chunks in parallel, write them in order, only blocks being filled stay in memory
+    for window in chunks.chunks(threads.max(1) * parse::CHUNKS_PER_THREAD) {
+        for (chunk_frames, names, chunk_skipped) in
+            parse::parallel(window, threads, parse::parse_chunk)
+        {
+            let remap = parse::remap_devices(&mut writer.devices, &names)?;
+            for mut frame in chunk_frames {
+                frame.device = remap[frame.device as usize];
+                writer.add(&frame)?;
+            }
+            skipped += chunk_skipped;
+        }
+    }
+
+    let frames = writer
+        .series
+        .iter()
+        .map(|w| w.series.frames + w.pending.len() as u64)
+        .sum::<u64>();
+    writer.finish()?;
+    Ok((frames, skipped))
+}
+
+// bounds checked little endian reads, a short read is a corrupt capture
+struct Reader<'a> {
+    buf: &'a [u8],
+    pos: usize,
+}
+
+fn corrupt() -> io::Error {
+    io::Error::new(io::ErrorKind::InvalidData, "corrupt capture")
+}
+
+impl<'a> Reader<'a> {
+    fn bytes(&mut self, n: usize) -> io::Result<&'a [u8]> {
+        let bytes = self.buf.get(self.pos..self.pos + n).ok_or_else(corrupt)?;
+        self.pos += n;
+        Ok(bytes)
+    }
+
+    fn u8(&mut self) -> io::Result<u8> {
+        Ok(self.bytes(1)?[0])
+    }
+
+    fn u16(&mut self) -> io::Result<u16> {
+        Ok(u16::from_le_bytes(self.bytes(2)?.try_into().unwrap()))
+    }
+
+    fn u32(&mut self) -> io::Result<u32> {
+        Ok(u32::from_le_bytes(self.bytes(4)?.try_into().unwrap()))
+    }
+
+    fn u64(&mut self) -> io::Result<u64> {
+        Ok(u64::from_le_bytes(self.bytes(8)?.try_into().unwrap()))
+    }
+
+    fn varint(&mut self) -> io::Result<u64> {
+        let mut value = 0;
+        let mut shift = 0;
+        loop {
+            let byte = self.u8()?;
+            if shift > 63 {
+                return Err(corrupt());
+            }
+            value |= u64::from(byte & 0x7F) << shift;
+            if byte & 0x80 == 0 {
+                return Ok(value);
+            }
+            shift += 7;
+        }
+    }
+}
+
+// true if path is a columnar capture rather than a text dump
+pub fn is_capture(path: &Path) -> bool {
+    let mut magic = [0; MAGIC.len()];
+    File::open(path)
+        .and_then(|mut f| io::Read::read_exact(&mut f, &mut magic))
+        .is_ok_and(|_| magic == *MAGIC)
+}
+
+// an opened capture, only the footer is read
+pub struct Indexed {
+    map: Mmap,
+    devices: Vec<String>,
+    series: Vec<Series>,
+}
+
+impl Indexed {
+    pub fn open(path: &Path) -> io::Result<Self> {
+        let map = Mmap::open(path)?;
+        map.advise_random();
+        if map.len() < MAGIC.len() + TRAILER
+            || &map[..MAGIC.len()] != MAGIC
+            || &map[map.len() - MAGIC.len()..] != MAGIC
+        {
+            return Err(io::Error::new(io::ErrorKind::InvalidData, "not a capture"));
+        }
+
+        let mut trailer = Reader {
+            buf: &map,
+            pos: map.len() - TRAILER,
+        };
+        let mut footer = Reader {
+            buf: &map[..map.len() - TRAILER],
+            pos: trailer.u64()? as usize,
+        };
+
+        let mut devices = Vec::new();
+        for _ in 0..footer.u16()? {
+            let len = footer.u8()? as usize;
+            devices.push(String::from_utf8_lossy(footer.bytes(len)?).into_owned());
+        }
+        let mut series = Vec::new();
+        for _ in 0..footer.u32()? {
+            let mut s = Series {
+                device: footer.u16()?,
+                id: footer.u32()?,
+                extended: footer.u8()? != 0,
+                frames: footer.u64()?,
+                blocks: Vec::new(),
+            };
+            for _ in 0..footer.u32()? {
+                s.blocks.push(Block {
+                    offset: footer.u64()?,
+                    size: footer.u32()?,
+                    frames: footer.u32()?,
+                    first_us: footer.u64()?,
+                    last_us: footer.u64()?,
+                });
+            }
+            if usize::from(s.device) >= devices.len() {
+                return Err(corrupt());
+            }
+            series.push(s);
+        }
+
+        Ok(Self {
+            map,
+            devices,
+            series,
+        })
+    }
+
+    fn decode(
+        &self,
+        series: &Series,
+        block: &Block,
+        query: &Query,
+        out: &mut Vec<Frame>,
+    ) -> io::Result<()> {
+        let start = block.offset as usize;
+        let mut r = Reader {
+            buf: self
+                .map
+                .get(start..start + block.size as usize)
+                .ok_or_else(corrupt)?,
+            pos: 0,
+        };
+        let count = block.frames as usize;
+
+        let mut stamps = Vec::with_capacity(count);
+        let mut stamp = r.u64()?;
+        stamps.push(stamp);
+        for _ in 1..count {
+            let zigzag = r.varint()?;
+            let delta = ((zigzag >> 1) as i64) ^ -((zigzag & 1) as i64);
+            stamp = stamp.wrapping_add(delta as u64);
+            stamps.push(stamp);
+        }
+        let lens = r.bytes(count)?;
+
+        for (stamp, len) in stamps.into_iter().zip(lens) {
+            let mut frame = Frame {
+                timestamp_us: stamp,
+                id: series.id,
+                device: series.device,
+                extended: series.extended,
+                remote: len & REMOTE != 0,
+                len: len & !REMOTE,
+                data: [0; 8],
+            };
+            if frame.len > 8 {
+                return Err(corrupt());
+            }
+            frame.data[..frame.len as usize].copy_from_slice(r.bytes(frame.len as usize)?);
+            if query.matches(&frame) {
+                out.push(frame);
+            }
+        }
+        Ok(())
+    }
+
+    // frames matching query, by timestamp, only blocks of the ID overlapping the time range are decoded
+    pub fn query(&self, query: &Query) -> io::Result<Capture> {
+        let mut capture = Capture {
+            devices: self.devices.clone(),
+            ..Capture::default()
+        };
+        for series in self
+            .series
+            .iter()
+            .filter(|s| query.id.is_none_or(|id| id == s.id))
+        {
+            for block in &series.blocks {
+                if block.last_us >= query.from_us && block.first_us <= query.to_us {
+                    self.decode(series, block, query, &mut capture.frames)?;
+                }
+            }
+        }
+        capture.frames.sort_by_key(|f| f.timestamp_us);
+        Ok(capture)
+    }
+}
+
+// query every capture file, frames of all files by timestamp
+pub fn load(paths: &[PathBuf], query: &Query) -> io::Result<Capture> {
+    let mut capture = Capture::default();
+    for path in paths {
+        let indexed = Indexed::open(path)
+            .map_err(|e| io::Error::new(e.kind(), format!("{}: {}", path.display(), e)))?;
+        let names: Vec<&[u8]> = indexed.devices.iter().map(|d| d.as_bytes()).collect();
+        let remap = parse::remap_devices(&mut capture.devices, &names)?;
+        capture
+            .frames
+            .extend(indexed.query(query)?.frames.into_iter().map(|mut f| {
+                f.device = remap[f.device as usize];
+                f
+            }));
+    }
+    capture.frames.sort_by_key(|f| f.timestamp_us);
+    Ok(capture)
+}
@@ -0,0 +1,708 @@
+use std::collections::{BTreeMap, HashMap};
+use std::io;
+use std::path::PathBuf;
+
+use crate::parse::{self, Capture, Chunk, Devices, Frame, Query};
+
+// values are sampled on this grid to line up IDs sent at different rates for correlation
+const GRID_US: u64 = 100_000;
+// a sample is stale this many grid steps after its frame
+const HOLD_STEPS: u64 = 10;
+// a nibble or byte is a counter if it goes up by one in at least this fraction of frames
+const COUNTER_RATE: f64 = 0.8;
+// checksum bytes look random: every bit flips in about half the frames and is 1 about half the time
+const CHECKSUM_FLIPS: (f64, f64) = (0.35, 0.65);
+const CHECKSUM_ENTROPY: f64 = 0.95;
+// towards the MSB of one signal flip rates fall, a rise by more than this factor starts a new signal
+const FLIP_TOLERANCE: f64 = 1.2;
+// except among the noisy low bits of a signal, which all flip about half the time
+const FLIP_NOISE: f64 = 0.4;
+// narrower fields are flags, not worth correlating
+const MIN_CORRELATE_BITS: usize = 4;
+const MIN_SAMPLES: usize = 20;
+const TOP: usize = 20;
+
+// counter candidates within a byte, widest first: (shift, mask)
+const COUNTERS: [(u32, u8); 3] = [(0, 0xFF), (0, 0x0F), (4, 0x0F)];
+
+#[derive(Debug, Clone, Copy, PartialEq, Eq)]
+pub enum Class {
+    Absent,
+    Constant,
+    Counter,
+    Checksum,
+    Signal,
+}
+
+impl Class {
+    fn symbol(self) -> char {
+        match self {
+            Class::Absent => ' ',
+            Class::Constant => '.',
+            Class::Counter => 'C',
+            Class::Checksum => 'X',
+            Class::Signal => 'S',
+        }
+    }
+}
+
+// everything one pass learns about an ID, bits in DBC numbering (bit 0 is the LSB of byte 0)
+#[derive(Clone)]
+struct IdAcc {
+    frames: u64,
+    // frames that have the byte, and of those how many have each bit set
+    present: [u64; 8],
+    ones: [u64; 64],
+    // consecutive frame pairs that both have the byte, and of those how many flip each bit
+    compared: [u64; 8],
+    flips: [u64; 64],
+    // frame pairs where a COUNTERS candidate went up by one
+    increments: [[u64; COUNTERS.len()]; 8],
+    // Σ|Δ| of bytes i and i + 1 read as one 16 bit value, little and big endian
+    pair_deltas: [[u64; 2]; 7],
+    // last frame of every grid step
+    samples: Vec<Frame>,
+    first: Frame,
+    last: Frame,
+}
+
+impl Default for IdAcc {
+    fn default() -> Self {
+        Self {
+            frames: 0,
+            present: [0; 8],
+            ones: [0; 64],
+            compared: [0; 8],
+            flips: [0; 64],
+            increments: [[0; COUNTERS.len()]; 8],
+            pair_deltas: [[0; 2]; 7],
+            samples: Vec::new(),
+            first: Frame::default(),
+            last: Frame::default(),
+        }
+    }
+}
+
+impl IdAcc {
+    fn add(&mut self, frame: &Frame) {
+        if self.frames == 0 {
+            self.first = *frame;
+        } else {
+            let last = self.last;
+            self.follow(&last, frame);
+        }
+        for (i, byte) in frame.payload().iter().enumerate() {
+            self.present[i] += 1;
+            for bit in 0..8 {
+                self.ones[i * 8 + bit] += u64::from(byte >> bit & 1);
+            }
+        }
+        self.sample(*frame);
+        self.last = *frame;
+        self.frames += 1;
+    }
+
+    fn sample(&mut self, frame: Frame) {
+        match self.samples.last_mut() {
+            Some(last) if last.timestamp_us / GRID_US == frame.timestamp_us / GRID_US => {
+                *last = frame
+            }
+            _ => self.samples.push(frame),
+        }
+    }
+
+    fn follow(&mut self, prev: &Frame, frame: &Frame) {
+        let len = prev.len.min(frame.len) as usize;
+        for i in 0..len {
+            let (a, b) = (prev.data[i], frame.data[i]);
+            self.compared[i] += 1;
+            let changed = a ^ b;
+            for bit in 0..8 {
+                self.flips[i * 8 + bit] += u64::from(changed >> bit & 1);
+            }
+            for (k, (shift, mask)) in COUNTERS.iter().enumerate() {
+                if (b >> shift).wrapping_sub(a >> shift) & mask == 1 {
+                    self.increments[i][k] += 1;
+                }
+            }
+            if i + 1 < len {
+                let (c, d) = (prev.data[i + 1], frame.data[i + 1]);
+                let little = u16::from_le_bytes([b, d]).wrapping_sub(u16::from_le_bytes([a, c]));
+                let big = u16::from_be_bytes([b, d]).wrapping_sub(u16::from_be_bytes([a, c]));
+                self.pair_deltas[i][0] += u64::from((little as i16).unsigned_abs());
+                self.pair_deltas[i][1] += u64::from((big as i16).unsigned_abs());
+            }
+        }
+    }
+
+    // add the frames after these, continues if they directly follow in the same file
+    fn merge(&mut self, other: IdAcc, continues: bool) {
+        if self.frames == 0 {
+            *self = other;
+            return;
+        }
+        if continues {
+            let last = self.last;
+            self.follow(&last, &other.first);
+        }
+        self.frames += other.frames;
+        for i in 0..8 {
+            self.present[i] += other.present[i];
+            self.compared[i] += other.compared[i];
+            for k in 0..COUNTERS.len() {
+                self.increments[i][k] += other.increments[i][k];
+            }
+        }
+        for i in 0..64 {
+            self.ones[i] += other.ones[i];
+            self.flips[i] += other.flips[i];
+        }
+        for i in 0..7 {
+            self.pair_deltas[i][0] += other.pair_deltas[i][0];
+            self.pair_deltas[i][1] += other.pair_deltas[i][1];
+        }
+        for frame in other.samples {
+            self.sample(frame);
+        }
+        self.last = other.last;
+    }
+
+    fn flip_rate(&self, bit: usize) -> f64 {
+        match self.compared[bit / 8] {
+            0 => 0.0,
+            n => self.flips[bit] as f64 / n as f64,
+        }
+    }
+
+    // Shannon entropy of the bit in bits, 1.0 if it is 0 and 1 equally often
+    fn entropy(&self, bit: usize) -> f64 {
+        let n = self.present[bit / 8];
+        if n == 0 {
+            return 0.0;
+        }
+        let p = self.ones[bit] as f64 / n as f64;
+        if p <= 0.0 || p >= 1.0 {
+            0.0
+        } else {
+            -(p * p.log2() + (1.0 - p) * (1.0 - p).log2())
+        }
+    }
+
+    fn classify(&self) -> [Class; 64] {
+        let mut classes = [Class::Absent; 64];
+        for byte in 0..8 {
+            if self.present[byte] == 0 {
+                continue;
+            }
+            let bits = byte * 8..byte * 8 + 8;
+            for bit in bits.clone() {
+                classes[bit] = if self.flips[bit] == 0 {
+                    Class::Constant
+                } else {
+                    Class::Signal
+                };
+            }
+
+            if self.compared[byte] > 0 {
+                let compared = self.compared[byte] as f64;
+                if let Some((shift, mask)) = COUNTERS
+                    .iter()
+                    .zip(self.increments[byte])
+                    .find(|(_, n)| *n as f64 / compared >= COUNTER_RATE)
+                    .map(|(c, _)| *c)
+                {
+                    for bit in 0..8 {
+                        if (u32::from(mask) << shift) & (1 << bit) != 0
+                            && classes[byte * 8 + bit] == Class::Signal
+                        {
+                            classes[byte * 8 + bit] = Class::Counter;
+                        }
+                    }
+                    continue;
+                }
+            }
+
+            let random = bits.clone().all(|bit| {
+                let flips = self.flip_rate(bit);
+                flips >= CHECKSUM_FLIPS.0
+                    && flips <= CHECKSUM_FLIPS.1
+                    && self.entropy(bit) >= CHECKSUM_ENTROPY
+            });
+            if random {
+                for bit in bits {
+                    classes[bit] = Class::Checksum;
+                }
+            }
+        }
+        classes
+    }
+}
+
+// a candidate signal
+#[derive(Debug, Clone)]
+pub struct Field {
+    // DBC bit numbers, least significant first
+    bits: Vec<usize>,
+    // None if within one byte, where both byte orders read the same bits
+    big: Option<bool>,
+    // mean |Δ| of the bytes spanned read in this byte order over the other, low favours this order
+    delta_ratio: Option<f64>,
+}
+
+impl Field {
+    // DBC start bit: LSB for little endian, MSB for big endian
+    fn start(&self) -> usize {
+        match self.big {
+            Some(true) => *self.bits.last().unwrap(),
+            _ => self.bits[0],
+        }
+    }
+
+    fn bytes(&self) -> (usize, usize) {
+        let a = self.bits[0] / 8;
+        let b = self.bits.last().unwrap() / 8;
+        (a.min(b), a.max(b))
+    }
+
+    fn name(&self) -> String {
+        format!(
+            "{}|{}@{}",
+            self.start(),
+            self.bits.len(),
+            if self.big == Some(true) { 0 } else { 1 }
+        )
+    }
+
+    fn endian(&self) -> &'static str {
+        match self.big {
+            None => "either",
+            Some(true) => "big",
+            Some(false) => "little",
+        }
+    }
+
+    // raw unsigned value, None if the frame is too short
+    fn value(&self, frame: &Frame) -> Option<u64> {
+        let mut value = 0;
+        for (k, bit) in self.bits.iter().enumerate() {
+            if bit / 8 >= frame.len as usize {
+                return None;
+            }
+            value |= u64::from(frame.data[bit / 8] >> (bit % 8) & 1) << k;
+        }
+        Some(value)
+    }
+}
+
+// bit runs of signal bits whose flip rate does not rise towards the MSB, order lists bits LSB first
+fn segment(order: &[usize], classes: &[Class; 64], acc: &IdAcc) -> Vec<Vec<usize>> {
+    let mut fields: Vec<Vec<usize>> = Vec::new();
+    let mut current: Vec<usize> = Vec::new();
+    for &bit in order {
+        if classes[bit] != Class::Signal {
+            if !current.is_empty() {
+                fields.push(std::mem::take(&mut current));
+            }
+            continue;
+        }
+        if let Some(&prev) = current.last() {
+            let (rate, prev) = (acc.flip_rate(bit), acc.flip_rate(prev));
+            if rate > prev * FLIP_TOLERANCE && prev < FLIP_NOISE {
+                fields.push(std::mem::take(&mut current));
+            }
+        }
+        current.push(bit);
+    }
+    if !current.is_empty() {
+        fields.push(current);
+    }
+    fields
+}
+
+fn fields(classes: &[Class; 64], acc: &IdAcc) -> Vec<Field> {
+    let little: Vec<usize> = (0..64).collect();
+    let big: Vec<usize> = (0..8)
+        .rev()
+        .flat_map(|byte| byte * 8..byte * 8 + 8)
+        .collect();
+
+    let mut candidates: Vec<Field> = Vec::new();
+    for (is_big, order) in [(false, &little), (true, &big)] {
+        for bits in segment(order, classes, acc) {
+            let mut field = Field {
+                bits,
+                big: Some(is_big),
+                delta_ratio: None,
+            };
+            let (first, last) = field.bytes();
+            if first == last {
+                field.big = None;
+            } else {
+                let (own, other) = (first..last).fold((0, 0), |(own, other), pair| {
+                    let deltas = acc.pair_deltas[pair];
+                    (
+                        own + deltas[is_big as usize],
+                        other + deltas[!is_big as usize],
+                    )
+                });
+                field.delta_ratio = Some(own as f64 / other.max(1) as f64);
+            }
+            candidates.push(field);
+        }
+    }
+
+    // single byte fields are found in both orders, drop repeats and those inside a multi-byte field
+    let mut result: Vec<Field> = Vec::new();
+    for field in &candidates {
+        let inside = field.big.is_none()
+            && candidates
+                .iter()
+                .any(|f| f.big.is_some() && field.bits.iter().all(|b| f.bits.contains(b)));
+        let repeat = result.iter().any(|f| f.bits == field.bits);
+        if !inside && !repeat {
+            result.push(field.clone());
+        }
+    }
+    result.sort_by_key(|f| (f.bytes().0, f.start()));
+    result
+}
+
+// one ID after the pass
+pub struct Analysis {
+    pub device: u16,
+    pub id: u32,
+    pub frames: u64,
+    classes: [Class; 64],
+    flip_rates: [f64; 64],
+    fields: Vec<Field>,
+    samples: Vec<Frame>,
+}
+
+pub struct Correlation {
+    r: f64,
+    // (analysis, field, signed)
+    a: (usize, usize, bool),
+    b: (usize, usize, bool),
+    samples: usize,
+}
+
+pub struct Discovery {
+    pub devices: Vec<String>,
+    pub ids: Vec<Analysis>,
+    pub correlations: Vec<Correlation>,
+    pub skipped: usize,
+}
+
+struct ChunkAcc<'a> {
+    file: usize,
+    ids: HashMap<(u16, u32), IdAcc>,
+    devices: Vec<&'a [u8]>,
+    skipped: usize,
+}
+
+fn chunk_acc<'a>(chunk: &Chunk<'a>, query: &Query) -> ChunkAcc<'a> {
+    let mut ids: HashMap<(u16, u32), IdAcc> = HashMap::new();
+    let mut devices = Devices::default();
+    let skipped = parse::parse_text(chunk.text, &mut devices, |frame| {
+        if query.matches(&frame) {
+            ids.entry((frame.device, frame.id)).or_default().add(&frame);
+        }
+    });
+    ChunkAcc {
+        file: chunk.file,
+        ids,
+        devices: devices.names,
+        skipped,
+    }
+}
+
+// field values on the shared grid, None where the ID has no recent frame
+fn series(analysis: &Analysis, field: &Field, ticks: &[u64], signed: bool) -> Vec<Option<f64>> {
+    let width = field.bits.len();
+    let mut out = Vec::with_capacity(ticks.len());
+    let mut next = 0;
+    let mut held: Option<(u64, f64)> = None;
+    for &tick in ticks {
+        while next < analysis.samples.len() && analysis.samples[next].timestamp_us / GRID_US <= tick
+        {
+            let frame = &analysis.samples[next];
+            held = field.value(frame).map(|raw| {
+                let value = if signed && width < 64 && raw >> (width - 1) & 1 != 0 {
+                    raw as f64 - (1u64 << width) as f64
+                } else {
+                    raw as f64
+                };
+                (frame.timestamp_us / GRID_US, value)
+            });
+            next += 1;
+        }
+        out.push(
+            held.filter(|(at, _)| tick - at <= HOLD_STEPS)
+                .map(|(_, v)| v),
+        );
+    }
+    out
+}
+
+fn pearson(a: &[Option<f64>], b: &[Option<f64>]) -> Option<(f64, usize)> {
+    let (mut n, mut sa, mut sb) = (0usize, 0.0, 0.0);
+    for (x, y) in a.iter().zip(b) {
+        if let (Some(x), Some(y)) = (x, y) {
+            n += 1;
+            sa += x;
+            sb += y;
+        }
+    }
+    if n < MIN_SAMPLES {
+        return None;
+    }
+    let (ma, mb) = (sa / n as f64, sb / n as f64);
+    let (mut cov, mut va, mut vb) = (0.0, 0.0, 0.0);
+    for (x, y) in a.iter().zip(b) {
+        if let (Some(x), Some(y)) = (x, y) {
+            cov += (x - ma) * (y - mb);
+            va += (x - ma) * (x - ma);
+            vb += (y - mb) * (y - mb);
+        }
+    }
+    if va == 0.0 || vb == 0.0 {
+        return None;
+    }
+    Some((cov / (va * vb).sqrt(), n))
+}
+
+// rank correlations between fields of different IDs, or only against reference when given
+fn correlate(ids: &[Analysis], reference: Option<u32>, threads: usize) -> Vec<Correlation> {
+    let mut ticks: Vec<u64> = ids
+        .iter()
+        .flat_map(|a| a.samples.iter().map(|f| f.timestamp_us / GRID_US))
+        .collect();
+    ticks.sort_unstable();
+    ticks.dedup();
+
+    // (analysis, field, signed) and its values on the grid
+    let mut keys = Vec::new();
+    for (i, analysis) in ids.iter().enumerate() {
+        for (j, field) in analysis.fields.iter().enumerate() {
+            if field.bits.len() >= MIN_CORRELATE_BITS {
+                keys.push((i, j));
+            }
+        }
+    }
+    let values: Vec<[Vec<Option<f64>>; 2]> = parse::parallel(&keys, threads, |&(i, j)| {
+        [false, true].map(|signed| series(&ids[i], &ids[i].fields[j], &ticks, signed))
+    });
+
+    let mut pairs = Vec::new();
+    for a in 0..keys.len() {
+        for b in a + 1..keys.len() {
+            let (ia, ib) = (keys[a].0, keys[b].0);
+            let wanted = reference.is_none_or(|id| ids[ia].id == id || ids[ib].id == id);
+            if ids[ia].id != ids[ib].id && wanted {
+                pairs.push((a, b));
+            }
+        }
+    }
+
+    let batches: Vec<&[(usize, usize)]> = pairs.chunks(256).collect();
+    let mut correlations: Vec<Correlation> = parse::parallel(&batches, threads, |batch| {
+        batch
+            .iter()
+            .filter_map(|&(a, b)| {
+                let mut best: Option<Correlation> = None;
+                for sa in [false, true] {
+                    for sb in [false, true] {
+                        if let Some((r, samples)) =
+                            pearson(&values[a][sa as usize], &values[b][sb as usize])
+                        {
+                            if best.as_ref().is_none_or(|c| r.abs() > c.r.abs() + 1e-9) {
+                                best = Some(Correlation {
+                                    r,
+                                    a: (keys[a].0, keys[a].1, sa),
+                                    b: (keys[b].0, keys[b].1, sb),
+                                    samples,
+                                });
+                            }
+                        }
+                    }
+                }
+                best
+            })
+            .collect::<Vec<_>>()
+    })
+    .into_iter()
+    .flatten()
+    .collect();
+
+    correlations.sort_by(|x, y| y.r.abs().total_cmp(&x.r.abs()));
+    correlations.truncate(TOP);
+    correlations
+}
+
+fn analyse(device: u16, id: u32, acc: IdAcc) -> Analysis {
+    let classes = acc.classify();
+    let fields = fields(&classes, &acc);
+    let mut flip_rates = [0.0; 64];
+    for (bit, rate) in flip_rates.iter_mut().enumerate() {
+        *rate = acc.flip_rate(bit);
+    }
+    Analysis {
+        device,
+        id,
+        frames: acc.frames,
+        classes,
+        flip_rates,
+        fields,
+        samples: acc.samples,
+    }
+}
+
+fn finish(
+    devices: Vec<String>,
+    accs: BTreeMap<(u16, u32), IdAcc>,
+    skipped: usize,
+    query: &Query,
+    threads: usize,
+) -> Discovery {
+    let ids: Vec<Analysis> = accs
+        .into_iter()
+        .map(|((device, id), acc)| analyse(device, id, acc))
+        .collect();
+    let correlations = correlate(&ids, query.id, threads);
+    Discovery {
+        devices,
+        ids,
+        correlations,
+        skipped,
+    }
+}
+
+// classify bits and find signals of every ID in one parallel pass over the dump files
+pub fn collect(paths: &[PathBuf], threads: usize, query: &Query) -> io::Result<Discovery> {
+    let maps = parse::map_files(paths)?;
+    let chunks = parse::chunks(&maps);
+
+    // correlation needs every ID, --id only picks what is shown
+    let all = Query { id: None, ..*query };
+    let mut devices = Vec::new();
+    let mut accs: BTreeMap<(u16, u32), IdAcc> = BTreeMap::new();
+    let mut last_file: HashMap<(u16, u32), usize> = HashMap::new();
+    let mut skipped = 0;
+
+    for window in chunks.chunks(threads.max(1) * parse::CHUNKS_PER_THREAD) {
+        for chunk in parse::parallel(window, threads, |chunk| chunk_acc(chunk, &all)) {
+            let remap = parse::remap_devices(&mut devices, &chunk.devices)?;
+            for ((device, id), acc) in chunk.ids {
+                let key = (remap[device as usize], id);
+                let continues = last_file.insert(key, chunk.file) == Some(chunk.file);
+                accs.entry(key).or_default().merge(acc, continues);
+            }
+            skipped += chunk.skipped;
+        }
+    }
+
+    Ok(finish(devices, accs, skipped, query, threads))
+}
+
+// the same from already loaded frames, in timestamp order per ID
+pub fn from_capture(capture: &Capture, threads: usize, query: &Query) -> Discovery {
+    let mut accs: BTreeMap<(u16, u32), IdAcc> = BTreeMap::new();
+    for frame in &capture.frames {
+        accs.entry((frame.device, frame.id)).or_default().add(frame);
+    }
+    finish(
+        capture.devices.clone(),
+        accs,
+        capture.skipped,
+        query,
+        threads,
+    )
+}
+
+fn format_id(id: u32) -> String {
+    if id <= 0x7FF {
+        format!("{:03X}", id)
+    } else {
+        format!("{:08X}", id)
+    }
+}
+
+fn describe(discovery: &Discovery, (i, j, signed): (usize, usize, bool)) -> String {
+    let analysis = &discovery.ids[i];
+    let field = &analysis.fields[j];
+    format!(
+        "{} {:>8} {:>8} {:<6} {}",
+        discovery.devices[analysis.device as usize],
+        format_id(analysis.id),
+        field.name(),
+        field.endian(),
+        if signed { "signed" } else { "unsigned" }
+    )
+}
+
+pub fn print(discovery: &Discovery, id: Option<u32>) {
+    for analysis in discovery
+        .ids
+        .iter()
+        .filter(|a| id.is_none_or(|id| id == a.id))
+    {
+        println!(
+            "{} {} {} frames",
+            discovery.devices[analysis.device as usize],
+            format_id(analysis.id),
+            analysis.frames
+        );
+        println!("  byte  bit 7..0  flip rate % bit 7..0");
+        for byte in 0..8 {
+            if analysis.classes[byte * 8] == Class::Absent {
+                continue;
+            }
+            let bits: String = (0..8)
+                .rev()
+                .map(|bit| analysis.classes[byte * 8 + bit].symbol())
+                .collect();
+            let rates: Vec<String> = (0..8)
+                .rev()
+                .map(|bit| format!("{:>5.1}", analysis.flip_rates[byte * 8 + bit] * 100.0))
+                .collect();
+            println!("  {:>4}  {}  {}", byte, bits, rates.join(" "));
+        }
+        if !analysis.fields.is_empty() {
+            println!(
+                "  {:>10}  {:<6}  {:>9}  {:>9}  {:>7}",
+                "field", "endian", "MSB flip%", "LSB flip%", "Δ ratio"
+            );
+        }
+        for field in &analysis.fields {
+            println!(
+                "  {:>10}  {:<6}  {:>9.2}  {:>9.2}  {:>7}",
+                field.name(),
+                field.endian(),
+                analysis.flip_rates[*field.bits.last().unwrap()] * 100.0,
+                analysis.flip_rates[field.bits[0]] * 100.0,
+                field
+                    .delta_ratio
+                    .map_or(String::new(), |r| format!("{:.3}", r))
+            );
+        }
+        println!();
+    }
+
+    println!("bits: '.' constant, 'C' counter, 'X' checksum (random), 'S' signal");
+    println!("fields: DBC start|length@1 little endian (start is the LSB), @0 big endian (start is the MSB)");
+    println!("Δ ratio: mean change of the bytes read in this byte order over the other, below 1 favours it");
+
+    if !discovery.correlations.is_empty() {
+        println!();
+        println!("{:>7} {:>7}  {:<38} field", "r", "samples", "field");
+        for c in &discovery.correlations {
+            println!(
+                "{:>+7.3} {:>7}  {:<38} {}",
+                c.r,
+                c.samples,
+                describe(discovery, c.a),
+                describe(discovery, c.b)
+            );
+        }
+    }
+}
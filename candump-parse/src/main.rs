@@ -1,12 +1,20 @@
 use std::convert::TryInto;
-use std::fs::File;
-use std::io::{BufRead, BufReader};
+use std::io;
 use std::path::PathBuf;
+use std::process::exit;
 
 use clap::{value_parser, Parser, ValueEnum};
 use clap_num::maybe_hex;
-use hex::decode;
-use sscanf::scanf;
+
+mod bench;
+mod columnar;
+mod discover;
+mod mmap;
+mod parse;
+mod rates;
+mod stats;
+
+use parse::{Capture, Frame, Query};
 
 #[derive(Debug, Parser)]
 struct Args {
@@ -21,6 +29,14 @@ struct Args {
     #[arg(long, value_parser = maybe_hex::<u32>)]
     id: Option<u32>,
 
+    // show only frames from this timestamp on (seconds, as printed by --data)
+    #[arg(long)]
+    from: Option<f64>,
+
+    // show only frames up to this timestamp (seconds, as printed by --data)
+    #[arg(long)]
+    to: Option<f64>,
+
     // when converting bytes to values, how endian'ness to use
     #[arg(long, default_value_t = Endian::Little, value_enum)]
     endian: Endian,
@@ -48,6 +64,46 @@ struct Args {
     // value offset
     #[arg(long, default_value_t = 0.0, allow_hyphen_values(true))]
     offset: f64,
+
+    // show per ID statistics, with --id also the interval histogram and bit change map
+    #[arg(long)]
+    stats: bool,
+
+    // classify bits, find candidate signals per ID and rank correlations between IDs (against --id if given)
+    #[arg(long)]
+    discover: bool,
+
+    // pick rate divisors for the --target output rates from the measured bus rates, print a decoder table
+    #[arg(long)]
+    rates: bool,
+
+    // wanted output rate of an ID for --rates, ID=HZ[:high|normal|low], repeat for every ID
+    #[arg(long, value_parser = rates::parse_target)]
+    target: Vec<rates::Target>,
+
+    // Bluetooth LE MTU to predict CONFIG_RC_BATCH_NOTIFY notifications for, with --rates
+    #[arg(long, value_parser = value_parser!(u16).range(23..))]
+    mtu: Option<u16>,
+
+    // frames per second the Bluetooth LE link sustains (CONFIG_RC_SCHED_RATE), with --rates
+    #[arg(long, default_value_t = 400.0)]
+    budget: f64,
+
+    // statistics output format
+    #[arg(long, default_value_t = stats::Format::Table, value_enum)]
+    format: stats::Format,
+
+    // threads to parse with, default all cores
+    #[arg(long)]
+    threads: Option<usize>,
+
+    // convert the dump files to an indexed columnar capture, which can be given instead of dump files later
+    #[arg(long, value_name = "CAPTURE")]
+    convert: Option<PathBuf>,
+
+    // time the original line based loader against the mapped parallel parser
+    #[arg(long)]
+    bench: bool,
 }
 
 #[derive(Debug, Copy, Clone, PartialEq, Eq, PartialOrd, Ord, ValueEnum)]
@@ -56,24 +112,12 @@ enum Endian {
     Big,
 }
 
-#[derive(Debug)]
-struct CanFrame {
-    timestamp: f64,
-    device: String,
-    id: u32,
-    data: Vec<u8>,
+struct CanFrame<'a> {
+    frame: &'a Frame,
+    device: &'a str,
 }
 
-impl CanFrame {
-    fn new(timestamp: f64, device: String, id: String, data: String) -> Self {
-        Self {
-            timestamp,
-            device,
-            id: u32::from_be_bytes(decode(id).unwrap().try_into().unwrap()),
-            data: decode(data).unwrap(),
-        }
-    }
-
+impl CanFrame<'_> {
     fn to_string(
         &self,
         endian: Endian,
@@ -84,18 +128,22 @@ impl CanFrame {
         factor: f64,
         offset: f64,
     ) -> String {
-        let id = if self.id <= 0x7FF {
-            format!("     {:03X}", self.id)
+        let id = if self.frame.id <= 0x7FF {
+            format!("     {:03X}", self.frame.id)
         } else {
-            format!("{:08X}", self.id)
+            format!("{:08X}", self.frame.id)
         };
 
         let mut data: String = String::with_capacity(32);
         let mut value_bytes: Vec<u8> = Vec::new();
-        let data_len: u8 = std::cmp::min(self.data.len() as u8 - 1, end_byte);
+        let payload = self.frame.payload();
+        if payload.len() <= start_byte as usize {
+            return format!("{} | {} | {} |", timestamp(self.frame), self.device, id);
+        }
+        let data_len: u8 = std::cmp::min(payload.len() as u8 - 1, end_byte);
 
         for i in start_byte..=data_len {
-            let mut byte = self.data[i as usize];
+            let mut byte = payload[i as usize];
             if i == start_byte {
                 byte &= start_mask;
             }
@@ -131,8 +179,8 @@ impl CanFrame {
         }
 
         format!(
-            "{:.6} | {} | {} | {} | {:.6} | {:.6}",
-            self.timestamp,
+            "{} | {} | {} | {} | {:.6} | {:.6}",
+            timestamp(self.frame),
             self.device,
             id,
             data,
@@ -142,42 +190,141 @@ impl CanFrame {
     }
 }
 
-#[derive(Debug)]
-struct Context {
-    frames: Vec<CanFrame>,
+// seconds.micros, exact
+fn timestamp(frame: &Frame) -> String {
+    format!(
+        "{}.{:06}",
+        frame.timestamp_us / 1_000_000,
+        frame.timestamp_us % 1_000_000
+    )
+}
+
+// seconds as printed by --data to microseconds
+fn seconds_to_us(seconds: f64) -> u64 {
+    (seconds * 1e6).round() as u64
 }
 
-impl Context {
-    fn new() -> Self {
-        Self {
-            frames: Vec::with_capacity(100000),
+fn or_exit<T>(result: io::Result<T>) -> T {
+    match result {
+        Ok(value) => value,
+        Err(e) => {
+            eprintln!("{}", e);
+            exit(1);
         }
     }
 }
 
+// columnar captures are looked up through their index, text dumps are parsed
+fn load(
+    dump_files: &[PathBuf],
+    columnar: bool,
+    threads: usize,
+    query: &Query,
+) -> io::Result<Capture> {
+    if columnar {
+        columnar::load(dump_files, query)
+    } else {
+        parse::load(dump_files, threads)
+    }
+}
+
 fn main() {
     let args = Args::parse();
-    let mut context = Context::new();
+    let threads = args.threads.unwrap_or_else(parse::default_threads);
+    let query = Query {
+        id: args.id,
+        from_us: args.from.map_or(0, seconds_to_us),
+        to_us: args.to.map_or(u64::MAX, seconds_to_us),
+    };
+
+    if args.bench {
+        bench::run(&args.dump_file, threads);
+        return;
+    }
+
+    if let Some(out) = &args.convert {
+        let (frames, skipped) = or_exit(columnar::convert(&args.dump_file, out, threads));
+        if skipped > 0 {
+            eprintln!("Skipped {} lines that are not CAN frames", skipped);
+        }
+        println!("Converted {} frames to {}", frames, out.display());
+        return;
+    }
+
+    let captures = args
+        .dump_file
+        .iter()
+        .filter(|f| columnar::is_capture(f))
+        .count();
+    if captures > 0 && captures < args.dump_file.len() {
+        eprintln!("Give either columnar captures or candump files, not both");
+        exit(1);
+    }
+    let columnar = captures > 0;
+
+    if args.stats {
+        let stats = if columnar {
+            stats::from_capture(&or_exit(columnar::load(&args.dump_file, &query)))
+        } else {
+            or_exit(stats::collect(&args.dump_file, threads, &query))
+        };
+        if stats.skipped > 0 {
+            eprintln!("Skipped {} lines that are not CAN frames", stats.skipped);
+        }
+        stats::print(&stats, args.format, args.id.is_some());
+        return;
+    }
+
+    if args.discover {
+        let discovery = if columnar {
+            discover::from_capture(
+                &or_exit(columnar::load(
+                    &args.dump_file,
+                    &Query { id: None, ..query },
+                )),
+                threads,
+                &query,
+            )
+        } else {
+            or_exit(discover::collect(&args.dump_file, threads, &query))
+        };
+        if discovery.skipped > 0 {
+            eprintln!(
+                "Skipped {} lines that are not CAN frames",
+                discovery.skipped
+            );
+        }
+        discover::print(&discovery, args.id);
+        return;
+    }
+
+    if args.rates {
+        let capture = or_exit(load(
+            &args.dump_file,
+            columnar,
+            threads,
+            &Query { id: None, ..query },
+        ));
+        let plan = rates::plan(&capture, &args.target, args.mtu);
+        rates::print(&plan, &args.dump_file, args.mtu, args.budget);
+        return;
+    }
 
     for dump_file in args.dump_file.iter() {
         println!("Processing file {}...", dump_file.display());
-        let reader = BufReader::new(File::open(dump_file).unwrap());
-        for line in reader.lines().map(|l| l.unwrap()) {
-            let (ts, dev, mut id, data) =
-                scanf!(line, "({f64}) {String} {String}#{String}").unwrap();
-            // hex crate does not like odd hex strings, 11-bit can ids need to prepend 0
-            id.insert_str(0, "0".repeat(8 - id.len()).as_str());
-            context.frames.push(CanFrame::new(ts, dev, id, data));
-        }
+    }
+    let capture = or_exit(load(&args.dump_file, columnar, threads, &query));
+    if capture.skipped > 0 {
+        eprintln!("Skipped {} lines that are not CAN frames", capture.skipped);
     }
 
     if args.data {
-        let frames = context.frames.iter().filter(|frame| match args.id {
-            Some(id) => id == frame.id,
-            None => true,
-        });
-
+        let frames = capture.frames.iter().filter(|frame| query.matches(frame));
         for frame in frames {
+            let frame = CanFrame {
+                frame,
+                device: &capture.devices[frame.device as usize],
+            };
             println!(
                 "{}",
                 frame.to_string(
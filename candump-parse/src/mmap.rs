@@ -0,0 +1,88 @@
+use std::fs::File;
+use std::io;
+use std::ops::Deref;
+use std::os::unix::io::AsRawFd;
+use std::path::Path;
+use std::ptr;
+use std::slice;
+
+// read-only memory map of a whole file
+pub struct Mmap {
+    ptr: *mut libc::c_void,
+    len: usize,
+}
+
+// the mapping is read-only and never changes
+unsafe impl Send for Mmap {}
+unsafe impl Sync for Mmap {}
+
+impl Mmap {
+    pub fn open(path: &Path) -> io::Result<Self> {
+        let file = File::open(path)?;
+        let len = usize::try_from(file.metadata()?.len())
+            .map_err(|_| io::Error::new(io::ErrorKind::InvalidInput, "file too large to map"))?;
+
+        // mmap does not take empty mappings
+        if len == 0 {
+            return Ok(Self {
+                ptr: ptr::null_mut(),
+                len: 0,
+            });
+        }
+
+        // SAFETY: private read-only mapping, dumps are not modified while we read them
+        let ptr = unsafe {
+            libc::mmap(
+                ptr::null_mut(),
+                len,
+                libc::PROT_READ,
+                libc::MAP_PRIVATE,
+                file.as_raw_fd(),
+                0,
+            )
+        };
+        if ptr == libc::MAP_FAILED {
+            return Err(io::Error::last_os_error());
+        }
+
+        // dumps are read front to back, let the kernel read ahead (advisory only)
+        unsafe {
+            libc::madvise(ptr, len, libc::MADV_SEQUENTIAL);
+        }
+
+        Ok(Self { ptr, len })
+    }
+}
+
+impl Mmap {
+    // the mapping is read at random (indexed lookups), do not read ahead (advisory only)
+    pub fn advise_random(&self) {
+        if self.len > 0 {
+            unsafe {
+                libc::madvise(self.ptr, self.len, libc::MADV_RANDOM);
+            }
+        }
+    }
+}
+
+impl Deref for Mmap {
+    type Target = [u8];
+
+    fn deref(&self) -> &[u8] {
+        if self.len == 0 {
+            return &[];
+        }
+        // SAFETY: ptr maps len readable bytes until drop
+        unsafe { slice::from_raw_parts(self.ptr as *const u8, self.len) }
+    }
+}
+
+impl Drop for Mmap {
+    fn drop(&mut self) {
+        if self.len > 0 {
+            unsafe {
+                libc::munmap(self.ptr, self.len);
+            }
+        }
+    }
+}
@@ -0,0 +1,371 @@
+use std::io;
+use std::path::PathBuf;
+use std::sync::atomic::{AtomicUsize, Ordering};
+use std::sync::Mutex;
+use std::thread;
+
+use memchr::memchr;
+
+use crate::mmap::Mmap;
+
+// files are split into chunks of about this size, so one large file still keeps every thread busy
+const CHUNK_SIZE: usize = 8 << 20;
+
+// chunks in flight per thread when streaming, bounds memory to a few chunks however large the dumps are
+pub const CHUNKS_PER_THREAD: usize = 4;
+
+// one classic CAN frame, fixed size so a dump parses into a flat Vec without per frame allocations
+#[derive(Debug, Clone, Copy, Default, PartialEq, Eq)]
+pub struct Frame {
+    // microseconds since the epoch, exact (no float rounding)
+    pub timestamp_us: u64,
+    pub id: u32,
+    // index into Capture::devices
+    pub device: u16,
+    pub extended: bool,
+    pub remote: bool,
+    pub len: u8,
+    pub data: [u8; 8],
+}
+
+impl Frame {
+    pub fn payload(&self) -> &[u8] {
+        &self.data[..self.len as usize]
+    }
+}
+
+// which frames to look at: one ID or all, within a time range
+#[derive(Debug, Clone, Copy)]
+pub struct Query {
+    pub id: Option<u32>,
+    // microseconds since the epoch, inclusive
+    pub from_us: u64,
+    pub to_us: u64,
+}
+
+impl Default for Query {
+    fn default() -> Self {
+        Self {
+            id: None,
+            from_us: 0,
+            to_us: u64::MAX,
+        }
+    }
+}
+
+impl Query {
+    pub fn matches(&self, frame: &Frame) -> bool {
+        self.id.is_none_or(|id| id == frame.id)
+            && frame.timestamp_us >= self.from_us
+            && frame.timestamp_us <= self.to_us
+    }
+}
+
+// all frames of the dump files, in file and line order
+#[derive(Debug, Default)]
+pub struct Capture {
+    pub frames: Vec<Frame>,
+    pub devices: Vec<String>,
+    // lines that are not classic CAN frames (malformed, CAN FD, ...)
+    pub skipped: usize,
+}
+
+// a line range of one mapped dump file
+pub struct Chunk<'a> {
+    // index of the file the chunk is from
+    pub file: usize,
+    pub text: &'a [u8],
+}
+
+// device names seen in one chunk, borrowed from the mapped file
+#[derive(Default)]
+pub struct Devices<'a> {
+    pub names: Vec<&'a [u8]>,
+    last: usize,
+}
+
+impl<'a> Devices<'a> {
+    // None once a new name would not fit a u16 device index
+    fn index(&mut self, name: &'a [u8]) -> Option<u16> {
+        // nearly every line repeats the previous device
+        if self.last < self.names.len() && self.names[self.last] == name {
+            return Some(self.last as u16);
+        }
+        self.last = match self.names.iter().position(|n| *n == name) {
+            Some(i) => i,
+            None => {
+                if self.names.len() > usize::from(u16::MAX) {
+                    return None;
+                }
+                self.names.push(name);
+                self.names.len() - 1
+            }
+        };
+        Some(self.last as u16)
+    }
+}
+
+const fn hex_table() -> [u8; 256] {
+    let mut table = [0xFF; 256];
+    let mut i = 0;
+    while i < 10 {
+        table[b'0' as usize + i] = i as u8;
+        i += 1;
+    }
+    i = 0;
+    while i < 6 {
+        table[b'a' as usize + i] = 10 + i as u8;
+        table[b'A' as usize + i] = 10 + i as u8;
+        i += 1;
+    }
+    table
+}
+
+// hex digit value, 0xFF if not a hex digit
+static HEX: [u8; 256] = hex_table();
+
+// parse "(1656278931.123456) can0 0A5#0011223344556677", None if not a classic CAN frame
+pub fn parse_line<'a>(line: &'a [u8], devices: &mut Devices<'a>) -> Option<Frame> {
+    let mut frame = Frame::default();
+    let mut p = 0;
+
+    // timestamp, any number of fraction digits scaled to microseconds
+    if line.first() != Some(&b'(') {
+        return None;
+    }
+    p += 1;
+    let mut secs: u64 = 0;
+    while p < line.len() && line[p].is_ascii_digit() {
+        secs = secs
+            .checked_mul(10)?
+            .checked_add(u64::from(line[p] - b'0'))?;
+        p += 1;
+    }
+    let mut micros: u64 = 0;
+    if line.get(p) == Some(&b'.') {
+        p += 1;
+        let mut scale = 100_000;
+        while p < line.len() && line[p].is_ascii_digit() {
+            micros += u64::from(line[p] - b'0') * scale;
+            scale /= 10;
+            p += 1;
+        }
+    }
+    if line.get(p) != Some(&b')') {
+        return None;
+    }
+    p += 1;
+    frame.timestamp_us = secs.checked_mul(1_000_000)? + micros;
+
+    // interface
+    while line.get(p) == Some(&b' ') {
+        p += 1;
+    }
+    let start = p;
+    while p < line.len() && line[p] != b' ' {
+        p += 1;
+    }
+    if p == start {
+        return None;
+    }
+    frame.device = devices.index(&line[start..p])?;
+    while line.get(p) == Some(&b' ') {
+        p += 1;
+    }
+
+    // ID, candump writes 3 digits for standard and 8 for extended IDs
+    let start = p;
+    while p < line.len() && line[p] != b'#' {
+        let digit = HEX[line[p] as usize];
+        if digit == 0xFF || p - start == 8 {
+            return None;
+        }
+        frame.id = (frame.id << 4) | u32::from(digit);
+        p += 1;
+    }
+    if p == start || p == line.len() {
+        return None;
+    }
+    frame.extended = p - start > 3;
+    p += 1;
+
+    // "##" is a CAN FD frame
+    match line.get(p) {
+        Some(b'#') => return None,
+        Some(b'R') => {
+            frame.remote = true;
+            return Some(frame);
+        }
+        _ => {}
+    }
+
+    // data bytes, up to the end of the line or a trailing field
+    while p < line.len() && line[p] != b' ' && line[p] != b'\r' {
+        let hi = HEX[line[p] as usize];
+        let lo = HEX[*line.get(p + 1)? as usize];
+        if hi == 0xFF || lo == 0xFF || frame.len == 8 {
+            return None;
+        }
+        frame.data[frame.len as usize] = (hi << 4) | lo;
+        frame.len += 1;
+        p += 2;
+    }
+
+    Some(frame)
+}
+
+// call on_frame for every frame in text, returns the number of lines skipped
+pub fn parse_text<'a>(
+    text: &'a [u8],
+    devices: &mut Devices<'a>,
+    mut on_frame: impl FnMut(Frame),
+) -> usize {
+    let mut skipped = 0;
+    let mut rest = text;
+    while !rest.is_empty() {
+        let end = memchr(b'\n', rest).unwrap_or(rest.len());
+        let line = &rest[..end];
+        rest = &rest[(end + 1).min(rest.len())..];
+
+        if line.is_empty() || line == b"\r" {
+            continue;
+        }
+        match parse_line(line, devices) {
+            Some(frame) => on_frame(frame),
+            None => skipped += 1,
+        }
+    }
+    skipped
+}
+
+// split text into chunks of about size bytes at line boundaries
+pub fn split(file: usize, text: &[u8], size: usize) -> Vec<Chunk<'_>> {
+    let mut chunks = Vec::new();
+    let mut start = 0;
+    while start < text.len() {
+        let mut end = (start + size).min(text.len());
+        if end < text.len() {
+            end = match memchr(b'\n', &text[end..]) {
+                Some(i) => end + i + 1,
+                None => text.len(),
+            };
+        }
+        chunks.push(Chunk {
+            file,
+            text: &text[start..end],
+        });
+        start = end;
+    }
+    chunks
+}
+
+// number of threads to use when none is given
+pub fn default_threads() -> usize {
+    thread::available_parallelism().map_or(1, |n| n.get())
+}
+
+// map every dump file
+pub fn map_files(paths: &[PathBuf]) -> io::Result<Vec<Mmap>> {
+    paths
+        .iter()
+        .map(|path| {
+            Mmap::open(path)
+                .map_err(|e| io::Error::new(e.kind(), format!("{}: {}", path.display(), e)))
+        })
+        .collect()
+}
+
+// split every mapped file into chunks, in file and line order
+pub fn chunks(maps: &[Mmap]) -> Vec<Chunk<'_>> {
+    maps.iter()
+        .enumerate()
+        .flat_map(|(file, map)| split(file, map, CHUNK_SIZE))
+        .collect()
+}
+
+// run work over every item (e.g. chunk) on up to threads threads, results in item order
+pub fn parallel<I, T, F>(chunks: &[I], threads: usize, work: F) -> Vec<T>
+where
+    I: Sync,
+    T: Send,
+    F: Fn(&I) -> T + Sync,
+{
+    let threads = threads.clamp(1, chunks.len().max(1));
+    if threads == 1 {
+        return chunks.iter().map(&work).collect();
+    }
+
+    let next = AtomicUsize::new(0);
+    let results: Vec<Mutex<Option<T>>> = chunks.iter().map(|_| Mutex::new(None)).collect();
+
+    thread::scope(|scope| {
+        for _ in 0..threads {
+            scope.spawn(|| loop {
+                let i = next.fetch_add(1, Ordering::Relaxed);
+                if i >= chunks.len() {
+                    break;
+                }
+                let result = work(&chunks[i]);
+                *results[i].lock().unwrap() = Some(result);
+            });
+        }
+    });
+
+    results
+        .into_iter()
+        .map(|r| r.into_inner().unwrap().unwrap())
+        .collect()
+}
+
+// chunk device indexes to indexes into devices, adding names not seen before
+pub fn remap_devices(devices: &mut Vec<String>, names: &[&[u8]]) -> io::Result<Vec<u16>> {
+    names
+        .iter()
+        .map(|name| {
+            let name = String::from_utf8_lossy(name)?;
+            match devices.iter().position(|d| *d == name) {
+                Some(i) => Ok(i as u16),
+                None if devices.len() > usize::from(u16::MAX) => Err(io::Error::new(
+                    io::ErrorKind::InvalidData,
+                    "more than 65536 interface names",
+                )),
+                None => {
+                    devices.push(name.into_owned());
+                    Ok((devices.len() - 1) as u16)
+                }
+            }
+        })
+        .collect()
+}
+
+// frames, device names and number of skipped lines of one chunk
+pub fn parse_chunk<'a>(chunk: &Chunk<'a>) -> (Vec<Frame>, Vec<&'a [u8]>, usize) {
+    // about 40 bytes per line
+    let mut frames = Vec::with_capacity(chunk.text.len() / 40 + 1);
+    let mut devices = Devices::default();
+    let skipped = parse_text(chunk.text, &mut devices, |f| frames.push(f));
+    (frames, devices.names, skipped)
+}
+
+// parse all dump files, in parallel across files and chunks of files
+pub fn load(paths: &[PathBuf], threads: usize) -> io::Result<Capture> {
+    let maps = map_files(paths)?;
+    let chunks = chunks(&maps);
+
+    let parsed = parallel(&chunks, threads, parse_chunk);
+
+    let mut capture = Capture {
+        frames: Vec::with_capacity(parsed.iter().map(|p| p.0.len()).sum()),
+        ..Capture::default()
+    };
+    for (frames, names, skipped) in parsed {
+        let remap = remap_devices(&mut capture.devices, &names)?;
+        capture.frames.extend(frames.into_iter().map(|mut f| {
+            f.device = remap[f.device as usize];
+            f
+        }));
+        capture.skipped += skipped;
+    }
+
+    Ok(capture)
+}
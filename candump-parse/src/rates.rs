@@ -0,0 +1,322 @@
+use std::collections::HashMap;
+use std::path::PathBuf;
+
+use clap_num::maybe_hex;
+
+use crate::parse::{Capture, Frame};
+use crate::stats;
+
+// firmware defaults, see src/racechrono-canbus.hpp
+const SUPPRESS_MAX_AGE_US: u64 = 3_000_000; // CONFIG_RC_SUPPRESS_MAX_AGE
+const BATCH_DEADLINE_US: u64 = 10_000; // CONFIG_RC_BATCH_DEADLINE
+const NOTIFY_HEADER_SIZE: usize = 3; // racechrono::device::notify_header_size
+const MAX_VALUE_SIZE: usize = 512; // racechrono::device::max_value_size
+
+// measured rates are a little off nominal, output may exceed the target by this fraction
+const RATE_TOLERANCE: f64 = 0.02;
+
+#[derive(Debug, Clone, Copy, PartialEq, Eq)]
+pub enum Priority {
+    High,
+    Normal,
+    Low,
+}
+
+impl Priority {
+    fn name(self) -> &'static str {
+        match self {
+            Priority::High => "high",
+            Priority::Normal => "normal",
+            Priority::Low => "low",
+        }
+    }
+}
+
+// wanted output rate of one ID
+#[derive(Debug, Clone, Copy)]
+pub struct Target {
+    pub id: u32,
+    pub hz: f64,
+    pub priority: Priority,
+}
+
+// "0x0A5=30" or "0x0A5=30:high", priority defaults to normal
+pub fn parse_target(s: &str) -> Result<Target, String> {
+    let (id, rest) = s.split_once('=').ok_or("expected ID=HZ[:PRIORITY]")?;
+    let (hz, priority) = rest.split_once(':').unwrap_or((rest, "normal"));
+    let hz: f64 = hz.parse().map_err(|e| format!("rate {}: {}", hz, e))?;
+    if hz <= 0.0 {
+        return Err(format!("rate {} must be above 0", hz));
+    }
+    Ok(Target {
+        id: maybe_hex::<u32>(id)?,
+        hz,
+        priority: match priority {
+            "high" => Priority::High,
+            "normal" => Priority::Normal,
+            "low" => Priority::Low,
+            _ => return Err(format!("priority {} is not high, normal or low", priority)),
+        },
+    })
+}
+
+pub struct Row {
+    pub target: Target,
+    pub frames: u64,
+    pub hz: f64,
+    pub jitter_ms: f64,
+    pub divisor: u16,
+    // frames the decoder forwards, and of those sent with CONFIG_RC_SUPPRESS_UNCHANGED
+    pub forwarded: u64,
+    pub sent: u64,
+}
+
+pub struct Plan {
+    pub rows: Vec<Row>,
+    pub seconds: f64,
+    // notifications with CONFIG_RC_BATCH_NOTIFY, without and with CONFIG_RC_SUPPRESS_UNCHANGED
+    pub notifies: Option<(u64, u64)>,
+}
+
+// per ID state of the decoder, as in canbus::decoder::should_decode() and should_send()
+#[derive(Default)]
+struct Decoder {
+    n: u16,
+    sent: Option<(u64, u8, [u8; 8])>,
+}
+
+// notification batching, as in racechrono::device::send() and poll()
+struct Batch {
+    capacity: usize,
+    len: usize,
+    frames: usize,
+    started_us: u64,
+    notifies: u64,
+}
+
+impl Batch {
+    fn new(mtu: u16) -> Self {
+        Self {
+            capacity: (usize::from(mtu) - NOTIFY_HEADER_SIZE).min(MAX_VALUE_SIZE),
+            len: 0,
+            frames: 0,
+            started_us: 0,
+            notifies: 0,
+        }
+    }
+
+    fn flush(&mut self) {
+        if self.frames > 0 {
+            self.notifies += 1;
+        }
+        self.len = 0;
+        self.frames = 0;
+    }
+
+    fn send(&mut self, frame: &Frame) {
+        if self.frames > 0
+            && frame.timestamp_us.saturating_sub(self.started_us) >= BATCH_DEADLINE_US
+        {
+            self.flush();
+        }
+        // RaceChrono frame: 4 byte ID and the data, behind a length byte
+        let len = 4 + frame.len as usize;
+        if self.len + 1 + len > self.capacity {
+            self.flush();
+        }
+        if self.frames == 0 {
+            self.started_us = frame.timestamp_us;
+        }
+        self.len += 1 + len;
+        self.frames += 1;
+        if self.len + 1 + 4 > self.capacity {
+            self.flush();
+        }
+    }
+}
+
+// measure the targets in capture, pick divisors and replay the capture through the decoder logic
+pub fn plan(capture: &Capture, targets: &[Target], mtu: Option<u16>) -> Plan {
+    let stats = stats::from_capture(capture);
+    let mut rows: Vec<Row> = targets
+        .iter()
+        .map(|target| {
+            let measured = stats
+                .ids
+                .iter()
+                .find(|((_, id), _)| *id == target.id)
+                .map(|(_, s)| s);
+            let (frames, hz, jitter_ms) = measured.map_or((0, 0.0, 0.0), |s| {
+                (s.frames, s.frequency(), s.intervals.std_dev() / 1000.0)
+            });
+            Row {
+                target: *target,
+                frames,
+                hz,
+                jitter_ms,
+                // never (noticeably) above the target
+                divisor: (hz / target.hz * (1.0 - RATE_TOLERANCE))
+                    .ceil()
+                    .clamp(1.0, f64::from(u16::MAX)) as u16,
+                forwarded: 0,
+                sent: 0,
+            }
+        })
+        .collect();
+
+    let index: HashMap<u32, usize> = rows
+        .iter()
+        .enumerate()
+        .map(|(i, r)| (r.target.id, i))
+        .collect();
+    let mut decoders: Vec<Decoder> = rows.iter().map(|_| Decoder::default()).collect();
+    let mut batches = mtu.map(|mtu| (Batch::new(mtu), Batch::new(mtu)));
+
+    for frame in &capture.frames {
+        let Some(&i) = index.get(&frame.id) else {
+            continue;
+        };
+        let decoder = &mut decoders[i];
+        decoder.n += 1;
+        if decoder.n < rows[i].divisor {
+            continue;
+        }
+        decoder.n = 0;
+        rows[i].forwarded += 1;
+
+        let unchanged = decoder.sent.is_some_and(|(at, len, data)| {
+            len == frame.len
+                && data[..len as usize] == *frame.payload()
+                && frame.timestamp_us.saturating_sub(at) < SUPPRESS_MAX_AGE_US
+        });
+        if !unchanged {
+            decoder.sent = Some((frame.timestamp_us, frame.len, frame.data));
+            rows[i].sent += 1;
+        }
+
+        if let Some((all, changed)) = &mut batches {
+            all.send(frame);
+            if !unchanged {
+                changed.send(frame);
+            }
+        }
+    }
+
+    let first = capture
+        .frames
+        .iter()
+        .map(|f| f.timestamp_us)
+        .min()
+        .unwrap_or(0);
+    let last = capture
+        .frames
+        .iter()
+        .map(|f| f.timestamp_us)
+        .max()
+        .unwrap_or(0);
+    Plan {
+        rows,
+        seconds: (last - first) as f64 / 1e6,
+        notifies: batches.map(|(mut all, mut changed)| {
+            all.flush();
+            changed.flush();
+            (all.notifies, changed.notifies)
+        }),
+    }
+}
+
+fn format_id(id: u32) -> String {
+    if id <= 0x7FF {
+        format!("0x{:03X}", id)
+    } else {
+        format!("0x{:08X}", id)
+    }
+}
+
+pub fn print(plan: &Plan, dump_files: &[PathBuf], mtu: Option<u16>, budget: f64) {
+    let per_second = |n: u64| {
+        if plan.seconds > 0.0 {
+            n as f64 / plan.seconds
+        } else {
+            0.0
+        }
+    };
+
+    println!(
+        "{:>10} {:>9} {:>10} {:>10} {:>8} {:>10} {:>10} {:>9}",
+        "ID", "bus Hz", "jitter ms", "target Hz", "divisor", "output Hz", "interval", "changed/s"
+    );
+    for row in &plan.rows {
+        if row.frames == 0 {
+            eprintln!("{} is not in the capture", format_id(row.target.id));
+            continue;
+        }
+        let out = row.hz / f64::from(row.divisor);
+        println!(
+            "{:>10} {:>9.2} {:>10.3} {:>10.2} {:>8} {:>10.2} {:>7.1} ms {:>9.2}",
+            format_id(row.target.id),
+            row.hz,
+            row.jitter_ms,
+            row.target.hz,
+            row.divisor,
+            out,
+            if out > 0.0 { 1000.0 / out } else { 0.0 },
+            per_second(row.sent)
+        );
+    }
+
+    let forwarded = per_second(plan.rows.iter().map(|r| r.forwarded).sum());
+    let sent = per_second(plan.rows.iter().map(|r| r.sent).sum());
+    println!();
+    println!("predicted over {:.1} s of capture:", plan.seconds);
+    println!("{:>40}: {:>8.1} frames/s", "Bluetooth LE", forwarded);
+    println!(
+        "{:>40}: {:>8.1} frames/s",
+        "with CONFIG_RC_SUPPRESS_UNCHANGED", sent
+    );
+    if let (Some(mtu), Some((all, changed))) = (mtu, plan.notifies) {
+        println!(
+            "{:>40}: {:>8.1} notifications/s",
+            format!("with CONFIG_RC_BATCH_NOTIFY, MTU {}", mtu),
+            per_second(all)
+        );
+        println!(
+            "{:>40}: {:>8.1} notifications/s",
+            "and CONFIG_RC_SUPPRESS_UNCHANGED",
+            per_second(changed)
+        );
+    }
+    if forwarded > budget {
+        println!("exceeds the link budget of {:.0} frames/s, raise divisors or enable CONFIG_RC_SCHEDULER", budget);
+    } else {
+        println!("fits the link budget of {:.0} frames/s", budget);
+    }
+
+    println!();
+    let files: Vec<String> = dump_files.iter().map(|f| f.display().to_string()).collect();
+    println!(
+        "    // rate divisors from candump-parse --rates, {}",
+        files.join(" ")
+    );
+    println!("    static constexpr vehicle::message messages[] = {{");
+    for row in &plan.rows {
+        let entry = format!(
+            "{{ {}, {}, priority::{} }},",
+            format_id(row.target.id),
+            row.divisor,
+            row.target.priority.name()
+        );
+        let comment = if row.frames == 0 {
+            "not in the capture".to_string()
+        } else {
+            format!(
+                "{:.0}hz on the bus, {:.1}hz out (target {})",
+                row.hz,
+                row.hz / f64::from(row.divisor),
+                row.target.hz
+            )
+        };
+        println!("        {:<33}// {}", entry, comment);
+    }
+    println!("    }};");
+}
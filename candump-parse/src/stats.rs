@@ -0,0 +1,552 @@
+use std::collections::{BTreeMap, HashMap};
+use std::io;
+use std::path::PathBuf;
+
+use clap::ValueEnum;
+use serde_json::{json, Value};
+
+use crate::parse::{self, Capture, Chunk, Devices, Frame, Query};
+
+// interval histogram: exact below 32 µs, then 32 buckets per power of two (about 3 % wide)
+const SUB_BITS: u32 = 5;
+const SUB: usize = 1 << SUB_BITS;
+// intervals of 2^40 µs (12 days) and up land in the last bucket
+const MAX_EXP: u32 = 40;
+const BUCKETS: usize = (MAX_EXP - SUB_BITS + 1) as usize * SUB;
+
+#[derive(Debug, Copy, Clone, PartialEq, Eq, ValueEnum)]
+pub enum Format {
+    Table,
+    Csv,
+    Json,
+}
+
+#[derive(Clone)]
+pub struct Histogram {
+    counts: Box<[u64; BUCKETS]>,
+}
+
+impl Default for Histogram {
+    fn default() -> Self {
+        Self {
+            counts: Box::new([0; BUCKETS]),
+        }
+    }
+}
+
+impl Histogram {
+    fn bucket(us: u64) -> usize {
+        let us = us.min((1 << MAX_EXP) - 1);
+        if us < SUB as u64 {
+            return us as usize;
+        }
+        let exp = 63 - us.leading_zeros();
+        let sub = (us >> (exp - SUB_BITS)) as usize - SUB;
+        (exp - SUB_BITS + 1) as usize * SUB + sub
+    }
+
+    // [from, to) in µs of bucket i
+    fn range(i: usize) -> (u64, u64) {
+        if i < SUB {
+            return (i as u64, i as u64 + 1);
+        }
+        let shift = (i / SUB - 1) as u32;
+        let from = ((SUB + i % SUB) as u64) << shift;
+        (from, from + (1 << shift))
+    }
+
+    fn add(&mut self, us: u64) {
+        self.counts[Self::bucket(us)] += 1;
+    }
+
+    fn merge(&mut self, other: &Histogram) {
+        for (a, b) in self.counts.iter_mut().zip(other.counts.iter()) {
+            *a += b;
+        }
+    }
+
+    // interval below which fraction q of intervals are, middle of the bucket
+    pub fn quantile(&self, q: f64) -> f64 {
+        let total: u64 = self.counts.iter().sum();
+        let rank = (q * total as f64).ceil().max(1.0) as u64;
+        let mut seen = 0;
+        for (i, count) in self.counts.iter().enumerate() {
+            seen += count;
+            if seen >= rank {
+                let (from, to) = Self::range(i);
+                return (from + to - 1) as f64 / 2.0;
+            }
+        }
+        0.0
+    }
+
+    // (from µs, to µs, count) of every bucket in use
+    pub fn buckets(&self) -> impl Iterator<Item = (u64, u64, u64)> + '_ {
+        self.counts
+            .iter()
+            .enumerate()
+            .filter(|(_, count)| **count > 0)
+            .map(|(i, count)| {
+                let (from, to) = Self::range(i);
+                (from, to, *count)
+            })
+    }
+}
+
+// count, mean, variance, min and max in one pass, mergeable (Chan et al.)
+#[derive(Debug, Clone, Copy, Default)]
+pub struct Moments {
+    pub count: u64,
+    pub mean: f64,
+    m2: f64,
+    pub min: u64,
+    pub max: u64,
+}
+
+impl Moments {
+    fn add(&mut self, value: u64) {
+        self.merge(&Moments {
+            count: 1,
+            mean: value as f64,
+            m2: 0.0,
+            min: value,
+            max: value,
+        });
+    }
+
+    fn merge(&mut self, other: &Moments) {
+        if other.count == 0 {
+            return;
+        }
+        if self.count == 0 {
+            *self = *other;
+            return;
+        }
+        let count = self.count + other.count;
+        let delta = other.mean - self.mean;
+        self.mean += delta * other.count as f64 / count as f64;
+        self.m2 +=
+            other.m2 + delta * delta * (self.count as f64 * other.count as f64 / count as f64);
+        self.count = count;
+        self.min = self.min.min(other.min);
+        self.max = self.max.max(other.max);
+    }
+
+    pub fn std_dev(&self) -> f64 {
+        if self.count < 2 {
+            0.0
+        } else {
+            (self.m2 / (self.count - 1) as f64).sqrt()
+        }
+    }
+}
+
+// everything known about one ID on one device, fixed size whatever the number of frames
+#[derive(Clone)]
+pub struct IdStats {
+    pub frames: u64,
+    // frames per data length
+    pub dlc: [u64; 9],
+    // µs between consecutive frames
+    pub intervals: Moments,
+    pub histogram: Histogram,
+    // consecutive frame pairs that both have the byte, and how many of those changed it / each of its bits
+    pub compared: [u64; 8],
+    pub byte_changes: [u64; 8],
+    // DBC numbering, bit 0 is the least significant bit of byte 0
+    pub bit_changes: [u64; 64],
+    first: Frame,
+    last: Frame,
+}
+
+impl Default for IdStats {
+    fn default() -> Self {
+        Self {
+            frames: 0,
+            dlc: [0; 9],
+            intervals: Moments::default(),
+            histogram: Histogram::default(),
+            compared: [0; 8],
+            byte_changes: [0; 8],
+            bit_changes: [0; 64],
+            first: Frame::default(),
+            last: Frame::default(),
+        }
+    }
+}
+
+impl IdStats {
+    fn add(&mut self, frame: &Frame) {
+        if self.frames == 0 {
+            self.first = *frame;
+        } else {
+            let last = self.last;
+            self.follow(&last, frame);
+        }
+        self.last = *frame;
+        self.frames += 1;
+        self.dlc[frame.len as usize] += 1;
+    }
+
+    // account frame directly following prev
+    fn follow(&mut self, prev: &Frame, frame: &Frame) {
+        // candump stamps frames in order, anything else is not an interval
+        if frame.timestamp_us >= prev.timestamp_us {
+            let interval = frame.timestamp_us - prev.timestamp_us;
+            self.intervals.add(interval);
+            self.histogram.add(interval);
+        }
+
+        let len = prev.len.min(frame.len) as usize;
+        for i in 0..len {
+            self.compared[i] += 1;
+            let changed = prev.data[i] ^ frame.data[i];
+            if changed != 0 {
+                self.byte_changes[i] += 1;
+                for bit in 0..8 {
+                    if changed & (1 << bit) != 0 {
+                        self.bit_changes[i * 8 + bit] += 1;
+                    }
+                }
+            }
+        }
+    }
+
+    // add the stats of the frames after these, continues if they directly follow in the same file
+    fn merge(&mut self, other: &IdStats, continues: bool) {
+        if self.frames == 0 {
+            *self = other.clone();
+            return;
+        }
+        if continues {
+            let last = self.last;
+            self.follow(&last, &other.first);
+        }
+        self.frames += other.frames;
+        for i in 0..self.dlc.len() {
+            self.dlc[i] += other.dlc[i];
+        }
+        self.intervals.merge(&other.intervals);
+        self.histogram.merge(&other.histogram);
+        for i in 0..8 {
+            self.compared[i] += other.compared[i];
+            self.byte_changes[i] += other.byte_changes[i];
+        }
+        for i in 0..64 {
+            self.bit_changes[i] += other.bit_changes[i];
+        }
+        self.last = other.last;
+    }
+
+    pub fn frequency(&self) -> f64 {
+        if self.intervals.mean > 0.0 {
+            1e6 / self.intervals.mean
+        } else {
+            0.0
+        }
+    }
+
+    // fraction of frames that changed byte i, None if no two frames had it
+    pub fn byte_change_rate(&self, i: usize) -> Option<f64> {
+        match self.compared[i] {
+            0 => None,
+            n => Some(self.byte_changes[i] as f64 / n as f64),
+        }
+    }
+
+    pub fn bit_change_rate(&self, bit: usize) -> Option<f64> {
+        match self.compared[bit / 8] {
+            0 => None,
+            n => Some(self.bit_changes[bit] as f64 / n as f64),
+        }
+    }
+
+    // "8" or "2-8" if the ID uses several data lengths
+    pub fn dlc_range(&self) -> String {
+        let min = self.dlc.iter().position(|n| *n > 0).unwrap_or(0);
+        let max = self.dlc.iter().rposition(|n| *n > 0).unwrap_or(0);
+        if min == max {
+            format!("{}", min)
+        } else {
+            format!("{}-{}", min, max)
+        }
+    }
+}
+
+// per ID stats of all dump files, sorted by device then ID
+#[derive(Default)]
+pub struct Stats {
+    pub ids: BTreeMap<(u16, u32), IdStats>,
+    pub devices: Vec<String>,
+    pub skipped: usize,
+}
+
+struct ChunkStats<'a> {
+    file: usize,
+    ids: HashMap<(u16, u32), IdStats>,
+    devices: Vec<&'a [u8]>,
+    skipped: usize,
+}
+
+fn chunk_stats<'a>(chunk: &Chunk<'a>, query: &Query) -> ChunkStats<'a> {
+    let mut ids: HashMap<(u16, u32), IdStats> = HashMap::new();
+    let mut devices = Devices::default();
+    let skipped = parse::parse_text(chunk.text, &mut devices, |frame| {
+        if query.matches(&frame) {
+            ids.entry((frame.device, frame.id)).or_default().add(&frame);
+        }
+    });
+    ChunkStats {
+        file: chunk.file,
+        ids,
+        devices: devices.names,
+        skipped,
+    }
+}
+
+// gather stats of the frames matching query in one pass over the dump files
+pub fn collect(paths: &[PathBuf], threads: usize, query: &Query) -> io::Result<Stats> {
+    let maps = parse::map_files(paths)?;
+    let chunks = parse::chunks(&maps);
+
+    let mut stats = Stats::default();
+    // file each ID was last seen in, frames only follow on within a file
+    let mut last_file: HashMap<(u16, u32), usize> = HashMap::new();
+
+    for window in chunks.chunks(threads.max(1) * parse::CHUNKS_PER_THREAD) {
+        for chunk in parse::parallel(window, threads, |chunk| chunk_stats(chunk, query)) {
+            let remap = parse::remap_devices(&mut stats.devices, &chunk.devices)?;
+            for ((device, id), other) in chunk.ids {
+                let key = (remap[device as usize], id);
+                let continues = last_file.insert(key, chunk.file) == Some(chunk.file);
+                stats.ids.entry(key).or_default().merge(&other, continues);
+            }
+            stats.skipped += chunk.skipped;
+        }
+    }
+
+    Ok(stats)
+}
+
+// gather stats of already loaded frames, in timestamp order per ID
+pub fn from_capture(capture: &Capture) -> Stats {
+    let mut stats = Stats {
+        devices: capture.devices.clone(),
+        skipped: capture.skipped,
+        ..Stats::default()
+    };
+    for frame in &capture.frames {
+        stats
+            .ids
+            .entry((frame.device, frame.id))
+            .or_default()
+            .add(frame);
+    }
+    stats
+}
+
+fn format_id(id: u32) -> String {
+    if id <= 0x7FF {
+        format!("{:03X}", id)
+    } else {
+        format!("{:08X}", id)
+    }
+}
+
+fn ms(us: f64) -> f64 {
+    us / 1000.0
+}
+
+// one character per byte: ' ' never compared, '.' never changes, 0-9 changes in (n * 10)..(n * 10 + 10) % of frames
+fn change_map(stats: &IdStats) -> String {
+    (0..8)
+        .map(|i| match stats.byte_change_rate(i) {
+            None => ' ',
+            Some(_) if stats.byte_changes[i] == 0 => '.',
+            Some(rate) => char::from(b'0' + ((rate * 10.0) as u8).min(9)),
+        })
+        .collect()
+}
+
+fn print_table(stats: &Stats) {
+    println!(
+        "{:<8} {:>8} {:>10} {:>9} {:>10} {:>10} {:>9} {:>9} {:>9} {:>5}  changes",
+        "device",
+        "ID",
+        "frames",
+        "Hz",
+        "period ms",
+        "jitter ms",
+        "p1 ms",
+        "p50 ms",
+        "p99 ms",
+        "DLC"
+    );
+    for ((device, id), s) in &stats.ids {
+        println!(
+            "{:<8} {:>8} {:>10} {:>9.2} {:>10.3} {:>10.3} {:>9.3} {:>9.3} {:>9.3} {:>5}  {}",
+            stats.devices[*device as usize],
+            format_id(*id),
+            s.frames,
+            s.frequency(),
+            ms(s.intervals.mean),
+            ms(s.intervals.std_dev()),
+            ms(s.histogram.quantile(0.01)),
+            ms(s.histogram.quantile(0.5)),
+            ms(s.histogram.quantile(0.99)),
+            s.dlc_range(),
+            change_map(s)
+        );
+    }
+    println!();
+    println!(
+        "jitter: standard deviation of the period, p1/p50/p99: period percentiles (3 % resolution)"
+    );
+    println!(
+        "changes: per data byte, '.' never changes, 0-9 changes in n*10 to n*10+10 % of frames"
+    );
+}
+
+// interval histogram and bit change map of one ID
+fn print_detail(stats: &Stats, device: u16, id: u32, s: &IdStats) {
+    const BAR: f64 = 50.0;
+
+    println!();
+    println!(
+        "{} {} intervals, mean {:.3} ms, min {:.3} ms, max {:.3} ms",
+        stats.devices[device as usize],
+        format_id(id),
+        ms(s.intervals.mean),
+        ms(s.intervals.min as f64),
+        ms(s.intervals.max as f64)
+    );
+    println!("{:>21} {:>9} {:>10}", "interval ms", "jitter %", "frames");
+    let most = s.histogram.buckets().map(|b| b.2).max().unwrap_or(1);
+    for (from, to, count) in s.histogram.buckets() {
+        let middle = (from + to - 1) as f64 / 2.0;
+        println!(
+            "{:>10.3} - {:>8.3} {:>+9.1} {:>10} {}",
+            ms(from as f64),
+            ms(to as f64),
+            (middle / s.intervals.mean - 1.0) * 100.0,
+            count,
+            "#".repeat(((count as f64 / most as f64) * BAR).ceil() as usize)
+        );
+    }
+
+    println!();
+    println!(
+        "{} {} bit change rate %, bit 7 first",
+        stats.devices[device as usize],
+        format_id(id)
+    );
+    for byte in 0..8 {
+        if s.compared[byte] == 0 {
+            continue;
+        }
+        let bits: Vec<String> = (0..8)
+            .rev()
+            .map(|bit| {
+                format!(
+                    "{:>5.1}",
+                    s.bit_change_rate(byte * 8 + bit).unwrap_or(0.0) * 100.0
+                )
+            })
+            .collect();
+        println!("byte {} {}", byte, bits.join(" "));
+    }
+}
+
+fn print_csv(stats: &Stats) {
+    let mut header: Vec<String> = [
+        "device",
+        "id",
+        "frames",
+        "hz",
+        "period_ms",
+        "jitter_ms",
+        "min_ms",
+        "p1_ms",
+        "p50_ms",
+        "p99_ms",
+        "max_ms",
+    ]
+    .iter()
+    .map(|s| s.to_string())
+    .collect();
+    header.extend((0..=8).map(|i| format!("dlc{}", i)));
+    header.extend((0..8).map(|i| format!("byte{}_change", i)));
+    header.extend((0..64).map(|i| format!("bit{}_change", i)));
+    println!("{}", header.join(","));
+
+    let rate = |r: Option<f64>| r.map_or(String::new(), |r| format!("{:.6}", r));
+    for ((device, id), s) in &stats.ids {
+        let mut row = vec![
+            stats.devices[*device as usize].clone(),
+            format!("0x{}", format_id(*id)),
+            s.frames.to_string(),
+            format!("{:.3}", s.frequency()),
+            format!("{:.3}", ms(s.intervals.mean)),
+            format!("{:.3}", ms(s.intervals.std_dev())),
+            format!("{:.3}", ms(s.intervals.min as f64)),
+            format!("{:.3}", ms(s.histogram.quantile(0.01))),
+            format!("{:.3}", ms(s.histogram.quantile(0.5))),
+            format!("{:.3}", ms(s.histogram.quantile(0.99))),
+            format!("{:.3}", ms(s.intervals.max as f64)),
+        ];
+        row.extend(s.dlc.iter().map(|n| n.to_string()));
+        row.extend((0..8).map(|i| rate(s.byte_change_rate(i))));
+        row.extend((0..64).map(|i| rate(s.bit_change_rate(i))));
+        println!("{}", row.join(","));
+    }
+}
+
+fn print_json(stats: &Stats) {
+    let ids: Vec<Value> = stats
+        .ids
+        .iter()
+        .map(|((device, id), s)| {
+            json!({
+                "device": stats.devices[*device as usize],
+                "id": id,
+                "extended": *id > 0x7FF,
+                "frames": s.frames,
+                "hz": s.frequency(),
+                "period_ms": {
+                    "mean": ms(s.intervals.mean),
+                    "std_dev": ms(s.intervals.std_dev()),
+                    "min": ms(s.intervals.min as f64),
+                    "p1": ms(s.histogram.quantile(0.01)),
+                    "p50": ms(s.histogram.quantile(0.5)),
+                    "p99": ms(s.histogram.quantile(0.99)),
+                    "max": ms(s.intervals.max as f64),
+                },
+                "histogram_us": s.histogram.buckets()
+                    .map(|(from, to, count)| json!({ "from": from, "to": to, "frames": count }))
+                    .collect::<Vec<_>>(),
+                "dlc": s.dlc,
+                "byte_change_rate": (0..8).map(|i| s.byte_change_rate(i)).collect::<Vec<_>>(),
+                "bit_change_rate": (0..64).map(|i| s.bit_change_rate(i)).collect::<Vec<_>>(),
+            })
+        })
+        .collect();
+    println!(
+        "{}",
+        serde_json::to_string(&json!({ "skipped": stats.skipped, "ids": ids })).unwrap()
+    );
+}
+
+pub fn print(stats: &Stats, format: Format, detail: bool) {
+    match format {
+        Format::Table => {
+            print_table(stats);
+            if detail {
+                for ((device, id), s) in &stats.ids {
+                    print_detail(stats, *device, *id, s);
+                }
+            }
+        }
+        Format::Csv => print_csv(stats),
+        Format::Json => print_json(stats),
+    }
+}
@@ -0,0 +1,77 @@
+// MIT License
+//
+// Copyright (c) 2022 Joe Roback <joe.roback@gmail.com>
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+#pragma once
+
+/*
+ * Linux host stand-in for the parts of the Arduino ESP32 core used by the firmware.
+ */
+
+#include <sys/cdefs.h>
+
+#include <algorithm>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <utility>
+
+#include <esp_err.h>
+#include <esp_intr_alloc.h>
+#include <driver/gpio.h>
+
+#define IRAM_ATTR
+
+typedef enum
+{
+    ESP_MAC_WIFI_STA,
+    ESP_MAC_WIFI_SOFTAP,
+    ESP_MAC_BT,
+    ESP_MAC_ETH,
+} esp_mac_type_t;
+
+esp_err_t esp_read_mac(uint8_t* mac, esp_mac_type_t type);
+
+[[noreturn]] void esp_restart();
+
+unsigned long micros();
+unsigned long millis();
+void delay(uint32_t ms);
+
+/**
+ * serial console, written to stdout
+ */
+class HardwareSerial
+{
+public:
+    void begin(unsigned long baud);
+    size_t write(uint8_t c);
+    size_t write(const char* buf, size_t len);
+    size_t write(const uint8_t* buf, size_t len);
+    size_t print(const char* str);
+    size_t print(int value);
+    size_t println();
+    size_t println(const char* str);
+    size_t println(int value);
+    void flush();
+};
+
+extern HardwareSerial Serial;
@@ -0,0 +1,44 @@
+// MIT License
+//
+// Copyright (c) 2022 Joe Roback <joe.roback@gmail.com>
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+#pragma once
+
+/*
+ * Linux host stand-in for the Arduino ESP32 BLE client characteristic
+ * configuration descriptor.
+ */
+
+#include "BLECharacteristic.h"
+
+class BLE2902 : public BLEDescriptor
+{
+public:
+    BLE2902() : BLEDescriptor(BLEUUID(0x2902)), _notifications(false), _indications(false) {}
+
+    bool getNotifications() const { return _notifications; }
+    void setNotifications(bool flag) { _notifications = flag; }
+    bool getIndications() const { return _indications; }
+    void setIndications(bool flag) { _indications = flag; }
+
+private:
+    bool _notifications;
+    bool _indications;
+};
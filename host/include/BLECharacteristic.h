@@ -0,0 +1,120 @@
+// MIT License
+//
+// Copyright (c) 2022 Joe Roback <joe.roback@gmail.com>
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+#pragma once
+
+/*
+ * Linux host stand-in for the Arduino ESP32 BLE characteristic. notify()
+ * hands the current value to the sink installed with sim::ble_set_sink(),
+ * unless the client disabled notifications in the characteristic's BLE2902
+ * descriptor, or the link set with sim::ble_link_rate() has no buffer free.
+ */
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+class BLECharacteristic;
+
+/**
+ * 16-bit UUID only, that is all RaceChrono uses
+ */
+class BLEUUID
+{
+public:
+    BLEUUID(uint16_t uuid = 0) : _uuid(uuid) {}
+
+    uint16_t value() const { return _uuid; }
+
+private:
+    uint16_t _uuid;
+};
+
+class BLEDescriptor
+{
+public:
+    explicit BLEDescriptor(BLEUUID uuid) : _uuid(uuid) {}
+    virtual ~BLEDescriptor() = default;
+
+    BLEUUID getUUID() const { return _uuid; }
+
+private:
+    BLEUUID _uuid;
+};
+
+class BLECharacteristicCallbacks
+{
+public:
+    typedef enum
+    {
+        SUCCESS_INDICATE,
+        SUCCESS_NOTIFY,
+        ERROR_INDICATE_DISABLED,
+        ERROR_NOTIFY_DISABLED,
+        ERROR_GATT,
+        ERROR_NO_CLIENT,
+        ERROR_INDICATE_TIMEOUT,
+        ERROR_INDICATE_FAILURE
+    } Status;
+
+    virtual ~BLECharacteristicCallbacks() = default;
+    virtual void onRead(BLECharacteristic*) {}
+    virtual void onWrite(BLECharacteristic*) {}
+    virtual void onStatus(BLECharacteristic*, Status, uint32_t) {}
+};
+
+class BLECharacteristic
+{
+public:
+    static const uint32_t PROPERTY_READ      = 1 << 0;
+    static const uint32_t PROPERTY_WRITE     = 1 << 1;
+    static const uint32_t PROPERTY_NOTIFY    = 1 << 2;
+    static const uint32_t PROPERTY_BROADCAST = 1 << 3;
+    static const uint32_t PROPERTY_INDICATE  = 1 << 4;
+    static const uint32_t PROPERTY_WRITE_NR  = 1 << 5;
+
+    BLECharacteristic(BLEUUID uuid, uint32_t properties);
+    virtual ~BLECharacteristic() = default;
+
+    BLEUUID getUUID() const { return _uuid; }
+    uint32_t getProperties() const { return _properties; }
+
+    void setCallbacks(BLECharacteristicCallbacks* callbacks) { _callbacks = callbacks; }
+    BLECharacteristicCallbacks* getCallbacks() const { return _callbacks; }
+
+    void addDescriptor(BLEDescriptor* descriptor) { _descriptors.push_back(descriptor); }
+    BLEDescriptor* getDescriptorByUUID(BLEUUID uuid);
+
+    void setValue(uint8_t* data, size_t len);
+    void setValue(const uint8_t* data, size_t len);
+
+    uint8_t* getData() { return _value.data(); }
+    size_t getLength() const { return _value.size(); }
+
+    void notify(bool is_notification = true);
+
+private:
+    BLEUUID _uuid;
+    uint32_t _properties;
+    BLECharacteristicCallbacks* _callbacks;
+    std::vector<BLEDescriptor*> _descriptors;
+    std::vector<uint8_t> _value;
+};
@@ -0,0 +1,90 @@
+// MIT License
+//
+// Copyright (c) 2022 Joe Roback <joe.roback@gmail.com>
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+#pragma once
+
+/*
+ * Linux host stand-in for the Arduino ESP32 BLE server and service.
+ * Connections and writes are driven by the sim:: API in sim/sim.hpp.
+ */
+
+#include "BLECharacteristic.h"
+
+#include <cstdint>
+#include <vector>
+
+typedef union
+{
+    struct gatts_mtu_evt_param
+    {
+        uint16_t conn_id;
+        uint16_t mtu;
+    } mtu;
+} esp_ble_gatts_cb_param_t;
+
+class BLEServer;
+
+class BLEServerCallbacks
+{
+public:
+    virtual ~BLEServerCallbacks() = default;
+    virtual void onConnect(BLEServer*) {}
+    virtual void onDisconnect(BLEServer*) {}
+    virtual void onMtuChanged(BLEServer*, esp_ble_gatts_cb_param_t*) {}
+};
+
+class BLEService
+{
+public:
+    explicit BLEService(BLEUUID uuid) : _uuid(uuid) {}
+    ~BLEService();
+
+    BLECharacteristic* createCharacteristic(BLEUUID uuid, uint32_t properties);
+    BLECharacteristic* getCharacteristic(BLEUUID uuid);
+    BLEUUID getUUID() const { return _uuid; }
+    void start() {}
+
+private:
+    BLEUUID _uuid;
+    std::vector<BLECharacteristic*> _characteristics;
+};
+
+class BLEServer
+{
+public:
+    BLEServer() : _callbacks(nullptr), _connected(0) {}
+    ~BLEServer();
+
+    void setCallbacks(BLEServerCallbacks* callbacks) { _callbacks = callbacks; }
+    BLEServerCallbacks* getCallbacks() const { return _callbacks; }
+
+    BLEService* createService(BLEUUID uuid);
+    BLEService* getServiceByUUID(BLEUUID uuid);
+    BLECharacteristic* findCharacteristic(BLEUUID uuid);
+
+    uint32_t getConnectedCount() const { return _connected; }
+    void setConnectedCount(uint32_t count) { _connected = count; }
+
+private:
+    BLEServerCallbacks* _callbacks;
+    uint32_t _connected;
+    std::vector<BLEService*> _services;
+};
@@ -0,0 +1,68 @@
+// MIT License
+//
+// Copyright (c) 2022 Joe Roback <joe.roback@gmail.com>
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+#pragma once
+
+/*
+ * Linux host stand-in for the ESP-IDF FreeRTOS port. Critical sections are
+ * plain spinlocks; there is no interrupt masking on the host.
+ */
+
+#include <cstdint>
+
+typedef int BaseType_t;
+typedef unsigned int UBaseType_t;
+typedef uint32_t TickType_t;
+typedef uint8_t StackType_t;
+
+#define pdFALSE ((BaseType_t) 0)
+#define pdTRUE  ((BaseType_t) 1)
+#define pdPASS  pdTRUE
+#define pdFAIL  pdFALSE
+
+#define portMAX_DELAY ((TickType_t) 0xffffffffUL)
+#define portTICK_PERIOD_MS 1
+#define pdMS_TO_TICKS(_ms) ((TickType_t) (_ms))
+
+#define tskIDLE_PRIORITY ((UBaseType_t) 0U)
+
+typedef struct
+{
+    volatile uint32_t owner;
+} portMUX_TYPE;
+
+#define portMUX_FREE_VAL 0xB33FFFFFU
+
+#define portMUX_INITIALIZER_UNLOCKED { portMUX_FREE_VAL }
+
+void vPortEnterCritical(portMUX_TYPE* mux);
+void vPortExitCritical(portMUX_TYPE* mux);
+
+#define portENTER_CRITICAL(_mux)     vPortEnterCritical(_mux)
+#define portEXIT_CRITICAL(_mux)      vPortExitCritical(_mux)
+#define portENTER_CRITICAL_ISR(_mux) vPortEnterCritical(_mux)
+#define portEXIT_CRITICAL_ISR(_mux)  vPortExitCritical(_mux)
+
+void vPortYieldFromISR();
+
+#define portYIELD_FROM_ISR() vPortYieldFromISR()
+
+BaseType_t xPortGetCoreID();
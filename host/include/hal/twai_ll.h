@@ -0,0 +1,117 @@
+// MIT License
+//
+// Copyright (c) 2022 Joe Roback <joe.roback@gmail.com>
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+#pragma once
+
+/*
+ * Linux host stand-in for the ESP-IDF TWAI low level layer.
+ *
+ * twai_dev_t is a simulated SJA1000 register file. The frame at the head of
+ * the simulated RX FIFO is mapped into tx_rx_buffer, the same way the real
+ * peripheral maps it, so the interrupt handler reads it unchanged.
+ * Frames are injected with the sim:: API in sim/sim.hpp.
+ */
+
+#include "twai_types.h"
+
+#include <soc/soc_caps.h>
+
+#include <cstdint>
+
+#define TWAI_LL_INTR_RI     (1 << 0)
+#define TWAI_LL_INTR_TI     (1 << 1)
+#define TWAI_LL_INTR_EI     (1 << 2)
+#define TWAI_LL_INTR_DOI    (1 << 3)
+#define TWAI_LL_INTR_WUI    (1 << 4)
+#define TWAI_LL_INTR_EPI    (1 << 5)
+#define TWAI_LL_INTR_ALI    (1 << 6)
+#define TWAI_LL_INTR_BEI    (1 << 7)
+
+#define TWAI_LL_STATUS_RBS  (1 << 0)    // receive buffer status
+#define TWAI_LL_STATUS_DOS  (1 << 1)    // data overrun status
+#define TWAI_LL_STATUS_TBS  (1 << 2)    // transmit buffer status
+#define TWAI_LL_STATUS_TCS  (1 << 3)    // transmission complete status
+#define TWAI_LL_STATUS_RS   (1 << 4)    // receive status
+#define TWAI_LL_STATUS_TS   (1 << 5)    // transmit status
+#define TWAI_LL_STATUS_ES   (1 << 6)    // error status
+#define TWAI_LL_STATUS_BS   (1 << 7)    // bus status
+#if SOC_TWAI_SUPPORTS_RX_STATUS
+#define TWAI_LL_STATUS_MS   (1 << 8)    // miss status, the frame in the RX buffer was lost to an overrun
+#endif
+
+typedef union
+{
+    struct
+    {
+        uint32_t byte: 8;
+        uint32_t reserved24: 24;
+    };
+    uint32_t val;
+} twai_reg_t;
+
+typedef struct twai_dev_t
+{
+    uint32_t reset_mode;
+    twai_mode_t mode;
+    uint32_t status;
+    uint32_t interrupts;            // latched interrupts, cleared on read
+    uint32_t interrupts_enabled;
+    uint32_t brp;
+    uint32_t sjw;
+    uint32_t tseg_1;
+    uint32_t tseg_2;
+    uint32_t triple_sampling;
+    uint32_t acceptance_code;
+    uint32_t acceptance_mask;
+    bool single_filter;
+    uint32_t clkout;
+    uint32_t rec;
+    uint32_t tec;
+    uint32_t err_warn_lim;
+    twai_reg_t tx_rx_buffer[13];
+    uint32_t rx_message_counter;
+} twai_dev_t;
+
+extern twai_dev_t TWAI;
+
+void twai_ll_enter_reset_mode(twai_dev_t* hw);
+void twai_ll_exit_reset_mode(twai_dev_t* hw);
+bool twai_ll_is_in_reset_mode(twai_dev_t* hw);
+void twai_ll_set_mode(twai_dev_t* hw, twai_mode_t mode);
+
+void twai_ll_set_cmd_release_rx_buffer(twai_dev_t* hw);
+void twai_ll_set_cmd_clear_data_overrun(twai_dev_t* hw);
+
+uint32_t twai_ll_get_status(twai_dev_t* hw);
+uint32_t twai_ll_get_and_clear_intrs(twai_dev_t* hw);
+void twai_ll_set_enabled_intrs(twai_dev_t* hw, uint32_t intr_mask);
+
+void twai_ll_set_bus_timing(twai_dev_t* hw, uint32_t brp, uint32_t sjw, uint32_t tseg1, uint32_t tseg2, bool triple_sampling);
+void twai_ll_set_acc_filter(twai_dev_t* hw, uint32_t code, uint32_t mask, bool single_filter);
+void twai_ll_set_clkout(twai_dev_t* hw, uint32_t divider);
+
+uint32_t twai_ll_get_rec(twai_dev_t* hw);
+void twai_ll_set_rec(twai_dev_t* hw, uint32_t rec);
+uint32_t twai_ll_get_tec(twai_dev_t* hw);
+void twai_ll_set_tec(twai_dev_t* hw, uint32_t tec);
+void twai_ll_set_err_warn_lim(twai_dev_t* hw, uint32_t ewl);
+
+uint32_t twai_ll_get_rx_msg_count(twai_dev_t* hw);
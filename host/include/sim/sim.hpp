@@ -0,0 +1,226 @@
+// MIT License
+//
+// Copyright (c) 2022 Joe Roback <joe.roback@gmail.com>
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+#pragma once
+
+/*
+ * Control side of the Linux host simulation. The firmware only ever sees the
+ * stand-in ESP-IDF/Arduino headers; tools and tests drive the simulated
+ * TWAI controller and Bluetooth LE peer through this API.
+ */
+
+#include <freertos/FreeRTOS.h>
+
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <vector>
+
+namespace sim
+{
+
+/**
+ * CAN frame as seen on the wire
+ */
+struct can_frame
+{
+    uint32_t id;
+    bool extended;
+    bool rtr;
+    uint8_t dlc;
+    uint8_t data[8];
+};
+
+/**
+ * outcome of putting a frame on the simulated bus
+ */
+enum class rx_result
+{
+    accepted,   //!< frame stored in RX FIFO
+    filtered,   //!< frame rejected by the acceptance filter
+    overrun,    //!< RX FIFO full, frame lost (data overrun)
+    stopped,    //!< controller in reset mode, frame ignored
+};
+
+/**
+ * simulated TWAI controller counters
+ */
+struct twai_counters
+{
+    uint64_t received;          //!< frames seen on the bus
+    uint64_t accepted;          //!< frames stored in RX FIFO
+    uint64_t filtered;          //!< frames rejected by acceptance filter
+    uint64_t overruns;          //!< frames lost to a full RX FIFO
+    uint64_t corruptions;       //!< RX FIFO corrupted by 64 counted frames (ESP32 errata)
+    uint64_t resets;            //!< peripheral resets
+    uint64_t interrupts;        //!< interrupt handler invocations
+    uint32_t fifo_high_water;   //!< most RX FIFO bytes used at once
+    uint64_t fifo_wait_us;      //!< total time accepted frames waited in the RX FIFO until released
+    uint32_t fifo_wait_max_us;  //!< longest time a frame waited in the RX FIFO until released
+};
+
+/**
+ * size of the SJA1000 RX FIFO in bytes
+ */
+constexpr size_t twai_fifo_size = 64;
+
+/**
+ * the RX message counter saturates at this many frames, stored or lost
+ */
+constexpr size_t twai_fifo_messages = 64;
+
+/**
+ * put \p f on the bus. the frame passes the programmed acceptance filter into the
+ * RX FIFO and, if \p raise is set, the interrupt handler runs on the calling thread
+ * unless the core it was installed on has interrupts masked.
+ */
+rx_result twai_receive(can_frame const& f, bool raise = true);
+
+/**
+ * latch \p intrs and run the interrupt handler while any enabled interrupt is pending
+ */
+void twai_raise(uint32_t intrs = 0);
+
+/**
+ * take interrupts held off while \p core was masked, called when the last
+ * critical section on that core exits
+ */
+void twai_unmasked(BaseType_t core);
+
+/**
+ * @return frames counted in the RX FIFO, stored or lost
+ */
+size_t twai_rx_count();
+
+/**
+ * @return simulated controller counters
+ */
+twai_counters twai_stats();
+
+/**
+ * reset simulated controller counters
+ */
+void twai_reset_stats();
+
+/**
+ * @return bitrate in bit/s derived from the programmed bus timing (80 MHz APB)
+ */
+uint32_t twai_bitrate();
+
+/**
+ * called with the characteristic UUID and value on every notification
+ */
+using notify_sink = std::function<void(uint16_t uuid, uint8_t const* data, size_t len)>;
+
+/**
+ * install \p sink for characteristic notifications
+ */
+void ble_set_sink(notify_sink sink);
+
+/**
+ * model a link that carries \p notifications per second (0 = unlimited, the default). A
+ * notification finding the 8 controller buffers full fails with ERROR_GATT.
+ */
+void ble_link_rate(uint32_t notifications);
+
+/**
+ * connect a simulated client, negotiating \p mtu if larger than the default
+ */
+void ble_connect(uint16_t mtu = 23);
+
+/**
+ * disconnect the simulated client
+ */
+void ble_disconnect();
+
+/**
+ * write \p data to characteristic \p uuid, as the RaceChrono app would
+ * @return false if there is no such characteristic
+ */
+bool ble_write(uint16_t uuid, uint8_t const* data, size_t len);
+
+/**
+ * enable or disable notifications of characteristic \p uuid, as a client writing its client
+ * characteristic configuration descriptor would
+ * @return false if there is no such characteristic or it has no such descriptor
+ */
+bool ble_subscribe(uint16_t uuid, bool notifications);
+
+/**
+ * read characteristic \p uuid into \p out, as a client would (long reads included)
+ * @return false if there is no such characteristic
+ */
+bool ble_read(uint16_t uuid, std::vector<uint8_t>& out);
+
+/**
+ * set the core id xPortGetCoreID() reports for the calling thread
+ */
+void set_core_id(BaseType_t core);
+
+/**
+ * enable or disable Serial output (default enabled)
+ */
+void serial_enable(bool enable);
+
+/**
+ * model a UART at \p baud (0 = infinitely fast, the default). Serial.write() blocks
+ * once the 128 byte TX FIFO is full and Serial.flush() busy waits until it is empty.
+ */
+void serial_baud(uint32_t baud);
+
+/**
+ * @return true while a thread running as \p core is inside a critical section,
+ * which on the ESP32 masks interrupts on that core
+ */
+bool interrupts_masked(BaseType_t core);
+
+/**
+ * hold off interrupts on both cores until cache_enable(), as the ESP32 does for interrupt
+ * handlers outside IRAM while a flash operation has the cache disabled. handlers allocated
+ * with ESP_INTR_FLAG_IRAM still run, and PSRAM (heap_caps_malloc(MALLOC_CAP_SPIRAM)),
+ * which is cached too, faults on any access meanwhile. nests.
+ */
+void cache_disable();
+
+/**
+ * end cache_disable(), interrupts held off meanwhile are taken now
+ */
+void cache_enable();
+
+/**
+ * @return true between cache_disable() and cache_enable()
+ */
+bool cache_disabled();
+
+/**
+ * back partition \p label with the file at \p path, \p size bytes. a new or shorter file is
+ * extended with erased (0xFF) bytes.
+ * @return false if the file cannot be opened
+ */
+bool partition_attach(const char* label, const char* path, size_t size);
+
+/**
+ * if \p enable, partition erases and writes also take as long as on the ESP32 SPI flash
+ * (sector erase 45 ms, page program 0.4 ms typical) with the cache disabled
+ */
+void flash_timing(bool enable);
+
+} // namespace sim
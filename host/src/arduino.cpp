@@ -0,0 +1,425 @@
+// MIT License
+//
+// Copyright (c) 2022 Joe Roback <joe.roback@gmail.com>
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+#include <Arduino.h>
+#include <esp_heap_caps.h>
+#include <freertos/FreeRTOS.h>
+#include <freertos/task.h>
+
+#include <sim/sim.hpp>
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <map>
+#include <mutex>
+#include <cstdio>
+#include <cstdlib>
+#include <thread>
+
+#include <sys/mman.h>
+
+/*
+ * Linux host stand-ins for the Arduino core and the FreeRTOS port.
+ */
+
+namespace
+{
+
+std::chrono::steady_clock::time_point const boot_time = std::chrono::steady_clock::now();
+
+thread_local BaseType_t core_id = 1;
+
+struct task_state
+{
+    std::mutex lock;
+    std::condition_variable cv;
+    uint32_t notify_count = 0;
+};
+
+thread_local StaticTask_t own_task = { nullptr };
+thread_local TaskHandle_t current_task = nullptr;
+
+task_state& state(TaskHandle_t task)
+{
+    return *static_cast<task_state*>(task->state);
+}
+
+std::atomic<bool> serial_enabled(true);
+
+// UART model, time the last written byte leaves the TX FIFO
+constexpr size_t uart_fifo_size = 128;
+std::atomic<uint32_t> uart_baud(0);
+std::atomic<uint64_t> uart_busy_until(0);
+
+// critical section nesting per thread and per core, a core with any is masked
+thread_local int critical_depth = 0;
+std::atomic<int> masked_cores[2];
+
+// cache_disable() nesting, and the PSRAM mappings that fault meanwhile
+std::atomic<int> cache_disabled_depth(0);
+std::mutex psram_lock;
+std::map<void*, size_t> psram;
+
+/**
+ * make every PSRAM allocation accessible, or fault on any access
+ */
+void psram_protect(int prot)
+{
+    std::lock_guard<std::mutex> guard(psram_lock);
+    for (auto const& entry : psram)
+    {
+        mprotect(entry.first, entry.second, prot);
+    }
+}
+
+uint64_t now_us()
+{
+    return std::chrono::duration_cast<std::chrono::microseconds>(
+        std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+void busy_wait_until(uint64_t until)
+{
+    while (now_us() < until)
+    {
+        std::this_thread::yield();
+    }
+}
+
+/**
+ * account for \p len bytes sent at the modeled baud rate, blocking while the FIFO is full
+ */
+void uart_send(size_t len)
+{
+    uint32_t baud = uart_baud.load(std::memory_order_relaxed);
+    if (baud == 0)
+    {
+        return;
+    }
+
+    // 10 bits per byte (start, 8 data, stop)
+    uint64_t byte_us = 10000000ULL / baud;
+    uint64_t now = now_us();
+    uint64_t busy = uart_busy_until.load(std::memory_order_relaxed);
+    uint64_t until = std::max(busy, now) + len * byte_us;
+    uart_busy_until.store(until, std::memory_order_relaxed);
+
+    uint64_t fifo_us = uart_fifo_size * byte_us;
+    if (until > now + fifo_us)
+    {
+        busy_wait_until(until - fifo_us);
+    }
+}
+
+}
+
+namespace sim
+{
+
+void set_core_id(BaseType_t core)
+{
+    core_id = core;
+}
+
+void serial_enable(bool enable)
+{
+    serial_enabled.store(enable, std::memory_order_relaxed);
+}
+
+void serial_baud(uint32_t baud)
+{
+    uart_baud.store(baud, std::memory_order_relaxed);
+}
+
+bool interrupts_masked(BaseType_t core)
+{
+    return core >= 0 && core < 2 && masked_cores[core].load(std::memory_order_acquire) > 0;
+}
+
+bool cache_disabled()
+{
+    return cache_disabled_depth.load(std::memory_order_acquire) > 0;
+}
+
+void cache_disable()
+{
+    if (cache_disabled_depth.fetch_add(1, std::memory_order_acq_rel) == 0)
+    {
+        psram_protect(PROT_NONE);
+    }
+}
+
+void cache_enable()
+{
+    if (cache_disabled_depth.fetch_sub(1, std::memory_order_acq_rel) == 1)
+    {
+        psram_protect(PROT_READ | PROT_WRITE);
+        for (BaseType_t core = 0; core < 2; core++)
+        {
+            if (!interrupts_masked(core))
+            {
+                sim::twai_unmasked(core);
+            }
+        }
+    }
+}
+
+} // namespace sim
+
+HardwareSerial Serial;
+
+unsigned long micros()
+{
+    return static_cast<unsigned long>(std::chrono::duration_cast<std::chrono::microseconds>(
+        std::chrono::steady_clock::now() - boot_time).count());
+}
+
+unsigned long millis()
+{
+    return micros() / 1000UL;
+}
+
+void delay(uint32_t ms)
+{
+    std::this_thread::sleep_for(std::chrono::milliseconds(ms));
+}
+
+esp_err_t esp_read_mac(uint8_t* mac, esp_mac_type_t type)
+{
+    static uint8_t const base[6] = { 0x24, 0x0a, 0xc4, 0x00, 0x00, 0x00 };
+
+    for (size_t i = 0; i < sizeof(base); i++)
+    {
+        mac[i] = base[i];
+    }
+    mac[5] = static_cast<uint8_t>(mac[5] + type);
+
+    return ESP_OK;
+}
+
+void* heap_caps_malloc(size_t size, uint32_t caps)
+{
+    if (!(caps & MALLOC_CAP_SPIRAM))
+    {
+        return malloc(size);
+    }
+
+    void* ptr = mmap(nullptr, size, sim::cache_disabled() ? PROT_NONE : PROT_READ | PROT_WRITE,
+        MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (ptr == MAP_FAILED)
+    {
+        return nullptr;
+    }
+
+    std::lock_guard<std::mutex> guard(psram_lock);
+    psram[ptr] = size;
+    return ptr;
+}
+
+void heap_caps_free(void* ptr)
+{
+    {
+        std::lock_guard<std::mutex> guard(psram_lock);
+        auto entry = psram.find(ptr);
+        if (entry != psram.end())
+        {
+            munmap(entry->first, entry->second);
+            psram.erase(entry);
+            return;
+        }
+    }
+    free(ptr);
+}
+
+void esp_restart()
+{
+    fprintf(stderr, "esp_restart() called, exiting\n");
+    exit(EXIT_FAILURE);
+}
+
+void HardwareSerial::begin(unsigned long)
+{
+}
+
+size_t HardwareSerial::write(uint8_t c)
+{
+    return write(reinterpret_cast<const char*>(&c), 1);
+}
+
+size_t HardwareSerial::write(const uint8_t* buf, size_t len)
+{
+    return write(reinterpret_cast<const char*>(buf), len);
+}
+
+size_t HardwareSerial::write(const char* buf, size_t len)
+{
+    uart_send(len);
+    if (serial_enabled.load(std::memory_order_relaxed))
+    {
+        return fwrite(buf, 1, len, stdout);
+    }
+    return len;
+}
+
+size_t HardwareSerial::print(const char* str)
+{
+    return write(str, strlen(str));
+}
+
+size_t HardwareSerial::print(int value)
+{
+    char buf[16];
+    int len = snprintf(buf, sizeof(buf), "%d", value);
+    return write(buf, static_cast<size_t>(len));
+}
+
+size_t HardwareSerial::println()
+{
+    return write("\r\n", 2);
+}
+
+size_t HardwareSerial::println(const char* str)
+{
+    return print(str) + println();
+}
+
+size_t HardwareSerial::println(int value)
+{
+    return print(value) + println();
+}
+
+void HardwareSerial::flush()
+{
+    busy_wait_until(uart_busy_until.load(std::memory_order_relaxed));
+    if (serial_enabled.load(std::memory_order_relaxed))
+    {
+        fflush(stdout);
+    }
+}
+
+void vPortEnterCritical(portMUX_TYPE* mux)
+{
+    uint32_t owner = static_cast<uint32_t>(core_id);
+
+    while (true)
+    {
+        uint32_t expected = portMUX_FREE_VAL;
+        if (__atomic_compare_exchange_n(&mux->owner, &expected, owner, false, __ATOMIC_ACQUIRE, __ATOMIC_RELAXED))
+        {
+            if (critical_depth++ == 0 && core_id >= 0 && core_id < 2)
+            {
+                masked_cores[core_id].fetch_add(1, std::memory_order_acq_rel);
+            }
+            return;
+        }
+        std::this_thread::yield();
+    }
+}
+
+void vPortExitCritical(portMUX_TYPE* mux)
+{
+    __atomic_store_n(&mux->owner, portMUX_FREE_VAL, __ATOMIC_RELEASE);
+
+    if (--critical_depth == 0 && core_id >= 0 && core_id < 2)
+    {
+        // interrupts held off while this core was masked are taken now
+        if (masked_cores[core_id].fetch_sub(1, std::memory_order_acq_rel) == 1)
+        {
+            sim::twai_unmasked(core_id);
+        }
+    }
+}
+
+void vPortYieldFromISR()
+{
+}
+
+BaseType_t xPortGetCoreID()
+{
+    return core_id;
+}
+
+TaskHandle_t xTaskCreateStaticPinnedToCore(TaskFunction_t fn, const char*, uint32_t, void* arg,
+    UBaseType_t, StackType_t*, StaticTask_t* buffer, BaseType_t core)
+{
+    buffer->state = new task_state();
+    std::thread thread([fn, arg, core, buffer]() {
+        core_id = core == tskNO_AFFINITY ? 0 : core;
+        current_task = buffer;
+        fn(arg);
+    });
+    thread.detach();
+    return buffer;
+}
+
+void vTaskDelay(TickType_t ticks)
+{
+    std::this_thread::sleep_for(std::chrono::milliseconds(ticks * portTICK_PERIOD_MS));
+}
+
+TaskHandle_t xTaskGetCurrentTaskHandle()
+{
+    if (!current_task)
+    {
+        own_task.state = new task_state();
+        current_task = &own_task;
+    }
+    return current_task;
+}
+
+uint32_t ulTaskNotifyTake(BaseType_t clear_on_exit, TickType_t ticks)
+{
+    task_state& s = state(xTaskGetCurrentTaskHandle());
+    std::unique_lock<std::mutex> guard(s.lock);
+
+    if (ticks == portMAX_DELAY)
+    {
+        s.cv.wait(guard, [&s]() { return s.notify_count > 0; });
+    }
+    else
+    {
+        s.cv.wait_for(guard, std::chrono::milliseconds(ticks * portTICK_PERIOD_MS),
+            [&s]() { return s.notify_count > 0; });
+    }
+
+    uint32_t count = s.notify_count;
+    if (count > 0)
+    {
+        s.notify_count = clear_on_exit ? 0 : count - 1;
+    }
+    return count;
+}
+
+void vTaskNotifyGiveFromISR(TaskHandle_t task, BaseType_t* higher_priority_task_woken)
+{
+    task_state& s = state(task);
+    {
+        std::lock_guard<std::mutex> guard(s.lock);
+        s.notify_count++;
+    }
+    s.cv.notify_one();
+
+    if (higher_priority_task_woken)
+    {
+        *higher_priority_task_woken = pdTRUE;
+    }
+}
@@ -0,0 +1,369 @@
+// MIT License
+//
+// Copyright (c) 2022 Joe Roback <joe.roback@gmail.com>
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+#include <Arduino.h>
+#include <BLE2902.h>
+#include <BLECharacteristic.h>
+#include <BLEDevice.h>
+
+#include <sim/sim.hpp>
+
+/*
+ * Simulated Bluetooth LE stack. A single server with a single client; the
+ * client side is driven through sim::ble_*().
+ */
+
+namespace
+{
+
+BLEServer* server = nullptr;
+BLEAdvertising advertising;
+uint16_t local_mtu = 23;
+sim::notify_sink sink;
+
+// notifications per second the link carries, 0 = unlimited
+uint32_t link_rate = 0;
+
+// notifications the controller buffers until the link takes them
+constexpr uint32_t link_buffers = 8;
+
+// time in microseconds the link has sent every buffered notification
+uint64_t link_busy_until = 0;
+
+/**
+ * take a controller buffer for a notification at \p now
+ * @return false if all buffers are waiting for the link
+ */
+bool link_take(uint64_t now)
+{
+    if (link_rate == 0)
+    {
+        return true;
+    }
+
+    uint64_t interval = 1000000ULL / link_rate;
+    if (link_busy_until < now)
+    {
+        link_busy_until = now;
+    }
+    if (link_busy_until - now >= link_buffers * interval)
+    {
+        return false;
+    }
+
+    link_busy_until += interval;
+    return true;
+}
+
+} // namespace
+
+namespace sim
+{
+
+void ble_set_sink(notify_sink s)
+{
+    sink = s;
+}
+
+void ble_link_rate(uint32_t notifications)
+{
+    link_rate = notifications;
+    link_busy_until = 0;
+}
+
+void ble_connect(uint16_t mtu)
+{
+    if (!server)
+    {
+        return;
+    }
+
+    server->setConnectedCount(1);
+    BLEServerCallbacks* callbacks = server->getCallbacks();
+
+    if (callbacks)
+    {
+        callbacks->onConnect(server);
+
+        if (mtu > 23)
+        {
+            esp_ble_gatts_cb_param_t param;
+            param.mtu.conn_id = 0;
+            param.mtu.mtu = mtu < local_mtu ? mtu : local_mtu;
+            callbacks->onMtuChanged(server, &param);
+        }
+    }
+}
+
+void ble_disconnect()
+{
+    if (!server)
+    {
+        return;
+    }
+
+    server->setConnectedCount(0);
+    if (server->getCallbacks())
+    {
+        server->getCallbacks()->onDisconnect(server);
+    }
+}
+
+bool ble_write(uint16_t uuid, uint8_t const* data, size_t len)
+{
+    if (!server)
+    {
+        return false;
+    }
+
+    BLECharacteristic* characteristic = server->findCharacteristic(BLEUUID(uuid));
+    if (!characteristic)
+    {
+        return false;
+    }
+
+    characteristic->setValue(data, len);
+    if (characteristic->getCallbacks())
+    {
+        characteristic->getCallbacks()->onWrite(characteristic);
+    }
+
+    return true;
+}
+
+bool ble_subscribe(uint16_t uuid, bool notifications)
+{
+    if (!server)
+    {
+        return false;
+    }
+
+    BLECharacteristic* characteristic = server->findCharacteristic(BLEUUID(uuid));
+    BLEDescriptor* descriptor = characteristic ? characteristic->getDescriptorByUUID(BLEUUID(0x2902)) : nullptr;
+    if (!descriptor)
+    {
+        return false;
+    }
+
+    static_cast<BLE2902*>(descriptor)->setNotifications(notifications);
+
+    return true;
+}
+
+bool ble_read(uint16_t uuid, std::vector<uint8_t>& out)
+{
+    if (!server)
+    {
+        return false;
+    }
+
+    BLECharacteristic* characteristic = server->findCharacteristic(BLEUUID(uuid));
+    if (!characteristic)
+    {
+        return false;
+    }
+
+    if (characteristic->getCallbacks())
+    {
+        characteristic->getCallbacks()->onRead(characteristic);
+    }
+    out.assign(characteristic->getData(), characteristic->getData() + characteristic->getLength());
+
+    return true;
+}
+
+} // namespace sim
+
+BLECharacteristic::BLECharacteristic(BLEUUID uuid, uint32_t properties)
+    : _uuid(uuid)
+    , _properties(properties)
+    , _callbacks(nullptr)
+    , _descriptors()
+    , _value()
+{
+}
+
+BLEDescriptor* BLECharacteristic::getDescriptorByUUID(BLEUUID uuid)
+{
+    for (BLEDescriptor* descriptor : _descriptors)
+    {
+        if (descriptor->getUUID().value() == uuid.value())
+        {
+            return descriptor;
+        }
+    }
+    return nullptr;
+}
+
+void BLECharacteristic::setValue(uint8_t* data, size_t len)
+{
+    _value.assign(data, data + len);
+}
+
+void BLECharacteristic::setValue(const uint8_t* data, size_t len)
+{
+    _value.assign(data, data + len);
+}
+
+void BLECharacteristic::notify(bool is_notification)
+{
+    if (!server || server->getConnectedCount() == 0)
+    {
+        if (_callbacks)
+        {
+            _callbacks->onStatus(this, BLECharacteristicCallbacks::ERROR_NO_CLIENT, 0);
+        }
+        return;
+    }
+
+    // as the Arduino ESP32 library, which checks the client configuration before sending
+    BLEDescriptor* cccd = getDescriptorByUUID(BLEUUID(0x2902));
+    if (is_notification && cccd && !static_cast<BLE2902*>(cccd)->getNotifications())
+    {
+        if (_callbacks)
+        {
+            _callbacks->onStatus(this, BLECharacteristicCallbacks::ERROR_NOTIFY_DISABLED, 0);
+        }
+        return;
+    }
+
+    // as esp_ble_gatts_send_indicate() with the L2CAP buffers full
+    if (!link_take(micros()))
+    {
+        if (_callbacks)
+        {
+            _callbacks->onStatus(this, BLECharacteristicCallbacks::ERROR_GATT, static_cast<uint32_t>(ESP_FAIL));
+        }
+        return;
+    }
+
+    if (sink)
+    {
+        sink(_uuid.value(), _value.data(), _value.size());
+    }
+    if (_callbacks)
+    {
+        _callbacks->onStatus(this, BLECharacteristicCallbacks::SUCCESS_NOTIFY, 0);
+    }
+}
+
+BLEService::~BLEService()
+{
+    for (BLECharacteristic* characteristic : _characteristics)
+    {
+        delete characteristic;
+    }
+}
+
+BLECharacteristic* BLEService::createCharacteristic(BLEUUID uuid, uint32_t properties)
+{
+    BLECharacteristic* characteristic = new BLECharacteristic(uuid, properties);
+    _characteristics.push_back(characteristic);
+    return characteristic;
+}
+
+BLECharacteristic* BLEService::getCharacteristic(BLEUUID uuid)
+{
+    for (BLECharacteristic* characteristic : _characteristics)
+    {
+        if (characteristic->getUUID().value() == uuid.value())
+        {
+            return characteristic;
+        }
+    }
+    return nullptr;
+}
+
+BLEServer::~BLEServer()
+{
+    for (BLEService* service : _services)
+    {
+        delete service;
+    }
+}
+
+BLEService* BLEServer::createService(BLEUUID uuid)
+{
+    BLEService* service = new BLEService(uuid);
+    _services.push_back(service);
+    return service;
+}
+
+BLEService* BLEServer::getServiceByUUID(BLEUUID uuid)
+{
+    for (BLEService* service : _services)
+    {
+        if (service->getUUID().value() == uuid.value())
+        {
+            return service;
+        }
+    }
+    return nullptr;
+}
+
+BLECharacteristic* BLEServer::findCharacteristic(BLEUUID uuid)
+{
+    for (BLEService* service : _services)
+    {
+        BLECharacteristic* characteristic = service->getCharacteristic(uuid);
+        if (characteristic)
+        {
+            return characteristic;
+        }
+    }
+    return nullptr;
+}
+
+void BLEDevice::init(std::string)
+{
+}
+
+void BLEDevice::setPower(esp_power_level_t)
+{
+}
+
+void BLEDevice::setMTU(uint16_t mtu)
+{
+    local_mtu = mtu;
+}
+
+uint16_t BLEDevice::getMTU()
+{
+    return local_mtu;
+}
+
+BLEServer* BLEDevice::createServer()
+{
+    if (!server)
+    {
+        server = new BLEServer();
+    }
+    return server;
+}
+
+BLEAdvertising* BLEDevice::getAdvertising()
+{
+    return &advertising;
+}
+
+void BLEDevice::startAdvertising()
+{
+}
@@ -0,0 +1,255 @@
+// MIT License
+//
+// Copyright (c) 2022 Joe Roback <joe.roback@gmail.com>
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+#include <esp_partition.h>
+
+#include <sim/sim.hpp>
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <deque>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+/*
+ * File backed flash partitions.
+ *
+ * Each attached partition is a file of the partition size. Erase fills sectors
+ * with 0xFF and writes AND into the existing bytes, as NOR flash programming
+ * can only clear bits, so a block written twice without an erase in between
+ * reads back corrupted as it would on the device. With flash timing enabled,
+ * every sector erase and page program also waits the typical SPI flash time
+ * with the cache disabled, holding off the TWAI interrupt handler.
+ */
+
+namespace
+{
+
+constexpr size_t sector_size = 4096;
+constexpr size_t page_size = 256;
+
+// typical SPI NOR flash (e.g. W25Q32) timings
+constexpr uint64_t sector_erase_us = 45000;
+constexpr uint64_t page_program_us = 400;
+
+struct partition_file
+{
+    esp_partition_t partition;
+    int fd;
+};
+
+std::mutex lock;
+std::deque<partition_file> partitions;
+std::atomic<bool> timing(false);
+
+uint64_t now_us()
+{
+    return std::chrono::duration_cast<std::chrono::microseconds>(
+        std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+/**
+ * model the flash being busy for \p us with the cache disabled
+ */
+void flash_busy(uint64_t us)
+{
+    if (!timing.load(std::memory_order_relaxed))
+    {
+        return;
+    }
+
+    sim::cache_disable();
+    uint64_t until = now_us() + us;
+    while (now_us() < until)
+    {
+        std::this_thread::yield();
+    }
+    sim::cache_enable();
+}
+
+int fd_of(const esp_partition_t* partition)
+{
+    return reinterpret_cast<partition_file const*>(partition)->fd;
+}
+
+bool in_range(const esp_partition_t* partition, size_t offset, size_t size)
+{
+    return partition && offset <= partition->size && size <= partition->size - offset;
+}
+
+bool fill(int fd, size_t offset, size_t size)
+{
+    uint8_t erased[sector_size];
+    memset(erased, 0xFF, sizeof(erased));
+
+    while (size > 0)
+    {
+        size_t n = std::min(size, sizeof(erased));
+        if (pwrite(fd, erased, n, static_cast<off_t>(offset)) != static_cast<ssize_t>(n))
+        {
+            return false;
+        }
+        offset += n;
+        size -= n;
+    }
+    return true;
+}
+
+}
+
+namespace sim
+{
+
+bool partition_attach(const char* label, const char* path, size_t size)
+{
+    int fd = open(path, O_RDWR | O_CREAT, 0644);
+    if (fd < 0)
+    {
+        perror(path);
+        return false;
+    }
+
+    struct stat st;
+    if (fstat(fd, &st) != 0 || (static_cast<size_t>(st.st_size) < size
+        && !fill(fd, static_cast<size_t>(st.st_size), size - static_cast<size_t>(st.st_size))))
+    {
+        perror(path);
+        close(fd);
+        return false;
+    }
+
+    std::lock_guard<std::mutex> guard(lock);
+
+    partition_file p = {};
+    p.partition.type = ESP_PARTITION_TYPE_DATA;
+    p.partition.subtype = ESP_PARTITION_SUBTYPE_ANY;
+    p.partition.size = static_cast<uint32_t>(size);
+    snprintf(p.partition.label, sizeof(p.partition.label), "%s", label);
+    p.fd = fd;
+    partitions.push_back(p);
+
+    return true;
+}
+
+void flash_timing(bool enable)
+{
+    timing.store(enable, std::memory_order_relaxed);
+}
+
+} // namespace sim
+
+const esp_partition_t* esp_partition_find_first(esp_partition_type_t type, esp_partition_subtype_t subtype,
+    const char* label)
+{
+    std::lock_guard<std::mutex> guard(lock);
+
+    for (partition_file const& p : partitions)
+    {
+        if (p.partition.type == type
+            && (subtype == ESP_PARTITION_SUBTYPE_ANY || p.partition.subtype == subtype)
+            && (!label || strcmp(p.partition.label, label) == 0))
+        {
+            return &p.partition;
+        }
+    }
+    return nullptr;
+}
+
+esp_err_t esp_partition_read(const esp_partition_t* partition, size_t src_offset, void* dst, size_t size)
+{
+    if (!in_range(partition, src_offset, size))
+    {
+        return ESP_ERR_INVALID_SIZE;
+    }
+
+    ssize_t n = pread(fd_of(partition), dst, size, static_cast<off_t>(src_offset));
+    return n == static_cast<ssize_t>(size) ? ESP_OK : ESP_FAIL;
+}
+
+esp_err_t esp_partition_write(const esp_partition_t* partition, size_t dst_offset, const void* src, size_t size)
+{
+    if (!in_range(partition, dst_offset, size))
+    {
+        return ESP_ERR_INVALID_SIZE;
+    }
+
+    int fd = fd_of(partition);
+    uint8_t const* in = static_cast<uint8_t const*>(src);
+
+    // program page by page, the cache is enabled again between pages
+    while (size > 0)
+    {
+        size_t n = std::min(size, page_size - dst_offset % page_size);
+        uint8_t page[page_size];
+
+        if (pread(fd, page, n, static_cast<off_t>(dst_offset)) != static_cast<ssize_t>(n))
+        {
+            return ESP_FAIL;
+        }
+        for (size_t i = 0; i < n; i++)
+        {
+            page[i] &= in[i];
+        }
+        if (pwrite(fd, page, n, static_cast<off_t>(dst_offset)) != static_cast<ssize_t>(n))
+        {
+            return ESP_FAIL;
+        }
+        flash_busy(page_program_us);
+
+        dst_offset += n;
+        in += n;
+        size -= n;
+    }
+
+    return ESP_OK;
+}
+
+esp_err_t esp_partition_erase_range(const esp_partition_t* partition, size_t offset, size_t size)
+{
+    if (offset % sector_size != 0 || size % sector_size != 0)
+    {
+        return ESP_ERR_INVALID_ARG;
+    }
+    if (!in_range(partition, offset, size))
+    {
+        return ESP_ERR_INVALID_SIZE;
+    }
+
+    for (size_t end = offset + size; offset < end; offset += sector_size)
+    {
+        if (!fill(fd_of(partition), offset, sector_size))
+        {
+            return ESP_FAIL;
+        }
+        flash_busy(sector_erase_us);
+    }
+
+    return ESP_OK;
+}
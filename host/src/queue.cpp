@@ -0,0 +1,125 @@
+// MIT License
+//
+// Copyright (c) 2022 Joe Roback <joe.roback@gmail.com>
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+#include <freertos/FreeRTOS.h>
+#include <freertos/queue.h>
+
+#include <cstring>
+
+/*
+ * Linux host stand-in for statically allocated FreeRTOS queues.
+ */
+
+namespace
+{
+
+StaticQueue_t* definition(QueueHandle_t queue)
+{
+    return reinterpret_cast<StaticQueue_t*>(queue);
+}
+
+} // namespace
+
+QueueHandle_t xQueueCreateStatic(UBaseType_t length, UBaseType_t item_size, uint8_t* storage, StaticQueue_t* buffer)
+{
+    buffer->mux = portMUX_INITIALIZER_UNLOCKED;
+    buffer->storage = storage;
+    buffer->length = length;
+    buffer->item_size = item_size;
+    buffer->head = 0;
+    buffer->waiting = 0;
+    return reinterpret_cast<QueueHandle_t>(buffer);
+}
+
+BaseType_t xQueueSendToBackFromISR(QueueHandle_t queue, const void* item, BaseType_t* higher_priority_task_woken)
+{
+    StaticQueue_t* q = definition(queue);
+    BaseType_t sent = pdFAIL;
+
+    portENTER_CRITICAL_ISR(&q->mux);
+    if (q->waiting < q->length)
+    {
+        UBaseType_t back = (q->head + q->waiting) % q->length;
+        memcpy(q->storage + back * q->item_size, item, q->item_size);
+        q->waiting++;
+        sent = pdPASS;
+    }
+    portEXIT_CRITICAL_ISR(&q->mux);
+
+    if (higher_priority_task_woken)
+    {
+        *higher_priority_task_woken = pdFALSE;
+    }
+    return sent;
+}
+
+BaseType_t xQueueReceive(QueueHandle_t queue, void* item, TickType_t)
+{
+    StaticQueue_t* q = definition(queue);
+    BaseType_t received = pdFAIL;
+
+    portENTER_CRITICAL(&q->mux);
+    if (q->waiting > 0)
+    {
+        memcpy(item, q->storage + q->head * q->item_size, q->item_size);
+        q->head = (q->head + 1) % q->length;
+        q->waiting--;
+        received = pdPASS;
+    }
+    portEXIT_CRITICAL(&q->mux);
+
+    return received;
+}
+
+UBaseType_t uxQueueMessagesWaiting(QueueHandle_t queue)
+{
+    StaticQueue_t* q = definition(queue);
+
+    portENTER_CRITICAL(&q->mux);
+    UBaseType_t waiting = q->waiting;
+    portEXIT_CRITICAL(&q->mux);
+
+    return waiting;
+}
+
+UBaseType_t uxQueueSpacesAvailable(QueueHandle_t queue)
+{
+    StaticQueue_t* q = definition(queue);
+
+    portENTER_CRITICAL(&q->mux);
+    UBaseType_t spaces = q->length - q->waiting;
+    portEXIT_CRITICAL(&q->mux);
+
+    return spaces;
+}
+
+BaseType_t xQueueReset(QueueHandle_t queue)
+{
+    StaticQueue_t* q = definition(queue);
+
+    portENTER_CRITICAL(&q->mux);
+    q->head = 0;
+    q->waiting = 0;
+    portEXIT_CRITICAL(&q->mux);
+
+    return pdPASS;
+}
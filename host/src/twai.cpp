@@ -0,0 +1,505 @@
+// MIT License
+//
+// Copyright (c) 2022 Joe Roback <joe.roback@gmail.com>
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+#include <Arduino.h>
+#include <driver/periph_ctrl.h>
+#include <esp_intr_alloc.h>
+#include <hal/twai_ll.h>
+
+#include <sim/sim.hpp>
+
+#include <cstring>
+#include <deque>
+#include <mutex>
+
+/*
+ * Simulated SJA1000 style TWAI controller.
+ *
+ * Frames pass the acceptance filter into a 64 byte RX FIFO, the frame at the
+ * head of the FIFO is mapped into tx_rx_buffer, and the registered interrupt
+ * handler is called while any enabled interrupt is pending. While the core the
+ * handler was installed on is inside a critical section the interrupt is held
+ * off, as on the ESP32, and frames keep filling the FIFO.
+ *
+ * Overruns follow the ESP32: a frame that does not fit is lost, but still counted
+ * by the RX message counter. Releasing such a frame does not move the RX buffer
+ * window, so reading it returns the previous frame again. Once 64 frames are
+ * counted the FIFO is corrupt (ESP32 errata) and releases no longer free
+ * anything until the peripheral is reset.
+ *
+ * With SOC_TWAI_SUPPORTS_RX_STATUS (make CHIP=esp32s3) they follow the ESP32-S3
+ * instead: a lost frame is counted as well, but the miss status is set while it
+ * is at the head of the FIFO, and the FIFO never corrupts.
+ */
+
+twai_dev_t TWAI;
+
+struct intr_handle_data_t
+{
+    intr_handler_t handler;
+    void* arg;
+    BaseType_t core;
+    bool iram;          // ESP_INTR_FLAG_IRAM, runs with the cache disabled
+};
+
+namespace
+{
+
+// APB clock feeding the TWAI baud rate prescaler
+constexpr uint32_t apb_clock_hz = 80000000U;
+
+// guard against a handler that never clears the interrupt source
+constexpr int max_isr_loops = 64;
+
+struct rx_entry
+{
+    uint8_t buffer[13];
+    size_t size;        // bytes used in the RX FIFO
+    uint32_t arrival;   // micros() when the frame entered the RX FIFO
+    bool lost;          // overrun, counted but not stored
+};
+
+std::deque<rx_entry> fifo;
+size_t fifo_bytes = 0;
+bool fifo_corrupt = false;
+intr_handle_data_t isr = { nullptr, nullptr, 1, false };
+
+// bus side (frame arrival) and handler side of the controller, taken by whichever thread delivers
+std::recursive_mutex bus_lock;
+thread_local bool in_isr = false;
+sim::twai_counters counters = {};
+
+__always_inline bool match(uint32_t value, uint32_t code, uint32_t mask, uint32_t bits)
+{
+    return ((value ^ code) & ~mask & bits) == 0;
+}
+
+bool accept(sim::can_frame const& f)
+{
+    uint32_t code = TWAI.acceptance_code;
+    uint32_t mask = TWAI.acceptance_mask;
+    uint32_t rtr = f.rtr ? 1U : 0U;
+
+    if (TWAI.single_filter)
+    {
+        if (f.extended)
+        {
+            return match((f.id << 3) | (rtr << 2), code, mask, 0xFFFFFFFCU);
+        }
+
+        // ID, RTR and the first two data bytes (absent bytes are not compared)
+        uint32_t bits = 0xFFF00000U;
+        bits |= f.dlc > 0 ? 0x0000FF00U : 0U;
+        bits |= f.dlc > 1 ? 0x000000FFU : 0U;
+        uint32_t value = (f.id << 21) | (rtr << 20) | (uint32_t(f.data[0]) << 8) | f.data[1];
+        return match(value, code, mask, bits);
+    }
+
+    if (f.extended)
+    {
+        // both filters compare ID bits 28..13
+        uint32_t id = (f.id >> 13) & 0xFFFFU;
+        return match(id << 16, code, mask, 0xFFFF0000U) || match(id, code, mask, 0x0000FFFFU);
+    }
+
+    // filter 1: ID, RTR and the first data byte (split across two nibbles)
+    uint32_t bits = 0xFFF00000U | (f.dlc > 0 ? 0x000F000FU : 0U);
+    uint32_t value = (f.id << 21) | (rtr << 20) | (uint32_t(f.data[0] >> 4) << 16) | (f.data[0] & 0x0FU);
+    if (match(value, code, mask, bits))
+    {
+        return true;
+    }
+
+    // filter 2: ID and RTR
+    return match((f.id << 5) | (rtr << 4), code, mask, 0x0000FFF0U);
+}
+
+void map_head()
+{
+    if (fifo.empty())
+    {
+        TWAI.status &= ~TWAI_LL_STATUS_RBS;
+#if SOC_TWAI_SUPPORTS_RX_STATUS
+        TWAI.status &= ~TWAI_LL_STATUS_MS;
+#endif
+        return;
+    }
+
+    rx_entry const& head = fifo.front();
+#if SOC_TWAI_SUPPORTS_RX_STATUS
+    if (head.lost)
+    {
+        TWAI.status |= TWAI_LL_STATUS_MS;
+        return;
+    }
+    TWAI.status &= ~TWAI_LL_STATUS_MS;
+#else
+    if (head.lost)
+    {
+        return;
+    }
+#endif
+    for (size_t i = 0; i < sizeof(head.buffer); i++)
+    {
+        TWAI.tx_rx_buffer[i].val = head.buffer[i];
+    }
+    TWAI.status |= TWAI_LL_STATUS_RBS;
+}
+
+uint32_t pending()
+{
+    uint32_t intrs = TWAI.interrupts;
+    if (!fifo.empty())
+    {
+        intrs |= TWAI_LL_INTR_RI;   // receive interrupt is level triggered
+    }
+    return intrs & TWAI.interrupts_enabled;
+}
+
+void dispatch()
+{
+    if (in_isr)
+    {
+        return;
+    }
+
+    in_isr = true;
+    for (int i = 0; i < max_isr_loops && !TWAI.reset_mode && isr.handler && pending(); i++)
+    {
+        if (sim::interrupts_masked(isr.core) || (!isr.iram && sim::cache_disabled()))
+        {
+            break;
+        }
+        ++counters.interrupts;
+        isr.handler(isr.arg);
+    }
+    in_isr = false;
+}
+
+} // namespace
+
+namespace sim
+{
+
+rx_result twai_receive(can_frame const& f, bool raise)
+{
+    std::lock_guard<std::recursive_mutex> guard(bus_lock);
+
+    ++counters.received;
+
+    if (TWAI.reset_mode)
+    {
+        return rx_result::stopped;
+    }
+
+    if (!accept(f))
+    {
+        ++counters.filtered;
+        return rx_result::filtered;
+    }
+
+    rx_entry entry = {};
+    uint8_t dlc = f.dlc > 8 ? 8 : f.dlc;
+    entry.buffer[0] = static_cast<uint8_t>((f.extended ? 0x80U : 0U) | (f.rtr ? 0x40U : 0U) | (f.dlc & 0x0FU));
+
+    size_t offset;
+    if (f.extended)
+    {
+        entry.buffer[1] = static_cast<uint8_t>(f.id >> 21);
+        entry.buffer[2] = static_cast<uint8_t>(f.id >> 13);
+        entry.buffer[3] = static_cast<uint8_t>(f.id >> 5);
+        entry.buffer[4] = static_cast<uint8_t>(f.id << 3);
+        offset = 5;
+    }
+    else
+    {
+        entry.buffer[1] = static_cast<uint8_t>(f.id >> 3);
+        entry.buffer[2] = static_cast<uint8_t>(f.id << 5);
+        offset = 3;
+    }
+
+    if (!f.rtr)
+    {
+        memcpy(&entry.buffer[offset], f.data, dlc);
+        entry.size = offset + dlc;
+    }
+    else
+    {
+        entry.size = offset;
+    }
+
+    rx_result result;
+
+    if (fifo_corrupt || fifo_bytes + entry.size > twai_fifo_size)
+    {
+        ++counters.overruns;
+        TWAI.status |= TWAI_LL_STATUS_DOS;
+        TWAI.interrupts |= TWAI_LL_INTR_DOI;
+        result = rx_result::overrun;
+
+        // still counted, up to the counter's limit
+        if (fifo.size() < twai_fifo_messages)
+        {
+            rx_entry lost = {};
+            lost.lost = true;
+            fifo.push_back(lost);
+#if SOC_TWAI_SUPPORTS_RX_STATUS
+            if (fifo.size() == 1)
+            {
+                map_head();
+            }
+#else
+            if (fifo.size() == twai_fifo_messages)
+            {
+                fifo_corrupt = true;
+                ++counters.corruptions;
+            }
+#endif
+        }
+    }
+    else
+    {
+        ++counters.accepted;
+        entry.arrival = static_cast<uint32_t>(micros());
+        fifo.push_back(entry);
+        fifo_bytes += entry.size;
+        if (fifo_bytes > counters.fifo_high_water)
+        {
+            counters.fifo_high_water = static_cast<uint32_t>(fifo_bytes);
+        }
+        if (fifo.size() == 1)
+        {
+            map_head();
+        }
+        result = rx_result::accepted;
+    }
+
+    if (raise)
+    {
+        twai_raise();
+    }
+
+    return result;
+}
+
+void twai_raise(uint32_t intrs)
+{
+    std::lock_guard<std::recursive_mutex> guard(bus_lock);
+
+    TWAI.interrupts |= intrs;
+    dispatch();
+}
+
+void twai_unmasked(BaseType_t core)
+{
+    if (core == isr.core && !in_isr && isr.handler)
+    {
+        std::lock_guard<std::recursive_mutex> guard(bus_lock);
+        dispatch();
+    }
+}
+
+size_t twai_rx_count()
+{
+    std::lock_guard<std::recursive_mutex> guard(bus_lock);
+    return fifo.size();
+}
+
+twai_counters twai_stats()
+{
+    return counters;
+}
+
+void twai_reset_stats()
+{
+    counters = {};
+}
+
+uint32_t twai_bitrate()
+{
+    uint32_t tq = TWAI.brp * (1U + TWAI.tseg_1 + TWAI.tseg_2);
+    return tq ? apb_clock_hz / tq : 0U;
+}
+
+} // namespace sim
+
+int esp_intr_alloc(int, int flags, intr_handler_t handler, void* arg, intr_handle_t* ret_handle)
+{
+    isr.handler = handler;
+    isr.arg = arg;
+    isr.core = xPortGetCoreID();
+    isr.iram = (flags & ESP_INTR_FLAG_IRAM) != 0;
+    if (ret_handle)
+    {
+        *ret_handle = &isr;
+    }
+    return 0;
+}
+
+int esp_intr_free(intr_handle_t)
+{
+    isr.handler = nullptr;
+    isr.arg = nullptr;
+    return 0;
+}
+
+void twai_ll_enter_reset_mode(twai_dev_t* hw)
+{
+    // the RX FIFO is cleared in reset mode
+    if (hw == &TWAI && !hw->reset_mode)
+    {
+        std::lock_guard<std::recursive_mutex> guard(bus_lock);
+        fifo.clear();
+        fifo_bytes = 0;
+        fifo_corrupt = false;
+        map_head();
+    }
+    hw->reset_mode = 1;
+}
+
+void twai_ll_exit_reset_mode(twai_dev_t* hw)
+{
+    hw->reset_mode = 0;
+}
+
+bool twai_ll_is_in_reset_mode(twai_dev_t* hw)
+{
+    return hw->reset_mode != 0;
+}
+
+void twai_ll_set_mode(twai_dev_t* hw, twai_mode_t mode)
+{
+    hw->mode = mode;
+}
+
+void periph_module_reset(periph_module_t periph)
+{
+    if (periph != PERIPH_TWAI_MODULE)
+    {
+        return;
+    }
+
+    std::lock_guard<std::recursive_mutex> guard(bus_lock);
+
+    fifo.clear();
+    fifo_bytes = 0;
+    fifo_corrupt = false;
+    TWAI = twai_dev_t();
+    TWAI.reset_mode = 1;
+    ++counters.resets;
+}
+
+void twai_ll_set_cmd_release_rx_buffer(twai_dev_t* hw)
+{
+    if (hw == &TWAI && !fifo.empty() && !fifo_corrupt)
+    {
+        if (fifo.front().lost)
+        {
+            fifo.pop_front();
+            map_head();
+            return;
+        }
+
+        uint32_t wait = static_cast<uint32_t>(micros()) - fifo.front().arrival;
+        counters.fifo_wait_us += wait;
+        counters.fifo_wait_max_us = std::max(counters.fifo_wait_max_us, wait);
+        fifo_bytes -= fifo.front().size;
+        fifo.pop_front();
+        map_head();
+    }
+}
+
+void twai_ll_set_cmd_clear_data_overrun(twai_dev_t* hw)
+{
+    hw->status &= ~TWAI_LL_STATUS_DOS;
+}
+
+uint32_t twai_ll_get_status(twai_dev_t* hw)
+{
+    return hw->status;
+}
+
+uint32_t twai_ll_get_and_clear_intrs(twai_dev_t* hw)
+{
+    uint32_t intrs = hw->interrupts;
+    if (hw == &TWAI && !fifo.empty())
+    {
+        intrs |= TWAI_LL_INTR_RI;
+    }
+    hw->interrupts = 0;
+    return intrs;
+}
+
+void twai_ll_set_enabled_intrs(twai_dev_t* hw, uint32_t intr_mask)
+{
+    hw->interrupts_enabled = intr_mask;
+}
+
+void twai_ll_set_bus_timing(twai_dev_t* hw, uint32_t brp, uint32_t sjw, uint32_t tseg1, uint32_t tseg2, bool triple_sampling)
+{
+    hw->brp = brp;
+    hw->sjw = sjw;
+    hw->tseg_1 = tseg1;
+    hw->tseg_2 = tseg2;
+    hw->triple_sampling = triple_sampling;
+}
+
+void twai_ll_set_acc_filter(twai_dev_t* hw, uint32_t code, uint32_t mask, bool single_filter)
+{
+    hw->acceptance_code = code;
+    hw->acceptance_mask = mask;
+    hw->single_filter = single_filter;
+}
+
+void twai_ll_set_clkout(twai_dev_t* hw, uint32_t divider)
+{
+    hw->clkout = divider;
+}
+
+uint32_t twai_ll_get_rec(twai_dev_t* hw)
+{
+    return hw->rec;
+}
+
+void twai_ll_set_rec(twai_dev_t* hw, uint32_t rec)
+{
+    hw->rec = rec;
+}
+
+uint32_t twai_ll_get_tec(twai_dev_t* hw)
+{
+    return hw->tec;
+}
+
+void twai_ll_set_tec(twai_dev_t* hw, uint32_t tec)
+{
+    hw->tec = tec;
+}
+
+void twai_ll_set_err_warn_lim(twai_dev_t* hw, uint32_t ewl)
+{
+    hw->err_warn_lim = ewl;
+}
+
+uint32_t twai_ll_get_rx_msg_count(twai_dev_t* hw)
+{
+    return hw == &TWAI ? static_cast<uint32_t>(fifo.size()) : 0U;
+}
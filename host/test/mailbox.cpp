@@ -0,0 +1,159 @@
+// MIT License
+//
+// Copyright (c) 2022 Joe Roback <joe.roback@gmail.com>
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+#include "src/racechrono-canbus.hpp"
+#include "src/utils/mailbox.hpp"
+
+#include <cstdio>
+#include <cstdlib>
+
+/*
+ * Mailbox test.
+ *
+ * Checks that mailbox keeps only the newest value of a key, counts superseded
+ * values, and that with every key always dirty and room for fewer values than
+ * keys, pops serve the keys round robin, across the words of the dirty bitmap.
+ * A value stored while the consumer reads the slot must be collected once, not
+ * again by the next pop.
+ */
+
+#define CHECK(expr) check((expr), #expr, __FILE__, __LINE__)
+
+namespace
+{
+
+int failures = 0;
+
+void check(bool ok, const char* expr, const char* file, int line)
+{
+    if (!ok)
+    {
+        fprintf(stderr, "%s:%d: check failed: %s\n", file, line, expr);
+        failures++;
+    }
+}
+
+void latest_value()
+{
+    utils::mailbox<uint32_t, 8> box;
+
+    CHECK(box.push(3, 30U));
+    CHECK(box.push(3, 31U));
+    CHECK(box.push(5, 50U));
+    CHECK(!box.push(8, 80U));
+    CHECK(box.size() == 2U);
+    CHECK(box.drops() == 2U);
+    CHECK(box.pushed() == 3U);
+
+    uint32_t items[8];
+    CHECK(box.pop(items, 8) == 2U);
+    CHECK(items[0] == 31U);
+    CHECK(items[1] == 50U);
+    CHECK(box.pop(items, 8) == 0U);
+    CHECK(box.high_water() == 2U);
+}
+
+/**
+ * value that stores a newer value into its mailbox while the consumer copies it
+ */
+struct racing
+{
+    static utils::mailbox<racing, 4>* box;
+    static bool armed;
+
+    uint32_t value;
+
+    racing& operator=(racing const& other) noexcept
+    {
+        if (armed)
+        {
+            armed = false;
+            racing newer;
+            newer.value = other.value + 1U;
+            box->push(1, newer);
+        }
+        value = other.value;
+        return *this;
+    }
+};
+
+utils::mailbox<racing, 4>* racing::box = nullptr;
+bool racing::armed = false;
+
+void store_during_pop()
+{
+    utils::mailbox<racing, 4> box;
+    racing::box = &box;
+
+    racing v;
+    v.value = 10U;
+    CHECK(box.push(1, v));
+
+    racing items[4];
+    racing::armed = true;
+    CHECK(box.pop(items, 4) == 1U);
+    CHECK(!racing::armed);
+    CHECK(items[0].value == 11U);
+    CHECK(box.pop(items, 4) == 0U);
+    CHECK(box.size() == 0U);
+
+    racing::box = nullptr;
+}
+
+template <uint32_t Keys, uint32_t Batch>
+void round_robin()
+{
+    utils::mailbox<uint32_t, Keys> box;
+    uint32_t expected = 0;
+
+    for (uint32_t round = 0; round < 3 * Keys; round++)
+    {
+        // the producer keeps every key dirty
+        for (uint32_t key = 0; key < Keys; key++)
+        {
+            box.push(key, key);
+        }
+
+        uint32_t items[Batch];
+        size_t n = box.pop(items, Batch);
+        CHECK(n == Batch);
+        for (size_t i = 0; i < n; i++)
+        {
+            CHECK(items[i] == expected);
+            expected = (expected + 1U) % Keys;
+        }
+    }
+}
+
+} // namespace
+
+int main()
+{
+    latest_value();
+    store_during_pop();
+    round_robin<10, 3>();
+    round_robin<40, 7>();
+    round_robin<64, 32>();
+
+    printf("mailbox: %s\n", failures ? "FAILED" : "ok");
+    return failures ? EXIT_FAILURE : EXIT_SUCCESS;
+}
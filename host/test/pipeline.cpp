@@ -0,0 +1,321 @@
+// MIT License
+//
+// Copyright (c) 2022 Joe Roback <joe.roback@gmail.com>
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+#include "src/racechrono-canbus.hpp"
+#include "src/canbus/controller.hpp"
+#include "src/canbus/decoder.hpp"
+#include "src/canbus/frame.hpp"
+#include "src/diag/diagnostics.hpp"
+#include "src/logging/logging.hpp"
+#include "src/racechrono/device.hpp"
+#include "src/racechrono/pipeline.hpp"
+#include "src/racechrono/scheduler.hpp"
+
+#include <sim/sim.hpp>
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <map>
+#include <thread>
+#include <vector>
+
+/*
+ * Pipeline test.
+ *
+ * Runs the firmware pipeline unchanged, controller::isr -> decoder::should_decode ->
+ * frame queue -> racechrono::forward -> device::send, on frames injected into the
+ * simulated TWAI controller one at a time, and checks what reaches the RaceChrono
+ * client: the default rate divisors of the g8x table and the notify payloads.
+ */
+
+#define CHECK(expr) check((expr), #expr, __FILE__, __LINE__)
+
+namespace
+{
+
+int failures = 0;
+
+void check(bool ok, const char* expr, const char* file, int line)
+{
+    if (!ok)
+    {
+        fprintf(stderr, "%s:%d: check failed: %s\n", file, line, expr);
+        failures++;
+    }
+}
+
+struct notified
+{
+    uint32_t count = 0;
+    uint8_t dlc = 0;
+    uint8_t data[8] = {};
+};
+
+std::map<uint32_t, notified> sent;
+uint32_t notifications = 0;
+uint16_t last_uuid = 0;
+std::vector<uint8_t> last_notification;
+uint32_t diag_notifications = 0;
+std::vector<uint8_t> last_diag;
+
+void credit(uint8_t const* data, size_t len)
+{
+    CHECK(len >= sizeof(uint32_t) && len <= sizeof(uint32_t) + 8U);
+    if (len < sizeof(uint32_t) || len > sizeof(uint32_t) + 8U)
+    {
+        return;
+    }
+
+    uint32_t id;
+    memcpy(&id, data, sizeof(id));
+    notified& n = sent[id];
+    n.count++;
+    n.dlc = static_cast<uint8_t>(len - sizeof(uint32_t));
+    memcpy(n.data, data + sizeof(uint32_t), n.dlc);
+}
+
+void on_notify(uint16_t uuid, uint8_t const* data, size_t len)
+{
+    if (uuid == 0x10)
+    {
+        diag_notifications++;
+        last_diag.assign(data, data + len);
+        return;
+    }
+    if (uuid != 0x1 && uuid != 0x11)
+    {
+        return;
+    }
+
+    notifications++;
+    last_uuid = uuid;
+    last_notification.assign(data, data + len);
+
+    if (uuid == 0x11)
+    {
+        // batch characteristic: [length][id + payload] entries
+        size_t offset = 0;
+        while (offset < len && offset + 1 + data[offset] <= len)
+        {
+            credit(&data[offset + 1], data[offset]);
+            offset += 1 + data[offset];
+        }
+        CHECK(offset == len);
+        CHECK(len > 1U + data[0]);
+    }
+    else
+    {
+        credit(data, len);
+    }
+}
+
+// run the Bluetooth LE task until everything taken from the queue is sent
+void drain()
+{
+    static canbus::frame frames[CONFIG_CANBUS_QUEUE_LENGTH];
+
+    size_t count;
+    while ((count = CANCTLR.recv(frames, CONFIG_CANBUS_QUEUE_LENGTH)) > 0)
+    {
+        racechrono::forward(frames, count);
+    }
+    racechrono::service();
+#if defined(CONFIG_RC_SCHEDULER)
+    while (RCSCHED.size() > 0)
+    {
+        std::this_thread::sleep_for(std::chrono::microseconds(100));
+        racechrono::service();
+    }
+#endif
+}
+
+// put frame \p seq of \p id on the bus, every frame has a new payload
+void inject(uint32_t id, uint32_t seq, bool extended = false)
+{
+    sim::can_frame f = {};
+    f.id = id;
+    f.extended = extended;
+    f.dlc = 8;
+    for (size_t i = 0; i < sizeof(f.data); i++)
+    {
+        f.data[i] = static_cast<uint8_t>(seq + i);
+    }
+
+    sim::twai_receive(f);
+    drain();
+}
+
+} // namespace
+
+int main()
+{
+    constexpr uint32_t frames = 30;
+
+    sim::serial_enable(false);
+    sim::ble_set_sink(on_notify);
+    logging::logger::get().start();
+
+    if (!RCDEV.start(&CANDEC) || !CANCTLR.install() || !CANCTLR.start())
+    {
+        fprintf(stderr, "firmware startup failed\n");
+        return EXIT_FAILURE;
+    }
+
+    // allow all IDs at their default rate, as the RaceChrono app does
+    sim::ble_connect();
+#if defined(CONFIG_RC_BATCH_NOTIFY)
+    sim::ble_subscribe(0x11, true);
+#endif
+    uint8_t allow_all[3] = { 1, 0, 0 };
+    sim::ble_write(0x2, allow_all, sizeof(allow_all));
+    CANDEC.update_filter();
+
+    // RPM 1/3, BRAKE PRESSURE 1/2, BATTERY VOLTAGE 1/1 and an ID the table does not have
+    for (uint32_t seq = 0; seq < frames; seq++)
+    {
+        inject(0x0A5, seq);
+        inject(0x0EF, seq);
+        inject(0x281, seq);
+        inject(0x3C0, seq);
+    }
+    RCDEV.flush();
+
+    CHECK(sent[0x0A5].count == frames / 3);
+    CHECK(sent[0x0EF].count == frames / 2);
+
+    // an extended frame is not the standard ID of the same value, whatever the filter lets through
+    CANCTLR.set_filter(TWAI_FILTER_CONFIG_ACCEPT_ALL());
+    for (uint32_t seq = 0; seq < frames; seq++)
+    {
+        inject(0x0A5, seq, true);
+    }
+    RCDEV.flush();
+    CHECK(sent[0x0A5].count == frames / 3);
+    CHECK(sent[0x281].count == frames);
+    CHECK(sent[0x3C0].count == 0);
+
+    // the newest payload is the one sent last
+    notified const& last = sent[0x281];
+    CHECK(last.dlc == 8);
+    for (uint8_t i = 0; i < last.dlc; i++)
+    {
+        CHECK(last.data[i] == static_cast<uint8_t>(frames - 1 + i));
+    }
+
+    uint32_t total = 0;
+    for (auto const& s : sent)
+    {
+        total += s.second.count;
+    }
+#if defined(CONFIG_RC_BATCH_NOTIFY)
+    CHECK(notifications <= total);
+#else
+    CHECK(notifications == total);
+#endif
+
+#if defined(CONFIG_RC_BATCH_NOTIFY)
+    // a batch of one frame is a plain RaceChrono frame on the CAN-bus characteristic
+    inject(0x281, frames);
+    RCDEV.flush();
+    CHECK(last_uuid == 0x1);
+    CHECK(last_notification.size() == sizeof(uint32_t) + 8U);
+
+    // a client that did not opt in to batches gets plain frames only
+    sim::ble_subscribe(0x11, false);
+    uint32_t before = notifications;
+    for (uint32_t seq = 0; seq < frames; seq++)
+    {
+        inject(0x281, frames + 1 + seq);
+    }
+    RCDEV.flush();
+    CHECK(notifications - before == frames);
+    CHECK(last_uuid == 0x1);
+    sim::ble_subscribe(0x11, true);
+#endif
+
+#if defined(CONFIG_RC_PACKED_SIGNALS)
+    // the packed signal frame asked for by ID, RPM feeds it and is not forwarded itself
+    sent.clear();
+    uint8_t deny_all[1] = { 0 };
+    uint8_t allow_packed[7] = { 2, 0, 0, 0, 0, 0x07, 0x00 };
+    sim::ble_write(0x2, deny_all, sizeof(deny_all));
+    sim::ble_write(0x2, allow_packed, sizeof(allow_packed));
+    CANDEC.update_filter();
+
+    for (uint32_t seq = 0; seq < frames; seq++)
+    {
+        inject(0x0A5, seq);
+        inject(0x281, seq);
+    }
+    RCDEV.flush();
+
+    CHECK(sent[0x0A5].count == 0);
+    CHECK(sent[0x700].count == frames / 3);
+    CHECK(sent[0x281].count == 0);
+    CHECK(sent[0x700].dlc > 0);
+
+    // only the source messages of packed signals are handed to the packer
+    canbus::frame source = {};
+    source.id = 0x0A5;
+    CHECK(CANDEC.packs(source));
+    source.id = 0x281;
+    CHECK(!CANDEC.packs(source));
+#endif
+
+    // requests that plan the same filter do not reset the controller, the frame in the RX FIFO is kept
+    sim::ble_write(0x2, allow_all, sizeof(allow_all));
+    CANDEC.update_filter();
+    uint32_t held_before = sent[0x281].count;
+    sim::can_frame held = {};
+    held.id = 0x281;
+    held.dlc = 8;
+    sim::twai_receive(held, false);
+    uint8_t allow_slower[3] = { 1, 0, 100 };
+    sim::ble_write(0x2, allow_all, sizeof(allow_all));
+    sim::ble_write(0x2, allow_slower, sizeof(allow_slower));
+    CANDEC.update_filter();
+    sim::twai_raise();
+    drain();
+    RCDEV.flush();
+    CHECK(sent[0x281].count == held_before + 1U);
+
+#if defined(CONFIG_RC_DIAGNOSTICS)
+    // diagnostics are notified once the client enables them, with whole entries
+    DIAG.publish();
+    CHECK(diag_notifications == 0);
+    sim::ble_subscribe(0x10, true);
+    DIAG.publish();
+    CHECK(diag_notifications == 1);
+
+    std::vector<uint8_t> snapshot;
+    CHECK(sim::ble_read(0x10, snapshot));
+    CHECK(snapshot.size() > diag::diagnostics::header_size && last_diag.size() >= diag::diagnostics::header_size);
+    uint8_t entries = last_diag[1] & ~diag::diagnostics::count_truncated;
+    CHECK(last_diag.size() == diag::diagnostics::header_size + entries * diag::diagnostics::entry_size);
+    CHECK(((last_diag[1] & diag::diagnostics::count_truncated) != 0) == (entries < snapshot[1]));
+    CHECK(snapshot[1] == (snapshot.size() - diag::diagnostics::header_size) / diag::diagnostics::entry_size);
+#endif
+
+    printf("pipeline: %s\n", failures ? "FAILED" : "ok");
+    return failures ? EXIT_FAILURE : EXIT_SUCCESS;
+}
@@ -0,0 +1,194 @@
+// MIT License
+//
+// Copyright (c) 2022 Joe Roback <joe.roback@gmail.com>
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+#include "src/racechrono-canbus.hpp"
+#include "src/utils/ring.hpp"
+
+#include <cstdio>
+#include <cstdlib>
+
+/*
+ * Ring buffer test.
+ *
+ * Checks spsc_ring and mpsc_ring from a single thread: order across the end of
+ * the slot array, batch pops that wrap, the high water mark and drop counts.
+ */
+
+#define CHECK(expr) check((expr), #expr, __FILE__, __LINE__)
+
+namespace
+{
+
+int failures = 0;
+
+void check(bool ok, const char* expr, const char* file, int line)
+{
+    if (!ok)
+    {
+        fprintf(stderr, "%s:%d: check failed: %s\n", file, line, expr);
+        failures++;
+    }
+}
+
+constexpr uint32_t depth = 8;
+
+void spsc_wraparound()
+{
+    utils::spsc_ring<uint32_t, depth> ring;
+    uint32_t next = 0;
+    uint32_t expected = 0;
+
+    // keep three items queued, so every lap pushes and pops across the end of the array
+    for (uint32_t lap = 0; lap < 5 * depth; lap++)
+    {
+        while (ring.size() < 3U)
+        {
+            CHECK(ring.push(next++));
+        }
+
+        uint32_t item = 0;
+        CHECK(ring.pop(item));
+        CHECK(item == expected++);
+    }
+
+    uint32_t item;
+    while (ring.pop(item))
+    {
+        CHECK(item == expected++);
+    }
+    CHECK(expected == next);
+    CHECK(ring.pushed() == next);
+    CHECK(ring.size() == 0U);
+    CHECK(ring.high_water() == 3U);
+    CHECK(ring.drops() == 0U);
+}
+
+void spsc_bulk_pop()
+{
+    utils::spsc_ring<uint32_t, depth> ring;
+    uint32_t items[depth * 2];
+
+    // start the queued items near the end of the array
+    for (uint32_t i = 0; i < depth - 2U; i++)
+    {
+        CHECK(ring.push(i));
+    }
+    CHECK(ring.pop(items, depth - 2U) == depth - 2U);
+
+    for (uint32_t i = 0; i < depth; i++)
+    {
+        CHECK(ring.push(100U + i));
+    }
+
+    // a batch smaller than what is queued, then more than is left
+    CHECK(ring.pop(items, 3) == 3U);
+    for (uint32_t i = 0; i < 3U; i++)
+    {
+        CHECK(items[i] == 100U + i);
+    }
+    CHECK(ring.pop(items, depth * 2) == depth - 3U);
+    for (uint32_t i = 0; i < depth - 3U; i++)
+    {
+        CHECK(items[i] == 103U + i);
+    }
+    CHECK(ring.pop(items, depth) == 0U);
+    CHECK(ring.size() == 0U);
+}
+
+void spsc_full()
+{
+    utils::spsc_ring<uint32_t, depth> ring;
+
+    for (uint32_t i = 0; i < depth; i++)
+    {
+        CHECK(ring.push(i));
+    }
+    CHECK(!ring.push(depth));
+    CHECK(!ring.push(depth + 1U));
+    CHECK(ring.size() == depth);
+    CHECK(ring.drops() == 2U);
+
+    // the oldest items are kept, the new ones were dropped
+    uint32_t item = 0;
+    CHECK(ring.pop(item) && item == 0U);
+    CHECK(ring.high_water() == depth);
+    CHECK(ring.push(depth + 2U));
+    CHECK(ring.drops() == 2U);
+
+    uint32_t items[depth];
+    CHECK(ring.pop(items, depth) == depth);
+    CHECK(items[0] == 1U);
+    CHECK(items[depth - 1U] == depth + 2U);
+
+    ring.clear();
+    CHECK(ring.size() == 0U);
+    CHECK(ring.pushed() == 0U);
+    CHECK(ring.high_water() == 0U);
+    CHECK(ring.drops() == 0U);
+}
+
+void mpsc()
+{
+    utils::mpsc_ring<uint32_t, depth> ring;
+    uint32_t next = 0;
+    uint32_t expected = 0;
+
+    for (uint32_t lap = 0; lap < 5 * depth; lap++)
+    {
+        while (ring.size() < 3U)
+        {
+            CHECK(ring.push(next++));
+        }
+
+        uint32_t item = 0;
+        CHECK(ring.pop(item));
+        CHECK(item == expected++);
+    }
+
+    while (ring.size() < depth)
+    {
+        CHECK(ring.push(next++));
+    }
+    CHECK(!ring.push(next));
+    CHECK(ring.drops() == 1U);
+
+    uint32_t item;
+    while (ring.pop(item))
+    {
+        CHECK(item == expected++);
+    }
+    CHECK(expected == next);
+    CHECK(ring.size() == 0U);
+}
+
+} // namespace
+
+int main()
+{
+    spsc_wraparound();
+    spsc_bulk_pop();
+    spsc_full();
+    mpsc();
+
+    printf("ring: %s\n", failures ? "FAILED" : "ok");
+    return failures ? EXIT_FAILURE : EXIT_SUCCESS;
+}
@@ -0,0 +1,367 @@
+// MIT License
+//
+// Copyright (c) 2022 Joe Roback <joe.roback@gmail.com>
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+#include "src/racechrono-canbus.hpp"
+#include "src/logging/binary.hpp"
+
+#include <elf.h>
+
+#include <cinttypes>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <vector>
+
+/*
+ * Binary log decoder.
+ *
+ * Reads the Serial output of a firmware built with CONFIG_RC_LOG_BINARY (a file or
+ * stdin), looks the format string of every record up in the firmware ELF file by
+ * its address and prints the formatted line. Plain text between records is passed
+ * through unchanged.
+ *
+ *   logdecode racechrono-canbus.ino.elf capture.bin
+ *   build/replay --verbose ... | logdecode build/replay
+ */
+
+namespace
+{
+
+namespace binary = logging::binary;
+
+/**
+ * loaded (SHF_ALLOC) sections of an ELF file, for reading strings by address
+ */
+class elf_image
+{
+public:
+    bool load(const char* path)
+    {
+        FILE* file = fopen(path, "rb");
+        if (!file)
+        {
+            perror(path);
+            return false;
+        }
+
+        char buf[65536];
+        size_t n;
+        while ((n = fread(buf, 1, sizeof(buf), file)) > 0)
+        {
+            _data.insert(_data.end(), buf, buf + n);
+        }
+        fclose(file);
+
+        if (_data.size() < EI_NIDENT || memcmp(_data.data(), ELFMAG, SELFMAG) != 0 || _data[EI_DATA] != ELFDATA2LSB)
+        {
+            fprintf(stderr, "%s: not a little endian ELF file\n", path);
+            return false;
+        }
+
+        bool ok = _data[EI_CLASS] == ELFCLASS64
+            ? sections<Elf64_Ehdr, Elf64_Shdr>()
+            : sections<Elf32_Ehdr, Elf32_Shdr>();
+        if (!ok)
+        {
+            fprintf(stderr, "%s: bad section table\n", path);
+        }
+        return ok;
+    }
+
+    /**
+     * @return NUL terminated string at \p addr, or null if not in a loaded section
+     */
+    const char* string(uint64_t addr) const
+    {
+        for (section const& s : _sections)
+        {
+            if (addr >= s.addr && addr < s.addr + s.size)
+            {
+                uint64_t offset = s.offset + (addr - s.addr);
+                uint64_t end = s.offset + s.size;
+                if (memchr(&_data[offset], '\0', end - offset))
+                {
+                    return reinterpret_cast<const char*>(&_data[offset]);
+                }
+            }
+        }
+        return nullptr;
+    }
+
+private:
+    struct section
+    {
+        uint64_t addr;
+        uint64_t offset;
+        uint64_t size;
+    };
+
+    template <typename Ehdr, typename Shdr>
+    bool sections()
+    {
+        if (_data.size() < sizeof(Ehdr))
+        {
+            return false;
+        }
+
+        Ehdr ehdr;
+        memcpy(&ehdr, _data.data(), sizeof(ehdr));
+
+        for (size_t i = 0; i < ehdr.e_shnum; i++)
+        {
+            uint64_t pos = ehdr.e_shoff + i * static_cast<uint64_t>(ehdr.e_shentsize);
+            if (pos + sizeof(Shdr) > _data.size())
+            {
+                return false;
+            }
+
+            Shdr shdr;
+            memcpy(&shdr, &_data[pos], sizeof(shdr));
+
+            if ((shdr.sh_flags & SHF_ALLOC) && shdr.sh_type != SHT_NOBITS && shdr.sh_size > 0
+                && shdr.sh_offset + shdr.sh_size <= _data.size())
+            {
+                // format IDs are 32 bits, like the device addresses
+                _sections.push_back({ shdr.sh_addr & 0xFFFFFFFFU, shdr.sh_offset, shdr.sh_size });
+            }
+        }
+        return true;
+    }
+
+    std::vector<uint8_t> _data;
+    std::vector<section> _sections;
+};
+
+/**
+ * argument of a record, as tagged by the device
+ */
+struct argument
+{
+    uint8_t tag;
+    uint64_t value;
+    double real;
+    std::string text;
+};
+
+bool parse_arguments(uint8_t const* p, size_t len, std::vector<argument>& args)
+{
+    size_t pos = 0;
+    while (pos < len)
+    {
+        argument a = { p[pos++], 0, 0.0, std::string() };
+        switch (a.tag)
+        {
+            case binary::tag_int32:
+            {
+                uint32_t v;
+                if (pos + sizeof(v) > len) { return false; }
+                memcpy(&v, &p[pos], sizeof(v));
+                a.value = v;
+                pos += sizeof(v);
+                break;
+            }
+            case binary::tag_int64:
+                if (pos + sizeof(a.value) > len) { return false; }
+                memcpy(&a.value, &p[pos], sizeof(a.value));
+                pos += sizeof(a.value);
+                break;
+            case binary::tag_double:
+                if (pos + sizeof(a.real) > len) { return false; }
+                memcpy(&a.real, &p[pos], sizeof(a.real));
+                pos += sizeof(a.real);
+                break;
+            case binary::tag_string:
+            {
+                if (pos + 1 > len) { return false; }
+                size_t n = p[pos++];
+                if (pos + n > len) { return false; }
+                a.text.assign(reinterpret_cast<const char*>(&p[pos]), n);
+                pos += n;
+                break;
+            }
+            default:
+                return false;
+        }
+        args.push_back(a);
+    }
+    return true;
+}
+
+/**
+ * printf \p fmt with the device \p args, one conversion at a time
+ */
+std::string format(const char* fmt, std::vector<argument> const& args)
+{
+    std::string out;
+    size_t next = 0;
+    char buf[512];
+
+    for (const char* p = fmt; *p; p++)
+    {
+        if (*p != '%')
+        {
+            out += *p;
+            continue;
+        }
+
+        if (p[1] == '%')
+        {
+            out += '%';
+            p++;
+            continue;
+        }
+
+        // flags, width and precision are kept, length modifiers come from the argument tag
+        std::string spec = "%";
+        const char* q = p + 1;
+        while (*q && strchr("-+ #0", *q)) { spec += *q++; }
+        while (*q && (isdigit(static_cast<unsigned char>(*q)) || *q == '.')) { spec += *q++; }
+        while (*q && strchr("hlLqjzt", *q)) { q++; }
+        char conv = *q;
+        if (!conv)
+        {
+            break;
+        }
+        p = q;
+
+        if (next >= args.size())
+        {
+            out += "<?>";
+            continue;
+        }
+        argument const& a = args[next++];
+
+        if (strchr("diouxXc", conv) && (a.tag == binary::tag_int32 || a.tag == binary::tag_int64))
+        {
+            bool is_signed = conv == 'd' || conv == 'i';
+            long long v = a.tag == binary::tag_int32
+                ? (is_signed ? static_cast<long long>(static_cast<int32_t>(a.value)) : static_cast<long long>(a.value))
+                : static_cast<long long>(a.value);
+            if (conv == 'c')
+            {
+                snprintf(buf, sizeof(buf), (spec + 'c').c_str(), static_cast<int>(v));
+            }
+            else
+            {
+                snprintf(buf, sizeof(buf), (spec + "ll" + conv).c_str(), v);
+            }
+        }
+        else if (strchr("fFeEgGaA", conv) && a.tag == binary::tag_double)
+        {
+            snprintf(buf, sizeof(buf), (spec + conv).c_str(), a.real);
+        }
+        else if (conv == 's' && a.tag == binary::tag_string)
+        {
+            snprintf(buf, sizeof(buf), (spec + 's').c_str(), a.text.c_str());
+        }
+        else if (conv == 'p' && a.tag == binary::tag_int64)
+        {
+            snprintf(buf, sizeof(buf), "0x%" PRIx64, a.value);
+        }
+        else
+        {
+            snprintf(buf, sizeof(buf), "<?%c>", conv);
+        }
+        out += buf;
+    }
+
+    return out;
+}
+
+} // namespace
+
+int main(int argc, char** argv)
+{
+    if (argc < 2 || argc > 3)
+    {
+        fprintf(stderr, "usage: %s firmware.elf [serial_capture]\n", argv[0]);
+        return EXIT_FAILURE;
+    }
+
+    elf_image elf;
+    if (!elf.load(argv[1]))
+    {
+        return EXIT_FAILURE;
+    }
+
+    FILE* in = argc == 3 ? fopen(argv[2], "rb") : stdin;
+    if (!in)
+    {
+        perror(argv[2]);
+        return EXIT_FAILURE;
+    }
+
+    uint64_t records = 0;
+    uint64_t unknown = 0;
+    int c;
+    while ((c = fgetc(in)) != EOF)
+    {
+        if (c != binary::record_marker)
+        {
+            fputc(c, stdout);
+            continue;
+        }
+
+        int len = fgetc(in);
+        if (len == EOF || static_cast<size_t>(len) + 2 < binary::header_size)
+        {
+            break;
+        }
+
+        uint8_t rec[256];
+        if (fread(rec, 1, static_cast<size_t>(len), in) != static_cast<size_t>(len))
+        {
+            break;
+        }
+
+        uint8_t flags = rec[0];
+        uint32_t addr;
+        memcpy(&addr, &rec[1], sizeof(addr));
+
+        records++;
+        std::vector<argument> args;
+        const char* fmt = elf.string(addr);
+        size_t arg_offset = binary::header_size - 2;
+        if (!fmt || !parse_arguments(&rec[arg_offset], static_cast<size_t>(len) - arg_offset, args))
+        {
+            unknown++;
+            printf("<unknown log record, format 0x%08" PRIx32 ">", addr);
+        }
+        else
+        {
+            fputs(format(fmt, args).c_str(), stdout);
+        }
+
+        if (flags & binary::flag_newline)
+        {
+            fputc('\n', stdout);
+        }
+    }
+
+    if (in != stdin)
+    {
+        fclose(in);
+    }
+
+    fprintf(stderr, "%" PRIu64 " records, %" PRIu64 " not decoded\n", records, unknown);
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,160 @@
+// MIT License
+//
+// Copyright (c) 2022 Joe Roback <joe.roback@gmail.com>
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+#include "src/racechrono-canbus.hpp"
+#include "src/canbus/decoder.hpp"
+#include "src/canbus/id_index.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <random>
+#include <vector>
+
+/*
+ * ID lookup benchmark.
+ *
+ * Times the three ways decoder::find() maps a CAN-bus ID to its decoder table
+ * entry, for tables of 14 IDs (the g8x table), 64 and 254 (the most an 8-bit slot
+ * index holds): the direct index over all standard IDs, the perfect hash and
+ * std::lower_bound over the sorted table. The IDs are random standard IDs, the
+ * lookups are a random mix of IDs in the table and, like frames that pass a
+ * loose acceptance filter, IDs that are not.
+ */
+
+namespace
+{
+
+using clock_type = std::chrono::steady_clock;
+
+constexpr size_t lookups = 1 << 24;
+
+struct table
+{
+    std::vector<canbus::detail::ID> ids;
+    std::vector<uint8_t> index;
+    canbus::detail::id_hash hash;
+};
+
+void build(table& t, size_t count, std::mt19937& rng)
+{
+    std::vector<uint32_t> all(canbus::detail::standard_id_count);
+    for (uint32_t id = 0; id < all.size(); id++)
+    {
+        all[id] = id;
+    }
+    std::shuffle(all.begin(), all.end(), rng);
+    all.resize(count);
+    std::sort(all.begin(), all.end());
+
+    t.ids.assign(count, canbus::detail::ID{});
+    t.index.assign(canbus::detail::standard_id_count, canbus::detail::no_slot);
+    std::vector<uint8_t> slots(count);
+    for (size_t s = 0; s < count; s++)
+    {
+        t.ids[s].id = all[s];
+        t.index[all[s]] = static_cast<uint8_t>(s);
+        slots[s] = static_cast<uint8_t>(s);
+    }
+
+    if (!t.hash.build(all.data(), slots.data(), count))
+    {
+        fprintf(stderr, "no perfect hash for %zu IDs\n", count);
+        exit(EXIT_FAILURE);
+    }
+}
+
+// half of the lookups hit the table
+std::vector<uint32_t> queries(table const& t, std::mt19937& rng)
+{
+    std::uniform_int_distribution<uint32_t> any(0, canbus::detail::standard_id_count - 1);
+    std::uniform_int_distribution<size_t> known(0, t.ids.size() - 1);
+
+    std::vector<uint32_t> q(lookups);
+    for (size_t i = 0; i < q.size(); i++)
+    {
+        q[i] = (i & 1) ? t.ids[known(rng)].id : any(rng);
+    }
+    return q;
+}
+
+template <typename Find>
+double time_ns(std::vector<uint32_t> const& q, Find find, size_t& found)
+{
+    found = 0;
+    clock_type::time_point start = clock_type::now();
+    for (uint32_t id : q)
+    {
+        found += find(id) ? 1 : 0;
+    }
+    return std::chrono::duration<double, std::nano>(clock_type::now() - start).count() / q.size();
+}
+
+} // namespace
+
+int main()
+{
+    static size_t const sizes[] = { 14, 64, 254 };
+    std::mt19937 rng(1);
+
+    printf("%zu lookups, half of them IDs in the table\n\n", lookups);
+    printf("%6s %12s %12s %12s\n", "IDs", "index", "hash", "lower_bound");
+
+    for (size_t count : sizes)
+    {
+        table t;
+        build(t, count, rng);
+        std::vector<uint32_t> q = queries(t, rng);
+        canbus::detail::ID const* begin = t.ids.data();
+        canbus::detail::ID const* end = begin + t.ids.size();
+
+        size_t by_index;
+        size_t by_hash;
+        size_t by_search;
+
+        double index_ns = time_ns(q, [&t](uint32_t id) {
+            return t.index[id] != canbus::detail::no_slot;
+        }, by_index);
+
+        double hash_ns = time_ns(q, [&t](uint32_t id) {
+            uint8_t slot = t.hash.find(id);
+            return slot != canbus::detail::no_slot && t.ids[slot].id == id;
+        }, by_hash);
+
+        double search_ns = time_ns(q, [begin, end](uint32_t id) {
+            canbus::detail::ID const* entry = std::lower_bound(begin, end, id);
+            return entry != end && entry->id == id;
+        }, by_search);
+
+        if (by_index != by_hash || by_index != by_search)
+        {
+            fprintf(stderr, "lookups disagree: %zu %zu %zu\n", by_index, by_hash, by_search);
+            return EXIT_FAILURE;
+        }
+
+        printf("%6zu %9.2f ns %9.2f ns %9.2f ns\n", count, index_ns, hash_ns, search_ns);
+    }
+
+    return EXIT_SUCCESS;
+}
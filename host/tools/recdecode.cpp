@@ -0,0 +1,327 @@
+// MIT License
+//
+// Copyright (c) 2022 Joe Roback <joe.roback@gmail.com>
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+#include "src/racechrono-canbus.hpp"
+#include "src/recorder/format.hpp"
+
+#include <algorithm>
+#include <cinttypes>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <vector>
+
+/*
+ * Recorder partition decoder.
+ *
+ * Reads an image of the CONFIG_RC_RECORDER flash partition, orders the written
+ * blocks by sequence and prints their frames as candump text, the format
+ * candump-parse and replay read. Timestamps are seconds since the device booted,
+ * plus --start if given. Blocks that were torn by a reset or overwritten by the
+ * circular log are skipped, each block decodes on its own. A block still open when
+ * the device was reset decodes up to its first erased or malformed record.
+ *
+ *   esptool.py read_flash 0x210000 0x1E0000 canlog.bin
+ *   recdecode canlog.bin > session.log
+ *   recdecode --list canlog.bin
+ *   recdecode --session 3 --start 1656278931 canlog.bin
+ */
+
+namespace
+{
+
+namespace format = recorder::format;
+
+struct options
+{
+    bool list = false;
+    bool has_session = false;
+    uint16_t session = 0;
+    uint64_t start_us = 0;
+    std::string interface = "can0";
+    std::string file;
+};
+
+struct block
+{
+    format::block_header header;
+    uint8_t const* records;
+    bool open;      // not closed, used, frames and lost were counted or are unknown
+};
+
+struct session_summary
+{
+    uint16_t session;
+    uint32_t blocks;
+    uint64_t frames;
+    uint32_t lost;
+    uint64_t first_us;
+    uint64_t last_us;
+};
+
+void usage(const char* name)
+{
+    fprintf(stderr,
+        "usage: %s [options] partition_image\n"
+        "  --list          list the recorded sessions instead of printing frames\n"
+        "  --session N     print only session N (default all)\n"
+        "  --start SECS    add SECS to the timestamps, e.g. the epoch time the device booted\n"
+        "  --interface IF  interface name printed for each frame (default can0)\n",
+        name);
+}
+
+bool parse_args(int argc, char** argv, options& opts)
+{
+    for (int i = 1; i < argc; i++)
+    {
+        std::string arg = argv[i];
+        bool has_value = i + 1 < argc;
+
+        if (arg == "--list")
+        {
+            opts.list = true;
+        }
+        else if (arg == "--session" && has_value)
+        {
+            opts.session = static_cast<uint16_t>(strtoul(argv[++i], nullptr, 0));
+            opts.has_session = true;
+        }
+        else if (arg == "--start" && has_value)
+        {
+            opts.start_us = static_cast<uint64_t>(strtod(argv[++i], nullptr) * 1e6);
+        }
+        else if (arg == "--interface" && has_value)
+        {
+            opts.interface = argv[++i];
+        }
+        else if (arg.size() > 1 && arg[0] == '-')
+        {
+            return false;
+        }
+        else if (opts.file.empty())
+        {
+            opts.file = arg;
+        }
+        else
+        {
+            return false;
+        }
+    }
+
+    return !opts.file.empty();
+}
+
+bool load(std::string const& file, std::vector<uint8_t>& image)
+{
+    FILE* fp = fopen(file.c_str(), "rb");
+    if (!fp)
+    {
+        perror(file.c_str());
+        return false;
+    }
+
+    uint8_t buf[65536];
+    size_t n;
+    while ((n = fread(buf, 1, sizeof(buf), fp)) > 0)
+    {
+        image.insert(image.end(), buf, buf + n);
+    }
+
+    fclose(fp);
+    return true;
+}
+
+/**
+ * call \p on_record with the time and contents of every record in \p b
+ * @return false if the block does not decode to its frame count
+ */
+template <typename F>
+bool decode(block const& b, F on_record)
+{
+    uint64_t ts = b.header.base;
+    size_t pos = 0;
+    uint32_t frames = 0;
+
+    while (pos < b.header.used)
+    {
+        format::record r;
+        size_t len = format::decode(&b.records[pos], b.header.used - pos, r);
+        if (len == 0)
+        {
+            return false;
+        }
+
+        ts += r.delta;
+        on_record(ts, r);
+        pos += len;
+        frames++;
+    }
+
+    return frames == b.header.frames;
+}
+
+/**
+ * written blocks of \p image, ordered by sequence
+ */
+std::vector<block> blocks(std::vector<uint8_t> const& image)
+{
+    std::vector<block> found;
+
+    for (size_t offset = 0; offset + format::block_size <= image.size(); offset += format::block_size)
+    {
+        block b;
+        memcpy(&b.header, &image[offset], sizeof(b.header));
+        b.records = &image[offset + format::header_size];
+        b.open = b.header.magic == format::block_magic && b.header.used == format::used_open;
+
+        if (b.open)
+        {
+            // records end at the first one that does not decode, the erased tail among them
+            size_t capacity = format::block_size - format::header_size;
+            b.header.used = 0;
+            b.header.frames = 0;
+            format::record r;
+            while (size_t len = format::decode(&b.records[b.header.used], capacity - b.header.used, r))
+            {
+                b.header.used = static_cast<uint16_t>(b.header.used + len);
+                b.header.frames++;
+            }
+        }
+
+        if (b.header.magic == format::block_magic
+            && b.header.used <= format::block_size - format::header_size
+            && decode(b, [](uint64_t, format::record const&) {}))
+        {
+            found.push_back(b);
+        }
+    }
+
+    std::sort(found.begin(), found.end(),
+        [](block const& a, block const& b) { return a.header.sequence < b.header.sequence; });
+
+    return found;
+}
+
+void print_frame(options const& opts, uint64_t ts, format::record const& r)
+{
+    ts += opts.start_us;
+
+    char line[64];
+    int len = snprintf(line, sizeof(line), "(%" PRIu64 ".%06u) %s ", ts / 1000000U,
+        static_cast<unsigned>(ts % 1000000U), opts.interface.c_str());
+    len += snprintf(&line[len], sizeof(line) - static_cast<size_t>(len),
+        r.extended() ? "%08" PRIX32 "#" : "%03" PRIX32 "#", r.id);
+
+    if (r.remote())
+    {
+        line[len++] = 'R';
+    }
+    else
+    {
+        static const char hex[] = "0123456789ABCDEF";
+        for (uint8_t i = 0; i < r.dlc(); i++)
+        {
+            line[len++] = hex[r.data[i] >> 4];
+            line[len++] = hex[r.data[i] & 0x0F];
+        }
+    }
+    line[len++] = '\n';
+
+    fwrite(line, 1, static_cast<size_t>(len), stdout);
+}
+
+} // namespace
+
+int main(int argc, char** argv)
+{
+    options opts;
+    if (!parse_args(argc, argv, opts))
+    {
+        usage(argv[0]);
+        return EXIT_FAILURE;
+    }
+
+    std::vector<uint8_t> image;
+    if (!load(opts.file, image))
+    {
+        return EXIT_FAILURE;
+    }
+
+    std::vector<session_summary> sessions;
+    uint64_t lost_marks = 0;
+
+    for (block const& b : blocks(image))
+    {
+        if (opts.has_session && b.header.session != opts.session)
+        {
+            continue;
+        }
+
+        if (sessions.empty() || sessions.back().session != b.header.session)
+        {
+            sessions.push_back({ b.header.session, 0, 0, 0, UINT64_MAX, 0 });
+        }
+        session_summary& s = sessions.back();
+        s.blocks++;
+        if (!b.open)
+        {
+            s.lost = b.header.lost;
+        }
+
+        decode(b, [&](uint64_t ts, format::record const& r) {
+            s.frames++;
+            s.first_us = std::min(s.first_us, ts);
+            s.last_us = std::max(s.last_us, ts);
+            if (r.lost())
+            {
+                lost_marks++;
+            }
+            if (!opts.list)
+            {
+                print_frame(opts, ts, r);
+            }
+        });
+    }
+
+    if (opts.list)
+    {
+        printf("session     blocks       frames     lost    start s      end s\n");
+        for (session_summary const& s : sessions)
+        {
+            printf("%7u %10u %12" PRIu64 " %8u %10.3f %10.3f\n", s.session, s.blocks, s.frames, s.lost,
+                static_cast<double>(s.first_us) * 1e-6, static_cast<double>(s.last_us) * 1e-6);
+        }
+        return EXIT_SUCCESS;
+    }
+
+    uint64_t frames = 0;
+    uint64_t lost = 0;
+    for (session_summary const& s : sessions)
+    {
+        frames += s.frames;
+        lost += s.lost;
+    }
+    fprintf(stderr, "%zu sessions, %" PRIu64 " frames, %" PRIu64 " lost by the recorder (%" PRIu64 " gaps)\n",
+        sessions.size(), frames, lost, lost_marks);
+
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,1046 @@
+// MIT License
+//
+// Copyright (c) 2022 Joe Roback <joe.roback@gmail.com>
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+#include "src/racechrono-canbus.hpp"
+#include "src/canbus/controller.hpp"
+#include "src/canbus/decoder.hpp"
+#include "src/canbus/filter.hpp"
+#include "src/canbus/frame.hpp"
+#include "src/diag/diagnostics.hpp"
+#include "src/logging/logging.hpp"
+#include "src/racechrono/device.hpp"
+#include "src/racechrono/pipeline.hpp"
+#include "src/racechrono/scheduler.hpp"
+#include "src/recorder/recorder.hpp"
+#include "src/trace/trace.hpp"
+
+#include <sim/sim.hpp>
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cinttypes>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <deque>
+#include <map>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <time.h>
+
+/*
+ * candump replay benchmark.
+ *
+ * Replays candump log files ("(ts) can0 ID#DATA", the same input as candump-parse)
+ * through the simulated TWAI controller and measures the whole firmware pipeline:
+ * controller::isr -> frame queue -> core 0 loop -> device::send -> notification.
+ *
+ * The bus thread plays the role of core 1 (interrupt handler), the consumer
+ * thread plays core 0 (Bluetooth LE task) and the loop thread prints the core 1
+ * stats, same as racechrono-canbus.ino. Serial is modeled as a UART, so logging
+ * inside a critical section on core 1 holds off the interrupt handler as it does
+ * on the device.
+ *
+ * --burst replaces the dump files with frames back to back at 100% bus load, each
+ * carrying a sequence number, to stress the RX FIFO. --holdoff masks interrupts on
+ * core 1 periodically, as other critical sections there would. --link limits the
+ * notifications the simulated link carries, so the scheduler has to find its rate.
+ */
+
+namespace
+{
+
+using clock_type = std::chrono::steady_clock;
+
+struct options
+{
+    double speed = 1.0;             // 0 = as fast as possible
+    uint16_t mtu = 23;
+    uint16_t interval_ms = 0;
+    std::vector<uint32_t> ids;      // empty = allow all
+    bool filter_score = false;
+    bool has_filter = false;
+    twai_filter_config_t filter = {};
+    bool verbose = false;
+    uint32_t baud = 115200;
+    logging::log_level log_level = logging::log_level::info;
+    std::string record;             // recorder partition image, empty = no partition
+    size_t record_size = 0x1E0000;
+    bool flash_timing = false;
+    uint32_t burst = 0;             // bit rate of the generated burst, 0 = replay files
+    double burst_seconds = 5.0;
+    uint32_t holdoff_us = 0;        // interrupts masked on core 1 this long ...
+    uint32_t holdoff_period_ms = 10;    // ... this often
+    uint32_t link_rate = 0;         // notifications per second the link carries, 0 = unlimited
+    bool plain = false;             // client does not enable batch notifications
+    std::vector<std::string> files;
+};
+
+struct replay_frame
+{
+    double ts;
+    sim::can_frame frame;
+};
+
+struct id_stats
+{
+    uint64_t rx = 0;
+    uint64_t sent = 0;
+    uint64_t stamp = 0;     // interrupt time of the newest frame handed to the scheduler
+    int64_t seq = -1;       // newest burst sequence number taken from the queue
+};
+
+#if defined(CONFIG_CANBUS_MAILBOX)
+// time the interrupt was raised for the newest frame of each ID (mailbox keeps no order)
+std::atomic<uint64_t> id_stamps[CONFIG_CANBUS_MAILBOX_SLOTS];
+#else
+// frames queued by the interrupt handler, with the time the interrupt was raised
+utils::spsc_ring<uint64_t, 4096> isr_stamps;
+#endif
+std::atomic<bool> bus_done(false);
+
+// consumer (core 0) side only
+std::deque<uint64_t> pending_stamps;
+std::vector<uint32_t> latencies;
+std::map<uint32_t, id_stats> per_id;
+uint64_t notifications = 0;
+uint64_t diag_notifications = 0;
+#if defined(CONFIG_RC_DIAGNOSTICS)
+uint64_t diag_truncated = 0;    // diagnostics notifications without all entries
+uint64_t diag_malformed = 0;    // diagnostics notifications not ending at a whole entry
+#endif
+uint64_t notified_frames = 0;
+uint64_t burst_errors = 0;      // queued burst frames with a bad payload or out of sequence
+uint32_t burst_bitrate = 0;     // bit rate of the generated burst, 0 = replaying files
+double consumer_cpu = 0.0;      // seconds of CPU time used by the consumer thread
+
+__always_inline uint64_t now_ns()
+{
+    return static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(
+        clock_type::now().time_since_epoch()).count());
+}
+
+void usage(const char* name)
+{
+    fprintf(stderr,
+        "usage: %s [options] dump_file... | --burst BITRATE\n"
+        "  --speed X       replay speed factor, 1 = recorded timing, 0 = maximum (default 1)\n"
+        "  --mtu N         MTU negotiated by the simulated client (default 23)\n"
+        "  --interval MS   notify interval sent with the RaceChrono allow request (default 0)\n"
+        "  --id ID         allow only ID (repeatable, hex with 0x prefix), default allow all\n"
+        "  --filter-score  do not replay, score acceptance filters for the allowed IDs against\n"
+        "                  the ID histogram of the dump files\n"
+        "  --filter CODE,MASK,single|dual\n"
+        "                  with --filter-score, also score this acceptance filter\n"
+        "  --baud N        modeled Serial baud rate, 0 = instant (default 115200)\n"
+        "  --log LEVEL     firmware log level: boot, error, warn, info, verbose, debug (default info)\n"
+        "  --verbose       show firmware serial output\n"
+        "  --record FILE   back the recorder partition with FILE (CONFIG_RC_RECORDER)\n"
+        "  --record-size N size of the recorder partition in bytes (default 0x1E0000)\n"
+        "  --flash-timing  model SPI flash erase and write times, with the cache disabled\n"
+        "  --burst BITRATE replay no files, generate frames back to back at 100%% load of BITRATE\n"
+        "  --burst-seconds S\n"
+        "                  length of the burst (default 5)\n"
+        "  --holdoff US[,MS]\n"
+        "                  mask interrupts on core 1 for US microseconds every MS (default 10) ms\n"
+        "  --link N        the link carries N notifications/s, more fail (CONFIG_RC_SCHEDULER, default unlimited)\n"
+        "  --plain         do not enable batch notifications, as the RaceChrono app (CONFIG_RC_BATCH_NOTIFY)\n",
+        name);
+}
+
+bool parse_args(int argc, char** argv, options& opts)
+{
+    for (int i = 1; i < argc; i++)
+    {
+        std::string arg = argv[i];
+        bool has_value = i + 1 < argc;
+
+        if (arg == "--speed" && has_value)
+        {
+            opts.speed = strtod(argv[++i], nullptr);
+        }
+        else if (arg == "--mtu" && has_value)
+        {
+            opts.mtu = static_cast<uint16_t>(strtoul(argv[++i], nullptr, 0));
+        }
+        else if (arg == "--interval" && has_value)
+        {
+            opts.interval_ms = static_cast<uint16_t>(strtoul(argv[++i], nullptr, 0));
+        }
+        else if (arg == "--id" && has_value)
+        {
+            opts.ids.push_back(static_cast<uint32_t>(strtoul(argv[++i], nullptr, 0)));
+        }
+        else if (arg == "--filter-score")
+        {
+            opts.filter_score = true;
+        }
+        else if (arg == "--filter" && has_value)
+        {
+            char* end;
+            opts.filter.acceptance_code = static_cast<uint32_t>(strtoul(argv[++i], &end, 0));
+            opts.filter.acceptance_mask = static_cast<uint32_t>(strtoul(*end ? end + 1 : end, &end, 0));
+            opts.filter.single_filter = strcmp(*end ? end + 1 : end, "dual") != 0;
+            opts.has_filter = true;
+        }
+        else if (arg == "--baud" && has_value)
+        {
+            opts.baud = static_cast<uint32_t>(strtoul(argv[++i], nullptr, 0));
+        }
+        else if (arg == "--log" && has_value)
+        {
+            static const char* const levels[] = { "off", "boot", "error", "warn", "info", "verbose", "debug" };
+            std::string level = argv[++i];
+            auto found = std::find(std::begin(levels), std::end(levels), level);
+            if (found == std::end(levels))
+            {
+                return false;
+            }
+            opts.log_level = static_cast<logging::log_level>(found - std::begin(levels));
+        }
+        else if (arg == "--verbose")
+        {
+            opts.verbose = true;
+        }
+        else if (arg == "--record" && has_value)
+        {
+            opts.record = argv[++i];
+        }
+        else if (arg == "--record-size" && has_value)
+        {
+            opts.record_size = static_cast<size_t>(strtoul(argv[++i], nullptr, 0));
+        }
+        else if (arg == "--flash-timing")
+        {
+            opts.flash_timing = true;
+        }
+        else if (arg == "--burst" && has_value)
+        {
+            opts.burst = static_cast<uint32_t>(strtoul(argv[++i], nullptr, 0));
+        }
+        else if (arg == "--burst-seconds" && has_value)
+        {
+            opts.burst_seconds = strtod(argv[++i], nullptr);
+        }
+        else if (arg == "--holdoff" && has_value)
+        {
+            char* end;
+            opts.holdoff_us = static_cast<uint32_t>(strtoul(argv[++i], &end, 0));
+            if (*end == ',')
+            {
+                opts.holdoff_period_ms = static_cast<uint32_t>(strtoul(end + 1, nullptr, 0));
+            }
+        }
+        else if (arg == "--link" && has_value)
+        {
+            opts.link_rate = static_cast<uint32_t>(strtoul(argv[++i], nullptr, 0));
+        }
+        else if (arg == "--plain")
+        {
+            opts.plain = true;
+        }
+        else if (arg.size() > 1 && arg[0] == '-')
+        {
+            return false;
+        }
+        else
+        {
+            opts.files.push_back(arg);
+        }
+    }
+
+#if !defined(CONFIG_RC_SCHEDULER)
+    // frames of a failed notification would be matched to the stamps of later ones
+    if (opts.link_rate > 0)
+    {
+        return false;
+    }
+#endif
+
+    return opts.burst > 0 ? opts.files.empty() : !opts.files.empty();
+}
+
+int hex_value(char c)
+{
+    if (c >= '0' && c <= '9') { return c - '0'; }
+    if (c >= 'a' && c <= 'f') { return c - 'a' + 10; }
+    if (c >= 'A' && c <= 'F') { return c - 'A' + 10; }
+    return -1;
+}
+
+/**
+ * parse "(1656278931.123456) can0 0A5#0011223344556677"
+ */
+bool parse_line(const char* line, replay_frame& out)
+{
+    const char* p = strchr(line, '(');
+    if (!p)
+    {
+        return false;
+    }
+
+    char* end;
+    out.ts = strtod(p + 1, &end);
+    if (*end != ')')
+    {
+        return false;
+    }
+
+    // skip interface name
+    p = end + 1;
+    while (*p == ' ') { p++; }
+    while (*p && *p != ' ') { p++; }
+    while (*p == ' ') { p++; }
+
+    const char* hash = strchr(p, '#');
+    if (!hash)
+    {
+        return false;
+    }
+
+    sim::can_frame& f = out.frame;
+    memset(&f, 0, sizeof(f));
+    f.extended = (hash - p) > 3;
+    f.id = static_cast<uint32_t>(strtoul(p, nullptr, 16));
+
+    p = hash + 1;
+    if (*p == 'R')
+    {
+        f.rtr = true;
+        return true;
+    }
+
+    while (f.dlc < 8)
+    {
+        int hi = hex_value(p[0]);
+        int lo = hi >= 0 ? hex_value(p[1]) : -1;
+        if (lo < 0)
+        {
+            break;
+        }
+        f.data[f.dlc++] = static_cast<uint8_t>((hi << 4) | lo);
+        p += 2;
+    }
+
+    return true;
+}
+
+/**
+ * frames back to back at 100% load of \p bitrate for \p seconds, round-robin over the allowed IDs
+ * the acceptance filter lets through. the payload is the sequence number and its complement.
+ */
+bool generate_burst(options const& opts, std::vector<replay_frame>& frames)
+{
+    twai_filter_config_t filter = CANDEC.filter();
+    std::vector<uint32_t> ids;
+    for (uint32_t id = 0; id < canbus::detail::standard_id_count; id++)
+    {
+        bool allowed = opts.ids.empty()
+            ? CANDEC.can_decode(id)
+            : std::find(opts.ids.begin(), opts.ids.end(), id) != opts.ids.end();
+        if (allowed && canbus::filter_accepts(filter, id))
+        {
+            ids.push_back(id);
+        }
+    }
+    if (ids.empty())
+    {
+        fprintf(stderr, "no allowed ID passes the acceptance filter\n");
+        return false;
+    }
+
+    // SOF to the end of the interframe space without stuff bits, the shortest 8 byte frame
+    double frame_time = (47.0 + 64.0) / static_cast<double>(opts.burst);
+    size_t count = static_cast<size_t>(opts.burst_seconds / frame_time);
+
+    frames.reserve(count);
+    for (size_t i = 0; i < count; i++)
+    {
+        uint32_t seq = static_cast<uint32_t>(i);
+        replay_frame f = {};
+        f.ts = static_cast<double>(i) * frame_time;
+        f.frame.id = ids[i % ids.size()];
+        f.frame.dlc = 8;
+        memcpy(&f.frame.data[0], &seq, sizeof(seq));
+        seq = ~seq;
+        memcpy(&f.frame.data[4], &seq, sizeof(seq));
+        frames.push_back(f);
+    }
+
+    return true;
+}
+
+/**
+ * a queued burst frame must carry an intact payload, newer than the last one of its ID
+ */
+void check_burst(canbus::frame const& f)
+{
+    uint32_t seq;
+    uint32_t check;
+    memcpy(&seq, &f.data.u8[0], sizeof(seq));
+    memcpy(&check, &f.data.u8[4], sizeof(check));
+
+    id_stats& s = per_id[f.id];
+    if (f.info.dlc != 8 || check != ~seq || static_cast<int64_t>(seq) <= s.seq)
+    {
+        burst_errors++;
+    }
+    s.seq = seq;
+}
+
+bool load(std::string const& file, std::vector<replay_frame>& frames)
+{
+    FILE* fp = fopen(file.c_str(), "r");
+    if (!fp)
+    {
+        fprintf(stderr, "unable to open %s\n", file.c_str());
+        return false;
+    }
+
+    char line[256];
+    replay_frame f;
+    while (fgets(line, sizeof(line), fp))
+    {
+        if (parse_line(line, f))
+        {
+            frames.push_back(f);
+        }
+    }
+
+    fclose(fp);
+    return true;
+}
+
+/**
+ * credit a notified frame to its ID
+ */
+void credit(uint32_t id, uint64_t now)
+{
+    id_stats& s = per_id[id];
+    s.sent++;
+#if defined(CONFIG_RC_SCHEDULER)
+    // the scheduler reorders and replaces frames, match by ID instead of order
+    latencies.push_back(static_cast<uint32_t>((now - s.stamp) / 1000U));
+#else
+    (void) now;
+#endif
+}
+
+/**
+ * count frames in a notification of characteristic \p uuid, crediting each to its ID
+ */
+size_t account(uint16_t uuid, uint8_t const* data, size_t len, uint64_t now)
+{
+    if (uuid == 0x11)
+    {
+        // batch characteristic: [length][id + payload] entries
+        size_t count = 0;
+        for (size_t offset = 0; offset < len && data[offset] >= sizeof(uint32_t) && offset + 1 + data[offset] <= len;
+            offset += 1 + data[offset])
+        {
+            uint32_t id;
+            memcpy(&id, &data[offset + 1], sizeof(id));
+            credit(id, now);
+            count++;
+        }
+        return count;
+    }
+
+    // CAN-bus characteristic: one plain RaceChrono frame
+    uint32_t id;
+    memcpy(&id, data, sizeof(id));
+    credit(id, now);
+    return 1;
+}
+
+void on_notify(uint16_t uuid, uint8_t const* data, size_t len)
+{
+    if (uuid == 0x10)
+    {
+        diag_notifications++;
+#if defined(CONFIG_RC_DIAGNOSTICS)
+        uint8_t entries = len > 1 ? data[1] & ~diag::diagnostics::count_truncated : 0;
+        if (len != diag::diagnostics::header_size + entries * diag::diagnostics::entry_size)
+        {
+            diag_malformed++;
+        }
+        if (len > 1 && (data[1] & diag::diagnostics::count_truncated))
+        {
+            diag_truncated++;
+        }
+#endif
+        return;
+    }
+    if ((uuid != 0x1 && uuid != 0x11) || len < sizeof(uint32_t))
+    {
+        return;
+    }
+
+    uint64_t now = now_ns();
+    size_t count = account(uuid, data, len, now);
+
+    notifications++;
+    notified_frames += count;
+
+#if defined(CONFIG_RC_SCHEDULER)
+    return;
+#endif
+    for (size_t i = 0; i < count && !pending_stamps.empty(); i++)
+    {
+        latencies.push_back(static_cast<uint32_t>((now - pending_stamps.front()) / 1000U));
+        pending_stamps.pop_front();
+    }
+}
+
+// decoder table ID of a frame on the bus, see canbus::table_id()
+uint32_t table_id(sim::can_frame const& f)
+{
+    return f.extended ? canbus::extended_id(f.id) : f.id;
+}
+
+// one stamp per frame the interrupt handler queued since \p pushed, \p id is its table ID
+void stamp_queued(uint32_t& pushed, uint64_t stamp, uint32_t id)
+{
+    uint32_t queued = CANCTLR.queue().pushed;
+#if defined(CONFIG_CANBUS_MAILBOX)
+    if (pushed != queued)
+    {
+        id_stamps[CANDEC.slot(id)].store(stamp, std::memory_order_release);
+        pushed = queued;
+    }
+#else
+    (void) id;
+    for (; pushed != queued; pushed++)
+    {
+        while (!isr_stamps.push(stamp))
+        {
+            std::this_thread::yield();
+        }
+    }
+#endif
+}
+
+// core 1 - put frames on the bus, interrupt handler runs on this thread
+void bus(std::vector<replay_frame> const& frames, double speed)
+{
+    sim::set_core_id(1);
+
+    clock_type::time_point start = clock_type::now();
+    double first_ts = frames.empty() ? 0.0 : frames.front().ts;
+    uint32_t pushed = CANCTLR.queue().pushed;
+
+    for (replay_frame const& f : frames)
+    {
+        if (speed > 0.0)
+        {
+            auto due = start + std::chrono::duration_cast<clock_type::duration>(
+                std::chrono::duration<double>((f.ts - first_ts) / speed));
+            while (clock_type::now() < due)
+            {
+                std::this_thread::yield();
+            }
+        }
+
+        uint64_t stamp = now_ns();
+        sim::twai_receive(f.frame);
+        stamp_queued(pushed, stamp, table_id(f.frame));
+    }
+
+    // frames held off at the end (--holdoff) are taken once core 1 is unmasked
+    while (sim::twai_rx_count() > 0)
+    {
+        sim::twai_raise();
+        std::this_thread::yield();
+    }
+    if (!frames.empty())
+    {
+        stamp_queued(pushed, now_ns(), table_id(frames.back().frame));
+    }
+
+    bus_done.store(true, std::memory_order_release);
+}
+
+// observes the shipped Bluetooth LE task loop, stamping each frame sent with its interrupt time
+struct replay_hooks
+{
+    uint64_t stamp = 0;     // interrupt time of the frame taken last
+
+    void taken(canbus::frame const& f)
+    {
+        if (burst_bitrate > 0)
+        {
+            check_burst(f);
+        }
+
+#if defined(CONFIG_CANBUS_MAILBOX)
+        stamp = id_stamps[CANDEC.slot(canbus::table_id(f))].load(std::memory_order_acquire);
+#else
+        while (!isr_stamps.pop(stamp))
+        {
+            std::this_thread::yield();
+        }
+#endif
+    }
+
+    // packed frames carry the interrupt time of the frame completing them
+    void output(canbus::frame const& f)
+    {
+#if defined(CONFIG_RC_SCHEDULER)
+        per_id[f.id].stamp = stamp;
+#else
+        (void) f;
+        pending_stamps.push_back(stamp);
+#endif
+    }
+};
+
+// core 0 - drain the frame queue and send, the loop of core0() in racechrono-canbus.ino
+void consumer()
+{
+    sim::set_core_id(0);
+
+    static canbus::frame frames[CONFIG_CANBUS_QUEUE_LENGTH];
+    replay_hooks hooks;
+
+    CANCTLR.set_consumer(xTaskGetCurrentTaskHandle());
+
+    while (true)
+    {
+        CANCTLR.wait();
+
+        bool done = bus_done.load(std::memory_order_acquire);
+
+        size_t count;
+        bool idle = true;
+        while ((count = CANCTLR.recv(frames, CONFIG_CANBUS_QUEUE_LENGTH)) > 0)
+        {
+            idle = false;
+            racechrono::forward(frames, count, hooks);
+        }
+        racechrono::service();
+#if defined(CONFIG_RC_SCHEDULER)
+        idle = idle && RCSCHED.size() == 0;
+        done = done && RCSCHED.size() == 0;
+#endif
+
+        if (done && CANCTLR.queue().size == 0)
+        {
+            RCDEV.flush();
+#if defined(CONFIG_RC_DIAGNOSTICS)
+            // final snapshot, read back in report()
+            DIAG.publish();
+#endif
+
+            timespec cpu;
+            clock_gettime(CLOCK_THREAD_CPUTIME_ID, &cpu);
+            consumer_cpu = static_cast<double>(cpu.tv_sec) + static_cast<double>(cpu.tv_nsec) * 1e-9;
+            return;
+        }
+
+        if (idle)
+        {
+            std::this_thread::yield();
+        }
+    }
+}
+
+// core 1 - loop(), writes recorded frames to flash and prints the controller stats
+void loop(std::atomic<bool> const& stop, options const& opts)
+{
+    sim::set_core_id(1);
+
+    portMUX_TYPE holdoff_lock = portMUX_INITIALIZER_UNLOCKED;
+    clock_type::time_point holdoff_next = clock_type::now();
+
+    while (!stop.load(std::memory_order_acquire))
+    {
+#if defined(CONFIG_RC_RECORDER)
+        RECORDER.flush();
+        RECORDER.stats();
+#endif
+        CANCTLR.stats();
+
+        if (opts.holdoff_us > 0 && clock_type::now() >= holdoff_next)
+        {
+            // a critical section on core 1 holds the interrupt handler off
+            portENTER_CRITICAL(&holdoff_lock);
+            clock_type::time_point until = clock_type::now() + std::chrono::microseconds(opts.holdoff_us);
+            while (clock_type::now() < until)
+            {
+            }
+            portEXIT_CRITICAL(&holdoff_lock);
+            holdoff_next += std::chrono::milliseconds(opts.holdoff_period_ms);
+        }
+
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    }
+}
+
+void score_filter(const char* name, twai_filter_config_t const& filter, std::vector<uint32_t> const& histogram,
+    std::vector<bool> const& wanted)
+{
+    uint64_t total = 0;
+    uint64_t accepted = 0;
+    uint64_t unwanted = 0;
+    uint64_t missed = 0;
+    uint32_t unwanted_ids = 0;
+
+    for (uint32_t id = 0; id < canbus::detail::standard_id_count; id++)
+    {
+        uint32_t count = histogram[id];
+        bool accept = canbus::filter_accepts(filter, id);
+
+        total += count;
+        if (accept)
+        {
+            accepted += count;
+            if (!wanted[id])
+            {
+                unwanted += count;
+                unwanted_ids += count > 0 ? 1U : 0U;
+            }
+        }
+        else if (wanted[id])
+        {
+            missed += count;
+        }
+    }
+
+    printf("%-10s code 0x%08X mask 0x%08X %-6s accepts %" PRIu64 " / %" PRIu64 " frames, "
+        "%" PRIu64 " unwanted (%u IDs, %.1f%%), %" PRIu64 " wanted rejected\n",
+        name, filter.acceptance_code, filter.acceptance_mask, filter.single_filter ? "single" : "dual",
+        accepted, total, unwanted, unwanted_ids, total ? 100.0 * static_cast<double>(unwanted) / static_cast<double>(total) : 0.0,
+        missed);
+}
+
+/**
+ * offline acceptance filter scoring against the dump's standard ID histogram
+ */
+void filter_score(options const& opts, std::vector<replay_frame> const& frames)
+{
+    std::vector<uint32_t> histogram(canbus::detail::standard_id_count, 0U);
+    std::vector<bool> wanted(canbus::detail::standard_id_count, false);
+    std::vector<uint32_t> ids;
+
+    for (replay_frame const& f : frames)
+    {
+        if (!f.frame.extended)
+        {
+            histogram[f.frame.id]++;
+        }
+    }
+
+    for (uint32_t id = 0; id < canbus::detail::standard_id_count; id++)
+    {
+        bool allowed = opts.ids.empty()
+            ? CANDEC.can_decode(id)
+            : std::find(opts.ids.begin(), opts.ids.end(), id) != opts.ids.end();
+        if (allowed)
+        {
+            wanted[id] = true;
+            ids.push_back(id);
+        }
+    }
+
+    printf("Allowed IDs: %zu, frames in dump: %zu\n", ids.size(), frames.size());
+    score_filter("accept-all", TWAI_FILTER_CONFIG_ACCEPT_ALL(), histogram, wanted);
+    score_filter("device", canbus::plan_filter(ids.data(), ids.size()), histogram, wanted);
+    score_filter("histogram", canbus::plan_filter(ids.data(), ids.size(), histogram.data()), histogram, wanted);
+    if (opts.has_filter)
+    {
+        score_filter("given", opts.filter, histogram, wanted);
+    }
+}
+
+#if defined(CONFIG_RC_DIAGNOSTICS)
+uint32_t get_le32(uint8_t const* p)
+{
+    return static_cast<uint32_t>(p[0]) | static_cast<uint32_t>(p[1]) << 8 | static_cast<uint32_t>(p[2]) << 16
+        | static_cast<uint32_t>(p[3]) << 24;
+}
+
+// read the diagnostics characteristic as a client would and print it
+void report_diagnostics()
+{
+    std::vector<uint8_t> value;
+    if (!sim::ble_read(0x10, value) || value.size() < diag::diagnostics::header_size)
+    {
+        printf("\nDiagnostics:            not readable\n");
+        return;
+    }
+
+    uint8_t const* v = value.data();
+    size_t count = (value.size() - diag::diagnostics::header_size) / diag::diagnostics::entry_size;
+    printf("\nDiagnostics:            version %u, %u bus errors, %u overruns\n", v[0], get_le32(&v[8]),
+        get_le32(&v[12]));
+    printf("Diagnostics notified:   %" PRIu64 " (%" PRIu64 " without all entries, %" PRIu64 " malformed)\n",
+        diag_notifications, diag_truncated, diag_malformed);
+    printf("Rx load (last):         %.2f%%\n", static_cast<double>(v[2] | v[3] << 8) / 100.0);
+    printf("Packed forwarded:       %u\n", get_le32(&v[16]));
+    printf("\n      ID   received   accepted    dropped suppressed  forwarded\n");
+    for (size_t i = 0; i < count && i < v[1]; i++)
+    {
+        uint8_t const* e = v + diag::diagnostics::header_size + i * diag::diagnostics::entry_size;
+        uint32_t id = get_le32(e);
+        if (id == diag::diagnostics::other_id)
+        {
+            printf("   other");
+        }
+        else
+        {
+            printf("%8" PRIX32, id);
+        }
+        printf(" %10u %10u %10u %10u %10u\n", get_le32(e + 4), get_le32(e + 8), get_le32(e + 12), get_le32(e + 16),
+            get_le32(e + 20));
+    }
+}
+#endif
+
+uint32_t percentile(std::vector<uint32_t> const& sorted, double p)
+{
+    if (sorted.empty())
+    {
+        return 0;
+    }
+    size_t idx = static_cast<size_t>(p * static_cast<double>(sorted.size() - 1) + 0.5);
+    return sorted[idx];
+}
+
+void report(std::vector<replay_frame> const& frames, double elapsed)
+{
+    sim::twai_counters twai = sim::twai_stats();
+    canbus::controller::queue_stats queue = CANCTLR.queue();
+    canbus::controller::rx_stats rx = CANCTLR.rx();
+
+    printf("Frames replayed:        %zu in %.3f s (%.0f frames/s)\n",
+        frames.size(), elapsed, elapsed > 0.0 ? static_cast<double>(frames.size()) / elapsed : 0.0);
+    printf("Interrupts:             %" PRIu64 "\n", twai.interrupts);
+    printf("Filtered (hardware):    %" PRIu64 "\n", twai.filtered);
+    printf("RX FIFO overruns:       %" PRIu64 " (high water %u bytes)\n", twai.overruns, twai.fifo_high_water);
+    printf("RX FIFO wait us:        mean %.1f  max %u\n",
+        twai.accepted ? static_cast<double>(twai.fifo_wait_us) / static_cast<double>(twai.accepted) : 0.0,
+        twai.fifo_wait_max_us);
+    printf("RX FIFO corrupted:      %" PRIu64 " (peripheral resets %" PRIu64 ")\n", twai.corruptions, twai.resets);
+    printf("Controller read:        %u frames, %u overruns counted, %u FIFO resets\n", rx.frames, rx.overruns,
+        rx.resets);
+    if (burst_bitrate > 0)
+    {
+        uint64_t lost = frames.size() - rx.frames;
+        printf("Burst:                  %zu frames at %u bit/s, %" PRIu64 " lost (%" PRIu64 " uncounted), "
+            "%" PRIu64 " bad frames queued\n", frames.size(), burst_bitrate, lost,
+            lost > rx.overruns ? lost - rx.overruns : 0U, burst_errors);
+    }
+    printf("Log lines dropped:      %u\n", logging::logger::get().drops());
+    printf("Queued:                 %u\n", queue.pushed);
+#if defined(CONFIG_CANBUS_MAILBOX)
+    printf("Mailbox high water:     %u / %u\n", queue.high_water, static_cast<uint32_t>(CONFIG_CANBUS_MAILBOX_SLOTS));
+    printf("Mailbox superseded:     %u\n", queue.drops);
+#else
+    printf("Queue high water:       %u / %u\n", queue.high_water, static_cast<uint32_t>(CONFIG_CANBUS_QUEUE_LENGTH));
+    printf("Queue dropped:          %u\n", queue.drops);
+#endif
+#if defined(CONFIG_CANBUS_EVENT_DRIVEN)
+    printf("Consumer wakeups:       %u (%.2f frames/wakeup)\n", queue.wakeups,
+        queue.wakeups ? static_cast<double>(queue.pushed) / static_cast<double>(queue.wakeups) : 0.0);
+#endif
+    printf("Consumer CPU:           %.3f s (%.1f%% of one core)\n", consumer_cpu,
+        elapsed > 0.0 ? consumer_cpu / elapsed * 100.0 : 0.0);
+    printf("Notifications:          %" PRIu64 " (%.2f frames/notify)\n", notifications,
+        notifications ? static_cast<double>(notified_frames) / static_cast<double>(notifications) : 0.0);
+
+    std::sort(latencies.begin(), latencies.end());
+    printf("ISR->notify latency us: p50 %u  p90 %u  p99 %u  p99.9 %u  max %u\n",
+        percentile(latencies, 0.50), percentile(latencies, 0.90), percentile(latencies, 0.99),
+        percentile(latencies, 0.999), latencies.empty() ? 0U : latencies.back());
+
+#if defined(CONFIG_RC_RECORDER)
+    recorder::recorder::counters rec = RECORDER.totals();
+    printf("Recorded:               %u frames, %u dropped (high water staging %u, ring %u bytes)\n",
+        rec.frames, rec.drops, rec.high_water, rec.ring_high_water);
+    printf("Recorder blocks:        %u (%u erased ahead), %.2f bytes/frame, %u errors\n", rec.blocks,
+        rec.erased_ahead, rec.frames ? static_cast<double>(rec.bytes) / static_cast<double>(rec.frames) : 0.0,
+        rec.errors);
+    printf("Recorder flash:         %.3f s busy, %.2f MB/s, max %u us per write\n",
+        static_cast<double>(rec.flash_us) * 1e-6,
+        rec.flash_us ? static_cast<double>(rec.bytes) / static_cast<double>(rec.flash_us) : 0.0,
+        rec.flash_max_us);
+#endif
+
+#if defined(CONFIG_RC_SCHEDULER)
+    printf("Notify failures:        %u\n", RCDEV.notify_failures());
+    printf("Scheduler rate:         %u frames/s at the end\n", RCSCHED.rate());
+    static const char* const classes[canbus::priority_count] = { "high", "normal", "low" };
+    printf("\n   Class    offered       sent     sent/s  superseded    dropped\n");
+    for (size_t i = 0; i < canbus::priority_count; i++)
+    {
+        racechrono::scheduler::counters const& c = RCSCHED.totals(static_cast<canbus::priority>(i));
+        printf("%8s %10u %10u %10.1f  %10u %10u\n", classes[i], c.offered, c.sent,
+            elapsed > 0.0 ? static_cast<double>(c.sent) / elapsed : 0.0, c.superseded, c.dropped);
+    }
+#endif
+
+    printf("\n      ID         rx       sent   decimation\n");
+    for (auto const& entry : per_id)
+    {
+        id_stats const& s = entry.second;
+        if (s.sent > 0)
+        {
+            printf("%8" PRIX32 " %10" PRIu64 " %10" PRIu64 "   1/%.2f\n", entry.first, s.rx, s.sent,
+                static_cast<double>(s.rx) / static_cast<double>(s.sent));
+        }
+        else
+        {
+            printf("%8" PRIX32 " %10" PRIu64 " %10" PRIu64 "   -\n", entry.first, s.rx, s.sent);
+        }
+    }
+
+#if defined(CONFIG_RC_DIAGNOSTICS)
+    report_diagnostics();
+#endif
+}
+
+} // namespace
+
+int main(int argc, char** argv)
+{
+    options opts;
+    if (!parse_args(argc, argv, opts))
+    {
+        usage(argv[0]);
+        return EXIT_FAILURE;
+    }
+
+    std::vector<replay_frame> frames;
+    for (std::string const& file : opts.files)
+    {
+        if (!load(file, frames))
+        {
+            return EXIT_FAILURE;
+        }
+    }
+
+    std::stable_sort(frames.begin(), frames.end(),
+        [](replay_frame const& a, replay_frame const& b) { return a.ts < b.ts; });
+
+    if (opts.filter_score)
+    {
+        filter_score(opts, frames);
+        return EXIT_SUCCESS;
+    }
+
+    for (replay_frame const& f : frames)
+    {
+        per_id[f.frame.id].rx++;
+    }
+
+    sim::serial_enable(opts.verbose);
+    sim::serial_baud(opts.baud);
+    sim::ble_set_sink(on_notify);
+    logging::logger::get().set_level(opts.log_level);
+    logging::logger::get().start();
+    latencies.reserve(frames.size());
+
+#if defined(CONFIG_RC_RECORDER)
+    // without --record there is no partition and nothing is recorded, as on a device without one
+    if (!opts.record.empty() && !sim::partition_attach(CONFIG_RC_RECORDER_PARTITION, opts.record.c_str(),
+        opts.record_size))
+    {
+        return EXIT_FAILURE;
+    }
+    sim::flash_timing(opts.flash_timing);
+    RECORDER.start();
+#endif
+
+    if (!RCDEV.start(&CANDEC) || !CANCTLR.install() || !CANCTLR.start())
+    {
+        fprintf(stderr, "firmware startup failed\n");
+        return EXIT_FAILURE;
+    }
+
+    // connect and subscribe, as the RaceChrono app does
+    sim::ble_link_rate(opts.link_rate);
+    sim::ble_connect(opts.mtu);
+    if (!opts.plain)
+    {
+        // a client reading batches opts in to them, no-op without CONFIG_RC_BATCH_NOTIFY
+        sim::ble_subscribe(0x11, true);
+    }
+    // a diagnostics client enables its notifications, no-op without CONFIG_RC_DIAGNOSTICS
+    sim::ble_subscribe(0x10, true);
+    if (opts.ids.empty())
+    {
+        uint8_t cmd[3] = { 1, static_cast<uint8_t>(opts.interval_ms >> 8), static_cast<uint8_t>(opts.interval_ms) };
+        sim::ble_write(0x2, cmd, sizeof(cmd));
+    }
+    for (uint32_t id : opts.ids)
+    {
+        uint8_t cmd[7] = { 2, static_cast<uint8_t>(opts.interval_ms >> 8), static_cast<uint8_t>(opts.interval_ms),
+            static_cast<uint8_t>(id >> 24), static_cast<uint8_t>(id >> 16), static_cast<uint8_t>(id >> 8),
+            static_cast<uint8_t>(id) };
+        sim::ble_write(0x2, cmd, sizeof(cmd));
+    }
+    // as the Bluetooth LE task does on its next pass
+    CANDEC.update_filter();
+
+    // the burst takes the IDs the acceptance filter lets through once subscribed
+    if (opts.burst > 0)
+    {
+        if (!generate_burst(opts, frames))
+        {
+            return EXIT_FAILURE;
+        }
+        burst_bitrate = opts.burst;
+        for (replay_frame const& f : frames)
+        {
+            per_id[f.frame.id].rx++;
+        }
+    }
+
+    clock_type::time_point start = clock_type::now();
+    std::atomic<bool> stop(false);
+    std::thread consumer_thread(consumer);
+    std::thread loop_thread(loop, std::cref(stop), std::cref(opts));
+    std::thread bus_thread(bus, std::cref(frames), opts.speed);
+    bus_thread.join();
+    consumer_thread.join();
+    stop.store(true, std::memory_order_release);
+    loop_thread.join();
+    double elapsed = std::chrono::duration<double>(clock_type::now() - start).count();
+#if defined(CONFIG_RC_RECORDER)
+    RECORDER.sync();
+#endif
+
+    logging::logger::get().flush();
+    sim::serial_baud(0);
+    sim::serial_enable(true);
+    report(frames, elapsed);
+
+#if defined(CONFIG_RC_TRACE)
+    // per ID histograms recorded by the firmware tracer
+    printf("\n");
+    TRACER.dump();
+#endif
+
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,232 @@
+// MIT License
+//
+// Copyright (c) 2022 Joe Roback <joe.roback@gmail.com>
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+#include "src/racechrono-canbus.hpp"
+#include "src/canbus/frame.hpp"
+#include "src/utils/ring.hpp"
+
+#include <freertos/FreeRTOS.h>
+#include <freertos/queue.h>
+
+#include <sim/sim.hpp>
+
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <thread>
+
+/*
+ * Frame queue benchmark.
+ *
+ * Moves CAN frames through the controller's spsc_ring and through a statically
+ * allocated FreeRTOS queue of the same depth (the host stand-in copies each item
+ * inside a critical section, as the kernel does), with the queue depth the
+ * firmware uses:
+ *
+ *   same thread  the interrupt handler queues a burst, the Bluetooth LE task takes it
+ *                (one item per call for the FreeRTOS queue, a batch for the ring)
+ *   two threads  core 1 produces and core 0 consumes concurrently, spinning on full
+ *                and empty; only meaningful on a host with more than one CPU
+ */
+
+namespace
+{
+
+using clock_type = std::chrono::steady_clock;
+
+constexpr uint32_t depth = CONFIG_CANBUS_QUEUE_LENGTH;
+constexpr uint32_t burst = depth / 2;
+
+using ring_type = utils::spsc_ring<canbus::frame, depth>;
+
+struct ring_queue
+{
+    ring_type ring;
+
+    bool push(canbus::frame const& f)
+    {
+        return ring.push(f);
+    }
+
+    size_t pop(canbus::frame* frames, size_t count)
+    {
+        return ring.pop(frames, count);
+    }
+};
+
+struct kernel_queue
+{
+    StaticQueue_t buffer;
+    uint8_t storage[depth * sizeof(canbus::frame)];
+    QueueHandle_t queue;
+
+    kernel_queue()
+        : queue(xQueueCreateStatic(depth, sizeof(canbus::frame), storage, &buffer))
+    {
+    }
+
+    bool push(canbus::frame const& f)
+    {
+        BaseType_t woken = pdFALSE;
+        return xQueueSendToBackFromISR(queue, &f, &woken) == pdTRUE;
+    }
+
+    size_t pop(canbus::frame* frames, size_t count)
+    {
+        size_t n = 0;
+        while (n < count && xQueueReceive(queue, &frames[n], 0) == pdTRUE)
+        {
+            n++;
+        }
+        return n;
+    }
+};
+
+canbus::frame make_frame(uint32_t seq)
+{
+    canbus::frame f;
+    memset(&f, 0, sizeof(f));
+    f.id = 0x0A5;
+    f.info.dlc = 8;
+    memcpy(f.data.u8, &seq, sizeof(seq));
+    return f;
+}
+
+double elapsed_ns(clock_type::time_point start, uint32_t frames)
+{
+    return std::chrono::duration<double, std::nano>(clock_type::now() - start).count() / frames;
+}
+
+template <typename Queue>
+double same_thread(uint32_t frames)
+{
+    static Queue queue;
+    static canbus::frame out[depth];
+    uint32_t seq = 0;
+    uint32_t checksum = 0;
+
+    clock_type::time_point start = clock_type::now();
+    while (seq < frames)
+    {
+        sim::set_core_id(1);
+        for (uint32_t i = 0; i < burst; i++)
+        {
+            queue.push(make_frame(seq++));
+        }
+
+        sim::set_core_id(0);
+        size_t n = queue.pop(out, depth);
+        for (size_t i = 0; i < n; i++)
+        {
+            checksum += out[i].data.u8[0];
+        }
+    }
+    double ns = elapsed_ns(start, frames);
+
+    // keep the copies
+    if (checksum == 1)
+    {
+        printf("\n");
+    }
+    return ns;
+}
+
+template <typename Queue>
+double two_threads(uint32_t frames)
+{
+    static Queue queue;
+    std::atomic<bool> go(false);
+
+    std::thread producer([&go, frames]() {
+        sim::set_core_id(1);
+        while (!go.load(std::memory_order_acquire))
+        {
+        }
+        for (uint32_t seq = 0; seq < frames; seq++)
+        {
+            canbus::frame f = make_frame(seq);
+            while (!queue.push(f))
+            {
+                std::this_thread::yield();
+            }
+        }
+    });
+
+    sim::set_core_id(0);
+    canbus::frame out[depth];
+    uint32_t received = 0;
+    bool ordered = true;
+
+    clock_type::time_point start = clock_type::now();
+    go.store(true, std::memory_order_release);
+    while (received < frames)
+    {
+        size_t n = queue.pop(out, depth);
+        for (size_t i = 0; i < n; i++)
+        {
+            uint32_t seq;
+            memcpy(&seq, out[i].data.u8, sizeof(seq));
+            ordered = ordered && seq == received;
+            received++;
+        }
+        if (n == 0)
+        {
+            std::this_thread::yield();
+        }
+    }
+    double ns = elapsed_ns(start, frames);
+    producer.join();
+
+    if (!ordered)
+    {
+        fprintf(stderr, "frames out of order\n");
+        exit(EXIT_FAILURE);
+    }
+    return ns;
+}
+
+} // namespace
+
+int main(int argc, char** argv)
+{
+    uint32_t frames = 4000000;
+    if (argc == 3 && strcmp(argv[1], "--frames") == 0)
+    {
+        frames = static_cast<uint32_t>(strtoul(argv[2], nullptr, 0));
+    }
+    else if (argc != 1)
+    {
+        fprintf(stderr, "usage: %s [--frames N]\n", argv[0]);
+        return EXIT_FAILURE;
+    }
+
+    printf("%u frames of %zu bytes, queue depth %u, bursts of %u\n\n", frames, sizeof(canbus::frame), depth, burst);
+    printf("%-14s %14s %14s\n", "", "spsc_ring", "FreeRTOS queue");
+    printf("%-14s %11.1f ns %11.1f ns\n", "same thread", same_thread<ring_queue>(frames),
+        same_thread<kernel_queue>(frames));
+    printf("%-14s %11.1f ns %11.1f ns\n", "two threads", two_threads<ring_queue>(frames),
+        two_threads<kernel_queue>(frames));
+
+    return EXIT_SUCCESS;
+}
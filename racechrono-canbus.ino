@@ -25,6 +25,8 @@
 #include "src/canbus/frame.hpp"
 #include "src/led/led.hpp"
 #include "src/racechrono/device.hpp"
+#include "src/racechrono/pipeline.hpp"
+#include "src/recorder/recorder.hpp"
 
 #include <cstdint>
 
@@ -34,6 +36,12 @@ namespace
 {
 
 constexpr uint32_t core0_stack_size = 6 * 1024;
+#if defined(CONFIG_CANBUS_EVENT_DRIVEN)
+// blocks between batches of frames, so it can run above the idle task
+constexpr UBaseType_t core0_priority = tskIDLE_PRIORITY + 1;
+#else
+constexpr UBaseType_t core0_priority = tskIDLE_PRIORITY;
+#endif
 StaticTask_t core0_buffer;
 StackType_t core0_stack[core0_stack_size];
 TaskHandle_t core0_handle;
@@ -58,8 +66,9 @@ void setup()
     delay(5000);
 #endif
 
-    // set logging level
+    // set logging level, log lines are written to Serial from here on by a low priority task
     logger::get().set_level(log_level::info);
+    logger::get().start();
 
     //
     // ATTENTION:
@@ -74,7 +83,7 @@ void setup()
         "racechrono",
         core0_stack_size,
         nullptr,
-        tskIDLE_PRIORITY,
+        core0_priority,
         core0_stack,
         &core0_buffer,
         0
@@ -84,6 +93,12 @@ void setup()
     // wait for core 0 to start (not strictly necessary)
     while (!core0_started) { delay(100); }
 
+#if defined(CONFIG_RC_RECORDER)
+    // before the controller starts, the interrupt handler records from the first frame.
+    // without a partition or PSRAM the firmware still runs, nothing is recorded
+    RECORDER.start();
+#endif
+
     // setup can-bus on core 1 (default), interrupt handler will be serviced on core 1
     if (CANCTLR.install())
     {
@@ -94,12 +109,14 @@ void setup()
         else
         {
             errorln("ERROR: CAN bus controller startup failed!");
+            logger::get().flush();
             esp_restart();
         }
     }
     else
     {
         errorln("ERROR: CAN bus driver install failed!");
+        logger::get().flush();
         esp_restart();
     }
 }
@@ -110,31 +127,33 @@ namespace
 // core 0 - receive can frames from queue, send over bluetooth le
 void core0(void*)
 {
-    // xQueue copies all data, so we can use a static buffer here
-    static canbus::frame f;
+    // frames are copied out of the queue in bulk, so we can use a static buffer here
+    static canbus::frame frames[CONFIG_CANBUS_QUEUE_LENGTH];
 
     // start up bluetooth le connection
     if (RCDEV.start(&CANDEC))
     {
         core0_started = true;
 
+        // the interrupt handler wakes us when frames are queued (no-op when polling)
+        CANCTLR.set_consumer(xTaskGetCurrentTaskHandle());
+
         while (true)
         {
-            while (CANCTLR.recv(f))
+            CANCTLR.wait();
+
+            size_t count;
+            while ((count = CANCTLR.recv(frames, CONFIG_CANBUS_QUEUE_LENGTH)) > 0)
             {
-#if defined(DEBUG)
-                uint32_t id = f.id;
-                uint8_t len = f.info.dlc;
-                verboseln("PID 0x%03x LEN %u", id, len);
-#endif
-                RCDEV.send(reinterpret_cast<uint8_t*>(&f.id), sizeof(uint32_t) + f.info.dlc);
+                racechrono::forward(frames, count);
             }
-            RCDEV.stats();
+            racechrono::service();
         }
     }
     else
     {
         errorln("ERROR: RaceChrono bluetooth device startup failed!");
+        logger::get().flush();
         esp_restart();
     }
 
@@ -147,6 +166,12 @@ void core0(void*)
 // core 1 - can-bus interrupt handler is running here, but also print some stats
 void loop()
 {
+#if defined(CONFIG_RC_RECORDER)
+    // write recorded frames to flash
+    RECORDER.flush();
+    RECORDER.stats();
+#endif
+
     // print out stats
     CANCTLR.stats();
 }
@@ -20,12 +20,15 @@
 // OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
 // SOFTWARE.
 #include "../racechrono-canbus.hpp"
+#include "../diag/diagnostics.hpp"
+#include "../recorder/recorder.hpp"
 
 #include "decoder.hpp"
 #include "frame.hpp"
 
 #include <esp_intr_alloc.h>
 #include <esp_rom_gpio.h>
+#include <hal/clk_gate_ll.h>
 #include <hal/twai_ll.h>
 #include <driver/periph_ctrl.h>
 
@@ -45,6 +48,43 @@ namespace
 
 twai_dev_t* dev = &TWAI;
 
+#if !SOC_TWAI_SUPPORTS_RX_STATUS
+/**
+ * the ESP32 RX message counter saturates here, see controller::isr()
+ */
+constexpr uint32_t rx_fifo_messages = 64U;
+#endif
+
+/**
+ * interrupts taken: receive, error warning, data overrun, error passive and bus error.
+ * transmit is not needed listen-only, wakeup is for sleep mode, which is not used.
+ */
+constexpr uint32_t enabled_interrupts = TWAI_LL_INTR_RI | TWAI_LL_INTR_EI | TWAI_LL_INTR_DOI
+    | TWAI_LL_INTR_EPI | TWAI_LL_INTR_BEI;
+
+/**
+ * copy the data bytes of the frame in the RX buffer, starting at \p offset
+ */
+__always_inline void read_data(canbus::frame& f, uint8_t offset)
+{
+    // DLC 9..15 still means 8 data bytes
+    if (f.info.dlc > 8)
+    {
+        f.info.dlc = 8;
+    }
+
+    // remote frames carry no data bytes
+    if (f.info.rtr == canbus::frame_rtr::remote)
+    {
+        return;
+    }
+
+    for (uint8_t i = 0; i < f.info.dlc; i++)
+    {
+        f.data.u8[i] = dev->tx_rx_buffer[i+offset].val;
+    }
+}
+
 }
 
 namespace canbus
@@ -53,15 +93,25 @@ namespace canbus
 controller::controller() noexcept
     : _lock(portMUX_INITIALIZER_UNLOCKED)
     , _running(false)
-    , _queue(nullptr)
+    , _timing{}
+    , _filter{}
+    , _queue{}
     , _stats_timer{}
     , _ir_count(0U)
     , _er_count(0U)
     , _cb_count(0U)
     , _rc_count(0U)
+    , _rx_frames(0U)
+    , _overruns(0U)
+    , _resets(0U)
+#if defined(CONFIG_CANBUS_EVENT_DRIVEN)
+    , _consumer(nullptr)
+    , _wake_pending(0U)
+    , _wake_first(0U)
+    , _wakeups(0U)
+    , _stats_wakeups(0U)
+#endif
     , _isr_handle(nullptr)
-    , _queue_storage{}
-    , _static_queue{}
 {
 }
 
@@ -84,14 +134,27 @@ void controller::stats() noexcept
             uint32_t er_count = _er_count.exchange(0UL, std::memory_order_relaxed);
             uint32_t cb_count = _cb_count.exchange(0UL, std::memory_order_relaxed);
             uint32_t rc_count = _rc_count.exchange(0UL, std::memory_order_relaxed);
-            uint32_t waiting = uxQueueMessagesWaiting(_queue);
-            uint32_t available = uxQueueSpacesAvailable(_queue);
+            uint32_t waiting = _queue.size();
+            uint32_t available = _queue.capacity() - waiting;
 
             infoln("       Interrupts/s: %.2f", (static_cast<float>(ir_count) / static_cast<float>(delta)) * 1e6f);
             infoln("           Errors/s: %.2f", (static_cast<float>(er_count) / static_cast<float>(delta)) * 1e6f);
             infoln("      CAN bus msg/s: %.2f", (static_cast<float>(cb_count) / static_cast<float>(delta)) * 1e6f);
             infoln("   RaceChrono msg/s: %.2f", (static_cast<float>(rc_count) / static_cast<float>(delta)) * 1e6f);
             infoln("              Queue: %2u / %2u", waiting, available);
+            infoln("   Queue high water: %2u", _queue.high_water());
+            infoln("   RX FIFO overruns: %u", _overruns.load(std::memory_order_relaxed));
+            infoln("     RX FIFO resets: %u", _resets.load(std::memory_order_relaxed));
+#if defined(CONFIG_CANBUS_EVENT_DRIVEN)
+            uint32_t wakeups = _wakeups.load(std::memory_order_relaxed);
+            infoln("     Task wakeups/s: %.2f", (static_cast<float>(wakeups - _stats_wakeups) / static_cast<float>(delta)) * 1e6f);
+            _stats_wakeups = wakeups;
+#endif
+#if defined(CONFIG_CANBUS_MAILBOX)
+            infoln("   Queue superseded: %u", _queue.drops());
+#else
+            infoln("      Queue dropped: %u", _queue.drops());
+#endif
         }
     }
 }
@@ -103,10 +166,6 @@ bool controller::install() noexcept
 
     ENTER_CRITICAL();
 
-    bootln("CAN bus creating frame queue...");
-    _queue = xQueueCreateStatic(_queue_length, _queue_item_size, _queue_storage, &_static_queue);
-    bootln("CAN bus frame queue created...");
-
     // enable APB CLK to TWAI peripheral
     periph_module_reset(PERIPH_TWAI_MODULE);
     periph_module_enable(PERIPH_TWAI_MODULE);
@@ -118,39 +177,24 @@ bool controller::install() noexcept
         EXIT_CRITICAL();
         return false;
     }
-#if SOC_TWAI_SUPPORT_MULTI_ADDRESS_LAYOUT
-    twai_ll_enable_extended_reg_layout(dev);
-#endif
-    twai_ll_set_mode(dev, TWAI_MODE_LISTEN_ONLY);    // freeze REC by changing to LOM mode
-    // reset RX and TX error counters
-    twai_ll_set_rec(dev, 0);
-    twai_ll_set_tec(dev, 0);
-    twai_ll_set_err_warn_lim(dev, 96);
-
-    bootln("CAN bus mode reset...");
-
-    // configure bus timing, acceptance filter, CLKOUT, and interrupts
-    // get timing and filter from car specific decoder
-    twai_timing_config_t t_config = CANDEC.timing();
-    twai_filter_config_t f_config = CANDEC.filter();
 
-    twai_ll_set_bus_timing(dev, t_config.brp, t_config.sjw, t_config.tseg_1, t_config.tseg_2, t_config.triple_sampling);
-    twai_ll_set_acc_filter(dev, f_config.acceptance_code, f_config.acceptance_mask, f_config.single_filter);
-    twai_ll_set_clkout(dev, 0);
-    // enable interrupts
-    // disable tx interrupts, as we are listen-only
-    // disable data overrun and wakeup interrupts (both have issues on ESP32)
-    twai_ll_set_enabled_intrs(dev, 0xA7); //0xE7);
-    (void) twai_ll_get_and_clear_intrs(dev);    // clear any latched interrupts
+    // get timing and filter from car specific decoder, kept to reconfigure after a peripheral reset
+    _timing = CANDEC.timing();
+    _filter = CANDEC.filter();
+    configure();
+#if defined(CONFIG_RC_DIAGNOSTICS)
+    DIAG.set_timing(_timing);
+#endif
 
     EXIT_CRITICAL();
 
+    bootln("CAN bus mode reset...");
     bootln("CAN bus timings reset...");
-    bootln("          BRP: %3u", t_config.brp);
-    bootln("          SJW: %3u", t_config.sjw);
-    bootln("        TSEG1: %3u", t_config.tseg_1);
-    bootln("        TSEG2: %3u", t_config.tseg_2);
-    bootln("  3x Sampling: %3s", t_config.triple_sampling == 0 ? "No" : "Yes");
+    bootln("          BRP: %3u", _timing.brp);
+    bootln("          SJW: %3u", _timing.sjw);
+    bootln("        TSEG1: %3u", _timing.tseg_1);
+    bootln("        TSEG2: %3u", _timing.tseg_2);
+    bootln("  3x Sampling: %3s", _timing.triple_sampling == 0 ? "No" : "Yes");
 
     // only setup RX pin, we aren't transmitting any CAN messages on bus
     gpio_set_pull_mode(CAN_RX_PIN, GPIO_FLOATING);
@@ -160,7 +204,11 @@ bool controller::install() noexcept
     bootln("CAN bus GPIO pins reset...");
 
     // setup interrupt service routine
+#if defined(CONFIG_CANBUS_ISR_IN_IRAM)
+    esp_intr_alloc(ETS_TWAI_INTR_SOURCE, ESP_INTR_FLAG_LEVEL1 | ESP_INTR_FLAG_IRAM, isr, this, &_isr_handle);
+#else
     esp_intr_alloc(ETS_TWAI_INTR_SOURCE, ESP_INTR_FLAG_LEVEL1, isr, this, &_isr_handle);
+#endif
     bootln("CAN bus interrupt handler installed...");
 
     return true;
@@ -168,9 +216,6 @@ bool controller::install() noexcept
 
 bool controller::uninstall() noexcept
 {
-    ENTER_CRITICAL();
-    vQueueDelete(_queue);
-    EXIT_CRITICAL();
     return true;
 }
 
@@ -178,7 +223,7 @@ bool controller::start() noexcept
 {
     ENTER_CRITICAL();
 
-    xQueueReset(_queue);
+    _queue.clear();
 
     (void) twai_ll_get_and_clear_intrs(dev);    // clear any latched interrupts
     _running = true;
@@ -196,80 +241,334 @@ bool controller::stop() noexcept
     return true;
 }
 
+bool controller::set_filter(twai_filter_config_t const& f) noexcept
+{
+    ENTER_CRITICAL();
+
+    if (f.acceptance_code == _filter.acceptance_code && f.acceptance_mask == _filter.acceptance_mask
+        && f.single_filter == _filter.single_filter)
+    {
+        EXIT_CRITICAL();
+        return true;
+    }
+
+    // acceptance filter registers are only writable in reset mode
+    twai_ll_enter_reset_mode(dev);
+    _filter = f;
+    twai_ll_set_acc_filter(dev, f.acceptance_code, f.acceptance_mask, f.single_filter);
+    if (_running)
+    {
+        twai_ll_exit_reset_mode(dev);
+    }
+
+    EXIT_CRITICAL();
+
+    return true;
+}
+
 bool controller::recv(frame& f) noexcept
 {
-    return _queue ? xQueueReceive(_queue, &f, 0) == pdTRUE : false;
+    return _queue.pop(f);
+}
+
+size_t controller::recv(frame* frames, size_t count) noexcept
+{
+    return _queue.pop(frames, count);
+}
+
+#if defined(CONFIG_CANBUS_EVENT_DRIVEN)
+bool controller::wait() noexcept
+{
+    // a tick is the shortest block, so a quiet bus wakes us after at least the timeout
+    constexpr TickType_t ticks = (CONFIG_CANBUS_WAKE_TIMEOUT / 1000UL + 1UL) / portTICK_PERIOD_MS;
+
+    bool notified = ulTaskNotifyTake(pdTRUE, ticks > 0 ? ticks : 1) > 0;
+
+    // restart the batching window before draining, frames queued from here on wake us again
+    _wake_pending.store(0U, std::memory_order_relaxed);
+
+    return notified;
+}
+#endif
+
+controller::queue_stats controller::queue() const noexcept
+{
+#if defined(CONFIG_CANBUS_EVENT_DRIVEN)
+    uint32_t wakeups = _wakeups.load(std::memory_order_relaxed);
+#else
+    uint32_t wakeups = 0U;
+#endif
+    return { _queue.pushed(), _queue.size(), _queue.high_water(), _queue.drops(), wakeups };
+}
+
+controller::rx_stats controller::rx() const noexcept
+{
+    return { _rx_frames.load(std::memory_order_relaxed), _overruns.load(std::memory_order_relaxed),
+        _resets.load(std::memory_order_relaxed) };
+}
+
+void CANBUS_ISR_ATTR controller::configure() noexcept
+{
+#if SOC_TWAI_SUPPORT_MULTI_ADDRESS_LAYOUT
+    twai_ll_enable_extended_reg_layout(dev);
+#endif
+    twai_ll_set_mode(dev, TWAI_MODE_LISTEN_ONLY);    // freeze REC by changing to LOM mode
+    // reset RX and TX error counters
+    twai_ll_set_rec(dev, 0);
+    twai_ll_set_tec(dev, 0);
+    twai_ll_set_err_warn_lim(dev, 96);
+
+    // configure bus timing, acceptance filter, CLKOUT, and interrupts
+    twai_ll_set_bus_timing(dev, _timing.brp, _timing.sjw, _timing.tseg_1, _timing.tseg_2, _timing.triple_sampling);
+    twai_ll_set_acc_filter(dev, _filter.acceptance_code, _filter.acceptance_mask, _filter.single_filter);
+    twai_ll_set_clkout(dev, 0);
+    twai_ll_set_enabled_intrs(dev, enabled_interrupts);
+    (void) twai_ll_get_and_clear_intrs(dev);    // clear any latched interrupts
+}
+
+#if !SOC_TWAI_SUPPORTS_RX_STATUS
+uint32_t CANBUS_ISR_ATTR controller::clear_overrun(uint32_t count) noexcept
+{
+    uint32_t released = 0U;
+
+    // one counter read per pass, not per frame, frames may still be arriving
+    while (count > 0U)
+    {
+        for (uint32_t i = 0; i < count; i++)
+        {
+            twai_ll_set_cmd_release_rx_buffer(dev);
+        }
+        released += count;
+        count = twai_ll_get_rx_msg_count(dev);
+    }
+    twai_ll_set_cmd_clear_data_overrun(dev);
+
+    return released;
 }
+#endif
 
 void IRAM_ATTR controller::isr(void* arg)
 {
     static_cast<controller*>(arg)->isr();
 }
 
-void controller::isr() noexcept
+void CANBUS_ISR_ATTR controller::isr() noexcept
 {
-    BaseType_t task_woken = pdFALSE;
+    BaseType_t woken = pdFALSE;
 
     ENTER_CRITICAL_ISR();
 
     _ir_count.fetch_add(1, std::memory_order_relaxed);
 
     uint32_t interrupts = twai_ll_get_and_clear_intrs(dev);
-    // uint32_t status = twai_ll_get_status(dev);
-    // uint32_t tec = twai_ll_get_tec(dev);
-    // uint32_t rec = twai_ll_get_rec(dev);
 
-    if (interrupts & TWAI_LL_INTR_RI)
+    if (interrupts & (TWAI_LL_INTR_RI | TWAI_LL_INTR_DOI))
     {
         _cb_count.fetch_add(1, std::memory_order_relaxed);
 
-        // TODO: SOC_TWAI_SUPPORTS_RX_STATUS
+        // one timestamp per interrupt is close enough for rate limiting
+        uint32_t now = static_cast<uint32_t>(micros());
+
+        /*
+         * drain the RX FIFO: take the frames counted, then count again, so frames that arrived
+         * meanwhile are taken in the same interrupt.
+         *
+         * on the ESP32 frames lost to a full RX FIFO are still counted by the RX message counter,
+         * but the RX buffer window no longer moves over valid frames. so status is read once per
+         * pass, and after a data overrun all frames counted are released unread and the overrun
+         * cleared, as ESP-IDF does. once the counter reaches 64 the FIFO is corrupt for good
+         * (ESP32 errata, see ESP-IDF CONFIG_TWAI_ERRATA_FIX_RX_FIFO_CORRUPT) and only a peripheral
+         * reset recovers it.
+         *
+         * the ESP32-S3 (SOC_TWAI_SUPPORTS_RX_STATUS) flags each frame lost to an overrun with the
+         * miss status instead, the frames around it stay valid. only those are released unread.
+         */
         uint32_t msg_count = twai_ll_get_rx_msg_count(dev);
-        for (uint32_t i = 0; i < msg_count; i++)
+        while (msg_count > 0U)
         {
-            frame f;
-            f.info.u8 = dev->tx_rx_buffer[0].val;
-
-            if (f.info.rtr == frame_rtr::remote)
+#if SOC_TWAI_SUPPORTS_RX_STATUS
+            uint32_t missed = 0U;
+#else
+            if (twai_ll_get_status(dev) & TWAI_LL_STATUS_DOS)
             {
-                twai_ll_set_cmd_release_rx_buffer(dev);
-                continue;
+                uint32_t lost;
+                if (msg_count >= rx_fifo_messages)
+                {
+                    // frames past the 64th were not counted, the loss is at least this
+                    lost = msg_count;
+#if defined(CONFIG_CANBUS_ISR_IN_IRAM)
+                    // periph_module_reset() is in flash, this is what it does under its lock
+                    periph_ll_reset(PERIPH_TWAI_MODULE);
+#else
+                    periph_module_reset(PERIPH_TWAI_MODULE);
+#endif
+                    twai_ll_enter_reset_mode(dev);
+                    configure();
+                    twai_ll_exit_reset_mode(dev);
+                    _resets.fetch_add(1, std::memory_order_relaxed);
+                }
+                else
+                {
+                    lost = clear_overrun(msg_count);
+                }
+                _overruns.fetch_add(lost, std::memory_order_relaxed);
+#if defined(CONFIG_RC_DIAGNOSTICS)
+                DIAG.overrun(lost);
+#endif
+                break;
             }
+#endif
 
-            if (f.info.frame_format == frame_format::extended)
+            for (uint32_t i = 0; i < msg_count; i++)
             {
-                twai_ll_set_cmd_release_rx_buffer(dev);
-                continue;
-            }
+#if SOC_TWAI_SUPPORTS_RX_STATUS
+                if (twai_ll_get_status(dev) & TWAI_LL_STATUS_MS)
+                {
+                    twai_ll_set_cmd_release_rx_buffer(dev);
+                    ++missed;
+                    continue;
+                }
+#endif
 
-            f.id = (dev->tx_rx_buffer[1].val << 3) | (dev->tx_rx_buffer[2].val >> 5);
+                frame f;
+                f.info.u8 = dev->tx_rx_buffer[0].val;
+
+#if defined(CONFIG_RC_DIAGNOSTICS)
+                DIAG.rx(f.info);
+#endif
+
+#if !defined(CONFIG_RC_RECORDER)
+                if (f.info.rtr == frame_rtr::remote)
+                {
+                    twai_ll_set_cmd_release_rx_buffer(dev);
+                    continue;
+                }
+#endif
+
+                // standard frames: 2 ID bytes then data, extended frames: 4 ID bytes then data
+                uint8_t offset;
+                if (f.info.frame_format == frame_format::extended)
+                {
+                    f.id = (dev->tx_rx_buffer[1].val << 21) | (dev->tx_rx_buffer[2].val << 13)
+                         | (dev->tx_rx_buffer[3].val << 5) | (dev->tx_rx_buffer[4].val >> 3);
+                    offset = 5;
+                }
+                else
+                {
+                    f.id = (dev->tx_rx_buffer[1].val << 3) | (dev->tx_rx_buffer[2].val >> 5);
+                    offset = 3;
+                }
+                uint32_t id = table_id(f);
+
+#if defined(CONFIG_RC_RECORDER)
+                // the recorder keeps every frame the acceptance filter let through, before decimation
+                read_data(f, offset);
+                RECORDER.record(f, now);
+
+                if (f.info.rtr == frame_rtr::remote)
+                {
+                    twai_ll_set_cmd_release_rx_buffer(dev);
+                    continue;
+                }
+#endif
+
+#if defined(CONFIG_RC_DIAGNOSTICS)
+                // IDs the decoder does not know share the last entry
+                size_t slot = CANDEC.slot(id);
+                if (slot >= CANDEC.count())
+                {
+                    slot = CONFIG_RC_DIAG_IDS;
+                }
+                DIAG.received(slot, id);
+#endif
+
+                if (!CANDEC.should_decode(id, now))
+                {
+                    twai_ll_set_cmd_release_rx_buffer(dev);
+                    continue;
+                }
+
+#if defined(CONFIG_RC_DIAGNOSTICS)
+                DIAG.accepted(slot);
+                uint32_t drops = _queue.drops();
+#endif
+
+#if !defined(CONFIG_RC_RECORDER)
+                read_data(f, offset);
+#endif
+
+#if defined(CONFIG_RC_TRACE)
+                f.ts = now;
+#endif
+
+                // queue counts any drops itself when the consumer falls behind
+#if defined(CONFIG_CANBUS_MAILBOX)
+                if (_queue.push(CANDEC.slot(id), f))
+#else
+                if (_queue.push(f))
+#endif
+                {
+                    _rc_count.fetch_add(1, std::memory_order_relaxed);
+#if defined(CONFIG_CANBUS_EVENT_DRIVEN)
+                    if (_wake_pending.fetch_add(1U, std::memory_order_relaxed) == 0U)
+                    {
+                        _wake_first = now;
+                    }
+#endif
+                }
+
+#if defined(CONFIG_RC_DIAGNOSTICS)
+                // a full queue drops this frame, a mailbox supersedes the previous one of the ID
+                if (_queue.drops() != drops)
+                {
+                    DIAG.dropped(slot);
+                }
+#endif
 
-            if (!CANDEC.should_decode(f.id))
-            {
                 twai_ll_set_cmd_release_rx_buffer(dev);
-                continue;
             }
 
-            // copy data bytes
-            for (uint8_t i = 0; i < f.info.dlc; i++)
+#if SOC_TWAI_SUPPORTS_RX_STATUS
+            if (missed > 0U)
             {
-                f.data.u8[i] = dev->tx_rx_buffer[i+3].val;
+                // the miss status marks the lost frames, the overrun itself needs no recovery
+                twai_ll_set_cmd_clear_data_overrun(dev);
+                _overruns.fetch_add(missed, std::memory_order_relaxed);
+#if defined(CONFIG_RC_DIAGNOSTICS)
+                DIAG.overrun(missed);
+#endif
             }
+            _rx_frames.fetch_add(msg_count - missed, std::memory_order_relaxed);
+#else
+            _rx_frames.fetch_add(msg_count, std::memory_order_relaxed);
+#endif
+            msg_count = twai_ll_get_rx_msg_count(dev);
+        }
 
-            xQueueSendToBackFromISR(_queue, &f, &task_woken);
-            _rc_count.fetch_add(1, std::memory_order_relaxed);
-
-            twai_ll_set_cmd_release_rx_buffer(dev);
+#if defined(CONFIG_CANBUS_EVENT_DRIVEN)
+        // batching window: enough frames, or the oldest one waited long enough
+        uint32_t pending = _wake_pending.load(std::memory_order_relaxed);
+        if (_consumer && pending > 0U
+            && (pending >= CONFIG_CANBUS_WAKE_FRAMES || now - _wake_first >= CONFIG_CANBUS_WAKE_TIMEOUT))
+        {
+            _wake_pending.store(0U, std::memory_order_relaxed);
+            _wakeups.fetch_add(1U, std::memory_order_relaxed);
+            vTaskNotifyGiveFromISR(_consumer, &woken);
         }
+#endif
     }
-    else if (interrupts & (TWAI_LL_INTR_EI | TWAI_LL_INTR_EPI | TWAI_LL_INTR_ALI | TWAI_LL_INTR_BEI))
+
+    if (interrupts & (TWAI_LL_INTR_EI | TWAI_LL_INTR_EPI | TWAI_LL_INTR_ALI | TWAI_LL_INTR_BEI))
     {
         _er_count.fetch_add(1, std::memory_order_relaxed);
+#if defined(CONFIG_RC_DIAGNOSTICS)
+        DIAG.error();
+#endif
     }
 
     EXIT_CRITICAL_ISR();
 
-    if (task_woken == pdTRUE)
+    if (woken == pdTRUE)
     {
         portYIELD_FROM_ISR();
     }
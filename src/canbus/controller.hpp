@@ -23,12 +23,19 @@
 
 #include "../racechrono-canbus.hpp"
 #include "../logging/logging.hpp"
+#include "../utils/mailbox.hpp"
+#include "../utils/ring.hpp"
 #include "../utils/timer.hpp"
 
 #include "frame.hpp"
 
 #include <atomic>
 
+#include <freertos/FreeRTOS.h>
+#include <freertos/task.h>
+#include <hal/twai_types.h>
+#include <soc/soc_caps.h>
+
 namespace canbus
 {
 
@@ -83,11 +90,78 @@ public:
      */
     bool stop() noexcept;
 
+    /**
+     * reprogram the hardware acceptance filter. frames in the RX FIFO are lost
+     * while the controller is briefly put in reset mode, so nothing is done if
+     * \p f is the filter already programmed.
+     */
+    bool set_filter(twai_filter_config_t const& f) noexcept;
+
+#if defined(CONFIG_CANBUS_EVENT_DRIVEN)
+    /**
+     * \p task is woken by the interrupt handler when frames are queued (see wait())
+     */
+    void set_consumer(TaskHandle_t task) noexcept { _consumer = task; }
+
+    /**
+     * block the consumer task until CONFIG_CANBUS_WAKE_FRAMES frames are queued or the
+     * oldest has waited CONFIG_CANBUS_WAKE_TIMEOUT microseconds, or at most the timeout
+     * rounded up to a tick
+     * @return true if woken by the interrupt handler, false on timeout
+     */
+    bool wait() noexcept;
+#else
+    void set_consumer(TaskHandle_t) noexcept {}
+
+    /**
+     * polling consumer, returns immediately
+     */
+    bool wait() noexcept { return true; }
+#endif
+
     /**
      * receive a frame from the internal buffer
      */
     bool recv(frame& f) noexcept;
 
+    /**
+     * receive up to \p count frames from the internal buffer
+     * @return number of frames received
+     */
+    size_t recv(frame* frames, size_t count) noexcept;
+
+    /**
+     * frame queue counters
+     */
+    struct queue_stats
+    {
+        uint32_t pushed;        //!< frames queued since start (free running)
+        uint32_t size;          //!< frames currently queued
+        uint32_t high_water;    //!< most frames queued at once
+        uint32_t drops;         //!< frames dropped because the queue was full (superseded in mailbox mode)
+        uint32_t wakeups;       //!< consumer task notifications sent by the interrupt handler (free running)
+    };
+
+    /**
+     * @return frame queue counters
+     */
+    queue_stats queue() const noexcept;
+
+    /**
+     * RX FIFO counters
+     */
+    struct rx_stats
+    {
+        uint32_t frames;        //!< frames read from the RX FIFO (free running)
+        uint32_t overruns;      //!< frames lost to a full RX FIFO (free running, see isr())
+        uint32_t resets;        //!< peripheral resets to recover a corrupt RX FIFO (free running, ESP32 only)
+    };
+
+    /**
+     * @return RX FIFO counters
+     */
+    rx_stats rx() const noexcept;
+
 private:
     explicit controller() noexcept;
 
@@ -97,10 +171,23 @@ private:
     static void IRAM_ATTR isr(void* arg);
 
     /**
-     * interrupt service handler
+     * interrupt service handler, in IRAM with CONFIG_CANBUS_ISR_IN_IRAM as everything it calls
      */
     void isr() noexcept;
 
+    /**
+     * program bus timing, acceptance filter and interrupts, in reset mode
+     */
+    void configure() noexcept;
+
+#if !SOC_TWAI_SUPPORTS_RX_STATUS
+    /**
+     * release the \p count frames in the RX FIFO after a data overrun, and any arriving meanwhile
+     * @return number of frames released
+     */
+    uint32_t clear_overrun(uint32_t count) noexcept;
+#endif
+
     __always_inline void ENTER_CRITICAL() noexcept { portENTER_CRITICAL(&_lock); }
     __always_inline void EXIT_CRITICAL() noexcept { portEXIT_CRITICAL(&_lock); }
     __always_inline void ENTER_CRITICAL_ISR() noexcept { portENTER_CRITICAL_ISR(&_lock); }
@@ -109,17 +196,29 @@ private:
 private:
     portMUX_TYPE _lock;
     bool _running;
-    QueueHandle_t _queue;
+    twai_timing_config_t _timing;
+    twai_filter_config_t _filter;
+#if defined(CONFIG_CANBUS_MAILBOX)
+    utils::mailbox<frame, CONFIG_CANBUS_MAILBOX_SLOTS> _queue;
+#else
+    utils::spsc_ring<frame, CONFIG_CANBUS_QUEUE_LENGTH> _queue;
+#endif
     utils::timer _stats_timer;
     std::atomic<uint32_t> _ir_count;
     std::atomic<uint32_t> _er_count;
     std::atomic<uint32_t> _cb_count;
     std::atomic<uint32_t> _rc_count;
+    std::atomic<uint32_t> _rx_frames;
+    std::atomic<uint32_t> _overruns;
+    std::atomic<uint32_t> _resets;
+#if defined(CONFIG_CANBUS_EVENT_DRIVEN)
+    TaskHandle_t _consumer;
+    std::atomic<uint32_t> _wake_pending;    // frames queued since the consumer last woke
+    uint32_t _wake_first;                   // time the first of them was queued
+    std::atomic<uint32_t> _wakeups;
+    uint32_t _stats_wakeups;
+#endif
     intr_handle_t _isr_handle;
-    static constexpr uint32_t _queue_length = 8;
-    static constexpr uint32_t _queue_item_size = sizeof(canbus::frame);
-    uint8_t _queue_storage[_queue_length * _queue_item_size];
-    StaticQueue_t _static_queue;
 };
 
 } // namespace canbus
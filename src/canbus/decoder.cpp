@@ -20,29 +20,165 @@
 // OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
 // SOFTWARE.
 #include "../racechrono-canbus.hpp"
+#include "../diag/diagnostics.hpp"
 #include "../logging/logging.hpp"
 
 #include <algorithm>
+#include <cstring>
+
+#include <esp_heap_caps.h>
+
+#include "controller.hpp"
+#include "filter.hpp"
 
 #include "decoder.hpp"
 
 namespace canbus
 {
 
-decoder::decoder(size_t size) noexcept
-    : _ids(new ID[size])
+namespace
+{
+
+/**
+ * std::lower_bound over the \p n sorted IDs at \p first, inlined so the interrupt handler
+ * does not call out of IRAM (CONFIG_CANBUS_ISR_IN_IRAM)
+ */
+template <typename Entry>
+__always_inline Entry* lower_bound(Entry* first, size_t n, uint32_t id) noexcept
+{
+    while (n > 0)
+    {
+        size_t half = n / 2;
+        if (first[half].id < id)
+        {
+            first += half + 1;
+            n -= half + 1;
+        }
+        else
+        {
+            n = half;
+        }
+    }
+    return first;
+}
+
+} // namespace
+
+namespace detail
+{
+
+bool id_hash::build(uint32_t const* ids, uint8_t const* slots, size_t count) noexcept
+{
+    heap_caps_free(_slots);
+    _slots = nullptr;
+
+    if (count == 0)
+    {
+        return true;
+    }
+
+    // start at a load factor of at most 1/2 and grow the table if no multiplier is collision free
+    uint32_t bits = 1;
+    while ((1U << bits) < 2 * count)
+    {
+        bits++;
+    }
+
+    for (; bits <= 12; bits++)
+    {
+        size_t buckets = 1U << bits;
+        // internal RAM, the interrupt handler reads it (with the cache disabled, see CONFIG_CANBUS_ISR_IN_IRAM)
+        uint8_t* table = static_cast<uint8_t*>(heap_caps_malloc(buckets, MALLOC_CAP_INTERNAL | MALLOC_CAP_8BIT));
+        if (!table)
+        {
+            return false;
+        }
+
+        for (uint32_t attempt = 0; attempt < 64; attempt++)
+        {
+            // odd multipliers spread around the golden ratio
+            uint32_t mult = (0x9E3779B1U + attempt * 0x6A09E666U) | 1U;
+            uint32_t shift = 32 - bits;
+
+            std::fill(table, table + buckets, no_slot);
+
+            size_t i = 0;
+            for (; i < count; i++)
+            {
+                uint8_t& bucket = table[(ids[i] * mult) >> shift];
+                if (bucket != no_slot)
+                {
+                    break;
+                }
+                bucket = slots[i];
+            }
+
+            if (i == count)
+            {
+                _slots = table;
+                _mult = mult;
+                _shift = shift;
+                return true;
+            }
+        }
+
+        heap_caps_free(table);
+    }
+
+    return false;
+}
+
+} // namespace detail
+
+decoder::decoder(ID* ids, size_t size, uint8_t const* index) noexcept
+    : _ids(ids)
     , _size(size)
+    , _index(index)
+    , _stats_timer{}
+    , _filter_dirty(false)
 {
 }
 
 decoder::~decoder() noexcept
 {
-    delete[] _ids;
+}
+
+void decoder::index_ids() noexcept
+{
+    // id tables are bounded by the 8-bit slot index
+    uint32_t ids[detail::no_slot];
+    uint8_t slots[detail::no_slot];
+    size_t count = 0;
+
+    for (size_t i = 0; i < size() && i < detail::no_slot; i++)
+    {
+        if (!_index || _ids[i].id >= detail::standard_id_count)
+        {
+            ids[count] = _ids[i].id;
+            slots[count] = static_cast<uint8_t>(i);
+            count++;
+        }
+    }
+
+    // if no hash is found find() falls back to a binary search
+    _hash.build(ids, slots, count);
 }
 
 twai_filter_config_t decoder::filter() const noexcept
 {
-    return TWAI_FILTER_CONFIG_ACCEPT_ALL();
+    // id tables are bounded by the 8-bit slot index
+    uint32_t ids[detail::no_slot];
+    size_t count = 0;
+
+    for (size_t i = 0; i < size() && count < detail::no_slot; i++)
+    {
+        if (_ids[i].rate != rate_disabled)
+        {
+            ids[count++] = _ids[i].id;
+        }
+    }
+
+    return plan_filter(ids, count);
 }
 
 bool decoder::can_decode(uint32_t id) const noexcept
@@ -50,7 +186,7 @@ bool decoder::can_decode(uint32_t id) const noexcept
     return find(id) != cend();
 }
 
-bool decoder::should_decode(uint32_t id) noexcept
+bool CANBUS_ISR_ATTR decoder::should_decode(uint32_t id, uint32_t now) noexcept
 {
     auto entry = find(id);
 
@@ -68,39 +204,141 @@ bool decoder::should_decode(uint32_t id) noexcept
 
     ++(entry->n);
 
-    // if we hit our interval for this id, let's decode one
-    if (entry->n >= entry->rate)
+    // default rate divisor caps how often this id is decoded
+    if (entry->n < entry->rate)
+    {
+        return false;
+    }
+
+    if (entry->interval > 0)
+    {
+        // interval requested by RaceChrono not elapsed yet, the first frame
+        // after the deadline (the newest one) will be decoded instead
+        if (static_cast<int32_t>(now - entry->deadline) < 0)
+        {
+            entry->n = entry->rate;
+            return false;
+        }
+
+        // schedule from the previous deadline so jitter does not accumulate,
+        // unless we fell more than an interval behind
+        entry->deadline += entry->interval;
+        if (static_cast<int32_t>(now - entry->deadline) >= 0)
+        {
+            entry->deadline = now + entry->interval;
+        }
+    }
+
+    entry->n = 0;
+    return true;
+}
+
+bool decoder::should_send(frame const& f, uint32_t now) noexcept
+{
+#if defined(CONFIG_RC_PACKED_SIGNALS)
+    if (!forward(table_id(f)))
+    {
+        return false;
+    }
+#endif
+
+#if defined(CONFIG_RC_SUPPRESS_UNCHANGED)
+    auto entry = find(table_id(f));
+    if (entry == end())
     {
-        entry->n = 0;
         return true;
     }
 
-    return false;
+    ++(entry->checked);
+
+    // unsigned age, so a clock wrap only sends one frame early
+    if (entry->sent_dlc == f.info.dlc
+        && memcmp(entry->sent, f.data.u8, f.info.dlc) == 0
+        && now - entry->sent_at < CONFIG_RC_SUPPRESS_MAX_AGE)
+    {
+        ++(entry->unchanged);
+#if defined(CONFIG_RC_DIAGNOSTICS)
+        DIAG.suppressed(static_cast<size_t>(entry - begin()));
+#endif
+        return false;
+    }
+
+    entry->sent_at = now;
+    entry->sent_dlc = f.info.dlc;
+    memcpy(entry->sent, f.data.u8, f.info.dlc);
+#else
+    (void) f;
+    (void) now;
+#endif
+
+    return true;
+}
+
+#if defined(DEBUG)
+void decoder::stats() noexcept
+{
+#if defined(CONFIG_RC_SUPPRESS_UNCHANGED)
+    if (logging::logger::get().level() >= logging::log_level::info)
+    {
+        unsigned long delta = _stats_timer.elapsed(CONFIG_RC_STATS_TIMEOUT);
+
+        if (delta > 0UL)
+        {
+            infoln("   ID    checked/s  unchanged");
+            for (size_t i = 0; i < size(); i++)
+            {
+                ID& entry = _ids[i];
+                uint32_t checked = exchange(entry.checked, 0U);
+                uint32_t unchanged = exchange(entry.unchanged, 0U);
+                if (checked > 0U)
+                {
+                    infoln("%5x  %11.2f  %8.1f%%", entry.id,
+                        (static_cast<float>(checked) / static_cast<float>(delta)) * 1e6f,
+                        (static_cast<float>(unchanged) / static_cast<float>(checked)) * 100.0f);
+                }
+            }
+        }
+    }
+#endif
 }
+#endif
 
 void decoder::deny_all() noexcept
 {
     for (size_t i = 0; i < size(); i++)
     {
         _ids[i].rate = rate_disabled;
+        _ids[i].interval = 0;
     }
 }
 
-void decoder::allow_all() noexcept
+void decoder::allow_all(uint32_t interval) noexcept
 {
+    uint32_t now = static_cast<uint32_t>(micros());
+
     for (size_t i = 0; i < size(); i++)
     {
+        _ids[i].interval = interval;
+        _ids[i].deadline = now;
         _ids[i].rate = rate(_ids[i].id);
+#if defined(CONFIG_RC_SUPPRESS_UNCHANGED)
+        _ids[i].sent_dlc = no_payload;
+#endif
     }
 }
 
-void decoder::allow_id(uint32_t id) noexcept
+void decoder::allow_id(uint32_t id, uint32_t interval) noexcept
 {
     auto entry = find(id);
 
     if (entry != end())
     {
+        entry->interval = interval;
+        entry->deadline = static_cast<uint32_t>(micros());
         entry->rate = rate(id);
+#if defined(CONFIG_RC_SUPPRESS_UNCHANGED)
+        entry->sent_dlc = no_payload;
+#endif
     }
 }
 
@@ -119,7 +357,6 @@ void decoder::onWrite(BLECharacteristic* characteristic)
 
     debugln("ID request CMD %u LEN %u", command, len);
 
-    // NOTE: currently ignoring notify interval from RaceChrono app
     switch (command)
     {
         case 0:
@@ -134,27 +371,62 @@ void decoder::onWrite(BLECharacteristic* characteristic)
             {
                 uint16_t notifyIntervalMs = data[1] << 8 | data[2];
                 verboseln("ID request ALLOW all INTERVAL %u ms", notifyIntervalMs);
-                allow_all();
+                allow_all(notifyIntervalMs * 1000UL);
             }
             break;
         case 2:
             if (len == 7)
             {
                 uint16_t notifyIntervalMs = data[1] << 8 | data[2];
-                uint32_t id = data[3] << 24 | data[4] << 16 | data[5] << 8 | data[6];
-                verboseln("ID request ALLOW ID %u INTERVAL %u ms", id, notifyIntervalMs);
-                allow_id(id);
+                // standard or extended (29-bit) ID, big endian. the request has no frame format: an ID
+                // a standard frame cannot carry is extended, bit 31 asks for an extended ID below 0x800
+                uint32_t id = uint32_t(data[3]) << 24 | uint32_t(data[4]) << 16 | uint32_t(data[5]) << 8 | data[6];
+                if (id >= detail::standard_id_count)
+                {
+                    id = extended_id(id);
+                }
+                verboseln("ID request ALLOW ID 0x%x INTERVAL %u ms", id, notifyIntervalMs);
+                allow_id(id, notifyIntervalMs * 1000UL);
             }
             break;
         default:
             warnln("ID request UNKNOWN CMD %u", command);
-            break;
+            return;
     }
+
+    // planned and programmed by the Bluetooth LE task, once for a burst of requests
+    _filter_dirty.store(true, std::memory_order_release);
+}
+
+void decoder::update_filter() noexcept
+{
+    if (!_filter_dirty.exchange(false, std::memory_order_acquire))
+    {
+        return;
+    }
+
+    // only interrupt on what RaceChrono wants now
+    twai_filter_config_t f = filter();
+    debugln("ID request FILTER code 0x%08x mask 0x%08x %s", f.acceptance_code, f.acceptance_mask,
+        f.single_filter ? "single" : "dual");
+    CANCTLR.set_filter(f);
 }
 
-decoder::ID* decoder::find(uint32_t id) noexcept
+decoder::ID* CANBUS_ISR_ATTR decoder::find(uint32_t id) noexcept
 {
-    auto entry = std::lower_bound(begin(), end(), id);
+    if (RCLIKELY(_index && id < detail::standard_id_count))
+    {
+        uint8_t slot = _index[id];
+        return slot != detail::no_slot ? _ids + slot : end();
+    }
+
+    if (RCLIKELY(_hash))
+    {
+        uint8_t slot = _hash.find(id);
+        return slot != detail::no_slot && _ids[slot].id == id ? _ids + slot : end();
+    }
+
+    auto entry = lower_bound(begin(), size(), id);
     if (entry != end() && entry->id == id)
     {
         return entry;
@@ -162,9 +434,21 @@ decoder::ID* decoder::find(uint32_t id) noexcept
     return end();
 }
 
-decoder::ID const* decoder::find(uint32_t id) const noexcept
+decoder::ID const* CANBUS_ISR_ATTR decoder::find(uint32_t id) const noexcept
 {
-    auto entry = std::lower_bound(cbegin(), cend(), id);
+    if (RCLIKELY(_index && id < detail::standard_id_count))
+    {
+        uint8_t slot = _index[id];
+        return slot != detail::no_slot ? _ids + slot : cend();
+    }
+
+    if (RCLIKELY(_hash))
+    {
+        uint8_t slot = _hash.find(id);
+        return slot != detail::no_slot && _ids[slot].id == id ? _ids + slot : cend();
+    }
+
+    auto entry = lower_bound(cbegin(), size(), id);
     if (entry != cend() && entry->id == id)
     {
         return entry;
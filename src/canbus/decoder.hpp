@@ -22,7 +22,12 @@
 #pragma once
 
 #include "../racechrono-canbus.hpp"
+#include "../utils/timer.hpp"
 
+#include "frame.hpp"
+#include "id_index.hpp"
+
+#include <atomic>
 #include <type_traits>
 
 #include <hal/twai_types.h>
@@ -32,14 +37,39 @@ namespace canbus
 {
 
 
+/**
+ * output priority class of an ID, see CONFIG_RC_SCHEDULER
+ */
+enum class priority : uint8_t
+{
+    high,       //!< high dynamics channels (RPM, pedals, brakes, accelerations), keep their rate
+    normal,
+    low,        //!< slow channels (temperatures, fuel), degrade first under congestion
+};
+
+/// number of priority classes
+constexpr size_t priority_count = 3;
+
 namespace detail
 {
 
 struct ID
 {
-    uint32_t id;    // CAN bus ID
-    uint16_t rate;  // rate of IDs to record
-    uint16_t n;     // number of times seen ID
+    uint32_t id;        // CAN bus ID
+    uint16_t rate;      // rate of IDs to record
+    uint16_t n;         // number of times seen ID
+    uint32_t interval;  // minimum time between decoded frames in microseconds, 0 = no limit
+    uint32_t deadline;  // earliest time (micros) the next frame may be decoded
+#if defined(CONFIG_RC_SUPPRESS_UNCHANGED)
+    uint32_t sent_at;   // time (micros) the last frame was sent
+    uint32_t checked;   // frames checked for changes since the last stats
+    uint32_t unchanged; // ...of which suppressed
+    uint8_t sent_dlc;   // payload of the last frame sent, no_payload if none yet
+    uint8_t sent[8];
+#endif
+#if defined(CONFIG_RC_PACKED_SIGNALS)
+    bool packs;         // a signal of the ID feeds a packed signal frame
+#endif
 
     bool operator==(ID const& rhs) const noexcept
     {
@@ -85,6 +115,9 @@ protected:
 
     static constexpr uint16_t rate_disabled = 0;
     static constexpr uint16_t rate_default = 1;
+#if defined(CONFIG_RC_SUPPRESS_UNCHANGED)
+    static constexpr uint8_t no_payload = 0xFF;
+#endif
 
 public:
     virtual ~decoder() noexcept;
@@ -96,12 +129,20 @@ public:
     virtual twai_timing_config_t timing() const noexcept = 0;
 
     /**
-     * override this to use the CAN-bus controller built-in hardware filter. The default
-     * behavior is to accept all CAN-bus frames.
+     * CAN-bus controller built-in hardware filter. The default behavior is the tightest
+     * filter covering the IDs RaceChrono currently has enabled (see plan_filter()), and
+     * the controller is reprogrammed by update_filter() whenever that filter changes.
      * @see https://docs.espressif.com/projects/esp-idf/en/latest/esp32/api-reference/peripherals/twai.html#acceptance-filter
      */
     virtual twai_filter_config_t filter() const noexcept;
 
+    /**
+     * plan the filter again and reprogram the controller with it, if RaceChrono wrote ID
+     * requests since the last call. the Bluetooth LE task calls this once per pass, so a
+     * burst of requests is planned once and the controller only reset if the filter changed.
+     */
+    void update_filter() noexcept;
+
     /**
      * @return true is \p id can be decoded
      */
@@ -109,20 +150,112 @@ public:
 
     /**
      * should an \p id be decoded? the decoder must know how to decode the id
-     * and the rate limit must be triggered as well.
+     * and the rate limit must be triggered as well. \p now is the current time
+     * in microseconds, used for the interval requested by RaceChrono.
      * @return true is \p id should be decoded
      */
-    bool should_decode(uint32_t id) noexcept;
+    bool should_decode(uint32_t id, uint32_t now) noexcept;
+
+    /**
+     * @return position of \p id in the decoder ID table, or a value not less than the
+     * number of IDs if the id is unknown
+     */
+    __always_inline size_t slot(uint32_t id) const noexcept
+    {
+        return static_cast<size_t>(find(id) - cbegin());
+    }
+
+    /**
+     * @return number of IDs in the decoder ID table
+     */
+    __always_inline size_t count() const noexcept
+    {
+        return _size;
+    }
+
+    /**
+     * should decoded frame \p f be sent to RaceChrono as it is? not if it is only decoded
+     * for packed signal frames, or its payload has not changed since the last frame sent
+     * (see CONFIG_RC_SUPPRESS_UNCHANGED). \p now is the current time in microseconds.
+     */
+    bool should_send(frame const& f, uint32_t now) noexcept;
+
+    /**
+     * print any decoder stats
+     */
+#if defined(DEBUG)
+    void stats() noexcept;
+#else
+    void stats() noexcept {}
+#endif
+
+    /**
+     * @return output priority class of \p id
+     */
+    virtual priority priority_of(uint32_t id) const noexcept
+    {
+        (void) id;
+        return priority::normal;
+    }
+
+#if defined(CONFIG_RC_PACKED_SIGNALS)
+    /**
+     * @return true if RaceChrono wants frames of \p id as they are. IDs only enabled as
+     * the source of packed signal frames are decoded but not forwarded.
+     */
+    virtual bool forward(uint32_t id) const noexcept
+    {
+        (void) id;
+        return true;
+    }
+
+    /**
+     * @return true if a signal of decoded frame \p f feeds a packed signal frame, only then
+     * is pack() worth calling
+     */
+    __always_inline bool packs(frame const& f) const noexcept
+    {
+        ID const* entry = find(table_id(f));
+        return entry != cend() && entry->packs;
+    }
+
+    /**
+     * extract the signals of decoded frame \p f into the packed signal frames it feeds.
+     * @return number of packed frames due now, \p out points to them until the next call
+     */
+    virtual size_t pack(frame const& f, frame*& out) noexcept
+    {
+        (void) f;
+        (void) out;
+        return 0;
+    }
+#endif
 
 protected:
-    explicit decoder(size_t size) noexcept;
+    /**
+     * \p ids is the sub-class owned (static) storage for \p size IDs, sorted by ID.
+     * \p index maps each standard ID directly to its slot in the ID table (see detail::id_index).
+     * IDs it does not cover (extended IDs, or all of them if null) are looked up through a
+     * hash built by index_ids().
+     */
+    explicit decoder(ID* ids, size_t size, uint8_t const* index = nullptr) noexcept;
+
+    /**
+     * build the lookup for IDs the direct index does not cover, sub-classes call this
+     * once the ID table is filled in.
+     */
+    void index_ids() noexcept;
 
-    void deny_all() noexcept;
+    virtual void deny_all() noexcept;
 
-    void allow_all() noexcept;
+    virtual void allow_all(uint32_t interval) noexcept;
 
-    void allow_id(uint32_t id) noexcept;
+    virtual void allow_id(uint32_t id, uint32_t interval) noexcept;
 
+    /**
+     * default rate divisor for \p id, decode one of every rate frames. this also caps
+     * the rate when RaceChrono requests a notify interval.
+     */
     virtual uint16_t rate(uint32_t id) const noexcept = 0;
 
     __always_inline size_t size() const noexcept
@@ -162,8 +295,12 @@ private:
     void onWrite(BLECharacteristic* pCharacteristic) override;
 
 protected:
-    ID* _ids; // not using std::vector as it seemed broken on most arduino libc++ implementations...
+    ID* _ids; // storage owned by the sub-class, no heap allocation
     size_t _size;
+    uint8_t const* _index;
+    detail::id_hash _hash;
+    utils::timer _stats_timer;
+    std::atomic<bool> _filter_dirty;    // ID requests written since the last update_filter()
 };
 
 } // namespace canbus
@@ -21,147 +21,64 @@
 // SOFTWARE.
 #include "../racechrono-canbus.hpp"
 
-#include "decoder.hpp"
+#include "vehicle.hpp"
 
 namespace canbus
 {
 
 /**
- * decode for BMW g8x series vehicles.
- * 
+ * BMW g8x series vehicles.
+ *
  * Spreadsheet of g8x CAN-bus signals, data formats, units, formulas (factors + offsets)
  * https://docs.google.com/spreadsheets/d/1O491j8jlEOYR6voFPAYZ2NpbNyCKAgqbxt4HVw0bSDA/edit?usp=sharing
  */
-class decoder_bmwg8x
-    : public decoder
+struct bmwg8x
 {
-    CPP_NOCOPY(decoder_bmwg8x);
-    CPP_NOMOVE(decoder_bmwg8x);
+    static constexpr uint32_t bitrate = 500000;
 
-public:
-    static decoder_bmwg8x& get() noexcept
-    {
-        static decoder_bmwg8x instance;
-        return instance;
-    }
+    // IDs to forward, their default rate divisor and output priority, in any order
+    static constexpr vehicle::message messages[] = {
+        { 0x0A5, 3, priority::high },    // RPM - 100hz
+        { 0x0D9, 3, priority::high },    // THROTTLE (%) / ACCELERATOR PEDAL (%) - 100hz
+        { 0x0EF, 2, priority::high },    // BRAKE PRESSURE - 50hz
+        { 0x173, 2, priority::normal },  // ABS / ASC
+        { 0x199, 2, priority::high },    // LONGITUDINAL ACCELERATION - 50hz
+        { 0x19A, 2, priority::high },    // LATERAL ACCELERATION - 50hz
+        { 0x19F, 2, priority::high },    // YAW RATE - 50hz
+        { 0x1A1, 2, priority::high },    // SPEED - 50hz
+        { 0x281, 1, priority::low },     // BATTERY VOLTAGE
+        { 0x2C4, 1, priority::low },     // FUEL RAW
+        { 0x2CA, 1, priority::low },     // AIR_TEMP - 1hz
+        { 0x301, 1, priority::normal },  // STEERING ANGLE - 5hz
+        // STEERING ANGLE - 25hz (301 vs 302 both contain angle like units, 301 is steering on F-series)
+        // { 0x302, 1, priority::normal },
+        { 0x330, 1, priority::low },     // FUEL USED, FUEL LAMP, FUEL RANGE
+        { 0x3F9, 1, priority::low },     // GEAR, OIL_TEMP, WATER_TEMP - 1hz, gear changes trigger immediate update
+    };
 
-    ~decoder_bmwg8x() noexcept override
-    {
-    }
+    static constexpr vehicle::signal signals[] = {
+        { 0x0A5, "rpm",         40, 16, vehicle::byte_order::little, false, 0.25f,     0.0f,    "rpm"   },
+        { 0x0D9, "throttle",    16, 12, vehicle::byte_order::little, false, 0.025f,    0.0f,    "%"     },
+        { 0x199, "accel_long",  16, 16, vehicle::byte_order::little, false, 0.002f,    -65.0f,  "m/s2"  },
+        { 0x19A, "accel_lat",   16, 16, vehicle::byte_order::little, false, 0.002f,    -65.0f,  "m/s2"  },
+        { 0x19F, "yaw_rate",    16, 16, vehicle::byte_order::little, false, 0.005f,    -163.84f, "deg/s" },
+        { 0x1A1, "speed",       16, 16, vehicle::byte_order::little, false, 0.015625f, 0.0f,    "km/h"  },
+        { 0x2CA, "air_temp",     0,  8, vehicle::byte_order::little, false, 0.5f,      -40.0f,  "C"     },
+        { 0x3F9, "water_temp",  32,  8, vehicle::byte_order::little, false, 1.0f,      -48.0f,  "C"     },
+        { 0x3F9, "oil_temp",    40,  8, vehicle::byte_order::little, false, 1.0f,      -48.0f,  "C"     },
+    };
 
-    twai_timing_config_t timing() const noexcept override
-    {
-        return TWAI_TIMING_CONFIG_500KBITS();
-    }
-
-    twai_filter_config_t filter() const noexcept override
-    {
-        // TODO: test this filter out
-        //
-        //   ID 0x0?? - 0000 0000 0000
-        //   ID 0x1?? - 0001 0000 0000
-        //   ID 0x2?? - 0010 0000 0000
-        //   ID 0x3?? - 0011 0000 0000
-        // MASK 0x400 - 0100 0000 0000
-        //              X0XX XXXX XXXX
-        //   X == wildcard / do not care
-        //
-        // use hardware filter to trim down overall messages
-        // allow 0x000 to 0x3FF and the second filter allow none 0x000
-        return { .acceptance_code = (0x000 << 21) | (0x000 << 5),
-                 .acceptance_mask = ~((0x400 << 21) | (0x7ff << 5)),
-                 .single_filter = false };
-
-        // return TWAI_FILTER_CONFIG_ACCEPT_ALL();
-    }
-
-    uint16_t rate(uint32_t pid) const noexcept override
-    {
-        switch (pid)
-        {
-            // RPM - 100hz
-            case 0x0A5:
-                return 3;
-            // THROTTLE (%) / ACCELERATOR PEDAL (%) - 100hz
-            case 0x0D9:
-                return 3;
-            // BRAKE PRESSURE - 50hz
-            case 0x0EF:
-                return 2;
-            // ABS / ASC
-            case 0x173:
-                return 2;
-            // LONGITUDINAL ACCELERATION - 50hz
-            case 0x199:
-                return 2;
-            // LATERAL ACCELERATION - 50hz
-            case 0x19A:
-                return 2;
-            // YAW RATE - 50hz
-            case 0x19F:
-                return 2;
-            // SPEED - 50hz
-            case 0x1A1:
-                return 2;
-            // BATTERY VOLTAGE
-            case 0x281:
-                return 1;
-            // Fuel
-            case 0x2C4:
-                return 1;
-            // AIR_TEMP - 1hz
-            case 0x2CA:
-                return 1;
-            // STEERING ANGLE - 5hz
-            case 0x301:
-                return 1;
-            // Fuel Used, Fuel Indicator Lamp, Fuel Range
-            case 0x330:
-                return 1;
-            // STEERING ANGLE - 25hz (301 vs 302 both contain angle like units, 301 is steering on F-series)
-            // case 0x302:
-            //     return 1;
-            // GEAR, WATER_TEMP, OIL_TEMP, Max RPM - 1hz
-            // gear changes trigger immediate update
-            case 0x3F9:
-                return 1;
-            default:
-                return rate_default;
-        }
-    }
+    // sent with every RPM frame: rpm bits 0-15, throttle 16-27, accel_long 28-43, accel_lat 44-59
+    static constexpr vehicle::packed_frame packed_frames[] = {
+        { 0x700, { "rpm", "throttle", "accel_long", "accel_lat" } },
+    };
+};
 
-private:
-    explicit decoder_bmwg8x() noexcept
-        : decoder(14)
-    {
-        // pre-sorted list of pids
-        // list must be sorted by ID, as binary search is used
-        // easy enough to pre-sort this list here
-        size_t idx = 0;
-        _ids[idx++] = { 0x0A5, rate_disabled, 0 }; // RPM
-        _ids[idx++] = { 0x0D9, rate_disabled, 0 }; // THROTTLE
-        _ids[idx++] = { 0x0EF, rate_disabled, 0 }; // BRAKE PRESSURE
-        _ids[idx++] = { 0x173, rate_disabled, 0 }; // ABS / ASC
-        _ids[idx++] = { 0x199, rate_disabled, 0 }; // LONGITUDINAL ACCELERATION
-        _ids[idx++] = { 0x19A, rate_disabled, 0 }; // LATERAL ACCELERATION
-        _ids[idx++] = { 0x19F, rate_disabled, 0 }; // YAW RATE
-        _ids[idx++] = { 0x1A1, rate_disabled, 0 }; // SPEED
-        _ids[idx++] = { 0x281, rate_disabled, 0 }; // BATTERY VOLTAGE
-        _ids[idx++] = { 0x2C4, rate_disabled, 0 }; // FUEL RAW
-        _ids[idx++] = { 0x2CA, rate_disabled, 0 }; // AIR_TEMP
-        _ids[idx++] = { 0x301, rate_disabled, 0 }; // STEERING ANGLE
-        _ids[idx++] = { 0x330, rate_disabled, 0 }; // FUEL USED, FUEL LAMP, FUEL RANGE
-        _ids[idx++] = { 0x3F9, rate_disabled, 0 }; // GEAR, OIL_TEMP, WATER_TEMP (alternative)
+constexpr vehicle::message bmwg8x::messages[];
+constexpr vehicle::signal bmwg8x::signals[];
+constexpr vehicle::packed_frame bmwg8x::packed_frames[];
 
-        // make sure pids are in sorted order
-        uint32_t id = 0;
-        for (size_t i = 0; i < idx; i++)
-        {
-            RCASSERT(id < _ids[i].id);
-            id = _ids[i].id;
-        }
-    }
-};
+using decoder_bmwg8x = vehicle_decoder<bmwg8x>;
 
 } // namespace canbus
 
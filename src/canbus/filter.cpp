@@ -0,0 +1,58 @@
+// MIT License
+//
+// Copyright (c) 2022 Joe Roback <joe.roback@gmail.com>
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+#include "../racechrono-canbus.hpp"
+
+#include "filter.hpp"
+
+namespace canbus
+{
+
+using detail::filter_plan::extended_id_bits;
+using detail::filter_plan::id_bits;
+
+bool filter_accepts(twai_filter_config_t const& filter, uint32_t id, bool extended) noexcept
+{
+    uint32_t code = filter.acceptance_code;
+    uint32_t mask = filter.acceptance_mask;
+
+    if (extended)
+    {
+        if (filter.single_filter)
+        {
+            return (((id << 3) ^ code) & ~mask & (extended_id_bits << 3)) == 0;
+        }
+
+        uint32_t high = (id >> 13) & 0xFFFF;
+        return (((high << 16) ^ code) & ~mask & 0xFFFF0000) == 0
+            || ((high ^ code) & ~mask & 0x0000FFFF) == 0;
+    }
+
+    if (filter.single_filter)
+    {
+        return (((id << 21) ^ code) & ~mask & (id_bits << 21)) == 0;
+    }
+
+    return (((id << 21) ^ code) & ~mask & (id_bits << 21)) == 0
+        || (((id << 5) ^ code) & ~mask & (id_bits << 5)) == 0;
+}
+
+} // namespace canbus
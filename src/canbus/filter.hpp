@@ -0,0 +1,246 @@
+// MIT License
+//
+// Copyright (c) 2022 Joe Roback <joe.roback@gmail.com>
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+#pragma once
+
+#include "../racechrono-canbus.hpp"
+
+#include "frame.hpp"
+
+#include <cstddef>
+#include <cstdint>
+
+#include <hal/twai_types.h>
+
+/*
+ * Acceptance filter layout for standard frames (mask bit set = do not care):
+ *
+ *   single filter:  [31:21] ID  [20] RTR  [15:8] data byte 1  [7:0] data byte 2
+ *   dual filter 1:  [31:21] ID  [20] RTR  [19:16,3:0] data byte 1
+ *   dual filter 2:  [15:5]  ID  [4]  RTR
+ *
+ * and for extended frames:
+ *
+ *   single filter:  [31:3] ID  [2] RTR
+ *   dual filter 1:  [31:16] ID bits 28..13
+ *   dual filter 2:  [15:0]  ID bits 28..13
+ *
+ * A set of IDs is covered by a "cube": the bits all IDs agree on are compared,
+ * the rest are do not care. Planning picks the split of the wanted IDs into two
+ * cubes (one per dual filter) that accepts the fewest unwanted IDs.
+ *
+ * The planner is constexpr (C++11, so one return statement per function), vehicle
+ * tables plan their accept-all filter with it at compile time and the decoder plans
+ * at run time whenever RaceChrono changes the IDs it wants.
+ */
+
+namespace canbus
+{
+
+namespace detail
+{
+
+namespace filter_plan
+{
+
+constexpr uint32_t id_bits = 0x7FF;
+constexpr uint32_t extended_id_bits = 0x1FFFFFFF;
+
+// exhaustive search over all splits up to this many IDs, contiguous splits beyond
+constexpr size_t exhaustive_limit = 16;
+
+/// and/or over a set of IDs, its cube compares code() where mask() is clear
+struct cover
+{
+    uint32_t all_and;
+    uint32_t all_or;
+
+    constexpr cover add(uint32_t id) const noexcept
+    {
+        return { all_and & id, all_or | id };
+    }
+
+    constexpr uint32_t code() const noexcept
+    {
+        return all_and;
+    }
+
+    constexpr uint32_t mask() const noexcept
+    {
+        return all_and ^ all_or;
+    }
+};
+
+constexpr cover empty_cover = { id_bits, 0 };
+
+/// covers of the two filters of a split
+struct covers
+{
+    cover a;
+    cover b;
+
+    constexpr covers add(uint32_t id, bool second) const noexcept
+    {
+        return second ? covers{ a, b.add(id) } : covers{ a.add(id), b };
+    }
+};
+
+/// a split is a bit mask up to exhaustive_limit IDs, bit i - 1 set puts ID i in the second
+/// filter, and the index of the first ID of the second filter beyond
+constexpr bool in_second(uint32_t split, size_t n, size_t i) noexcept
+{
+    return n <= exhaustive_limit ? (i > 0 && ((split >> (i - 1)) & 1U)) : i >= split;
+}
+
+// tail recursive, so the run time planner does not grow the stack with the number of IDs
+constexpr covers split_covers(uint32_t const* ids, size_t n, uint32_t split, size_t i = 0,
+    covers c = covers{ empty_cover, empty_cover }) noexcept
+{
+    return i == n ? c : split_covers(ids, n, split, i + 1, c.add(ids[i], in_second(split, n, i)));
+}
+
+constexpr cover cover_all(uint32_t const* ids, size_t n, cover c, size_t i = 0) noexcept
+{
+    return i == n ? c : cover_all(ids, n, c.add(ids[i]), i + 1);
+}
+
+constexpr size_t count_extended(uint32_t const* ids, size_t n, size_t i = 0, size_t count = 0) noexcept
+{
+    return i == n ? count : count_extended(ids, n, i + 1, count + ((ids[i] & extended_flag) ? 1U : 0U));
+}
+
+/// IDs the cube \p code / \p mask accepts, weighted by \p weights if given
+constexpr uint64_t cube_weight(uint32_t code, uint32_t mask, uint32_t const* weights) noexcept
+{
+    return !weights ? 1ULL << __builtin_popcount(mask)
+        : mask == 0 ? weights[code]
+        : cube_weight(code, mask & (mask - 1U), weights)
+            + cube_weight(code | (mask & (~mask + 1U)), mask & (mask - 1U), weights);
+}
+
+constexpr uint64_t cube_weight(cover const& c, uint32_t const* weights) noexcept
+{
+    return cube_weight(c.code(), c.mask(), weights);
+}
+
+constexpr bool intersect(cover const& a, cover const& b) noexcept
+{
+    return ((a.code() ^ b.code()) & ~a.mask() & ~b.mask() & id_bits) == 0;
+}
+
+/// IDs both filters accept are only counted once
+constexpr uint64_t covers_weight(covers const& c, uint32_t const* weights) noexcept
+{
+    return cube_weight(c.a, weights) + cube_weight(c.b, weights)
+        - (intersect(c.a, c.b)
+            ? cube_weight((c.a.code() | c.b.code()) & ~(c.a.mask() & c.b.mask()), c.a.mask() & c.b.mask(), weights)
+            : 0);
+}
+
+struct candidate
+{
+    uint32_t split;
+    uint64_t weight;
+};
+
+constexpr candidate lighter(candidate const& a, candidate const& b) noexcept
+{
+    return b.weight < a.weight ? b : a;
+}
+
+/// lightest split in [lo, hi), the first one on ties. divide and conquer keeps the recursion shallow
+constexpr candidate best_split(uint32_t const* ids, size_t n, uint32_t const* weights, uint32_t lo, uint32_t hi) noexcept
+{
+    return hi - lo == 1 ? candidate{ lo, covers_weight(split_covers(ids, n, lo), weights) }
+        : lighter(best_split(ids, n, weights, lo, lo + (hi - lo) / 2),
+            best_split(ids, n, weights, lo + (hi - lo) / 2, hi));
+}
+
+constexpr uint32_t split_count(size_t n) noexcept
+{
+    return n <= exhaustive_limit ? 1U << (n - 1) : static_cast<uint32_t>(n);
+}
+
+constexpr twai_filter_config_t single(cover const& c) noexcept
+{
+    return { c.code() << 21, ~((~c.mask() & id_bits) << 21), true };
+}
+
+constexpr twai_filter_config_t dual(cover const& a, cover const& b) noexcept
+{
+    return { (a.code() << 21) | (b.code() << 5), ~(((~a.mask() & id_bits) << 21) | ((~b.mask() & id_bits) << 5)),
+             false };
+}
+
+constexpr twai_filter_config_t single_extended(cover const& c) noexcept
+{
+    return { c.code() << 3, ~((~c.mask() & extended_id_bits) << 3), true };
+}
+
+constexpr twai_filter_config_t split_filter(covers const& c) noexcept
+{
+    return c.a.all_and == c.b.all_and && c.a.all_or == c.b.all_or ? single(c.a) : dual(c.a, c.b);
+}
+
+/// one cube over all IDs, unless a split accepts fewer
+constexpr twai_filter_config_t standard(uint32_t const* ids, size_t n, uint32_t const* weights, cover const& all,
+    candidate const& best) noexcept
+{
+    return best.weight >= cube_weight(all, weights) ? single(all) : split_filter(split_covers(ids, n, best.split));
+}
+
+constexpr twai_filter_config_t plan(uint32_t const* ids, size_t n, uint32_t const* weights) noexcept
+{
+    // filters read standard and extended frames differently, a mix cannot be filtered
+    return n == 0 ? single({ id_bits, id_bits })
+        // the and over the IDs drops the extended_flag, single_extended() ignores it in the mask
+        : count_extended(ids, n) == n ? single_extended(cover_all(ids, n, { extended_id_bits, 0 }))
+        : count_extended(ids, n) > 0 ? twai_filter_config_t{ 0, 0xFFFFFFFF, true }
+        : n == 1 ? single(cover_all(ids, n, empty_cover))
+        : standard(ids, n, weights, cover_all(ids, n, empty_cover), best_split(ids, n, weights, 1, split_count(n)));
+}
+
+} // namespace filter_plan
+
+} // namespace detail
+
+/**
+ * Plan the tightest SJA1000 style acceptance filter (single or dual)
+ * that accepts every ID in \p ids. IDs accepted but not wanted are minimised, weighted
+ * by \p weights (indexed by ID, e.g. a bus ID histogram) or simply counted if null.
+ * Splits are searched in the order of \p ids, decoder tables keep them sorted.
+ *
+ * IDs tagged with extended_id() are extended (29-bit) IDs. If all IDs are extended a single filter
+ * over the 29-bit ID is planned, a mix of standard and extended IDs gives a filter
+ * accepting all frames. An empty set gives a filter that only accepts ID 0x7FF.
+ */
+constexpr twai_filter_config_t plan_filter(uint32_t const* ids, size_t count, uint32_t const* weights = nullptr) noexcept
+{
+    return detail::filter_plan::plan(ids, count, weights);
+}
+
+/**
+ * @return true if a data frame with \p id passes \p filter, the data bytes a
+ * standard frame filter may also compare are not considered
+ */
+bool filter_accepts(twai_filter_config_t const& filter, uint32_t id, bool extended = false) noexcept;
+
+} // namespace canbus
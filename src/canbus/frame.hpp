@@ -76,11 +76,41 @@ struct frame
         uint8_t u8[8];   //!< payload byte access
         uint32_t u32[2]; //!< payload u32 access
     } data;
+#if defined(CONFIG_RC_TRACE)
+    uint32_t ts;         //!< time the interrupt handler received the frame, once taken to be sent the time it was dequeued (trace::now())
+#endif
 } __attribute__ ((__packed__));
 
+/**
+ * decoder tables and lookups tag extended (29-bit) IDs with bit 31, so an extended ID
+ * never collides with the standard (11-bit) ID of the same value. frames carry the
+ * plain ID and the format in frame_info.
+ */
+constexpr uint32_t extended_flag = 0x80000000U;
+
+/**
+ * @return decoder table ID of the extended (29-bit) ID \p id
+ */
+constexpr uint32_t extended_id(uint32_t id) noexcept
+{
+    return id | extended_flag;
+}
+
+/**
+ * @return decoder table ID of frame \p f
+ */
+__always_inline uint32_t table_id(frame const& f) noexcept
+{
+    return f.info.frame_format == frame_format::extended ? extended_id(f.id) : f.id;
+}
+
 static_assert(std::is_standard_layout<frame>::value, "not standard layout");
 static_assert(std::is_move_constructible<frame>::value, "not move constructible");
 static_assert(std::is_move_assignable<frame>::value, "not move assignable");
+#if defined(CONFIG_RC_TRACE)
+static_assert(sizeof(frame) == 17, "not 17 bytes");
+#else
 static_assert(sizeof(frame) == 13, "not 13 bytes");
+#endif
 
 } // namespace canbus
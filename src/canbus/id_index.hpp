@@ -0,0 +1,158 @@
+// MIT License
+//
+// Copyright (c) 2022 Joe Roback <joe.roback@gmail.com>
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+#pragma once
+
+#include "../racechrono-canbus.hpp"
+
+#include <cstddef>
+#include <cstdint>
+
+#include <esp_heap_caps.h>
+
+namespace canbus
+{
+
+namespace detail
+{
+
+/// number of standard (11-bit) CAN-bus IDs
+constexpr size_t standard_id_count = 0x800;
+
+/// index table entry for an ID the decoder does not know
+constexpr uint8_t no_slot = 0xFF;
+
+/**
+ * compile-time integer sequence (std::index_sequence is C++14)
+ */
+template <size_t ...I>
+struct index_sequence
+{
+    using type = index_sequence;
+};
+
+template <typename S1, typename S2>
+struct concat_sequence;
+
+template <size_t ...I1, size_t ...I2>
+struct concat_sequence<index_sequence<I1...>, index_sequence<I2...>>
+    : index_sequence<I1..., (sizeof...(I1) + I2)...>
+{
+};
+
+/**
+ * index_sequence<0, ..., N - 1>, built with logarithmic template depth
+ */
+template <size_t N>
+struct make_index_sequence
+    : concat_sequence<typename make_index_sequence<N / 2>::type, typename make_index_sequence<N - N / 2>::type>
+{
+};
+
+template <>
+struct make_index_sequence<0> : index_sequence<>
+{
+};
+
+template <>
+struct make_index_sequence<1> : index_sequence<0>
+{
+};
+
+template <typename List, typename Seq>
+struct id_index_table;
+
+template <typename List, size_t ...I>
+struct id_index_table<List, index_sequence<I...>>
+{
+    static constexpr uint8_t table[sizeof...(I)] = { List::slot(I)... };
+};
+
+template <typename List, size_t ...I>
+constexpr uint8_t id_index_table<List, index_sequence<I...>>::table[];
+
+/**
+ * direct index from every standard ID to its slot in the decoder table,
+ * generated at compile time from \p List::slot(id)
+ */
+template <typename List>
+struct id_index
+{
+    static_assert(List::size < no_slot, "too many IDs for an 8-bit slot index");
+
+    static constexpr uint8_t const* table() noexcept
+    {
+        return id_index_table<List, make_index_sequence<standard_id_count>::type>::table;
+    }
+};
+
+/**
+ * perfect hash from sparse IDs (e.g. 29-bit extended IDs) to their slot in the
+ * decoder table, for IDs the direct index cannot cover. Built once when the
+ * decoder is constructed, a lookup is a multiply, a shift and one table read
+ * with no probing. The caller must still compare the ID stored in the slot.
+ */
+class id_hash
+{
+    CPP_NOCOPY(id_hash);
+    CPP_NOMOVE(id_hash);
+
+public:
+    id_hash() noexcept
+        : _slots(nullptr)
+        , _mult(0)
+        , _shift(0)
+    {
+    }
+
+    ~id_hash() noexcept
+    {
+        heap_caps_free(_slots);
+    }
+
+    /**
+     * build the hash of \p count unique \p ids, \p slots[i] is the table slot of ids[i]
+     * @return false if no collision free hash was found, the hash is then empty
+     */
+    bool build(uint32_t const* ids, uint8_t const* slots, size_t count) noexcept;
+
+    explicit operator bool() const noexcept
+    {
+        return _slots != nullptr;
+    }
+
+    /**
+     * @return candidate slot of \p id, or no_slot
+     */
+    __always_inline uint8_t find(uint32_t id) const noexcept
+    {
+        return _slots[(id * _mult) >> _shift];
+    }
+
+private:
+    uint8_t* _slots;
+    uint32_t _mult;
+    uint32_t _shift;
+};
+
+} // namespace detail
+
+} // namespace canbus
@@ -0,0 +1,712 @@
+// MIT License
+//
+// Copyright (c) 2022 Joe Roback <joe.roback@gmail.com>
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+#pragma once
+
+#include "../racechrono-canbus.hpp"
+
+#include "decoder.hpp"
+#include "filter.hpp"
+#include "id_index.hpp"
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+
+#include <hal/twai_types.h>
+
+/*
+ * Declarative vehicle database.
+ *
+ * A vehicle is a struct with its bus bitrate, the messages (CAN IDs) to forward
+ * with their default rate divisor and output priority, and the signal layouts
+ * inside them:
+ *
+ *   struct my_car
+ *   {
+ *       static constexpr uint32_t bitrate = 500000;
+ *       static constexpr vehicle::message messages[] = {
+ *           { 0x0A5, 3, priority::high },    // RPM - 100hz
+ *           ...
+ *       };
+ *       static constexpr vehicle::signal signals[] = {
+ *           { 0x0A5, "rpm", 40, 16, vehicle::byte_order::little, false, 0.25f, 0.0f, "rpm" },
+ *           ...
+ *       };
+ *       // optional, see CONFIG_RC_PACKED_SIGNALS
+ *       static constexpr vehicle::packed_frame packed_frames[] = {
+ *           { 0x700, { "rpm", "throttle" } },
+ *           ...
+ *       };
+ *   };
+ *
+ * vehicle_decoder<my_car> turns it into a decoder. The compiler sorts the IDs,
+ * rejects duplicates, bad rates, unsupported bitrates and signals that do not
+ * fit their frame, builds the direct ID index, plans the acceptance filter
+ * used when RaceChrono allows all IDs, and lays out the packed signal frames.
+ * ID tables live in static storage.
+ */
+
+namespace canbus
+{
+
+namespace vehicle
+{
+
+/**
+ * a CAN ID the vehicle decoder forwards
+ */
+struct message
+{
+    uint32_t id;    //!< CAN ID, extended (29-bit) IDs written as canbus::extended_id(id)
+    uint16_t rate;  //!< default rate divisor, forward one of every rate frames
+    canbus::priority priority;  //!< output priority class (CONFIG_RC_SCHEDULER)
+};
+
+/**
+ * signal byte order, as in DBC files
+ */
+enum class byte_order : uint8_t
+{
+    little,     //!< Intel, start is the least significant bit
+    big,        //!< Motorola, start is the most significant bit (DBC numbering)
+};
+
+/**
+ * a signal inside a message, physical value = raw * factor + offset
+ */
+struct signal
+{
+    uint32_t id;        //!< message CAN ID, as in its message
+    const char* name;
+    uint8_t start;      //!< start bit, bit 0 is the least significant bit of data byte 0
+    uint8_t length;     //!< length in bits, 1 to 32
+    byte_order order;
+    bool is_signed;
+    float factor;
+    float offset;
+    const char* unit;
+};
+
+/**
+ * signals repacked into one synthetic frame under a custom ID (CONFIG_RC_PACKED_SIGNALS).
+ * raw signal values are packed little endian from bit 0 in the order listed, the frame
+ * is sent with every decoded frame of the first signal's message.
+ */
+struct packed_frame
+{
+    uint32_t id;                //!< custom CAN ID, must not be a message ID. extended as in message
+    const char* signals[8];     //!< signal names, up to 64 bits in total
+};
+
+namespace detail
+{
+
+constexpr uint32_t standard_ids = 0x7FF;
+constexpr uint32_t extended_ids = 0x1FFFFFFF;
+
+constexpr bool supported_bitrate(uint32_t bitrate) noexcept
+{
+    return bitrate == 125000 || bitrate == 250000 || bitrate == 500000 || bitrate == 800000 || bitrate == 1000000;
+}
+
+constexpr size_t count_id(message const* m, size_t n, uint32_t id, size_t i = 0) noexcept
+{
+    return i == n ? 0 : (m[i].id == id ? 1 : 0) + count_id(m, n, id, i + 1);
+}
+
+constexpr bool unique(message const* m, size_t n, size_t i = 0) noexcept
+{
+    return i == n || (count_id(m, n, m[i].id) == 1 && unique(m, n, i + 1));
+}
+
+/// standard IDs up to 0x7FF, extended IDs tagged with extended_flag up to 29 bits
+constexpr bool valid_id(uint32_t id) noexcept
+{
+    return (id & extended_flag) ? (id & ~extended_flag) <= extended_ids : id <= standard_ids;
+}
+
+constexpr bool valid_messages(message const* m, size_t n, size_t i = 0) noexcept
+{
+    return i == n || (m[i].rate > 0 && valid_id(m[i].id) && valid_messages(m, n, i + 1));
+}
+
+/// number of IDs smaller than \p id, i.e. its position in the sorted table
+constexpr size_t rank(message const* m, size_t n, uint32_t id, size_t i = 0) noexcept
+{
+    return i == n ? 0 : (m[i].id < id ? 1 : 0) + rank(m, n, id, i + 1);
+}
+
+/// position of the \p k th smallest ID in \p m
+constexpr size_t nth(message const* m, size_t n, size_t k, size_t i = 0) noexcept
+{
+    return i == n ? n : rank(m, n, m[i].id) == k ? i : nth(m, n, k, i + 1);
+}
+
+/// last bit (sequential numbering) a signal occupies, or 64+ if it does not fit
+constexpr uint32_t last_bit(signal const& s) noexcept
+{
+    return s.order == byte_order::little
+        ? s.start + s.length - 1U
+        : (s.start / 8U) * 8U + (7U - s.start % 8U) + s.length - 1U;
+}
+
+constexpr bool valid_signals(signal const* s, size_t n, message const* m, size_t count, size_t i = 0) noexcept
+{
+    return i == n || (count_id(m, count, s[i].id) == 1
+        && s[i].length >= 1 && s[i].length <= 32
+        && last_bit(s[i]) < 64U
+        && valid_signals(s, n, m, count, i + 1));
+}
+
+/*
+ * packed signal frames
+ */
+
+constexpr bool same_name(const char* a, const char* b) noexcept
+{
+    return *a == *b && (*a == '\0' || same_name(a + 1, b + 1));
+}
+
+/// index of signal \p name, or \p n if unknown
+constexpr size_t find_signal(signal const* s, size_t n, const char* name, size_t i = 0) noexcept
+{
+    return i == n ? n : same_name(s[i].name, name) ? i : find_signal(s, n, name, i + 1);
+}
+
+constexpr bool known_signals(packed_frame const& p, signal const* s, size_t n, size_t j = 0) noexcept
+{
+    return j == 8 || p.signals[j] == nullptr
+        || (find_signal(s, n, p.signals[j]) < n && known_signals(p, s, n, j + 1));
+}
+
+/// bits used by the first \p j signals of \p p
+constexpr uint32_t packed_bits(packed_frame const& p, signal const* s, size_t n, size_t j) noexcept
+{
+    return j == 0 ? 0U
+        : packed_bits(p, s, n, j - 1) + (p.signals[j - 1] == nullptr ? 0U : s[find_signal(s, n, p.signals[j - 1])].length);
+}
+
+constexpr size_t count_packed(packed_frame const* p, size_t n, uint32_t id, size_t i = 0) noexcept
+{
+    return i == n ? 0 : (p[i].id == id ? 1 : 0) + count_packed(p, n, id, i + 1);
+}
+
+constexpr bool valid_packed(packed_frame const* p, size_t n, signal const* s, size_t signals,
+    message const* m, size_t count, size_t i = 0) noexcept
+{
+    return i == n || (p[i].signals[0] != nullptr
+        && valid_id(p[i].id)
+        && count_packed(p, n, p[i].id) == 1
+        && count_id(m, count, p[i].id) == 0
+        && known_signals(p[i], s, signals)
+        && packed_bits(p[i], s, signals, 8) <= 64U
+        && valid_packed(p, n, s, signals, m, count, i + 1));
+}
+
+/// shift of a signal's raw value in the payload read as a 64-bit little (or big, for Motorola) endian integer
+constexpr uint8_t payload_shift(signal const& s) noexcept
+{
+    return static_cast<uint8_t>(s.order == byte_order::little
+        ? s.start
+        : (7U - s.start / 8U) * 8U + s.start % 8U + 1U - s.length);
+}
+
+/**
+ * where one signal of a packed frame comes from and goes to
+ */
+struct packed_field
+{
+    uint8_t frame;      //!< packed frame index
+    uint8_t slot;       //!< source message slot, no_slot for an unused field
+    uint8_t source_dlc; //!< payload bytes the source frame needs to carry the signal
+    uint8_t packed_dlc; //!< payload bytes of the packed frame
+    uint8_t shift;      //!< see payload_shift()
+    uint8_t length;
+    bool big;
+    uint8_t position;   //!< first bit in the packed payload
+};
+
+template <typename Vehicle, typename = void>
+struct packed_frames
+{
+    static constexpr size_t size = 0;
+};
+
+template <typename Vehicle>
+struct packed_frames<Vehicle, decltype(void(Vehicle::packed_frames))>
+{
+    static constexpr size_t size = sizeof(Vehicle::packed_frames) / sizeof(packed_frame);
+};
+
+template <typename Vehicle, typename Seq>
+struct sorted_messages;
+
+template <typename Vehicle, size_t ...K>
+struct sorted_messages<Vehicle, canbus::detail::index_sequence<K...>>
+{
+    static constexpr size_t size = sizeof...(K);
+
+    static constexpr uint32_t ids[size] = { Vehicle::messages[nth(Vehicle::messages, size, K)].id... };
+    static constexpr uint16_t rates[size] = { Vehicle::messages[nth(Vehicle::messages, size, K)].rate... };
+    static constexpr canbus::priority priorities[size] = { Vehicle::messages[nth(Vehicle::messages, size, K)].priority... };
+};
+
+template <typename Vehicle, size_t ...K>
+constexpr uint32_t sorted_messages<Vehicle, canbus::detail::index_sequence<K...>>::ids[];
+
+template <typename Vehicle, size_t ...K>
+constexpr uint16_t sorted_messages<Vehicle, canbus::detail::index_sequence<K...>>::rates[];
+
+template <typename Vehicle, size_t ...K>
+constexpr canbus::priority sorted_messages<Vehicle, canbus::detail::index_sequence<K...>>::priorities[];
+
+/**
+ * compile-time tables of a vehicle, IDs in ascending order
+ */
+template <typename Vehicle>
+struct table
+    : sorted_messages<Vehicle, typename canbus::detail::make_index_sequence<
+        sizeof(Vehicle::messages) / sizeof(message)>::type>
+{
+    static constexpr size_t size = sizeof(Vehicle::messages) / sizeof(message);
+    static constexpr size_t signal_count = sizeof(Vehicle::signals) / sizeof(signal);
+
+    static_assert(size > 0, "vehicle has no messages");
+    static_assert(size < canbus::detail::no_slot, "too many IDs for an 8-bit slot index");
+    static_assert(unique(Vehicle::messages, size), "duplicate message ID");
+    static_assert(valid_messages(Vehicle::messages, size), "message rate must be at least 1 and IDs at most 29 bits");
+    static_assert(supported_bitrate(Vehicle::bitrate), "unsupported bitrate");
+    static_assert(valid_signals(Vehicle::signals, signal_count, Vehicle::messages, size),
+        "signal refers to an unknown ID, is longer than 32 bits or does not fit in 8 bytes");
+
+    /**
+     * @return table slot of \p id, or no_slot (for id_index)
+     */
+    static constexpr uint8_t slot(uint32_t id) noexcept
+    {
+        return count_id(Vehicle::messages, size, id) == 1
+            ? static_cast<uint8_t>(rank(Vehicle::messages, size, id)) : canbus::detail::no_slot;
+    }
+
+    /**
+     * acceptance filter when all IDs are allowed
+     */
+    static constexpr twai_filter_config_t filter() noexcept
+    {
+        return plan_filter(table::ids, size);
+    }
+};
+
+#if defined(CONFIG_RC_PACKED_SIGNALS)
+
+template <typename Vehicle, typename Seq>
+struct packed_layout;
+
+template <typename Vehicle, size_t ...K>
+struct packed_layout<Vehicle, canbus::detail::index_sequence<K...>>
+{
+    using table = detail::table<Vehicle>;
+
+    static constexpr size_t signal_count = table::signal_count;
+
+    static constexpr signal const& source(size_t k) noexcept
+    {
+        return Vehicle::signals[find_signal(Vehicle::signals, signal_count, Vehicle::packed_frames[k / 8].signals[k % 8])];
+    }
+
+    static constexpr packed_field field(size_t k) noexcept
+    {
+        return Vehicle::packed_frames[k / 8].signals[k % 8] == nullptr
+            ? packed_field{ static_cast<uint8_t>(k / 8), canbus::detail::no_slot, 0, 0, 0, 0, false, 0 }
+            : packed_field{
+                static_cast<uint8_t>(k / 8),
+                table::slot(source(k).id),
+                static_cast<uint8_t>(last_bit(source(k)) / 8U + 1U),
+                static_cast<uint8_t>((packed_bits(Vehicle::packed_frames[k / 8], Vehicle::signals, signal_count, 8) + 7U) / 8U),
+                payload_shift(source(k)),
+                source(k).length,
+                source(k).order == byte_order::big,
+                static_cast<uint8_t>(packed_bits(Vehicle::packed_frames[k / 8], Vehicle::signals, signal_count, k % 8)) };
+    }
+
+    static constexpr packed_field fields[sizeof...(K)] = { field(K)... };
+
+    /**
+     * @return true if a signal of the message in table slot \p slot is packed
+     */
+    static constexpr bool feeds(size_t slot, size_t k = 0) noexcept
+    {
+        return k < sizeof...(K) && (field(k).slot == slot || feeds(slot, k + 1));
+    }
+};
+
+template <typename Vehicle, size_t ...K>
+constexpr packed_field packed_layout<Vehicle, canbus::detail::index_sequence<K...>>::fields[];
+
+/**
+ * latest raw signal values of each packed frame, and the frames ready to send
+ */
+template <typename Vehicle, size_t Size = packed_frames<Vehicle>::size>
+class packer
+{
+    using table = detail::table<Vehicle>;
+    using layout = packed_layout<Vehicle, typename canbus::detail::make_index_sequence<Size * 8>::type>;
+
+    static_assert(Size < canbus::detail::no_slot, "too many packed frames");
+    static_assert(valid_packed(Vehicle::packed_frames, Size, Vehicle::signals, table::signal_count,
+        Vehicle::messages, table::size),
+        "packed frame is empty, reuses an ID, names an unknown signal or is longer than 64 bits");
+
+public:
+    static constexpr size_t size = Size;
+
+    packer() noexcept
+        : _enabled{}
+        , _values{}
+        , _ready{}
+    {
+    }
+
+    /**
+     * @return index of packed frame \p id, or size if it is not one
+     */
+    static size_t find(uint32_t id) noexcept
+    {
+        for (size_t p = 0; p < size; p++)
+        {
+            if (Vehicle::packed_frames[p].id == id)
+            {
+                return p;
+            }
+        }
+        return size;
+    }
+
+    /**
+     * call \p fn with the slot of each source message of packed frame \p p
+     */
+    template <typename Fn>
+    static void each_source(size_t p, Fn fn) noexcept
+    {
+        for (packed_field const& f : layout::fields)
+        {
+            if (f.frame == p && f.slot != canbus::detail::no_slot)
+            {
+                fn(f.slot);
+            }
+        }
+    }
+
+    /**
+     * @return slot of the message triggering packed frame \p p
+     */
+    static size_t trigger(size_t p) noexcept
+    {
+        return layout::fields[p * 8].slot;
+    }
+
+    /**
+     * @return true if a signal of the message in table slot \p slot is packed
+     */
+    static constexpr bool feeds(size_t slot) noexcept
+    {
+        return layout::feeds(slot);
+    }
+
+    void enable(size_t p, bool on) noexcept
+    {
+        _enabled[p] = on;
+    }
+
+    size_t pack(size_t slot, frame const& f, frame*& out) noexcept
+    {
+        uint64_t little;
+        memcpy(&little, f.data.u8, sizeof(little));
+        uint64_t big = __builtin_bswap64(little);
+
+        for (packed_field const& field : layout::fields)
+        {
+            if (field.slot == slot && field.source_dlc <= f.info.dlc)
+            {
+                uint64_t mask = field.length < 64 ? (1ULL << field.length) - 1ULL : ~0ULL;
+                uint64_t raw = ((field.big ? big : little) >> field.shift) & mask;
+                _values[field.frame] = (_values[field.frame] & ~(mask << field.position)) | (raw << field.position);
+            }
+        }
+
+        // the first signal's message triggers the frame
+        size_t count = 0;
+        for (size_t p = 0; p < size; p++)
+        {
+            packed_field const& first = layout::fields[p * 8];
+            if (_enabled[p] && first.slot == slot)
+            {
+                frame& ready = _ready[count++];
+                uint32_t id = Vehicle::packed_frames[p].id;
+                ready.info.u8 = 0;
+                ready.info.dlc = first.packed_dlc;
+                ready.info.frame_format = (id & extended_flag) ? extended : standard;
+                ready.id = id & ~extended_flag;
+                memcpy(ready.data.u8, &_values[p], sizeof(ready.data.u8));
+            }
+        }
+
+        out = _ready;
+        return count;
+    }
+
+private:
+    bool _enabled[size];
+    uint64_t _values[size];
+    frame _ready[size];
+};
+
+/**
+ * vehicles without packed frames
+ */
+template <typename Vehicle>
+class packer<Vehicle, 0>
+{
+public:
+    static constexpr size_t size = 0;
+
+    static size_t find(uint32_t) noexcept
+    {
+        return size;
+    }
+
+    template <typename Fn>
+    static void each_source(size_t, Fn) noexcept
+    {
+    }
+
+    static size_t trigger(size_t) noexcept
+    {
+        return canbus::detail::no_slot;
+    }
+
+    static constexpr bool feeds(size_t) noexcept
+    {
+        return false;
+    }
+
+    void enable(size_t, bool) noexcept
+    {
+    }
+
+    size_t pack(size_t, frame const&, frame*&) noexcept
+    {
+        return 0;
+    }
+};
+
+#endif // CONFIG_RC_PACKED_SIGNALS
+
+} // namespace detail
+
+} // namespace vehicle
+
+/**
+ * decoder generated from a vehicle database (see above)
+ */
+template <typename Vehicle>
+class vehicle_decoder final
+    : public decoder
+{
+    CPP_NOCOPY(vehicle_decoder);
+    CPP_NOMOVE(vehicle_decoder);
+
+    using table = vehicle::detail::table<Vehicle>;
+#if defined(CONFIG_RC_PACKED_SIGNALS)
+    using packer = vehicle::detail::packer<Vehicle>;
+#endif
+
+    static constexpr twai_filter_config_t all_filter = table::filter();
+
+public:
+    static vehicle_decoder& get() noexcept
+    {
+        static vehicle_decoder instance;
+        return instance;
+    }
+
+    ~vehicle_decoder() noexcept override
+    {
+    }
+
+    twai_timing_config_t timing() const noexcept override
+    {
+        switch (Vehicle::bitrate)
+        {
+            case 125000:
+                return TWAI_TIMING_CONFIG_125KBITS();
+            case 250000:
+                return TWAI_TIMING_CONFIG_250KBITS();
+            case 800000:
+                return TWAI_TIMING_CONFIG_800KBITS();
+            case 1000000:
+                return TWAI_TIMING_CONFIG_1MBITS();
+            default:
+                return TWAI_TIMING_CONFIG_500KBITS();
+        }
+    }
+
+    twai_filter_config_t filter() const noexcept override
+    {
+        // planned by the compiler when everything is allowed, otherwise for the subscribed IDs
+        for (size_t i = 0; i < size(); i++)
+        {
+            if (_ids[i].rate == rate_disabled)
+            {
+                return decoder::filter();
+            }
+        }
+        return all_filter;
+    }
+
+    uint16_t rate(uint32_t id) const noexcept override
+    {
+        size_t s = slot(id);
+        return s < table::size ? table::rates[s] : rate_default;
+    }
+
+    priority priority_of(uint32_t id) const noexcept override
+    {
+        size_t s = slot(id);
+#if defined(CONFIG_RC_PACKED_SIGNALS)
+        // packed frames go with the message triggering them
+        size_t p = packer::find(id);
+        if (p < packer::size)
+        {
+            s = packer::trigger(p);
+        }
+#endif
+        return s < table::size ? table::priorities[s] : priority::normal;
+    }
+
+#if defined(CONFIG_RC_PACKED_SIGNALS)
+    bool forward(uint32_t id) const noexcept override
+    {
+        size_t s = slot(id);
+        return s < table::size && _forward[s];
+    }
+
+    size_t pack(frame const& f, frame*& out) noexcept override
+    {
+        return _packer.pack(slot(table_id(f)), f, out);
+    }
+
+protected:
+    void deny_all() noexcept override
+    {
+        decoder::deny_all();
+        for (size_t i = 0; i < table::size; i++)
+        {
+            _forward[i] = false;
+        }
+        for (size_t p = 0; p < packer::size; p++)
+        {
+            _packer.enable(p, false);
+        }
+    }
+
+    void allow_all(uint32_t interval) noexcept override
+    {
+        // packed frames are only sent when asked for by ID
+        decoder::allow_all(interval);
+        for (size_t i = 0; i < table::size; i++)
+        {
+            _forward[i] = true;
+        }
+    }
+
+    void allow_id(uint32_t id, uint32_t interval) noexcept override
+    {
+        size_t p = packer::find(id);
+        if (p == packer::size)
+        {
+            decoder::allow_id(id, interval);
+            size_t s = slot(id);
+            if (s < table::size)
+            {
+                _forward[s] = true;
+            }
+            return;
+        }
+
+        // decode the source messages, unless RaceChrono already asked for them
+        _packer.enable(p, true);
+        packer::each_source(p, [this, interval](size_t s) {
+            if (_ids[s].rate == rate_disabled)
+            {
+                decoder::allow_id(_ids[s].id, interval);
+            }
+        });
+    }
+#endif
+
+private:
+    explicit vehicle_decoder() noexcept
+#if defined(CONFIG_CANBUS_ISR_IN_IRAM)
+        : decoder(_storage, table::size, _index)
+#else
+        : decoder(_storage, table::size, canbus::detail::id_index<table>::table())
+#endif
+        , _storage{}
+#if defined(CONFIG_RC_PACKED_SIGNALS)
+        , _forward{}
+        , _packer{}
+#endif
+    {
+#if defined(CONFIG_CANBUS_ISR_IN_IRAM)
+        // the interrupt handler reads the index with the cache disabled, keep a copy in RAM
+        memcpy(_index, canbus::detail::id_index<table>::table(), sizeof(_index));
+#endif
+        for (size_t i = 0; i < table::size; i++)
+        {
+            _storage[i].id = table::ids[i];
+            _storage[i].rate = rate_disabled;
+#if defined(CONFIG_RC_SUPPRESS_UNCHANGED)
+            _storage[i].sent_dlc = no_payload;
+#endif
+#if defined(CONFIG_RC_PACKED_SIGNALS)
+            _storage[i].packs = packer::feeds(i);
+#endif
+        }
+        index_ids();
+    }
+
+private:
+    ID _storage[table::size];
+#if defined(CONFIG_CANBUS_ISR_IN_IRAM)
+    uint8_t _index[canbus::detail::standard_id_count];
+#endif
+#if defined(CONFIG_RC_PACKED_SIGNALS)
+    bool _forward[table::size];     // RaceChrono asked for the frames themselves
+    packer _packer;
+#endif
+};
+
+template <typename Vehicle>
+constexpr twai_filter_config_t vehicle_decoder<Vehicle>::all_filter;
+
+} // namespace canbus
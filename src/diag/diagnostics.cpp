@@ -0,0 +1,150 @@
+// MIT License
+//
+// Copyright (c) 2022 Joe Roback <joe.roback@gmail.com>
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+#include "../racechrono-canbus.hpp"
+#include "../canbus/decoder.hpp"
+#include "../racechrono/device.hpp"
+
+#include "diagnostics.hpp"
+
+#if defined(CONFIG_RC_DIAGNOSTICS)
+
+namespace
+{
+
+// TWAI clock feeding the baud rate prescaler
+constexpr uint32_t twai_clock_hz = 80000000U;
+
+__always_inline uint8_t* put(uint8_t* p, uint32_t v) noexcept
+{
+    p[0] = static_cast<uint8_t>(v);
+    p[1] = static_cast<uint8_t>(v >> 8);
+    p[2] = static_cast<uint8_t>(v >> 16);
+    p[3] = static_cast<uint8_t>(v >> 24);
+    return p + 4;
+}
+
+}
+
+namespace diag
+{
+
+diagnostics& diagnostics::get() noexcept
+{
+    static diagnostics instance;
+    return instance;
+}
+
+diagnostics::diagnostics() noexcept
+    : _ids{}
+    , _rx_bits(0U)
+    , _errors(0U)
+    , _overruns(0U)
+    , _packed(0U)
+    , _bitrate(0U)
+    , _published(static_cast<uint32_t>(micros()))
+    , _published_rx_bits(0U)
+    , _snapshot{}
+{
+}
+
+void diagnostics::set_timing(twai_timing_config_t const& timing) noexcept
+{
+    uint32_t tq = timing.brp * (1U + timing.tseg_1 + timing.tseg_2);
+    _bitrate = tq > 0U ? twai_clock_hz / tq : 0U;
+}
+
+size_t diagnostics::output_entry(canbus::frame const& f) const noexcept
+{
+    // the decoder only lets IDs of its table through, any other frame is a packed one
+    size_t slot = CANDEC.slot(canbus::table_id(f));
+    if (slot >= CANDEC.count())
+    {
+        return packed_entry;
+    }
+    return slot < CONFIG_RC_DIAG_IDS ? slot : CONFIG_RC_DIAG_IDS;
+}
+
+void diagnostics::poll() noexcept
+{
+    if (static_cast<uint32_t>(micros()) - _published >= CONFIG_RC_DIAG_INTERVAL)
+    {
+        publish();
+    }
+}
+
+void diagnostics::publish() noexcept
+{
+    uint32_t now = static_cast<uint32_t>(micros());
+    uint32_t elapsed = now - _published;
+    uint32_t bits = _rx_bits.load(std::memory_order_relaxed);
+
+    // bits read over bits the bus could carry, in 0.01 %
+    uint32_t load = 0U;
+    if (_bitrate > 0U && elapsed > 0U)
+    {
+        uint64_t capacity = static_cast<uint64_t>(_bitrate) * elapsed / 1000000U;
+        uint64_t used = static_cast<uint64_t>(bits - _published_rx_bits) * 10000U;
+        load = capacity > 0U ? static_cast<uint32_t>(used / capacity) : 0U;
+        if (load > 10000U)
+        {
+            load = 10000U;
+        }
+    }
+    _published = now;
+    _published_rx_bits = bits;
+
+    uint8_t count = 0;
+    uint8_t* p = &_snapshot[header_size];
+    for (counters const& c : _ids)
+    {
+        uint32_t received = c.received.load(std::memory_order_relaxed);
+        if (received == 0U)
+        {
+            continue;
+        }
+
+        p = put(p, c.id.load(std::memory_order_relaxed));
+        p = put(p, received);
+        p = put(p, c.accepted.load(std::memory_order_relaxed));
+        p = put(p, c.dropped.load(std::memory_order_relaxed));
+        p = put(p, c.suppressed.load(std::memory_order_relaxed));
+        p = put(p, c.forwarded.load(std::memory_order_relaxed));
+        ++count;
+    }
+
+    _snapshot[0] = version;
+    _snapshot[1] = count;
+    _snapshot[2] = static_cast<uint8_t>(load);
+    _snapshot[3] = static_cast<uint8_t>(load >> 8);
+    put(&_snapshot[4], static_cast<uint32_t>(millis()));
+    put(&_snapshot[8], _errors.load(std::memory_order_relaxed));
+    put(&_snapshot[12], _overruns.load(std::memory_order_relaxed));
+    put(&_snapshot[16], _packed.load(std::memory_order_relaxed));
+
+    RCDEV.diagnostics(_snapshot, static_cast<size_t>(p - _snapshot));
+}
+
+} // namespace diag
+
+diag::diagnostics& DIAG = diag::diagnostics::get();
+
+#endif
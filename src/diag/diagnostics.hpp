@@ -0,0 +1,235 @@
+// MIT License
+//
+// Copyright (c) 2022 Joe Roback <joe.roback@gmail.com>
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+#pragma once
+
+#include "../racechrono-canbus.hpp"
+#include "../canbus/frame.hpp"
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+
+#include <hal/twai_types.h>
+
+#if defined(CONFIG_RC_DIAGNOSTICS)
+
+namespace diag
+{
+
+/**
+ * Bus and link diagnostics (CONFIG_RC_DIAGNOSTICS).
+ *
+ * Per ID, the CAN-bus interrupt handler counts frames received (let through by the
+ * acceptance filter), accepted by the decoder and dropped on the way to the Bluetooth LE
+ * task: not queued because the queue was full or, with CONFIG_CANBUS_MAILBOX,
+ * superseded by a newer frame of the ID before it was taken. The Bluetooth LE task
+ * counts frames suppressed as unchanged (CONFIG_RC_SUPPRESS_UNCHANGED) and frames
+ * forwarded, in a notification the stack took. Each counter has a single writer, so
+ * they are plain atomic loads and stores.
+ *
+ * Every CONFIG_RC_DIAG_INTERVAL the Bluetooth LE task publishes a snapshot on the
+ * diagnostics characteristic, little endian:
+ *
+ *   header  [version 1][count 1][rx load 2][time 4][errors 4][overruns 4][packed 4]
+ *   entry   [id 4][received 4][accepted 4][dropped 4][suppressed 4][forwarded 4]
+ *
+ * Rx load is in 0.01 % over the last interval, time is milliseconds since boot,
+ * errors counts bus error interrupts, overruns frames lost to a full RX FIFO (not
+ * in any entry, their IDs are unknown), packed the packed signal frames forwarded
+ * (CONFIG_RC_PACKED_SIGNALS) and count is the number of entries. Counters are free
+ * running, so a client gets rates by comparing two snapshots. Extended IDs have
+ * bit 31 set (canbus::extended_id()). Only IDs seen are listed, IDs past the first
+ * CONFIG_RC_DIAG_IDS of the decoder's table and IDs it does not know share the last
+ * entry, ID 0xFFFFFFFF. A client that enables notifications gets each snapshot with
+ * as many whole entries as fit the MTU. If that is not all of them, count has
+ * count_truncated set, its other bits give the entries in the notification and a
+ * read of the characteristic returns them all.
+ *
+ * Rx load counts the nominal bits (without stuff bits) of frames read from the
+ * controller's FIFO, relative to the bit rate. It is not the bus load: frames the
+ * acceptance filter rejects never reach the FIFO, frames lost to an overrun are never
+ * read.
+ */
+class diagnostics final
+{
+    CPP_NOCOPY(diagnostics);
+    CPP_NOMOVE(diagnostics);
+
+public:
+    /// snapshot format version
+    static constexpr uint8_t version = 1;
+
+    static constexpr size_t header_size = 20;
+    static constexpr size_t entry_size = 24;
+
+    /// flag in count of a notification without all entries, read the characteristic for them
+    static constexpr uint8_t count_truncated = 0x80;
+
+    /// ID of the entry shared by all other IDs
+    static constexpr uint32_t other_id = 0xFFFFFFFFU;
+
+    /// output_entry() of a packed signal frame
+    static constexpr size_t packed_entry = CONFIG_RC_DIAG_IDS + 1;
+
+    /// largest snapshot, must fit an ATT attribute value
+    static constexpr size_t max_snapshot_size = header_size + (CONFIG_RC_DIAG_IDS + 1) * entry_size;
+
+    static_assert(max_snapshot_size <= 512, "too many diagnostics IDs for one attribute value");
+
+    static diagnostics& get() noexcept;
+
+    ~diagnostics() noexcept = default;
+
+    /**
+     * rx load is relative to the bit rate of \p timing
+     */
+    void set_timing(twai_timing_config_t const& timing) noexcept;
+
+    /**
+     * count the bits of a frame with \p info read from the RX FIFO (interrupt handler only)
+     */
+    __always_inline void rx(canbus::frame_info info) noexcept
+    {
+        // SOF to the end of the interframe space, without stuff bits
+        uint32_t bits = info.frame_format == canbus::frame_format::extended ? 67U : 47U;
+        if (info.rtr == canbus::frame_rtr::data)
+        {
+            bits += 8U * (info.dlc > 8 ? 8U : info.dlc);
+        }
+        add(_rx_bits, bits);
+    }
+
+    /**
+     * frame of \p id in decoder table \p slot let through by the acceptance filter (interrupt handler only)
+     */
+    __always_inline void received(size_t slot, uint32_t id) noexcept
+    {
+        counters& c = entry(slot);
+        c.id.store(slot < CONFIG_RC_DIAG_IDS ? id : other_id, std::memory_order_relaxed);
+        add(c.received, 1U);
+    }
+
+    /**
+     * frame in \p slot accepted by the decoder (interrupt handler only)
+     */
+    __always_inline void accepted(size_t slot) noexcept
+    {
+        add(entry(slot).accepted, 1U);
+    }
+
+    /**
+     * frame in \p slot dropped by the queue (interrupt handler only)
+     */
+    __always_inline void dropped(size_t slot) noexcept
+    {
+        add(entry(slot).dropped, 1U);
+    }
+
+    /**
+     * frame in \p slot not sent, its payload is unchanged (Bluetooth LE task only)
+     */
+    __always_inline void suppressed(size_t slot) noexcept
+    {
+        add(entry(slot).suppressed, 1U);
+    }
+
+    /**
+     * @return counters entry of frame \p f handed to Bluetooth LE, packed_entry for a
+     * packed signal frame (Bluetooth LE task only)
+     */
+    size_t output_entry(canbus::frame const& f) const noexcept;
+
+    /**
+     * frame of output_entry() \p e sent in a notification the stack took (Bluetooth LE task only)
+     */
+    __always_inline void forwarded(size_t e) noexcept
+    {
+        add(e < packed_entry ? _ids[e].forwarded : _packed, 1U);
+    }
+
+    /**
+     * bus error interrupt (interrupt handler only)
+     */
+    __always_inline void error() noexcept
+    {
+        add(_errors, 1U);
+    }
+
+    /**
+     * \p n frames lost to a full RX FIFO (interrupt handler only)
+     */
+    __always_inline void overrun(uint32_t n) noexcept
+    {
+        add(_overruns, n);
+    }
+
+    /**
+     * publish a snapshot every CONFIG_RC_DIAG_INTERVAL (Bluetooth LE task only)
+     */
+    void poll() noexcept;
+
+    /**
+     * publish a snapshot now (Bluetooth LE task only)
+     */
+    void publish() noexcept;
+
+private:
+    struct counters
+    {
+        std::atomic<uint32_t> id;
+        std::atomic<uint32_t> received;
+        std::atomic<uint32_t> accepted;
+        std::atomic<uint32_t> dropped;
+        std::atomic<uint32_t> suppressed;
+        std::atomic<uint32_t> forwarded;
+    };
+
+    explicit diagnostics() noexcept;
+
+    static __always_inline void add(std::atomic<uint32_t>& counter, uint32_t n) noexcept
+    {
+        // single writer, no read-modify-write needed
+        counter.store(counter.load(std::memory_order_relaxed) + n, std::memory_order_relaxed);
+    }
+
+    __always_inline counters& entry(size_t slot) noexcept
+    {
+        return _ids[slot < CONFIG_RC_DIAG_IDS ? slot : CONFIG_RC_DIAG_IDS];
+    }
+
+private:
+    counters _ids[CONFIG_RC_DIAG_IDS + 1];
+    std::atomic<uint32_t> _rx_bits;
+    std::atomic<uint32_t> _errors;
+    std::atomic<uint32_t> _overruns;
+    std::atomic<uint32_t> _packed;
+    uint32_t _bitrate;
+    uint32_t _published;    // time of the last snapshot
+    uint32_t _published_rx_bits;
+    uint8_t _snapshot[max_snapshot_size];
+};
+
+} // namespace diag
+
+extern diag::diagnostics& DIAG;
+
+#endif
@@ -0,0 +1,198 @@
+// MIT License
+//
+// Copyright (c) 2022 Joe Roback <joe.roback@gmail.com>
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+#pragma once
+
+#include "../racechrono-canbus.hpp"
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <type_traits>
+
+/*
+ * Binary (deferred format) log records.
+ *
+ * Instead of formatting on the device, a call site stores the address of its
+ * format string, which doubles as an interned format ID, followed by its raw
+ * arguments. tools/logdecode on the host looks the format strings up in the
+ * firmware ELF file and does the formatting. Records are interleaved with
+ * plain text on Serial:
+ *
+ *   [record_marker][len][flags][format address, 4 bytes LE][tag][value]...
+ *
+ * len counts the bytes after itself. Each argument is a tag followed by its value:
+ *
+ *   tag_int32   4 bytes LE, integers up to 32 bits and enums
+ *   tag_int64   8 bytes LE, 64-bit integers and pointers
+ *   tag_double  8 bytes IEEE 754 LE, float is promoted as printf does
+ *   tag_string  1 byte length, then the characters (no terminator, may be truncated)
+ */
+
+namespace logging
+{
+
+namespace binary
+{
+
+/// first byte of every record, never part of a plain text log line
+constexpr uint8_t record_marker = 0x1E;
+
+/// bytes before the first argument
+constexpr size_t header_size = 7;
+
+/// flags bit: the call site appends a line ending (logln)
+constexpr uint8_t flag_newline = 0x01;
+
+constexpr uint8_t tag_int32 = 'i';
+constexpr uint8_t tag_int64 = 'I';
+constexpr uint8_t tag_double = 'd';
+constexpr uint8_t tag_string = 's';
+
+/**
+ * encodes one record into a caller provided buffer. strings are truncated to fit, the
+ * first other argument that does not fit ends the record.
+ */
+class writer final
+{
+    CPP_NOCOPY(writer);
+    CPP_NOMOVE(writer);
+
+public:
+    writer(char* buf, size_t size) noexcept
+        : _buf(reinterpret_cast<uint8_t*>(buf))
+        , _pos(0)
+        , _size(size)
+        , _full(false)
+    {
+    }
+
+    /**
+     * start a record for format string \p fmt
+     */
+    void header(const char* fmt, bool newline) noexcept
+    {
+        uint32_t addr = static_cast<uint32_t>(reinterpret_cast<uintptr_t>(fmt));
+        _buf[0] = record_marker;
+        _buf[2] = newline ? flag_newline : 0;
+        memcpy(&_buf[3], &addr, sizeof(addr));
+        _pos = header_size;
+    }
+
+    __always_inline void put() noexcept
+    {
+    }
+
+    template <typename T, typename ...TArgs>
+    __always_inline void put(T&& value, TArgs&& ...args) noexcept
+    {
+        arg(static_cast<typename std::decay<T>::type>(value));
+        put(std::forward<TArgs>(args)...);
+    }
+
+    /**
+     * finish the record
+     * @return size of the record in bytes
+     */
+    size_t finish() noexcept
+    {
+        _buf[1] = static_cast<uint8_t>(_pos - 2);
+        return _pos;
+    }
+
+private:
+    template <typename T>
+    typename std::enable_if<(std::is_integral<T>::value || std::is_enum<T>::value) && sizeof(T) <= 4>::type
+    arg(T value) noexcept
+    {
+        // sign or zero extended as the printf varargs promotion would
+        uint32_t v = static_cast<uint32_t>(value);
+        raw(tag_int32, &v, sizeof(v));
+    }
+
+    template <typename T>
+    typename std::enable_if<std::is_integral<T>::value && sizeof(T) == 8>::type
+    arg(T value) noexcept
+    {
+        uint64_t v = static_cast<uint64_t>(value);
+        raw(tag_int64, &v, sizeof(v));
+    }
+
+    template <typename T>
+    typename std::enable_if<std::is_floating_point<T>::value>::type
+    arg(T value) noexcept
+    {
+        double v = static_cast<double>(value);
+        raw(tag_double, &v, sizeof(v));
+    }
+
+    void arg(const char* value) noexcept
+    {
+        if (_full || _pos + 2 > _size)
+        {
+            _full = true;
+            return;
+        }
+
+        size_t len = value ? strnlen(value, _size - _pos - 2) : 0;
+        _buf[_pos++] = tag_string;
+        _buf[_pos++] = static_cast<uint8_t>(len);
+        if (len > 0)
+        {
+            memcpy(&_buf[_pos], value, len);
+            _pos += len;
+        }
+    }
+
+    void arg(char* value) noexcept
+    {
+        arg(static_cast<const char*>(value));
+    }
+
+    void arg(void const* value) noexcept
+    {
+        uint64_t v = reinterpret_cast<uintptr_t>(value);
+        raw(tag_int64, &v, sizeof(v));
+    }
+
+    void raw(uint8_t tag, void const* value, size_t len) noexcept
+    {
+        if (_full || _pos + 1 + len > _size)
+        {
+            _full = true;
+            return;
+        }
+
+        _buf[_pos++] = tag;
+        memcpy(&_buf[_pos], value, len);
+        _pos += len;
+    }
+
+private:
+    uint8_t* _buf;
+    size_t _pos;
+    size_t _size;
+    bool _full;
+};
+
+} // namespace binary
+
+} // namespace logging
@@ -24,6 +24,19 @@
 namespace logging
 {
 
+#if defined(CONFIG_RC_LOG_ASYNC)
+
+namespace
+{
+
+constexpr uint32_t drain_stack_size = 3 * 1024;
+StaticTask_t drain_buffer;
+StackType_t drain_stack[drain_stack_size];
+
+}
+
+#endif
+
 logger& logger::get() noexcept
 {
     static logger instance;
@@ -32,7 +45,13 @@ logger& logger::get() noexcept
 
 logger::logger() noexcept
     : _log_level(log_level::boot)
+#if defined(CONFIG_RC_LOG_ASYNC)
+    , _ring()
+    , _task(nullptr)
+    , _drops_reported(0)
+#else
     , _lock(portMUX_INITIALIZER_UNLOCKED)
+#endif
 {
 }
 
@@ -40,4 +59,95 @@ logger::~logger() noexcept
 {
 }
 
+#if defined(CONFIG_RC_LOG_ASYNC)
+
+void logger::start() noexcept
+{
+    if (_task)
+    {
+        return;
+    }
+
+    // pinned next to the CAN-bus interrupt handler, which preempts it, away from Bluetooth LE
+    _task = xTaskCreateStaticPinnedToCore(
+        drain_task,
+        "logging",
+        drain_stack_size,
+        this,
+        tskIDLE_PRIORITY + 1,
+        drain_stack,
+        &drain_buffer,
+        1
+    );
+    RCASSERT(_task);
+}
+
+void logger::flush() noexcept
+{
+    if (!_task)
+    {
+        drain();
+    }
+    else
+    {
+        while (_ring.size() > 0)
+        {
+            vTaskDelay(1);
+        }
+    }
+    Serial.flush();
+}
+
+uint32_t logger::drops() const noexcept
+{
+    return _ring.drops();
+}
+
+void logger::drain() noexcept
+{
+    line l;
+    while (_ring.pop(l))
+    {
+        Serial.write(l.text, l.len);
+    }
+
+    uint32_t drops = _ring.drops();
+    if (RCUNLIKELY(drops != _drops_reported))
+    {
+        char buf[48];
+        int len = snprintf(buf, sizeof(buf), "log dropped %u lines\r\n", drops - _drops_reported);
+        Serial.write(buf, static_cast<size_t>(len));
+        _drops_reported = drops;
+    }
+}
+
+void logger::drain_task(void* arg)
+{
+    logger* self = static_cast<logger*>(arg);
+
+    while (true)
+    {
+        self->drain();
+        vTaskDelay(1);
+    }
+}
+
+#else
+
+void logger::start() noexcept
+{
+}
+
+void logger::flush() noexcept
+{
+    Serial.flush();
+}
+
+uint32_t logger::drops() const noexcept
+{
+    return 0;
+}
+
+#endif
+
 } // namespace logging
@@ -23,8 +23,21 @@
 
 #include "../racechrono-canbus.hpp"
 
+#if defined(CONFIG_RC_LOG_ASYNC)
+#include "../utils/ring.hpp"
+#endif
+
+#if defined(CONFIG_RC_LOG_BINARY)
+#if !defined(CONFIG_RC_LOG_ASYNC)
+#error "CONFIG_RC_LOG_BINARY requires CONFIG_RC_LOG_ASYNC"
+#endif
+#include "binary.hpp"
+#endif
+
 #include <freertos/FreeRTOS.h>
+#include <freertos/task.h>
 
+#include <algorithm>
 #include <cstdio>
 #include <utility>
 
@@ -68,6 +81,23 @@ public:
      */
     void set_level(log_level level) noexcept { _log_level = level; }
 
+    /**
+     * start writing queued log lines to Serial from a low priority task. lines logged
+     * before are kept in the queue (or dropped once it is full). no-op unless
+     * CONFIG_RC_LOG_ASYNC is defined.
+     */
+    void start() noexcept;
+
+    /**
+     * wait until all queued log lines are written to Serial, e.g. before a restart
+     */
+    void flush() noexcept;
+
+    /**
+     * @return number of log lines dropped because the queue was full
+     */
+    uint32_t drops() const noexcept;
+
     /**
      * log message using printf-style formatting
      */
@@ -76,12 +106,7 @@ public:
     {
         if (level <= _log_level)
         {
-            char buf[128];
-            size_t len = snprintf(buf, sizeof(buf), fmt, std::forward<TArgs>(args)...);
-            portENTER_CRITICAL(&_lock);
-            Serial.write(buf, len);
-            Serial.flush();  // when writing to Serial on different cores, flush() seems required
-            portEXIT_CRITICAL(&_lock);
+            write(false, fmt, std::forward<TArgs>(args)...);
         }
     }
 
@@ -93,22 +118,97 @@ public:
     {
         if (level <= _log_level)
         {
-            char buf[128];
-            size_t len = snprintf(buf, sizeof(buf), fmt, std::forward<TArgs>(args)...);
-            portENTER_CRITICAL(&_lock);
-            Serial.write(buf, len);
-            Serial.println();
-            Serial.flush();  // when writing to Serial on different cores, flush() seems required
-            portEXIT_CRITICAL(&_lock);
+            write(true, fmt, std::forward<TArgs>(args)...);
         }
     }
 
 private:
     explicit logger() noexcept;
 
+#if defined(CONFIG_RC_LOG_ASYNC)
+
+    struct line
+    {
+        uint8_t len;
+        char text[CONFIG_RC_LOG_LINE_SIZE - 1];
+    };
+
+    static_assert(CONFIG_RC_LOG_LINE_SIZE <= 256, "log line length must fit in 8 bits");
+
+#if defined(CONFIG_RC_LOG_BINARY)
+
+    /**
+     * encode a binary record into a line and queue it, never blocks
+     */
+    template <typename ...TArgs>
+    void write(bool newline, const char* fmt, TArgs&& ...args) noexcept
+    {
+        line l;
+        binary::writer w(l.text, sizeof(l.text));
+        w.header(fmt, newline);
+        w.put(std::forward<TArgs>(args)...);
+        l.len = static_cast<uint8_t>(w.finish());
+        _ring.push(l);  // the ring counts drops
+    }
+
+#else
+
+    /**
+     * format into a line and queue it, never blocks
+     */
+    template <typename ...TArgs>
+    void write(bool newline, const char* fmt, TArgs&& ...args) noexcept
+    {
+        line l;
+        // leave room for the line ending, snprintf returns the untruncated length
+        int len = snprintf(l.text, sizeof(l.text) - 2, fmt, std::forward<TArgs>(args)...);
+        l.len = static_cast<uint8_t>(std::min(static_cast<size_t>(std::max(len, 0)), sizeof(l.text) - 3));
+        if (newline)
+        {
+            l.text[l.len++] = '\r';
+            l.text[l.len++] = '\n';
+        }
+        _ring.push(l);  // the ring counts drops
+    }
+
+#endif
+
+    /**
+     * write all queued lines to Serial (drain task only)
+     */
+    void drain() noexcept;
+
+    static void drain_task(void* arg);
+
+#else
+
+    template <typename ...TArgs>
+    void write(bool newline, const char* fmt, TArgs&& ...args) noexcept
+    {
+        char buf[CONFIG_RC_LOG_LINE_SIZE];
+        size_t len = snprintf(buf, sizeof(buf), fmt, std::forward<TArgs>(args)...);
+        len = std::min(len, sizeof(buf) - 1);   // snprintf returns the untruncated length
+        portENTER_CRITICAL(&_lock);
+        Serial.write(buf, len);
+        if (newline)
+        {
+            Serial.println();
+        }
+        Serial.flush();  // when writing to Serial on different cores, flush() seems required
+        portEXIT_CRITICAL(&_lock);
+    }
+
+#endif
+
 private:
     log_level _log_level;
+#if defined(CONFIG_RC_LOG_ASYNC)
+    utils::mpsc_ring<line, CONFIG_RC_LOG_QUEUE_LENGTH> _ring;
+    TaskHandle_t _task;
+    uint32_t _drops_reported;
+#else
     portMUX_TYPE _lock;
+#endif
 };
 
 } // namespace logging
@@ -38,6 +38,137 @@
 /// statistics timeout in microseconds
 #define CONFIG_RC_STATS_TIMEOUT 5000000
 
+/// depth of the CAN-bus frame queue between the interrupt handler and Bluetooth LE task (power of two)
+#define CONFIG_CANBUS_QUEUE_LENGTH 8
+
+/// if defined, hand frames from the interrupt handler to the Bluetooth LE task through a latest-value
+/// per-ID mailbox instead of a FIFO queue. under backpressure only the newest frame of each ID is kept.
+// #define CONFIG_CANBUS_MAILBOX
+
+/// number of per-ID mailbox slots, must be at least the number of IDs the decoder knows
+#define CONFIG_CANBUS_MAILBOX_SLOTS 32
+
+/// if defined, the Bluetooth LE task blocks until the interrupt handler signals queued frames,
+/// instead of polling the frame queue
+#define CONFIG_CANBUS_EVENT_DRIVEN
+
+/// event driven batching window: wake the Bluetooth LE task once this many frames are queued...
+#define CONFIG_CANBUS_WAKE_FRAMES 1
+
+/// ...or once the oldest queued frame has waited this many microseconds, whichever comes first.
+/// when the bus goes quiet the task wakes on its own after this time, rounded up to a tick
+#define CONFIG_CANBUS_WAKE_TIMEOUT 2000
+
+/// if defined, the CAN-bus interrupt handler and everything it calls run from IRAM and use no data in flash,
+/// and the interrupt is allocated with ESP_INTR_FLAG_IRAM, so frames are still taken while a flash erase or
+/// write has the cache disabled
+// #define CONFIG_CANBUS_ISR_IN_IRAM
+
+/// if defined, stamp every frame in the interrupt handler and record per ID latency histograms
+/// (interrupt -> dequeue -> notify), printed with the stats
+// #define CONFIG_RC_TRACE
+
+/// number of IDs with latency histograms in trace mode
+#define CONFIG_RC_TRACE_IDS 32
+
+/// if defined, every frame the acceptance filter lets through is recorded before decimation into a staging
+/// buffer in internal RAM, moved to a ring buffer in PSRAM and written in blocks to the
+/// CONFIG_RC_RECORDER_PARTITION flash partition (see partitions_recorder.csv and docs/Arduino.md).
+/// requires CONFIG_CANBUS_ISR_IN_IRAM. host/tools/recdecode converts a partition image to candump text
+// #define CONFIG_RC_RECORDER
+
+/// size of the recorder staging buffer in internal RAM in bytes (power of two), it holds the frames
+/// received while a block is erased and written
+#define CONFIG_RC_RECORDER_STAGING (16 * 1024)
+
+/// size of the recorder ring buffer in PSRAM in bytes (power of two)
+#define CONFIG_RC_RECORDER_BUFFER (1024 * 1024)
+
+/// longest time in microseconds recorded frames wait in a partly filled block before they are appended
+/// to its sector
+#define CONFIG_RC_RECORDER_FLUSH_INTERVAL 2000000
+
+/// label of the flash partition the recorder writes to
+#define CONFIG_RC_RECORDER_PARTITION "canlog"
+
+/// time in microseconds without a frame after which the recorder erases the sector of its next block
+/// ahead, so the write does not have to
+#define CONFIG_RC_RECORDER_ERASE_IDLE 100000
+
+/// if defined, frames received, accepted by the decoder, dropped, suppressed and forwarded are counted per
+/// ID and published, with the load of the frames received, as a binary snapshot on the diagnostics
+/// characteristic of the Bluetooth LE service (see src/diag/diagnostics.hpp)
+// #define CONFIG_RC_DIAGNOSTICS
+
+/// number of IDs with their own counters, the first of the decoder's table. other IDs share one entry
+#define CONFIG_RC_DIAG_IDS 19
+
+/// diagnostics snapshot interval in microseconds, the receive load is averaged over it
+#define CONFIG_RC_DIAG_INTERVAL 1000000
+
+/// if defined, log lines are queued to a lock-free ring and written to Serial by a low priority
+/// task, otherwise the caller writes them to Serial itself inside a critical section
+#define CONFIG_RC_LOG_ASYNC
+
+/// if defined, log calls queue the address of their format string and the raw arguments instead of
+/// formatting on the device, host/tools/logdecode formats them using the firmware ELF file.
+/// requires CONFIG_RC_LOG_ASYNC
+// #define CONFIG_RC_LOG_BINARY
+
+/// depth of the asynchronous log ring in lines (power of two)
+#define CONFIG_RC_LOG_QUEUE_LENGTH 32
+
+/// longest log line in bytes including the line ending, longer lines are truncated
+#define CONFIG_RC_LOG_LINE_SIZE 128
+
+/// cache line size, used to keep producer and consumer state apart
+#define CONFIG_RC_CACHE_LINE_SIZE 32
+
+/// if defined, signals listed in the vehicle's packed_frames are extracted on the device and repacked into
+/// synthetic frames under a custom ID, so one notification carries several signals. RaceChrono subscribes
+/// to the custom ID and decodes it with equations (see docs/AddingNewVehicles.md)
+// #define CONFIG_RC_PACKED_SIGNALS
+
+/// if defined, a decoded frame with the same payload as the last one sent for its ID is not sent,
+/// unless that was sent CONFIG_RC_SUPPRESS_MAX_AGE or longer ago
+// #define CONFIG_RC_SUPPRESS_UNCHANGED
+
+/// longest time in microseconds an ID with an unchanged payload goes without a frame sent, keeps
+/// RaceChrono from timing out the channel
+#define CONFIG_RC_SUPPRESS_MAX_AGE 3000000
+
+/// if defined, pack several CAN-bus frames into each Bluetooth LE notification (up to the negotiated MTU) on a
+/// batch characteristic, for clients that enable its notifications. others get plain RaceChrono frames
+// #define CONFIG_RC_BATCH_NOTIFY
+
+/// maximum time in microseconds a frame may wait in a notification batch before it is sent
+#define CONFIG_RC_BATCH_DEADLINE 10000
+
+/// if defined, frames wait in a queue per priority class and are paced to the rate the link takes,
+/// classes share the link by weighted deficit round-robin so slow channels cannot delay fast ones
+// #define CONFIG_RC_SCHEDULER
+
+/// highest rate in frames per second the scheduler sends at, and its rate at boot
+#define CONFIG_RC_SCHED_RATE 400
+
+/// lowest rate in frames per second the scheduler backs off to when notifications fail
+#define CONFIG_RC_SCHED_MIN_RATE 50
+
+/// frames per second the rate grows by each interval the link keeps up while frames wait
+#define CONFIG_RC_SCHED_RATE_STEP 20
+
+/// shortest time in microseconds between two changes of the scheduler rate
+#define CONFIG_RC_SCHED_ADAPT_INTERVAL 50000
+
+/// frames that may be sent back to back after the link was idle
+#define CONFIG_RC_SCHED_BURST 8
+
+/// round-robin quantum in frames of the high, normal and low priority classes
+#define CONFIG_RC_SCHED_WEIGHTS { 6, 3, 1 }
+
+/// depth of each priority class queue
+#define CONFIG_RC_SCHED_QUEUE_LENGTH 8
+
 /// if DEBUG is defined, logger will be enabled and print to serial console
 // #define DEBUG
 
@@ -47,6 +178,13 @@
 /// _x branch is unlikely to be true
 #define RCUNLIKELY(_x)  __builtin_expect(!!(_x), 0)
 
+/// CAN-bus interrupt handler code, see CONFIG_CANBUS_ISR_IN_IRAM
+#if defined(CONFIG_CANBUS_ISR_IN_IRAM)
+#define CANBUS_ISR_ATTR IRAM_ATTR
+#else
+#define CANBUS_ISR_ATTR
+#endif
+
 /// assert _expr is true (always not just DEBUG mode)
 #define RCASSERT(_expr) do {                  \
     if (RCUNLIKELY(!(_expr))) { abort(); }    \
@@ -74,6 +212,13 @@
 #define BLE_PWR_LVL ESP_PWR_LVL_P9
 #endif
 
+// Linux host build (simulated TWAI controller and Bluetooth LE, see host/)
+#if defined(RC_HOST)
+#define CAN_RX_PIN GPIO_NUM_26
+#define CAN_TX_PIN GPIO_NUM_25
+#define BLE_PWR_LVL ESP_PWR_LVL_P9
+#endif
+
 /// disable copy
 #define CPP_NOCOPY(_name)                     \
     _name(_name const&) = delete;             \
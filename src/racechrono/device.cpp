@@ -23,6 +23,7 @@
 #include "../logging/logging.hpp"
 
 #include <cstdio>
+#include <cstring>
 
 #include "device.hpp"
 
@@ -58,6 +59,10 @@ bool device::start(BLECharacteristicCallbacks* callbacks) noexcept
 
     BLEDevice::init(name);
     BLEDevice::setPower(BLE_PWR_LVL);
+#if defined(CONFIG_RC_BATCH_NOTIFY)
+    // allow the client to negotiate a large MTU, so many frames fit in one notification
+    BLEDevice::setMTU(max_value_size + notify_header_size);
+#endif
 
     _server = BLEDevice::createServer();
     _server->setCallbacks(this);
@@ -68,6 +73,18 @@ bool device::start(BLECharacteristicCallbacks* callbacks) noexcept
     _canbus_frames = _service->createCharacteristic(can_bus_characteristic_uuid,
         BLECharacteristic::PROPERTY_READ | BLECharacteristic::PROPERTY_NOTIFY);
     _canbus_frames->addDescriptor(&_2902_desc);
+    _canbus_frames->setCallbacks(this);
+#if defined(CONFIG_RC_BATCH_NOTIFY)
+    _canbus_batches = _service->createCharacteristic(can_bus_batch_characteristic_uuid,
+        BLECharacteristic::PROPERTY_READ | BLECharacteristic::PROPERTY_NOTIFY);
+    _canbus_batches->addDescriptor(&_batch_2902_desc);
+    _canbus_batches->setCallbacks(this);
+#endif
+#if defined(CONFIG_RC_DIAGNOSTICS)
+    _diagnostics = _service->createCharacteristic(diagnostics_characteristic_uuid,
+        BLECharacteristic::PROPERTY_READ | BLECharacteristic::PROPERTY_NOTIFY);
+    _diagnostics->addDescriptor(&_diagnostics_2902_desc);
+#endif
     _service->start();
 
     BLEAdvertising* advertising = BLEDevice::getAdvertising();
@@ -91,9 +108,150 @@ void device::onDisconnect(BLEServer*)
     // once connection is made, BLE stops advertising, so on disconnect, start advertising again..
     infoln("Bluetooth LE client disconnected!");
     _client_connected = false;
+    _mtu = default_mtu;
     BLEDevice::startAdvertising();
 }
 
+void device::onMtuChanged(BLEServer*, esp_ble_gatts_cb_param_t* param)
+{
+    infoln("Bluetooth LE MTU %u", param->mtu.mtu);
+    _mtu = param->mtu.mtu;
+}
+
+void device::onStatus(BLECharacteristic*, Status s, uint32_t)
+{
+    // esp_ble_gatts_send_indicate() fails while the L2CAP buffers wait for the link
+    if (s == Status::ERROR_GATT)
+    {
+        ++_notify_failures;
+    }
+}
+
+#if defined(CONFIG_RC_DIAGNOSTICS)
+void device::diagnostics(uint8_t* data, size_t len) noexcept
+{
+    if (_client_connected && _diagnostics_2902_desc.getNotifications())
+    {
+        // whole entries only, the count tells the client to read the rest
+        size_t capacity = _mtu - notify_header_size;
+        if (len <= capacity)
+        {
+            _diagnostics->setValue(data, len);
+            _diagnostics->notify();
+        }
+        else
+        {
+            size_t entries = (capacity - diag::diagnostics::header_size) / diag::diagnostics::entry_size;
+            uint8_t count = data[1];
+            data[1] = static_cast<uint8_t>(entries | diag::diagnostics::count_truncated);
+            _diagnostics->setValue(data, diag::diagnostics::header_size + entries * diag::diagnostics::entry_size);
+            _diagnostics->notify();
+            data[1] = count;
+        }
+    }
+
+    _diagnostics->setValue(data, len);
+}
+#endif
+
+#if defined(CONFIG_RC_BATCH_NOTIFY)
+void device::send(canbus::frame& f) noexcept
+{
+    if (!_client_connected)
+    {
+        _batch_len = 0;
+        _batch_frames = 0;
+        return;
+    }
+
+    // the client has not opted in to batches
+    if (!_batch_2902_desc.getNotifications())
+    {
+        flush();
+        send_frame(f);
+        return;
+    }
+
+    size_t len = sizeof(uint32_t) + f.info.dlc;
+    size_t capacity = _mtu - notify_header_size;
+    if (capacity > sizeof(_batch))
+    {
+        capacity = sizeof(_batch);
+    }
+
+    // next frame does not fit, send what we have first
+    if (_batch_len + 1 + len > capacity)
+    {
+        flush();
+    }
+
+    if (_batch_frames == 0)
+    {
+        _batch_ts = micros();
+    }
+
+#if defined(CONFIG_RC_DIAGNOSTICS)
+    _batch_entries[_batch_frames] = static_cast<uint8_t>(DIAG.output_entry(f));
+#endif
+#if defined(CONFIG_RC_TRACE)
+    _batch_ids[_batch_frames] = canbus::table_id(f);
+    _batch_dequeued[_batch_frames] = f.ts;
+#endif
+    _batch[_batch_len++] = static_cast<uint8_t>(len);
+    memcpy(&_batch[_batch_len], &f.id, len);
+    _batch_len += len;
+    ++_batch_frames;
+    ++_ble_count;
+
+    // not even the smallest frame (length + 4 byte id) would fit anymore
+    if (_batch_len + 1 + sizeof(uint32_t) > capacity)
+    {
+        flush();
+    }
+}
+
+void device::poll() noexcept
+{
+    if (_batch_frames > 0 && micros() - _batch_ts >= CONFIG_RC_BATCH_DEADLINE)
+    {
+        flush();
+    }
+}
+
+void device::flush() noexcept
+{
+    if (_batch_frames == 0)
+    {
+        return;
+    }
+
+    // single frame, keep standard RaceChrono format
+    bool sent = _client_connected
+        && (_batch_frames == 1
+            ? notify(_canbus_frames, &_batch[1], _batch_len - 1)
+            : notify(_canbus_batches, _batch, _batch_len));
+    if (sent)
+    {
+#if defined(CONFIG_RC_DIAGNOSTICS)
+        for (size_t i = 0; i < _batch_frames; i++)
+        {
+            DIAG.forwarded(_batch_entries[i]);
+        }
+#endif
+#if defined(CONFIG_RC_TRACE)
+        uint32_t now = trace::tracer::now();
+        for (size_t i = 0; i < _batch_frames; i++)
+        {
+            TRACER.notified(_batch_ids[i], _batch_dequeued[i], now);
+        }
+#endif
+    }
+
+    _batch_len = 0;
+    _batch_frames = 0;
+}
+#endif
+
 #if defined(DEBUG)
 void device::stats() noexcept
 {
@@ -103,8 +261,17 @@ void device::stats() noexcept
 
         if (delta > 0UL)
         {
-            float msg_per_sec = (static_cast<float>(exchange(_ble_count, 0UL)) / static_cast<float>(delta)) * 1e6f;
+            unsigned long ble_count = exchange(_ble_count, 0UL);
+            unsigned long notify_count = exchange(_notify_count, 0UL);
+            uint32_t notify_failures = _notify_failures - exchange(_reported_failures, _notify_failures);
+            float msg_per_sec = (static_cast<float>(ble_count) / static_cast<float>(delta)) * 1e6f;
+            float notify_per_sec = (static_cast<float>(notify_count) / static_cast<float>(delta)) * 1e6f;
+            float frames_per_notify = notify_count > 0UL ? static_cast<float>(ble_count) / static_cast<float>(notify_count) : 0.0f;
             infoln(" Bluetooth LE msg/s: %.2f", msg_per_sec);
+            infoln("       BLE notify/s: %.2f", notify_per_sec);
+            infoln("BLE notify failed/s: %.2f",
+                (static_cast<float>(notify_failures) / static_cast<float>(delta)) * 1e6f);
+            infoln("  BLE frames/notify: %.2f", frames_per_notify);
         }
     }
 }
@@ -22,6 +22,9 @@
 #pragma once
 
 #include "../racechrono-canbus.hpp"
+#include "../canbus/frame.hpp"
+#include "../diag/diagnostics.hpp"
+#include "../trace/trace.hpp"
 #include "../utils/timer.hpp"
 
 #include <BLE2902.h>
@@ -36,6 +39,7 @@ namespace racechrono
  */
 class device final
     : public BLEServerCallbacks
+    , public BLECharacteristicCallbacks
 {
     CPP_NOCOPY(device);
     CPP_NOMOVE(device);
@@ -70,19 +74,52 @@ public:
      */
     bool start(BLECharacteristicCallbacks* callbacks) noexcept;
 
+#if defined(CONFIG_RC_BATCH_NOTIFY)
     /**
-     * Send \p data of size \p len over Bluetooth LE stack as an LE notification.
+     * Queue frame \p f for the next batched LE notification, if the client enabled
+     * notifications of the batch characteristic. The batch is sent once the next frame
+     * would not fit in the negotiated MTU. Otherwise \p f is sent as a plain RaceChrono
+     * frame on the CAN-bus characteristic, as without CONFIG_RC_BATCH_NOTIFY.
+     *
+     * Batches go out on their own characteristic, as a sequence of [length (1 byte)]
+     * [RaceChrono frame (length bytes)], so the CAN-bus characteristic keeps the
+     * RaceChrono wire format for clients that do not read batches. A batch holding a
+     * single frame is sent as a plain RaceChrono frame on the CAN-bus characteristic.
      */
-    __always_inline void send(uint8_t* data, size_t len) noexcept
+    void send(canbus::frame& f) noexcept;
+
+    /**
+     * Send any pending batch, if its oldest frame has waited CONFIG_RC_BATCH_DEADLINE.
+     */
+    void poll() noexcept;
+
+    /**
+     * Send any pending batch now.
+     */
+    void flush() noexcept;
+#else
+    /**
+     * Send frame \p f over Bluetooth LE stack as an LE notification.
+     */
+    __always_inline void send(canbus::frame& f) noexcept
     {
-        if (_client_connected)
-        {
-            _canbus_frames->setValue(data, len);
-            _canbus_frames->notify();
-            ++_ble_count;
-        }
+        send_frame(f);
     }
 
+    void poll() noexcept {}
+
+    void flush() noexcept {}
+#endif
+
+#if defined(CONFIG_RC_DIAGNOSTICS)
+    /**
+     * Make diagnostics snapshot \p data of size \p len the value of the diagnostics
+     * characteristic, and notify a client that enabled notifications with the entries
+     * that fit the MTU.
+     */
+    void diagnostics(uint8_t* data, size_t len) noexcept;
+#endif
+
     /**
      * BLE callback for when a client (RaceChrono app) connects
      */
@@ -93,6 +130,26 @@ public:
      */
     void onDisconnect(BLEServer*) override;
 
+    /**
+     * BLE callback for when the client negotiates a new MTU
+     */
+    void onMtuChanged(BLEServer*, esp_ble_gatts_cb_param_t* param) override;
+
+    /**
+     * BLE callback with the outcome of a CAN-bus frames notification
+     */
+    void onStatus(BLECharacteristic*, Status s, uint32_t code) override;
+
+    /**
+     * @return CAN-bus frames notifications the stack refused since boot, free running. The
+     * stack refuses a notification while its buffers wait for the link, so this is the
+     * feedback a sender uses to back off.
+     */
+    __always_inline uint32_t notify_failures() const noexcept
+    {
+        return _notify_failures;
+    }
+
     /**
      * print any bluetooth stats
      */
@@ -112,28 +169,120 @@ private:
     static constexpr uint16_t can_bus_characteristic_uuid = 0x1;
     static constexpr uint16_t pid_characteristic_uuid = 0x2;
 
+    // bus and link diagnostics (not used by RaceChrono, 0x3 and 0x4 are its GPS characteristics)
+    static constexpr uint16_t diagnostics_characteristic_uuid = 0x10;
+
+    // batched CAN-bus frames (CONFIG_RC_BATCH_NOTIFY), for clients that enable its notifications
+    static constexpr uint16_t can_bus_batch_characteristic_uuid = 0x11;
+
+    // default ATT MTU before negotiation, and the ATT notification header size
+    static constexpr uint16_t default_mtu = 23;
+    static constexpr uint16_t notify_header_size = 3;
+
+    // largest ATT attribute value
+    static constexpr size_t max_value_size = 512;
+
     explicit device() noexcept
         : _server(nullptr)
         , _service(nullptr)
         , _pid_requests(nullptr)
         , _canbus_frames(nullptr)
         , _2902_desc{}
+#if defined(CONFIG_RC_DIAGNOSTICS)
+        , _diagnostics(nullptr)
+        , _diagnostics_2902_desc{}
+#endif
         , _client_connected(false)
+        , _mtu(default_mtu)
         , _stats_timer{}
         , _ble_count(0UL)
+        , _notify_count(0UL)
+        , _notify_failures(0U)
+        , _reported_failures(0U)
+#if defined(CONFIG_RC_BATCH_NOTIFY)
+        , _canbus_batches(nullptr)
+        , _batch_2902_desc{}
+        , _batch_ts(0UL)
+        , _batch_len(0U)
+        , _batch_frames(0U)
+        , _batch{}
+#if defined(CONFIG_RC_DIAGNOSTICS)
+        , _batch_entries{}
+#endif
+#if defined(CONFIG_RC_TRACE)
+        , _batch_ids{}
+        , _batch_dequeued{}
+#endif
+#endif
     {
         _2902_desc.setNotifications(true);
     }
 
+    /**
+     * notify \p characteristic with \p data of size \p len
+     * @return true if the stack took the notification
+     */
+    __always_inline bool notify(BLECharacteristic* characteristic, uint8_t* data, size_t len) noexcept
+    {
+        uint32_t failures = _notify_failures;
+        characteristic->setValue(data, len);
+        characteristic->notify();
+        ++_notify_count;
+        return _notify_failures == failures;
+    }
+
+    /**
+     * send frame \p f as a plain RaceChrono frame on the CAN-bus characteristic
+     */
+    __always_inline void send_frame(canbus::frame& f) noexcept
+    {
+        if (_client_connected)
+        {
+            if (notify(_canbus_frames, reinterpret_cast<uint8_t*>(&f.id), sizeof(uint32_t) + f.info.dlc))
+            {
+#if defined(CONFIG_RC_DIAGNOSTICS)
+                DIAG.forwarded(DIAG.output_entry(f));
+#endif
+#if defined(CONFIG_RC_TRACE)
+                TRACER.notified(canbus::table_id(f), f.ts, trace::tracer::now());
+#endif
+            }
+            ++_ble_count;
+        }
+    }
+
 private:
     BLEServer* _server;
     BLEService* _service;
     BLECharacteristic* _pid_requests;
     BLECharacteristic* _canbus_frames;
     BLE2902 _2902_desc;
+#if defined(CONFIG_RC_DIAGNOSTICS)
+    BLECharacteristic* _diagnostics;
+    BLE2902 _diagnostics_2902_desc;    // notifications left to the client
+#endif
     bool _client_connected;
+    volatile uint16_t _mtu;
     utils::timer _stats_timer;
-    unsigned long _ble_count;
+    unsigned long _ble_count;       // frames sent
+    unsigned long _notify_count;    // notifications sent
+    uint32_t _notify_failures;      // notifications the stack refused, never reset
+    uint32_t _reported_failures;    // _notify_failures at the last stats
+#if defined(CONFIG_RC_BATCH_NOTIFY)
+    BLECharacteristic* _canbus_batches;
+    BLE2902 _batch_2902_desc;       // notifications left to the client, which opts in to batches
+    unsigned long _batch_ts;        // time first frame was added to the batch
+    size_t _batch_len;
+    size_t _batch_frames;
+    uint8_t _batch[max_value_size];
+#if defined(CONFIG_RC_DIAGNOSTICS)
+    uint8_t _batch_entries[max_value_size / (1 + sizeof(uint32_t))];    // DIAG.output_entry() of each frame
+#endif
+#if defined(CONFIG_RC_TRACE)
+    uint32_t _batch_ids[max_value_size / (1 + sizeof(uint32_t))];        // canbus::table_id() of each frame
+    uint32_t _batch_dequeued[max_value_size / (1 + sizeof(uint32_t))];   // dequeue time of each frame
+#endif
+#endif
 };
 
 } // namespace racechrono
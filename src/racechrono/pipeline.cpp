@@ -0,0 +1,49 @@
+// MIT License
+//
+// Copyright (c) 2022 Joe Roback <joe.roback@gmail.com>
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+#include "../racechrono-canbus.hpp"
+#include "../diag/diagnostics.hpp"
+
+#include "pipeline.hpp"
+
+namespace racechrono
+{
+
+void service() noexcept
+{
+    CANDEC.update_filter();
+#if defined(CONFIG_RC_SCHEDULER)
+    // frames left waiting go out on a later pass, at the latest after the wake timeout
+    RCSCHED.run(static_cast<uint32_t>(micros()));
+    RCSCHED.stats();
+#endif
+    RCDEV.poll();
+#if defined(CONFIG_RC_DIAGNOSTICS)
+    DIAG.poll();
+#endif
+    RCDEV.stats();
+    CANDEC.stats();
+#if defined(CONFIG_RC_TRACE)
+    TRACER.stats();
+#endif
+}
+
+} // namespace racechrono
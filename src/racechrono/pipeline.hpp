@@ -0,0 +1,133 @@
+// MIT License
+//
+// Copyright (c) 2022 Joe Roback <joe.roback@gmail.com>
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+#pragma once
+
+#include "../racechrono-canbus.hpp"
+#include "../canbus/decoder.hpp"
+#include "../canbus/frame.hpp"
+#include "../logging/logging.hpp"
+#include "../trace/trace.hpp"
+
+#include "device.hpp"
+#include "scheduler.hpp"
+
+#include <cstddef>
+#include <cstdint>
+
+namespace racechrono
+{
+
+/*
+ * Bluetooth LE task side of the pipeline, one pass per batch of frames taken from the
+ * CAN-bus controller queue. core0() in racechrono-canbus.ino and the host replay
+ * benchmark both run it, so the benchmark measures the loop that ships.
+ */
+
+/**
+ * observers of forward(), the firmware has none. the host replay benchmark times
+ * frames with them.
+ */
+struct pipeline_hooks
+{
+    /**
+     * frame \p f was taken from the controller queue
+     */
+    __always_inline void taken(canbus::frame const& f) noexcept { (void) f; }
+
+    /**
+     * frame \p f is handed to the output scheduler, or straight to Bluetooth LE
+     */
+    __always_inline void output(canbus::frame const& f) noexcept { (void) f; }
+};
+
+/**
+ * hand a frame to the output scheduler, or straight to Bluetooth LE
+ */
+__always_inline void output(canbus::frame& f) noexcept
+{
+#if defined(CONFIG_RC_SCHEDULER)
+    RCSCHED.push(f);
+#else
+    RCDEV.send(f);
+#endif
+}
+
+/**
+ * send what should be sent of the \p count frames taken from the controller queue,
+ * plus the packed signal frames they complete
+ */
+template <typename Hooks>
+void forward(canbus::frame* frames, size_t count, Hooks& hooks) noexcept
+{
+    uint32_t now = static_cast<uint32_t>(micros());
+#if defined(CONFIG_RC_TRACE)
+    uint32_t dequeued = trace::tracer::now();
+#endif
+    for (size_t i = 0; i < count; i++)
+    {
+        canbus::frame& f = frames[i];
+        hooks.taken(f);
+#if defined(DEBUG)
+        uint32_t id = f.id;
+        uint8_t len = f.info.dlc;
+        verboseln("PID 0x%03x LEN %u", id, len);
+#endif
+        if (CANDEC.should_send(f, now))
+        {
+#if defined(CONFIG_RC_TRACE)
+            TRACER.dequeued(f, dequeued);
+#endif
+            hooks.output(f);
+            output(f);
+        }
+#if defined(CONFIG_RC_PACKED_SIGNALS)
+        if (CANDEC.packs(f))
+        {
+            canbus::frame* packed;
+            size_t packed_count = CANDEC.pack(f, packed);
+            for (size_t p = 0; p < packed_count; p++)
+            {
+#if defined(CONFIG_RC_TRACE)
+                packed[p].ts = dequeued;
+#endif
+                hooks.output(packed[p]);
+                output(packed[p]);
+            }
+        }
+#endif
+    }
+}
+
+__always_inline void forward(canbus::frame* frames, size_t count) noexcept
+{
+    pipeline_hooks hooks;
+    forward(frames, count, hooks);
+}
+
+/**
+ * once the controller queue is drained: apply new ID requests to the acceptance filter,
+ * send what the scheduler allows, flush due notifications, publish diagnostics and print
+ * stats
+ */
+void service() noexcept;
+
+} // namespace racechrono
@@ -0,0 +1,222 @@
+// MIT License
+//
+// Copyright (c) 2022 Joe Roback <joe.roback@gmail.com>
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+#include "../racechrono-canbus.hpp"
+#include "../logging/logging.hpp"
+
+#include "device.hpp"
+#include "scheduler.hpp"
+
+#if defined(CONFIG_RC_SCHEDULER)
+
+namespace racechrono
+{
+
+namespace
+{
+
+// round-robin quantum of each class in frames, indexed by canbus::priority
+constexpr uint32_t weights[canbus::priority_count] = CONFIG_RC_SCHED_WEIGHTS;
+
+// bucket depth, frames that may be sent back to back after an idle period
+constexpr uint64_t max_tokens = CONFIG_RC_SCHED_BURST * 1000000ULL;
+
+} // namespace
+
+scheduler& scheduler::get() noexcept
+{
+    static scheduler instance;
+    return instance;
+}
+
+scheduler::scheduler() noexcept
+    : _classes{}
+    , _current(0)
+    , _visited(false)
+    , _tokens(max_tokens)
+    , _refilled(static_cast<uint32_t>(micros()))
+    , _rate(CONFIG_RC_SCHED_RATE)
+    , _adapted(_refilled)
+    , _failures(0)
+    , _limited(false)
+    , _stats_timer{}
+{
+}
+
+void scheduler::push(canbus::frame const& f) noexcept
+{
+    uint32_t id = canbus::table_id(f);
+    queue& q = _classes[static_cast<size_t>(CANDEC.priority_of(id))];
+    ++q.totals.offered;
+
+    // the newest frame of an ID replaces one still waiting, in place
+    for (size_t i = 0; i < q.count; i++)
+    {
+        canbus::frame& waiting = q.frames[(q.head + i) % queue_length];
+        if (canbus::table_id(waiting) == id)
+        {
+            waiting = f;
+            ++q.totals.superseded;
+            return;
+        }
+    }
+
+    if (q.count == queue_length)
+    {
+        q.head = (q.head + 1) % queue_length;
+        --q.count;
+        ++q.totals.dropped;
+    }
+
+    q.frames[(q.head + q.count) % queue_length] = f;
+    ++q.count;
+}
+
+void scheduler::run(uint32_t now) noexcept
+{
+    adapt(now);
+
+    // at most one second of tokens, so a long idle period cannot overflow
+    uint32_t elapsed = now - _refilled;
+    _refilled = now;
+    _tokens += static_cast<uint64_t>(elapsed < 1000000U ? elapsed : 1000000U) * _rate;
+    if (_tokens > max_tokens)
+    {
+        _tokens = max_tokens;
+    }
+
+    size_t waiting = size();
+    while (waiting > 0 && _tokens >= frame_cost)
+    {
+        queue& q = _classes[_current];
+
+        // an empty class keeps no credit
+        if (q.count == 0)
+        {
+            q.deficit = 0;
+            next();
+            continue;
+        }
+
+        if (!_visited)
+        {
+            q.deficit += weights[_current];
+            _visited = true;
+        }
+
+        if (q.deficit == 0)
+        {
+            next();
+            continue;
+        }
+
+        canbus::frame& f = q.frames[q.head];
+        RCDEV.send(f);
+        q.head = (q.head + 1) % queue_length;
+        --q.count;
+        --q.deficit;
+        ++q.totals.sent;
+        _tokens -= frame_cost;
+        --waiting;
+    }
+
+    if (waiting > 0)
+    {
+        _limited = true;
+    }
+}
+
+size_t scheduler::size() const noexcept
+{
+    size_t count = 0;
+    for (queue const& q : _classes)
+    {
+        count += q.count;
+    }
+    return count;
+}
+
+void scheduler::next() noexcept
+{
+    _current = (_current + 1) % canbus::priority_count;
+    _visited = false;
+}
+
+void scheduler::adapt(uint32_t now) noexcept
+{
+    if (now - _adapted < CONFIG_RC_SCHED_ADAPT_INTERVAL)
+    {
+        return;
+    }
+    _adapted = now;
+
+    // the stack refused notifications, its buffers wait for the link: back off
+    uint32_t failures = RCDEV.notify_failures();
+    if (failures != _failures)
+    {
+        _failures = failures;
+        _rate = _rate / 2 > CONFIG_RC_SCHED_MIN_RATE ? _rate / 2 : CONFIG_RC_SCHED_MIN_RATE;
+        _tokens = 0;
+    }
+    // the link kept up and frames waited for tokens: probe for more
+    else if (_limited)
+    {
+        _rate = _rate + CONFIG_RC_SCHED_RATE_STEP < CONFIG_RC_SCHED_RATE ?
+            _rate + CONFIG_RC_SCHED_RATE_STEP : CONFIG_RC_SCHED_RATE;
+    }
+
+    _limited = false;
+}
+
+#if defined(DEBUG)
+void scheduler::stats() noexcept
+{
+    if (logging::logger::get().level() >= logging::log_level::info)
+    {
+        unsigned long delta = _stats_timer.elapsed(CONFIG_RC_STATS_TIMEOUT);
+
+        if (delta > 0UL)
+        {
+            static const char* const names[canbus::priority_count] = { "high", "normal", "low" };
+
+            infoln("  Scheduler rate: %u frames/s", static_cast<unsigned>(_rate));
+            infoln("  Class   offered/s  sent/s  superseded/s  dropped/s");
+            for (size_t i = 0; i < canbus::priority_count; i++)
+            {
+                queue& q = _classes[i];
+                float scale = 1e6f / static_cast<float>(delta);
+                infoln("%7s  %10.2f  %6.2f  %12.2f  %9.2f", names[i],
+                    static_cast<float>(q.totals.offered - q.reported.offered) * scale,
+                    static_cast<float>(q.totals.sent - q.reported.sent) * scale,
+                    static_cast<float>(q.totals.superseded - q.reported.superseded) * scale,
+                    static_cast<float>(q.totals.dropped - q.reported.dropped) * scale);
+                q.reported = q.totals;
+            }
+        }
+    }
+}
+#endif
+
+} // namespace racechrono
+
+racechrono::scheduler& RCSCHED = racechrono::scheduler::get();
+
+#endif
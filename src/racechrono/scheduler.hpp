@@ -0,0 +1,153 @@
+// MIT License
+//
+// Copyright (c) 2022 Joe Roback <joe.roback@gmail.com>
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+#pragma once
+
+#include "../racechrono-canbus.hpp"
+#include "../canbus/decoder.hpp"
+#include "../canbus/frame.hpp"
+#include "../utils/timer.hpp"
+
+#include <cstdint>
+
+#if defined(CONFIG_RC_SCHEDULER)
+
+namespace racechrono
+{
+
+/**
+ * Output scheduler (CONFIG_RC_SCHEDULER), between the CAN-bus frame queue and device::send().
+ *
+ * Frames wait in a small queue per priority class and are paced by a token bucket to the
+ * rate the Bluetooth LE link takes. When more is offered the classes share that budget by
+ * deficit round-robin, weighted by CONFIG_RC_SCHED_WEIGHTS, so slow channels cannot hold up
+ * high dynamics ones. A queued frame is replaced by a newer frame of the same ID, a full
+ * class queue drops its oldest.
+ *
+ * The rate follows the link: it starts at CONFIG_RC_SCHED_RATE, is halved (down to
+ * CONFIG_RC_SCHED_MIN_RATE) when the stack refused notifications (device::notify_failures())
+ * and grows by CONFIG_RC_SCHED_RATE_STEP while the link keeps up and frames wait, at most
+ * one change per CONFIG_RC_SCHED_ADAPT_INTERVAL. The connection interval and client
+ * latency then set the rate, not the configuration.
+ *
+ * Everything runs on core 0, no locking is needed.
+ */
+class scheduler final
+{
+    CPP_NOCOPY(scheduler);
+    CPP_NOMOVE(scheduler);
+
+public:
+    /**
+     * cumulative counters of a priority class
+     */
+    struct counters
+    {
+        uint32_t offered;       // frames pushed
+        uint32_t sent;          // frames handed to device::send()
+        uint32_t superseded;    // frames replaced by a newer frame of the same ID
+        uint32_t dropped;       // frames dropped from a full queue
+    };
+
+    static scheduler& get() noexcept;
+
+    ~scheduler() noexcept = default;
+
+    /**
+     * queue \p f in the priority class of its ID
+     */
+    void push(canbus::frame const& f) noexcept;
+
+    /**
+     * send as many queued frames as the link budget allows at \p now (microseconds)
+     */
+    void run(uint32_t now) noexcept;
+
+    /**
+     * @return current rate in frames per second
+     */
+    __always_inline uint32_t rate() const noexcept
+    {
+        return _rate;
+    }
+
+    /**
+     * @return number of frames waiting in all classes
+     */
+    size_t size() const noexcept;
+
+    /**
+     * @return counters of priority class \p p
+     */
+    counters const& totals(canbus::priority p) const noexcept
+    {
+        return _classes[static_cast<size_t>(p)].totals;
+    }
+
+    /**
+     * print per class offered and achieved rates
+     */
+#if defined(DEBUG)
+    void stats() noexcept;
+#else
+    void stats() noexcept {}
+#endif
+
+private:
+    static constexpr size_t queue_length = CONFIG_RC_SCHED_QUEUE_LENGTH;
+
+    // token bucket units per frame, tokens are added at _rate units per microsecond
+    static constexpr uint64_t frame_cost = 1000000ULL;
+
+    struct queue
+    {
+        canbus::frame frames[queue_length];
+        uint8_t head;
+        uint8_t count;
+        uint32_t deficit;       // frames this class may still send in the current round
+        counters totals;
+        counters reported;      // totals at the last stats
+    };
+
+    explicit scheduler() noexcept;
+
+    void next() noexcept;
+
+    void adapt(uint32_t now) noexcept;
+
+private:
+    queue _classes[canbus::priority_count];
+    size_t _current;            // class being served
+    bool _visited;              // _current got its quantum for this round
+    uint64_t _tokens;
+    uint32_t _refilled;         // time tokens were last added
+    uint32_t _rate;             // frames per second
+    uint32_t _adapted;          // time _rate was last changed or held
+    uint32_t _failures;         // device::notify_failures() acted on
+    bool _limited;              // frames waited for tokens since _adapted
+    utils::timer _stats_timer;
+};
+
+} // namespace racechrono
+
+extern racechrono::scheduler& RCSCHED;
+
+#endif
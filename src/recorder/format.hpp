@@ -0,0 +1,212 @@
+// MIT License
+//
+// Copyright (c) 2022 Joe Roback <joe.roback@gmail.com>
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+#pragma once
+
+#include "../racechrono-canbus.hpp"
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+
+/*
+ * Recorder flash format (CONFIG_RC_RECORDER).
+ *
+ * The recording partition is a circular log of fixed size blocks, one flash sector
+ * each. A block is a header followed by frame records:
+ *
+ *   [magic 4][sequence 4][base µs 8][session 2][used 2][frames 2][reserved 2][lost 4]
+ *
+ * all little endian. sequence increases by one per block written and orders the
+ * blocks once the log has wrapped, session increases by one per boot, base is the
+ * time (µs since boot) the first record's delta counts from and lost is the running
+ * count of frames dropped by the recorder this session. used is the number of record
+ * bytes after the header, the rest of the block is left erased.
+ *
+ * A block is written in place as it fills: records are appended to the erased tail of
+ * its sector, which NOR flash programs without a new erase. While the block is open
+ * used, frames, reserved and lost are left erased (all ones) and the records end at
+ * the first erased byte, a head of 0xFF never being valid. They are programmed when
+ * the block is closed, full or at sync.
+ *
+ * A record is one CAN frame:
+ *
+ *   [head][delta][id][data]
+ *
+ *   head    bits 0..3 DLC, bit 4 extended ID, bit 5 remote frame, bit 6 frames were
+ *           lost right before this one
+ *   delta   µs since the previous record, unsigned LEB128 (1 byte up to 127 µs)
+ *   id      2 bytes LE for standard IDs, 4 bytes LE for extended IDs
+ *   data    DLC bytes, none for remote frames
+ *
+ * tools/recdecode on the host converts a partition image to candump text.
+ */
+
+namespace recorder
+{
+
+namespace format
+{
+
+/// "RCR1", first word of every written block
+constexpr uint32_t block_magic = 0x31524352U;
+
+/// block size, one flash sector (the erase unit)
+constexpr size_t block_size = 4096;
+
+/// bytes before the first record of a block
+constexpr size_t header_size = 28;
+
+/// offset of used, the first header field left erased while the block is open
+constexpr size_t used_offset = 18;
+
+/// used of an open block
+constexpr uint16_t used_open = 0xFFFF;
+
+/// longest record: head, 5 byte delta, extended ID and 8 data bytes
+constexpr size_t max_record_size = 1 + 5 + 4 + 8;
+
+constexpr uint8_t head_dlc = 0x0F;
+constexpr uint8_t head_extended = 0x10;
+constexpr uint8_t head_remote = 0x20;
+constexpr uint8_t head_lost = 0x40;
+
+/**
+ * block header, as stored at the start of the block
+ */
+struct block_header
+{
+    uint32_t magic;
+    uint32_t sequence;
+    uint64_t base;
+    uint16_t session;
+    uint16_t used;
+    uint16_t frames;
+    uint16_t reserved;
+    uint32_t lost;
+} __attribute__ ((__packed__));
+
+static_assert(sizeof(block_header) == header_size, "block header size mismatch");
+static_assert(offsetof(block_header, used) == used_offset, "block header used offset mismatch");
+
+/**
+ * decoded record
+ */
+struct record
+{
+    uint8_t head;
+    uint32_t delta;
+    uint32_t id;
+    uint8_t data[8];
+
+    __always_inline uint8_t dlc() const noexcept { return head & head_dlc; }
+    __always_inline bool extended() const noexcept { return (head & head_extended) != 0; }
+    __always_inline bool remote() const noexcept { return (head & head_remote) != 0; }
+    __always_inline bool lost() const noexcept { return (head & head_lost) != 0; }
+};
+
+/**
+ * encode a record into \p out, which has room for max_record_size bytes
+ * @return size of the record in bytes
+ */
+__always_inline size_t encode(uint8_t* out, uint8_t head, uint32_t delta, uint32_t id, uint8_t const* data) noexcept
+{
+    size_t pos = 0;
+    out[pos++] = head;
+
+    while (delta >= 0x80U)
+    {
+        out[pos++] = static_cast<uint8_t>(delta | 0x80U);
+        delta >>= 7;
+    }
+    out[pos++] = static_cast<uint8_t>(delta);
+
+    out[pos++] = static_cast<uint8_t>(id);
+    out[pos++] = static_cast<uint8_t>(id >> 8);
+    if (head & head_extended)
+    {
+        out[pos++] = static_cast<uint8_t>(id >> 16);
+        out[pos++] = static_cast<uint8_t>(id >> 24);
+    }
+
+    if (!(head & head_remote))
+    {
+        uint8_t dlc = head & head_dlc;
+        memcpy(&out[pos], data, dlc);
+        pos += dlc;
+    }
+
+    return pos;
+}
+
+/**
+ * decode the record at \p in, of which \p avail bytes are readable
+ * @return size of the record in bytes, 0 if it is truncated or malformed
+ */
+inline size_t decode(uint8_t const* in, size_t avail, record& r) noexcept
+{
+    size_t pos = 0;
+    if (avail < 1)
+    {
+        return 0;
+    }
+    r.head = in[pos++];
+    if ((r.head & 0x80U) || (r.head & head_dlc) > 8)
+    {
+        return 0;
+    }
+
+    r.delta = 0;
+    for (uint32_t shift = 0; ; shift += 7)
+    {
+        if (pos >= avail || shift > 28)
+        {
+            return 0;
+        }
+        uint8_t b = in[pos++];
+        r.delta |= static_cast<uint32_t>(b & 0x7FU) << shift;
+        if (!(b & 0x80U))
+        {
+            break;
+        }
+    }
+
+    size_t id_size = r.extended() ? 4 : 2;
+    size_t data_size = r.remote() ? 0 : r.dlc();
+    if (pos + id_size + data_size > avail)
+    {
+        return 0;
+    }
+
+    r.id = 0;
+    for (size_t i = 0; i < id_size; i++)
+    {
+        r.id |= static_cast<uint32_t>(in[pos++]) << (8 * i);
+    }
+    memcpy(r.data, &in[pos], data_size);
+    pos += data_size;
+
+    return pos;
+}
+
+} // namespace format
+
+} // namespace recorder
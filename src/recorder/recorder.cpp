@@ -0,0 +1,455 @@
+// MIT License
+//
+// Copyright (c) 2022 Joe Roback <joe.roback@gmail.com>
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+#include "../racechrono-canbus.hpp"
+#include "../logging/logging.hpp"
+
+#include <esp_heap_caps.h>
+
+#include "recorder.hpp"
+
+#if defined(CONFIG_RC_RECORDER)
+
+namespace
+{
+
+constexpr uint32_t staging_mask = CONFIG_RC_RECORDER_STAGING - 1U;
+constexpr uint32_t ring_mask = CONFIG_RC_RECORDER_BUFFER - 1U;
+
+}
+
+namespace recorder
+{
+
+recorder& recorder::get() noexcept
+{
+    static recorder instance;
+    return instance;
+}
+
+recorder::recorder() noexcept
+    : _head(0U)
+    , _last(0U)
+    , _lost(false)
+    , _frames(0U)
+    , _drops(0U)
+    , _high_water(0U)
+    , _tail(0U)
+    , _staging(nullptr)
+    , _ring(nullptr)
+    , _ring_head(0U)
+    , _ring_tail(0U)
+    , _ring_high_water(0U)
+    , _seen(0U)
+    , _seen_at(0U)
+    , _partition(nullptr)
+    , _offset(0U)
+    , _erased(false)
+    , _written(0U)
+    , _sequence(0U)
+    , _session(0U)
+    , _clock(0U)
+    , _started(0U)
+    , _blocks(0U)
+    , _erased_ahead(0U)
+    , _bytes(0U)
+    , _flash_us(0U)
+    , _flash_max_us(0U)
+    , _errors(0U)
+    , _stats_timer{}
+    , _stats_frames(0U)
+    , _header{}
+    , _block{}
+{
+}
+
+bool recorder::start() noexcept
+{
+    _partition = esp_partition_find_first(ESP_PARTITION_TYPE_DATA, ESP_PARTITION_SUBTYPE_ANY,
+        CONFIG_RC_RECORDER_PARTITION);
+    if (!_partition || _partition->size < 2 * format::block_size)
+    {
+        errorln("ERROR: recorder partition %s not found!", CONFIG_RC_RECORDER_PARTITION);
+        return false;
+    }
+
+    // continue the log after the newest block of the previous session
+    uint32_t blocks = _partition->size / format::block_size;
+    bool found = false;
+    for (uint32_t i = 0; i < blocks; i++)
+    {
+        format::block_header h;
+        if (esp_partition_read(_partition, i * format::block_size, &h, sizeof(h)) == ESP_OK
+            && h.magic == format::block_magic && (!found || h.sequence >= _sequence))
+        {
+            found = true;
+            _offset = ((i + 1U) % blocks) * format::block_size;
+            _sequence = h.sequence + 1U;
+            _session = static_cast<uint16_t>(h.session + 1U);
+        }
+    }
+
+    uint8_t* ring = static_cast<uint8_t*>(heap_caps_malloc(CONFIG_RC_RECORDER_BUFFER, MALLOC_CAP_SPIRAM));
+    if (!ring)
+    {
+        errorln("ERROR: recorder buffer allocation failed (no PSRAM?)");
+        return false;
+    }
+
+    // the interrupt handler writes it with the cache disabled, PSRAM will not do
+    uint8_t* staging = static_cast<uint8_t*>(heap_caps_malloc(CONFIG_RC_RECORDER_STAGING,
+        MALLOC_CAP_INTERNAL | MALLOC_CAP_8BIT));
+    if (!staging)
+    {
+        heap_caps_free(ring);
+        errorln("ERROR: recorder staging buffer allocation failed");
+        return false;
+    }
+
+    _last = static_cast<uint32_t>(micros());
+    _seen_at = _last;
+    _clock = _last;
+    _header.base = _clock;
+    _ring = ring;
+    _staging = staging;
+
+    bootln("Recorder started, session %u at block %u of %u", _session, _offset / format::block_size, blocks);
+
+    return true;
+}
+
+void CANBUS_ISR_ATTR recorder::record(canbus::frame const& f, uint32_t now) noexcept
+{
+    if (RCUNLIKELY(!_staging))
+    {
+        return;
+    }
+
+    uint8_t head = f.info.dlc;
+    if (f.info.frame_format == canbus::frame_format::extended)
+    {
+        head |= format::head_extended;
+    }
+    if (f.info.rtr == canbus::frame_rtr::remote)
+    {
+        head |= format::head_remote;
+    }
+    if (_lost)
+    {
+        head |= format::head_lost;
+    }
+
+    uint8_t rec[format::max_record_size];
+    uint32_t len = static_cast<uint32_t>(format::encode(rec, head, now - _last, f.id, f.data.u8));
+
+    // the consumer runs on the same core, so reading its index is cheap and keeps the high water exact
+    uint32_t pos = _head.load(std::memory_order_relaxed);
+    uint32_t used = pos - _tail.load(std::memory_order_acquire);
+
+    if (RCUNLIKELY(used + len > CONFIG_RC_RECORDER_STAGING))
+    {
+        _drops.store(_drops.load(std::memory_order_relaxed) + 1U, std::memory_order_relaxed);
+        _lost = true;
+        return;
+    }
+
+    // a record may wrap around the end of the staging buffer
+    uint32_t at = pos & staging_mask;
+    uint32_t first = len < CONFIG_RC_RECORDER_STAGING - at ? len : CONFIG_RC_RECORDER_STAGING - at;
+    memcpy(&_staging[at], rec, first);
+    memcpy(_staging, &rec[first], len - first);
+    _head.store(pos + len, std::memory_order_release);
+
+    _last = now;
+    _lost = false;
+    _frames.store(_frames.load(std::memory_order_relaxed) + 1U, std::memory_order_relaxed);
+    if (used + len > _high_water.load(std::memory_order_relaxed))
+    {
+        _high_water.store(used + len, std::memory_order_relaxed);
+    }
+}
+
+void recorder::flush() noexcept
+{
+    if (!_ring)
+    {
+        return;
+    }
+
+    drain();
+
+    uint32_t now = static_cast<uint32_t>(micros());
+    if (_header.used > _written && now - _started >= CONFIG_RC_RECORDER_FLUSH_INTERVAL)
+    {
+        write(false);
+    }
+
+    // the bus is idle, erase now so the next block is only written
+    if (!_erased && _written == 0U && now - _seen_at >= CONFIG_RC_RECORDER_ERASE_IDLE)
+    {
+        erase();
+        if (_erased)
+        {
+            _erased_ahead++;
+        }
+        else
+        {
+            // failed, try again once the bus has been idle as long again
+            _seen_at = now;
+        }
+    }
+}
+
+void recorder::sync() noexcept
+{
+    if (!_ring)
+    {
+        return;
+    }
+
+    drain();
+    write(true);
+}
+
+void recorder::stage() noexcept
+{
+    uint32_t tail = _tail.load(std::memory_order_relaxed);
+    uint32_t head = _head.load(std::memory_order_acquire);
+
+    if (head != _seen)
+    {
+        _seen = head;
+        _seen_at = static_cast<uint32_t>(micros());
+    }
+
+    // as much as the ring has room for, the last record moved may be cut, drain() waits for the rest
+    uint32_t n = head - tail;
+    uint32_t space = CONFIG_RC_RECORDER_BUFFER - (_ring_head - _ring_tail);
+    if (n > space)
+    {
+        n = space;
+    }
+
+    // either buffer may wrap
+    while (n > 0U)
+    {
+        uint32_t from = tail & staging_mask;
+        uint32_t to = _ring_head & ring_mask;
+        uint32_t chunk = n;
+        if (chunk > CONFIG_RC_RECORDER_STAGING - from)
+        {
+            chunk = CONFIG_RC_RECORDER_STAGING - from;
+        }
+        if (chunk > CONFIG_RC_RECORDER_BUFFER - to)
+        {
+            chunk = CONFIG_RC_RECORDER_BUFFER - to;
+        }
+        memcpy(&_ring[to], &_staging[from], chunk);
+        tail += chunk;
+        _ring_head += chunk;
+        n -= chunk;
+    }
+
+    _tail.store(tail, std::memory_order_release);
+    if (_ring_head - _ring_tail > _ring_high_water)
+    {
+        _ring_high_water = _ring_head - _ring_tail;
+    }
+}
+
+void recorder::drain() noexcept
+{
+    constexpr size_t capacity = format::block_size - format::header_size;
+
+    stage();
+
+    while (_ring_tail != _ring_head)
+    {
+        // copy out at most one record
+        uint8_t rec[format::max_record_size];
+        uint32_t avail = _ring_head - _ring_tail;
+        uint32_t n = avail < sizeof(rec) ? avail : static_cast<uint32_t>(sizeof(rec));
+        uint32_t at = _ring_tail & ring_mask;
+        uint32_t first = n < CONFIG_RC_RECORDER_BUFFER - at ? n : CONFIG_RC_RECORDER_BUFFER - at;
+        memcpy(rec, &_ring[at], first);
+        memcpy(&rec[first], _ring, n - first);
+
+        format::record r;
+        size_t len = format::decode(rec, n, r);
+        if (len == 0)
+        {
+            // the rest of a record cut by stage() is still in the staging buffer
+            RCASSERT(n < sizeof(rec));
+            break;
+        }
+
+        if (_header.used + len > capacity)
+        {
+            write(true);
+            // frames staged while the block was written
+            stage();
+        }
+        if (_header.used == _written)
+        {
+            _started = static_cast<uint32_t>(micros());
+        }
+
+        memcpy(&_block[format::header_size + _header.used], rec, len);
+        _header.used = static_cast<uint16_t>(_header.used + len);
+        _header.frames++;
+        _clock += r.delta;
+
+        _ring_tail += static_cast<uint32_t>(len);
+    }
+}
+
+void recorder::erase() noexcept
+{
+    uint32_t begin = static_cast<uint32_t>(micros());
+
+    esp_err_t err = esp_partition_erase_range(_partition, _offset, format::block_size);
+    if (err != ESP_OK && _errors++ == 0U)
+    {
+        errorln("ERROR: recorder flash erase failed (%d)", err);
+    }
+    _erased = err == ESP_OK;
+
+    _flash_us += static_cast<uint32_t>(micros()) - begin;
+}
+
+void recorder::write(bool close) noexcept
+{
+    if (_header.frames == 0U)
+    {
+        return;
+    }
+
+    uint32_t begin = static_cast<uint32_t>(micros());
+    bool opened = _written > 0U;
+
+    _header.magic = format::block_magic;
+    _header.sequence = _sequence;
+    _header.session = _session;
+    _header.lost = _drops.load(std::memory_order_relaxed);
+    memcpy(_block, &_header, format::header_size);
+
+    // records go to the erased tail of the sector, the header after them, so a block
+    // torn by a reset before its first header write has no magic and is skipped.
+    // an open block has the header up to used, the rest stays erased until it is closed
+    esp_err_t err = ESP_OK;
+    if (!opened && !_erased)
+    {
+        err = esp_partition_erase_range(_partition, _offset, format::block_size);
+    }
+    if (err == ESP_OK && _header.used > _written)
+    {
+        err = esp_partition_write(_partition, _offset + format::header_size + _written,
+            &_block[format::header_size + _written], _header.used - _written);
+    }
+    if (err == ESP_OK && (!opened || close))
+    {
+        size_t from = opened ? format::used_offset : 0U;
+        size_t to = close ? format::header_size : format::used_offset;
+        err = esp_partition_write(_partition, _offset + from, &_block[from], to - from);
+    }
+    if (err == ESP_OK)
+    {
+        _bytes += _header.used - _written;
+        _written = _header.used;
+    }
+    else if (_errors++ == 0U)
+    {
+        errorln("ERROR: recorder flash write failed (%d)", err);
+    }
+
+    uint32_t elapsed = static_cast<uint32_t>(micros()) - begin;
+    _flash_us += elapsed;
+    if (elapsed > _flash_max_us)
+    {
+        _flash_max_us = elapsed;
+    }
+
+    if (!close)
+    {
+        return;
+    }
+
+    _blocks++;
+    _offset += format::block_size;
+    if (_offset + format::block_size > _partition->size)
+    {
+        _offset = 0U;
+    }
+    _erased = false;
+    _written = 0U;
+    _sequence++;
+
+    // the next block's first delta counts from the newest record of this one
+    _header.base = _clock;
+    _header.used = 0U;
+    _header.frames = 0U;
+}
+
+#if defined(DEBUG)
+void recorder::stats() noexcept
+{
+    if (logging::logger::get().level() >= logging::log_level::info)
+    {
+        unsigned long delta = _stats_timer.elapsed(CONFIG_RC_STATS_TIMEOUT);
+
+        if (delta > 0UL && _ring)
+        {
+            uint32_t frames = _frames.load(std::memory_order_relaxed);
+
+            infoln("  Recorded frames/s: %.2f", (static_cast<float>(frames - _stats_frames) / static_cast<float>(delta)) * 1e6f);
+            infoln("   Recorder dropped: %u", _drops.load(std::memory_order_relaxed));
+            infoln(" Staging high water: %u / %u", _high_water.load(std::memory_order_relaxed),
+                static_cast<uint32_t>(CONFIG_RC_RECORDER_STAGING));
+            infoln("Recorder high water: %u / %u", _ring_high_water, static_cast<uint32_t>(CONFIG_RC_RECORDER_BUFFER));
+            infoln("      Blocks closed: %u (%u erased ahead, %u errors)", _blocks, _erased_ahead, _errors);
+            infoln("    Flash write max: %u us", _flash_max_us);
+            _stats_frames = frames;
+        }
+    }
+}
+#endif
+
+recorder::counters recorder::totals() const noexcept
+{
+    return {
+        _frames.load(std::memory_order_relaxed),
+        _drops.load(std::memory_order_relaxed),
+        _high_water.load(std::memory_order_relaxed),
+        _ring_high_water,
+        _blocks,
+        _erased_ahead,
+        _bytes,
+        _flash_us,
+        _flash_max_us,
+        _errors,
+    };
+}
+
+} // namespace recorder
+
+recorder::recorder& RECORDER = recorder::recorder::get();
+
+#endif
@@ -0,0 +1,212 @@
+// MIT License
+//
+// Copyright (c) 2022 Joe Roback <joe.roback@gmail.com>
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+#pragma once
+
+#include "../racechrono-canbus.hpp"
+#include "../canbus/frame.hpp"
+#include "../utils/timer.hpp"
+
+#include "format.hpp"
+
+#include <atomic>
+#include <cstdint>
+
+#include <esp_partition.h>
+
+#if defined(CONFIG_RC_RECORDER)
+
+#if !defined(CONFIG_CANBUS_ISR_IN_IRAM)
+#error "CONFIG_RC_RECORDER requires CONFIG_CANBUS_ISR_IN_IRAM"
+#endif
+
+namespace recorder
+{
+
+/**
+ * Full rate frame recorder (CONFIG_RC_RECORDER).
+ *
+ * The CAN-bus interrupt handler appends every frame the acceptance filter lets
+ * through, before decimation, to a staging buffer in internal RAM as a compact
+ * record (see format.hpp). loop() on core 1 moves the records to a large ring
+ * buffer in PSRAM, from there into a block, and writes the block to its sector of
+ * the recording partition. The partition is a circular log and a new session
+ * continues after the newest block of the previous one. A block's sector is erased
+ * ahead once the bus has been idle CONFIG_RC_RECORDER_ERASE_IDLE, otherwise right
+ * before its first records are written.
+ *
+ * Records that have waited CONFIG_RC_RECORDER_FLUSH_INTERVAL are appended to the
+ * block's sector, which stays open until the block fills. So every sector is erased
+ * once per block of records however slow the bus, and a session fills the partition
+ * as its size suggests; the price is that a reset loses at most the records of the
+ * last interval, and a low traffic sector is programmed many times between erases,
+ * which NOR flash allows for bytes still erased (not with flash encryption).
+ *
+ * Flash erases and writes disable the cache for up to a sector erase, about 45 ms,
+ * long enough for the 64 byte RX FIFO to overrun on a busy bus. The interrupt
+ * handler keeps running from IRAM meanwhile (CONFIG_CANBUS_ISR_IN_IRAM), and as
+ * PSRAM is cached too it only touches the staging buffer, which holds the frames
+ * until loop() is back. The interrupt handler is the only producer of the staging
+ * buffer and loop() the only consumer, so it needs no lock. A full staging buffer
+ * drops the frame, counts it and marks the next record.
+ */
+class recorder final
+{
+    CPP_NOCOPY(recorder);
+    CPP_NOMOVE(recorder);
+
+    static_assert(CONFIG_RC_RECORDER_BUFFER >= 2 * format::block_size
+        && (CONFIG_RC_RECORDER_BUFFER & (CONFIG_RC_RECORDER_BUFFER - 1)) == 0,
+        "recorder buffer must be a power of two of at least two blocks");
+    static_assert(CONFIG_RC_RECORDER_STAGING >= format::max_record_size
+        && (CONFIG_RC_RECORDER_STAGING & (CONFIG_RC_RECORDER_STAGING - 1)) == 0,
+        "recorder staging buffer must be a power of two of at least one record");
+
+public:
+    static recorder& get() noexcept;
+
+    ~recorder() noexcept = default;
+
+    /**
+     * find the recording partition, allocate the staging and ring buffers and find
+     * where the previous session stopped. call before the CAN-bus controller starts.
+     * @return false if there is no partition or no PSRAM, nothing is recorded then
+     */
+    bool start() noexcept;
+
+    /**
+     * append \p f, received at \p now, to the staging buffer (interrupt handler only,
+     * in IRAM)
+     */
+    void record(canbus::frame const& f, uint32_t now) noexcept;
+
+    /**
+     * write every filled block, and append the records of a partly filled one once
+     * they have waited CONFIG_RC_RECORDER_FLUSH_INTERVAL. erase the next block's
+     * sector ahead if the bus is idle (loop() only)
+     */
+    void flush() noexcept;
+
+    /**
+     * write everything recorded so far and close the block, even partly filled (loop() only)
+     */
+    void sync() noexcept;
+
+    /**
+     * print any recorder stats
+     */
+#if defined(DEBUG)
+    void stats() noexcept;
+#else
+    void stats() noexcept {}
+#endif
+
+    /**
+     * recorder counters
+     */
+    struct counters
+    {
+        uint32_t frames;        //!< frames recorded (free running)
+        uint32_t drops;         //!< frames dropped because the staging buffer was full
+        uint32_t high_water;    //!< most staging buffer bytes used at once
+        uint32_t ring_high_water;   //!< most ring buffer bytes used at once
+        uint32_t blocks;        //!< blocks closed
+        uint32_t erased_ahead;  //!< blocks whose sector was erased ahead, while the bus was idle
+        uint64_t bytes;         //!< record bytes written
+        uint64_t flash_us;      //!< time spent erasing and writing blocks
+        uint32_t flash_max_us;  //!< longest time spent on one block
+        uint32_t errors;        //!< failed erases and writes
+    };
+
+    /**
+     * @return recorder counters
+     */
+    counters totals() const noexcept;
+
+private:
+    explicit recorder() noexcept;
+
+    /**
+     * move the staged records to the ring buffer, as much as fits
+     */
+    void stage() noexcept;
+
+    /**
+     * move whole records from the ring buffer into the block, writing every block that fills
+     */
+    void drain() noexcept;
+
+    /**
+     * erase the sector of the next block
+     */
+    void erase() noexcept;
+
+    /**
+     * write the records of the block not in flash yet and, if \p close, finish its
+     * header and move on to the next sector. a new block's sector is erased first,
+     * unless it was erased ahead
+     */
+    void write(bool close) noexcept;
+
+private:
+    // producer owned (interrupt handler)
+    alignas(CONFIG_RC_CACHE_LINE_SIZE) std::atomic<uint32_t> _head;
+    uint32_t _last;                     // time of the newest record
+    bool _lost;                         // frames were dropped since the newest record
+    std::atomic<uint32_t> _frames;
+    std::atomic<uint32_t> _drops;
+    std::atomic<uint32_t> _high_water;
+
+    // consumer owned (loop)
+    alignas(CONFIG_RC_CACHE_LINE_SIZE) std::atomic<uint32_t> _tail;
+
+    uint8_t* _staging;                  // CONFIG_RC_RECORDER_STAGING bytes of internal RAM
+    uint8_t* _ring;                     // CONFIG_RC_RECORDER_BUFFER bytes of PSRAM
+    uint32_t _ring_head;
+    uint32_t _ring_tail;
+    uint32_t _ring_high_water;
+    uint32_t _seen;                     // staging head at the last stage()
+    uint32_t _seen_at;                  // time stage() last found new records
+    const esp_partition_t* _partition;
+    uint32_t _offset;                   // partition offset of the next block
+    bool _erased;                       // the sector at _offset was erased ahead
+    uint16_t _written;                  // record bytes of the block in flash, 0 until it is opened
+    uint32_t _sequence;                 // sequence of the next block
+    uint16_t _session;
+    uint64_t _clock;                    // time of the newest record moved into the block, µs since boot
+    uint32_t _started;                  // time the first record not in flash was moved into the block
+    uint32_t _blocks;
+    uint32_t _erased_ahead;
+    uint64_t _bytes;
+    uint64_t _flash_us;
+    uint32_t _flash_max_us;
+    uint32_t _errors;
+    utils::timer _stats_timer;
+    uint32_t _stats_frames;
+    format::block_header _header;
+    uint8_t _block[format::block_size];
+};
+
+} // namespace recorder
+
+extern recorder::recorder& RECORDER;
+
+#endif
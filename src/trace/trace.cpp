@@ -0,0 +1,197 @@
+// MIT License
+//
+// Copyright (c) 2022 Joe Roback <joe.roback@gmail.com>
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+#include "../racechrono-canbus.hpp"
+#include "../canbus/decoder.hpp"
+#include "../logging/logging.hpp"
+
+#include <cinttypes>
+#include <cstdio>
+#include <cstring>
+
+#include "trace.hpp"
+
+#if defined(CONFIG_RC_TRACE)
+
+namespace trace
+{
+
+namespace
+{
+
+/**
+ * print decoder table ID \p id into \p out as candump does, 3 hex digits or 8 for an extended ID
+ */
+void format_id(uint32_t id, char (&out)[9]) noexcept
+{
+    if (id & canbus::extended_flag)
+    {
+        snprintf(out, sizeof(out), "%08" PRIX32, id & ~canbus::extended_flag);
+    }
+    else
+    {
+        snprintf(out, sizeof(out), "%03" PRIX32, id);
+    }
+}
+
+} // namespace
+
+tracer& tracer::get() noexcept
+{
+    static tracer instance;
+    return instance;
+}
+
+tracer::tracer() noexcept
+    : _stats_timer{}
+    , _entries{}
+{
+}
+
+void tracer::histogram::add(uint32_t us) noexcept
+{
+    uint32_t bucket = us == 0 ? 0 : 32 - __builtin_clz(us);
+    if (bucket >= bucket_count)
+    {
+        bucket = bucket_count - 1;
+    }
+
+    ++buckets[bucket];
+    ++count;
+    if (us > max)
+    {
+        max = us;
+    }
+}
+
+uint32_t tracer::histogram::percentile(uint32_t p) const noexcept
+{
+    // upper bound of the bucket holding the p-th percentile
+    uint32_t target = (count * p + 99) / 100;
+    uint32_t seen = 0;
+
+    for (uint32_t i = 0; i < bucket_count; i++)
+    {
+        seen += buckets[i];
+        if (seen >= target && seen > 0)
+        {
+            return i + 1 < bucket_count ? (1U << i) : max;
+        }
+    }
+
+    return max;
+}
+
+void tracer::dequeued(canbus::frame& f, uint32_t now) noexcept
+{
+    entry* e = find(canbus::table_id(f));
+    if (e != nullptr)
+    {
+        e->isr_to_dequeue.add(now - f.ts);
+    }
+    f.ts = now;
+}
+
+void tracer::notified(uint32_t id, uint32_t dequeued, uint32_t now) noexcept
+{
+    entry* e = find(id);
+    if (e != nullptr)
+    {
+        e->dequeue_to_notify.add(now - dequeued);
+    }
+}
+
+tracer::entry* tracer::find(uint32_t id) noexcept
+{
+    size_t slot = CANDEC.slot(id);
+    if (slot >= CONFIG_RC_TRACE_IDS)
+    {
+        return nullptr;
+    }
+
+    entry& e = _entries[slot];
+    e.id = id;
+    return &e;
+}
+
+void tracer::stats() noexcept
+{
+    unsigned long delta = _stats_timer.elapsed(CONFIG_RC_STATS_TIMEOUT);
+
+    if (delta == 0UL)
+    {
+        return;
+    }
+
+#if defined(DEBUG)
+    if (logging::logger::get().level() >= logging::log_level::info)
+    {
+        infoln("      ID  ISR->dequeue p50/p99/max us  dequeue->notify p50/p99/max us");
+        for (entry const& e : _entries)
+        {
+            if (e.isr_to_dequeue.count > 0 || e.dequeue_to_notify.count > 0)
+            {
+                char id[9];
+                format_id(e.id, id);
+                infoln("%8s  %8u %8u %8u  %8u %8u %8u", id,
+                    e.isr_to_dequeue.percentile(50), e.isr_to_dequeue.percentile(99), e.isr_to_dequeue.max,
+                    e.dequeue_to_notify.percentile(50), e.dequeue_to_notify.percentile(99), e.dequeue_to_notify.max);
+            }
+        }
+    }
+#endif
+
+    dump();
+    reset();
+}
+
+void tracer::dump() noexcept
+{
+    for (entry const& e : _entries)
+    {
+        if (e.isr_to_dequeue.count > 0 || e.dequeue_to_notify.count > 0)
+        {
+            print(e, "isr", e.isr_to_dequeue);
+            print(e, "notify", e.dequeue_to_notify);
+        }
+    }
+}
+
+void tracer::reset() noexcept
+{
+    memset(_entries, 0, sizeof(_entries));
+}
+
+void tracer::print(entry const& e, const char* stage, histogram const& h) noexcept
+{
+    char id[9];
+    format_id(e.id, id);
+    bootln("TRACE,%s,%s,%u,%u,%u,%u,%u,%u,%u,%u,%u,%u,%u,%u,%u,%u,%u,%u,%u,%u", id, stage, h.count, h.max,
+        h.buckets[0], h.buckets[1], h.buckets[2], h.buckets[3], h.buckets[4], h.buckets[5], h.buckets[6], h.buckets[7],
+        h.buckets[8], h.buckets[9], h.buckets[10], h.buckets[11], h.buckets[12], h.buckets[13], h.buckets[14],
+        h.buckets[15]);
+}
+
+} // namespace trace
+
+trace::tracer& TRACER = trace::tracer::get();
+
+#endif
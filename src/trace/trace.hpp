@@ -0,0 +1,133 @@
+// MIT License
+//
+// Copyright (c) 2022 Joe Roback <joe.roback@gmail.com>
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+#pragma once
+
+#include "../racechrono-canbus.hpp"
+#include "../canbus/frame.hpp"
+#include "../utils/timer.hpp"
+
+#include <cstdint>
+
+#if defined(CONFIG_RC_TRACE)
+
+namespace trace
+{
+
+/**
+ * End-to-end latency tracer (CONFIG_RC_TRACE). Frames are stamped in the CAN-bus
+ * interrupt handler; the Bluetooth LE task records, per ID, interrupt -> dequeue
+ * latency of the frames it sends, and dequeue -> notify latency once a frame goes
+ * out in a notification the stack took, after the scheduler and batching, into
+ * fixed log2 microsecond bucket histograms.
+ *
+ * All recording and printing happens on core 0, so no locking is needed.
+ */
+class tracer final
+{
+    CPP_NOCOPY(tracer);
+    CPP_NOMOVE(tracer);
+
+public:
+    /// histogram bucket i counts latencies in [2^(i-1), 2^i) microseconds, bucket 0 is < 1us
+    static constexpr uint32_t bucket_count = 16;
+
+    static tracer& get() noexcept;
+
+    ~tracer() noexcept = default;
+
+    /**
+     * trace clock in microseconds. esp_timer based, so stamps taken on
+     * different cores can be compared (the CPU cycle counters are per core).
+     */
+    static __always_inline uint32_t now() noexcept
+    {
+        return static_cast<uint32_t>(micros());
+    }
+
+    /**
+     * record interrupt -> dequeue latency of \p f, taken from the controller queue at
+     * \p now to be sent, and restamp it with \p now for notified()
+     */
+    void dequeued(canbus::frame& f, uint32_t now) noexcept;
+
+    /**
+     * record dequeue -> notify latency of a frame with decoder table ID \p id (see
+     * canbus::table_id()), dequeued at \p dequeued and notified at \p now
+     */
+    void notified(uint32_t id, uint32_t dequeued, uint32_t now) noexcept;
+
+    /**
+     * every CONFIG_RC_STATS_TIMEOUT print a latency summary (DEBUG) and the
+     * machine readable dump, then start new histograms
+     */
+    void stats() noexcept;
+
+    /**
+     * print histograms, one line per ID and stage, IDs as candump does (3 hex digits,
+     * 8 for extended IDs):
+     * TRACE,<id hex>,<isr|notify>,<count>,<max us>,<bucket 0>,...,<bucket 15>
+     */
+    void dump() noexcept;
+
+    /**
+     * clear all histograms
+     */
+    void reset() noexcept;
+
+private:
+    struct histogram
+    {
+        uint32_t count;
+        uint32_t max;
+        uint32_t buckets[bucket_count];
+
+        void add(uint32_t us) noexcept;
+
+        uint32_t percentile(uint32_t p) const noexcept;
+    };
+
+    struct entry
+    {
+        uint32_t id;    // decoder table ID
+        histogram isr_to_dequeue;
+        histogram dequeue_to_notify;
+    };
+
+    explicit tracer() noexcept;
+
+    /**
+     * @return histograms of decoder table ID \p id, nullptr if it has none
+     */
+    entry* find(uint32_t id) noexcept;
+
+    void print(entry const& e, const char* stage, histogram const& h) noexcept;
+
+private:
+    utils::timer _stats_timer;
+    entry _entries[CONFIG_RC_TRACE_IDS];
+};
+
+} // namespace trace
+
+extern trace::tracer& TRACER;
+
+#endif
@@ -0,0 +1,264 @@
+// MIT License
+//
+// Copyright (c) 2022 Joe Roback <joe.roback@gmail.com>
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+#pragma once
+
+#include "../racechrono-canbus.hpp"
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+
+namespace utils
+{
+
+/**
+ * Latest-value mailbox with one slot per key (single producer, single consumer).
+ *
+ * The producer overwrites the slot for a key and marks it in a dirty bitmap, the
+ * consumer collects the newest value of every dirty slot. Each slot is guarded by
+ * a sequence lock, so neither side ever waits for the other and a value is never
+ * stale: under backpressure older values of a key are superseded, not queued.
+ */
+template <typename T, uint32_t N>
+class mailbox final
+{
+    CPP_NOCOPY(mailbox);
+    CPP_NOMOVE(mailbox);
+
+    static constexpr uint32_t word_bits = 32;
+    static constexpr uint32_t words = (N + word_bits - 1) / word_bits;
+
+    struct slot
+    {
+        std::atomic<uint32_t> seq;  // odd while the producer is writing
+        T item;
+    };
+
+public:
+    explicit mailbox() noexcept
+        : _pushed(0U)
+        , _high_water(0U)
+        , _drops(0U)
+        , _next(0U)
+        , _dirty{}
+        , _slots{}
+    {
+    }
+
+    ~mailbox() noexcept = default;
+
+    /**
+     * @return number of slots
+     */
+    static constexpr uint32_t capacity() noexcept
+    {
+        return N;
+    }
+
+    /**
+     * store \p item as the newest value of \p key (producer only).
+     * @return true if stored; false if \p key has no slot
+     */
+    __always_inline bool push(uint32_t key, T const& item) noexcept
+    {
+        if (RCUNLIKELY(key >= N))
+        {
+            _drops.store(_drops.load(std::memory_order_relaxed) + 1U, std::memory_order_relaxed);
+            return false;
+        }
+
+        slot& s = _slots[key];
+        uint32_t seq = s.seq.load(std::memory_order_relaxed);
+        s.seq.store(seq + 1U, std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_release);
+        s.item = item;
+        s.seq.store(seq + 2U, std::memory_order_release);
+
+        uint32_t bit = 1U << (key % word_bits);
+        uint32_t dirty = _dirty[key / word_bits].fetch_or(bit, std::memory_order_release);
+
+        _pushed.store(_pushed.load(std::memory_order_relaxed) + 1U, std::memory_order_relaxed);
+        if (dirty & bit)
+        {
+            // consumer never saw the previous value
+            _drops.store(_drops.load(std::memory_order_relaxed) + 1U, std::memory_order_relaxed);
+        }
+        else
+        {
+            uint32_t pending = size();
+            if (pending > _high_water.load(std::memory_order_relaxed))
+            {
+                _high_water.store(pending, std::memory_order_relaxed);
+            }
+        }
+
+        return true;
+    }
+
+    /**
+     * collect the newest value of one dirty slot into \p item (consumer only).
+     * @return true if a value was collected
+     */
+    __always_inline bool pop(T& item) noexcept
+    {
+        return pop(&item, 1) == 1;
+    }
+
+    /**
+     * collect the newest values of up to \p count dirty slots into \p items (consumer only).
+     * scanning resumes at the key after the last one collected, so no slot is starved.
+     * @return number of values collected
+     */
+    size_t pop(T* items, size_t count) noexcept
+    {
+        size_t n = 0;
+        uint32_t first = _next / word_bits;
+        uint32_t from = _next % word_bits;
+
+        // the cursor's word is visited twice: keys from the cursor up first, the keys below it last
+        for (uint32_t i = 0; i <= words && n < count; i++)
+        {
+            uint32_t w = (first + i) % words;
+            uint32_t mask = i == 0 ? ~0U << from : (i == words ? ~(~0U << from) : ~0U);
+            if (mask == 0U)
+            {
+                continue;
+            }
+
+            uint32_t dirty = _dirty[w].load(std::memory_order_acquire) & mask;
+
+            while (dirty && n < count)
+            {
+                uint32_t index = static_cast<uint32_t>(__builtin_ctz(dirty));
+                uint32_t key = w * word_bits + index;
+                dirty &= dirty - 1U;
+                take(_dirty[w], 1U << index, _slots[key], items[n++]);
+                _next = (key + 1U) % N;
+            }
+        }
+
+        return n;
+    }
+
+    /**
+     * @return number of slots holding a value not collected yet
+     */
+    __always_inline uint32_t size() const noexcept
+    {
+        uint32_t pending = 0;
+        for (uint32_t w = 0; w < words; w++)
+        {
+            pending += static_cast<uint32_t>(__builtin_popcount(_dirty[w].load(std::memory_order_relaxed)));
+        }
+        return pending;
+    }
+
+    /**
+     * @return total number of values ever stored (free running)
+     */
+    __always_inline uint32_t pushed() const noexcept
+    {
+        return _pushed.load(std::memory_order_relaxed);
+    }
+
+    /**
+     * @return most slots waiting to be collected at once since the last clear()
+     */
+    __always_inline uint32_t high_water() const noexcept
+    {
+        return _high_water.load(std::memory_order_relaxed);
+    }
+
+    /**
+     * @return number of values superseded before they were collected, or without a slot
+     */
+    __always_inline uint32_t drops() const noexcept
+    {
+        return _drops.load(std::memory_order_relaxed);
+    }
+
+    /**
+     * empty all slots and reset counters. neither producer nor consumer may be active.
+     */
+    void clear() noexcept
+    {
+        for (uint32_t w = 0; w < words; w++)
+        {
+            _dirty[w].store(0U, std::memory_order_relaxed);
+        }
+        _pushed.store(0U, std::memory_order_relaxed);
+        _high_water.store(0U, std::memory_order_relaxed);
+        _drops.store(0U, std::memory_order_relaxed);
+        _next = 0U;
+    }
+
+private:
+    /**
+     * collect the value of \p s and clear its \p bit in \p dirty. the bit is cleared only
+     * after the read: clearing first would let a value stored in between be collected now
+     * and, its bit set again, a second time by the next pop. a value stored after the read
+     * whose bit was already set when it got cleared is marked dirty again.
+     */
+    __always_inline void take(std::atomic<uint32_t>& dirty, uint32_t bit, slot& s, T& item) noexcept
+    {
+        uint32_t seq = read(s, item);
+        dirty.fetch_and(~bit, std::memory_order_acq_rel);
+        if (s.seq.load(std::memory_order_acquire) != seq)
+        {
+            dirty.fetch_or(bit, std::memory_order_relaxed);
+        }
+    }
+
+    /**
+     * @return sequence of the value read
+     */
+    __always_inline uint32_t read(slot& s, T& item) noexcept
+    {
+        uint32_t before;
+        uint32_t after;
+
+        do
+        {
+            before = s.seq.load(std::memory_order_acquire);
+            item = s.item;
+            std::atomic_thread_fence(std::memory_order_acquire);
+            after = s.seq.load(std::memory_order_relaxed);
+        } while ((before & 1U) || before != after);
+
+        return before;
+    }
+
+private:
+    // producer owned
+    alignas(CONFIG_RC_CACHE_LINE_SIZE) std::atomic<uint32_t> _pushed;
+    std::atomic<uint32_t> _high_water;
+    std::atomic<uint32_t> _drops;
+
+    // consumer owned, the key after the last one collected
+    alignas(CONFIG_RC_CACHE_LINE_SIZE) uint32_t _next;
+
+    // shared
+    alignas(CONFIG_RC_CACHE_LINE_SIZE) std::atomic<uint32_t> _dirty[words];
+    slot _slots[N];
+};
+
+} // namespace utils
@@ -0,0 +1,351 @@
+// MIT License
+//
+// Copyright (c) 2022 Joe Roback <joe.roback@gmail.com>
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+#pragma once
+
+#include "../racechrono-canbus.hpp"
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+
+namespace utils
+{
+
+/**
+ * Wait-free single-producer/single-consumer ring buffer.
+ *
+ * The producer (CAN-bus interrupt handler) only writes the head index and the
+ * consumer (Bluetooth LE task) only writes the tail index, so neither side ever
+ * needs a lock or a kernel call. Head and tail are free running counters, kept
+ * on separate cache lines, and masked into the slot array on access.
+ *
+ * \p N must be a power of two.
+ */
+template <typename T, uint32_t N>
+class spsc_ring final
+{
+    CPP_NOCOPY(spsc_ring);
+    CPP_NOMOVE(spsc_ring);
+
+    static_assert(N >= 2 && (N & (N - 1)) == 0, "ring depth must be a power of two");
+
+public:
+    explicit spsc_ring() noexcept
+        : _head(0U)
+        , _tail_cache(0U)
+        , _drops(0U)
+        , _tail(0U)
+        , _high_water(0U)
+        , _items{}
+    {
+    }
+
+    ~spsc_ring() noexcept = default;
+
+    /**
+     * @return maximum number of items the ring can hold
+     */
+    static constexpr uint32_t capacity() noexcept
+    {
+        return N;
+    }
+
+    /**
+     * push \p item to the back of the ring (producer only).
+     * @return true if pushed; false if the ring was full and the item was dropped
+     */
+    __always_inline bool push(T const& item) noexcept
+    {
+        uint32_t head = _head.load(std::memory_order_relaxed);
+        uint32_t used = head - _tail_cache;
+
+        if (RCUNLIKELY(used >= N))
+        {
+            // refresh our view of the consumer only when we appear full
+            _tail_cache = _tail.load(std::memory_order_acquire);
+            used = head - _tail_cache;
+
+            if (used >= N)
+            {
+                _drops.store(_drops.load(std::memory_order_relaxed) + 1U, std::memory_order_relaxed);
+                return false;
+            }
+        }
+
+        _items[head & (N - 1U)] = item;
+        _head.store(head + 1U, std::memory_order_release);
+
+        return true;
+    }
+
+    /**
+     * pop one item from the front of the ring into \p item (consumer only).
+     * @return true if an item was popped; false if the ring was empty
+     */
+    __always_inline bool pop(T& item) noexcept
+    {
+        uint32_t tail = _tail.load(std::memory_order_relaxed);
+        uint32_t avail = _head.load(std::memory_order_acquire) - tail;
+
+        if (avail == 0U)
+        {
+            return false;
+        }
+
+        watermark(avail);
+        item = _items[tail & (N - 1U)];
+        _tail.store(tail + 1U, std::memory_order_release);
+
+        return true;
+    }
+
+    /**
+     * pop up to \p count items into \p items (consumer only). Only touches
+     * the shared indices once for the whole batch.
+     * @return number of items popped
+     */
+    size_t pop(T* items, size_t count) noexcept
+    {
+        uint32_t tail = _tail.load(std::memory_order_relaxed);
+        uint32_t avail = _head.load(std::memory_order_acquire) - tail;
+        uint32_t n = count < avail ? static_cast<uint32_t>(count) : avail;
+
+        watermark(avail);
+
+        for (uint32_t i = 0; i < n; i++)
+        {
+            items[i] = _items[(tail + i) & (N - 1U)];
+        }
+
+        if (n > 0U)
+        {
+            _tail.store(tail + n, std::memory_order_release);
+        }
+
+        return n;
+    }
+
+    /**
+     * @return number of items currently queued (approximate from either side)
+     */
+    __always_inline uint32_t size() const noexcept
+    {
+        return _head.load(std::memory_order_acquire) - _tail.load(std::memory_order_acquire);
+    }
+
+    /**
+     * @return total number of items ever pushed (free running)
+     */
+    __always_inline uint32_t pushed() const noexcept
+    {
+        return _head.load(std::memory_order_acquire);
+    }
+
+    /**
+     * @return highest number of items queued at once since the last clear(). the queue
+     * is deepest just before a pop, so the consumer measures it there; items never
+     * popped are not counted.
+     */
+    __always_inline uint32_t high_water() const noexcept
+    {
+        return _high_water.load(std::memory_order_relaxed);
+    }
+
+    /**
+     * @return number of items dropped because the ring was full since the last clear()
+     */
+    __always_inline uint32_t drops() const noexcept
+    {
+        return _drops.load(std::memory_order_relaxed);
+    }
+
+    /**
+     * empty the ring and reset counters. neither producer nor consumer may be active.
+     */
+    void clear() noexcept
+    {
+        _head.store(0U, std::memory_order_relaxed);
+        _tail_cache = 0U;
+        _high_water.store(0U, std::memory_order_relaxed);
+        _drops.store(0U, std::memory_order_relaxed);
+        _tail.store(0U, std::memory_order_release);
+    }
+
+private:
+    __always_inline void watermark(uint32_t avail) noexcept
+    {
+        if (avail > _high_water.load(std::memory_order_relaxed))
+        {
+            _high_water.store(avail, std::memory_order_relaxed);
+        }
+    }
+
+    // producer owned
+    alignas(CONFIG_RC_CACHE_LINE_SIZE) std::atomic<uint32_t> _head;
+    uint32_t _tail_cache;
+    std::atomic<uint32_t> _drops;
+
+    // consumer owned, the producer only sees a stale tail so it cannot tell how deep the queue is
+    alignas(CONFIG_RC_CACHE_LINE_SIZE) std::atomic<uint32_t> _tail;
+    std::atomic<uint32_t> _high_water;
+
+    alignas(CONFIG_RC_CACHE_LINE_SIZE) T _items[N];
+};
+
+/**
+ * Lock-free multi-producer/single-consumer ring buffer (bounded Vyukov queue).
+ *
+ * Producers on either core, including interrupt handlers, claim a slot by
+ * advancing the shared head with compare-and-swap and then publish it through
+ * the slot's sequence number; the consumer only reads slots whose sequence
+ * says they are complete. Nobody ever waits on a lock, a full ring drops the
+ * new item and counts it.
+ *
+ * \p N must be a power of two.
+ */
+template <typename T, uint32_t N>
+class mpsc_ring final
+{
+    CPP_NOCOPY(mpsc_ring);
+    CPP_NOMOVE(mpsc_ring);
+
+    static_assert(N >= 2 && (N & (N - 1)) == 0, "ring depth must be a power of two");
+
+public:
+    explicit mpsc_ring() noexcept
+        : _head(0U)
+        , _drops(0U)
+        , _tail(0U)
+    {
+        for (uint32_t i = 0; i < N; i++)
+        {
+            _cells[i].seq.store(i, std::memory_order_relaxed);
+        }
+    }
+
+    ~mpsc_ring() noexcept = default;
+
+    /**
+     * @return maximum number of items the ring can hold
+     */
+    static constexpr uint32_t capacity() noexcept
+    {
+        return N;
+    }
+
+    /**
+     * push \p item to the back of the ring (any producer).
+     * @return true if pushed; false if the ring was full and the item was dropped
+     */
+    bool push(T const& item) noexcept
+    {
+        uint32_t head = _head.load(std::memory_order_relaxed);
+        cell* c;
+
+        while (true)
+        {
+            c = &_cells[head & (N - 1U)];
+            int32_t diff = static_cast<int32_t>(c->seq.load(std::memory_order_acquire) - head);
+
+            if (diff == 0)
+            {
+                // slot is free for this lap, try to claim it
+                if (_head.compare_exchange_weak(head, head + 1U, std::memory_order_relaxed))
+                {
+                    break;
+                }
+            }
+            else if (diff < 0)
+            {
+                // consumer has not freed the slot from the previous lap
+                _drops.fetch_add(1U, std::memory_order_relaxed);
+                return false;
+            }
+            else
+            {
+                // another producer claimed the slot first
+                head = _head.load(std::memory_order_relaxed);
+            }
+        }
+
+        c->item = item;
+        c->seq.store(head + 1U, std::memory_order_release);
+
+        return true;
+    }
+
+    /**
+     * pop one item from the front of the ring into \p item (consumer only).
+     * @return true if an item was popped; false if the ring was empty or the
+     * oldest slot is still being written
+     */
+    bool pop(T& item) noexcept
+    {
+        uint32_t tail = _tail.load(std::memory_order_relaxed);
+        cell& c = _cells[tail & (N - 1U)];
+
+        if (c.seq.load(std::memory_order_acquire) != tail + 1U)
+        {
+            return false;
+        }
+
+        item = c.item;
+        c.seq.store(tail + N, std::memory_order_release);
+        _tail.store(tail + 1U, std::memory_order_release);
+
+        return true;
+    }
+
+    /**
+     * @return number of items currently claimed by producers and not yet popped (approximate)
+     */
+    __always_inline uint32_t size() const noexcept
+    {
+        return _head.load(std::memory_order_acquire) - _tail.load(std::memory_order_acquire);
+    }
+
+    /**
+     * @return number of items dropped because the ring was full (free running)
+     */
+    __always_inline uint32_t drops() const noexcept
+    {
+        return _drops.load(std::memory_order_relaxed);
+    }
+
+private:
+    struct cell
+    {
+        std::atomic<uint32_t> seq;
+        T item;
+    };
+
+    // shared by producers
+    alignas(CONFIG_RC_CACHE_LINE_SIZE) std::atomic<uint32_t> _head;
+    std::atomic<uint32_t> _drops;
+
+    // consumer owned
+    alignas(CONFIG_RC_CACHE_LINE_SIZE) std::atomic<uint32_t> _tail;
+
+    alignas(CONFIG_RC_CACHE_LINE_SIZE) cell _cells[N];
+};
+
+} // namespace utils